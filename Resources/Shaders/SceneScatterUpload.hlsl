@@ -0,0 +1,27 @@
+#include "Common.hlsli"
+
+struct PassParams
+{
+	uint NumElements;
+	uint ElementSize;
+	uint DataOffset;
+	RWByteBufferH Target;
+};
+DEFINE_CONSTANTS(PassParams, 0);
+
+// Destination index of each element, followed by the element data at DataOffset
+ByteAddressBuffer tUploadData : register(t1, space100);
+
+[numthreads(64, 1, 1)]
+void ScatterUploadCS(uint threadID : SV_DispatchThreadID)
+{
+	uint wordsPerElement = cPassParams.ElementSize / 4;
+	uint element = threadID / wordsPerElement;
+	if(element >= cPassParams.NumElements)
+		return;
+
+	uint word = threadID % wordsPerElement;
+	uint targetIndex = tUploadData.Load(element * 4);
+	uint value = tUploadData.Load(cPassParams.DataOffset + threadID * 4);
+	cPassParams.Target.Store<uint>(targetIndex * cPassParams.ElementSize + word * 4, value);
+}
@@ -5,6 +5,9 @@
 #include "Core/Console.h"
 #include "Core/CommandLine.h"
 #include "Core/TaskQueue.h"
+#include "Core/AsyncIO.h"
+#include "Scene/MeshCache.h"
+#include "Scene/GltfImport.h"
 #include "Core/ConsoleVariables.h"
 #include "Core/Window.h"
 #include "Core/Profiler.h"
@@ -14,8 +17,17 @@
 #include "RHI/CommandContext.h"
 
 #include "Renderer/RenderTypes.h"
+#include "Renderer/GPUSceneBuffer.h"
+#include "Renderer/FrustumCulling.h"
+#include "Renderer/InstanceBVH.h"
+#include "Renderer/SkeletalAnimation.h"
+#include "Renderer/AnimationCompression.h"
 #include "Renderer/Techniques/ImGuiRenderer.h"
+#include "RenderGraph/RenderGraph.h"
 #include "RenderGraph/RenderGraphAllocator.h"
+#include "RenderGraph/RenderGraphScheduler.h"
+#include "RenderGraph/RenderGraphCore.h"
+#include "RenderGraph/RenderGraphPlacement.h"
 
 #ifdef _DEBUG
 #define _CRTDBG_MAP_ALLOC
@@ -78,8 +90,87 @@ static SuperluminalAPI sSuperluminal;
 App::App() = default;
 App::~App() = default;
 
+// Runs 'job' without creating a window or a device. Used by command line tools that only need the CPU side of the engine.
+template<typename Job>
+static int RunHeadless(Job&& job)
+{
+	Console::Initialize();
+	TaskQueue::Initialize(std::thread::hardware_concurrency());
+	AsyncIO::Initialize(4);
+
+	bool success = job();
+
+	AsyncIO::Shutdown();
+	TaskQueue::Shutdown();
+	Console::Shutdown();
+	return success ? 0 : 1;
+}
+
 int App::Run()
 {
+	Thread::SetMainThread();
+	CommandLine::Parse(GetCommandLineA());
+
+	// -cookmeshes=<scene>: Fill the mesh cache
+	// -importgltf=<scene>: Import a glTF scene on the CPU and log the time spent in each stage
+	// -rgschedulertest: Validate render graph queue scheduling on random graphs
+	// -rgcoretest: Compile and validate random render graphs without a device
+	// -rgcorebenchmark: Measure render graph compile time on random graphs of 100 to 5000 passes
+	// -rggroupingbenchmark: Compare the simulated recording time of render graphs with passes grouped by count and by recording cost
+	// -rgrecordingbenchmark: Count the allocations made while recording render graphs of 1000 passes
+	// -rgplacementreplay=<recording>: Compare transient resource placement algorithms on a recording made with RGRecordPlacement
+	// -rgreorderbenchmark[=<recording>]: Compare render graphs compiled with and without pass reordering, on a recording made with RGRecordGraph or on random graphs
+	// -gpuscenebenchmark: Compare the bytes and time spent uploading 100000 instances of which 1% move each frame, with and without delta uploads
+	// -frustumcullingtest: Validate the SIMD frustum culling kernel against the scalar path on random views
+	// -frustumcullingbenchmark: Measure frustum culling of 10k, 100k and 1M instances against 13 views
+	// -bvhtest: Validate the instance BVH and its queries against testing every instance
+	// -bvhbenchmark: Measure building, updating and querying the instance BVH on a synthetic city of 100k and 1M instances
+	// -animationbenchmark: Measure and validate skeletal animation of 1000 characters against sampling each character on its own
+	// -animationcompressionbenchmark: Report the size, error and sampling speed of compressed synthetic animations compared with the uncompressed ones
+	const char* pScenePath = nullptr;
+	if (CommandLine::GetValue("cookmeshes", &pScenePath))
+		return RunHeadless([&]() { return MeshCache::CookScene(pScenePath); });
+	if (CommandLine::GetValue("importgltf", &pScenePath))
+	{
+		return RunHeadless([&]()
+			{
+				GltfImportData data;
+				if (!GltfImport::Load(pScenePath, data))
+					return false;
+				GltfImport::LogTimings(pScenePath, data.Timings);
+				return true;
+			});
+	}
+	if (CommandLine::GetBool("rgschedulertest"))
+		return RunHeadless([]() { return RGScheduler::RunSelfTest(1000, 0); });
+	if (CommandLine::GetBool("rgcoretest"))
+		return RunHeadless([]() { return RGCore::RunSelfTest(1000, 0); });
+	if (CommandLine::GetBool("rgcorebenchmark"))
+		return RunHeadless([]() { RGCore::RunBenchmark(0); return true; });
+	if (CommandLine::GetBool("rggroupingbenchmark"))
+		return RunHeadless([]() { RGCore::RunGroupingBenchmark(0); return true; });
+	if (CommandLine::GetBool("rgrecordingbenchmark"))
+		return RunHeadless([]() { RGUtils::RunRecordingBenchmark(1000); return true; });
+	const char* pRecordingPath = nullptr;
+	if (CommandLine::GetValue("rgplacementreplay", &pRecordingPath))
+		return RunHeadless([&]() { return RGPlacement::RunReplay(pRecordingPath); });
+	if (CommandLine::GetValue("rgreorderbenchmark", &pRecordingPath))
+		return RunHeadless([&]() { return RGCore::RunReorderBenchmark(pRecordingPath, 0); });
+	if (CommandLine::GetBool("gpuscenebenchmark"))
+		return RunHeadless([]() { GPUSceneBuffer::RunBenchmark(100000, 0.01f); return true; });
+	if (CommandLine::GetBool("frustumcullingtest"))
+		return RunHeadless([]() { return FrustumCulling::RunSelfTest(0); });
+	if (CommandLine::GetBool("frustumcullingbenchmark"))
+		return RunHeadless([]() { FrustumCulling::RunBenchmark(0); return true; });
+	if (CommandLine::GetBool("bvhtest"))
+		return RunHeadless([]() { return InstanceBVH::RunSelfTest(0); });
+	if (CommandLine::GetBool("bvhbenchmark"))
+		return RunHeadless([]() { InstanceBVH::RunBenchmark(0); return true; });
+	if (CommandLine::GetBool("animationbenchmark"))
+		return RunHeadless([]() { return SkeletalAnimation::RunBenchmark(1000, 0); });
+	if (CommandLine::GetBool("animationcompressionbenchmark"))
+		return RunHeadless([]() { AnimationCompression::RunBenchmark(0); return true; });
+
 	Init_Internal();
 	while (m_Window.PollMessages())
 	{
@@ -149,9 +240,6 @@ void App::Init_Internal()
 #endif
 #endif
 
-	Thread::SetMainThread();
-	CommandLine::Parse(GetCommandLineA());
-
 	if (CommandLine::GetBool("debuggerwait"))
 	{
 		while (!::IsDebuggerPresent())
@@ -164,6 +252,7 @@ void App::Init_Internal()
 	ConsoleManager::Initialize();
 
 	TaskQueue::Initialize(std::thread::hardware_concurrency());
+	AsyncIO::Initialize(4);
 
 	Vector2i displayDimensions = Window::GetDisplaySize();
 
@@ -235,6 +324,7 @@ void App::Shutdown_Internal()
 	Shutdown();
 
 	m_pDevice->IdleGPU();
+	gProfilerCapture.End();
 	gGPUProfiler.Shutdown();
 	gCPUProfiler.Shutdown();
 
@@ -242,6 +332,7 @@ void App::Shutdown_Internal()
 	ImGuiRenderer::Shutdown();
 	GraphicsCommon::Destroy();
 
+	AsyncIO::Shutdown();
 	TaskQueue::Shutdown();
 	Console::Shutdown();
 }
@@ -0,0 +1,548 @@
+#include "stdafx.h"
+#include "AsyncIO.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
+#include "Core/Profiler.h"
+#include "Core/Stream.h"
+#include "Core/TaskQueue.h"
+#include "Core/Utils.h"
+
+#include <thread>
+#include <condition_variable>
+
+#if !PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Requests for the same file less than this apart are read with a single read
+static constexpr uint64 CoalesceGap			= 64u << 10;
+// Coalescing stops growing a read beyond this size
+static constexpr uint64 MaxCoalescedSize	= 8u << 20;
+
+struct IORequest
+{
+	AsyncReadDelegate	Callback;
+	TaskContext*		pContext;
+	uint64				Offset;
+	uint64				Size;
+};
+
+// All pending requests for a file
+struct PendingFile
+{
+	Array<IORequest>	Requests;
+	IOPriority			Priority;
+};
+
+// Memory of a single read. Shared by all requests coalesced into it and freed after the last callback.
+struct IOBuffer
+{
+	String				Path;
+	Array<uint8>		Data;
+	std::atomic<uint32>	NumPending;
+};
+
+// A read of one or more neighbouring requests
+struct IOBatch
+{
+	uint64		Offset			= 0;
+	uint64		Size			= 0;
+	uint32		FirstRequest	= 0;
+	uint32		NumRequests		= 0;
+	bool		Success			= false;
+	bool		Issued			= false;
+	IOBuffer*	pBuffer			= nullptr;
+#if PLATFORM_WINDOWS
+	OVERLAPPED	Overlapped		= {};
+#endif
+};
+
+static Array<std::thread>				m_Threads;
+
+static std::mutex						m_QueueMutex;
+static std::condition_variable			m_QueueCondition;
+static HashMap<String, PendingFile>		m_PendingFiles;									///< Pending requests by path
+static std::deque<String>				m_PathQueues[(uint32)IOPriority::Num];			///< Paths in m_PendingFiles per priority. Can contain stale paths
+static bool								m_Shutdown = false;
+
+static std::mutex						m_BudgetMutex;
+static std::condition_variable			m_BudgetCondition;
+static uint64							m_BytesInFlight = 0;
+static uint64							m_MaxBytesInFlight = 0;
+static uint64							m_PeakBytesInFlight = 0;
+
+static std::atomic<uint64>				m_NumRequests = 0;
+static std::atomic<uint64>				m_NumReads = 0;
+static std::atomic<uint64>				m_NumFailed = 0;
+static std::atomic<uint64>				m_NumBytesRead = 0;
+
+#if PLATFORM_WINDOWS
+
+using IOFileHandle = HANDLE;
+static const IOFileHandle InvalidIOFile = INVALID_HANDLE_VALUE;
+
+static IOFileHandle OpenIOFile(const char* pPath, uint64& outSize)
+{
+	HANDLE file = ::CreateFileA(pPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER fileSize;
+		::GetFileSizeEx(file, &fileSize);
+		outSize = fileSize.QuadPart;
+	}
+	return file;
+}
+
+static void CloseIOFile(IOFileHandle file)
+{
+	::CloseHandle(file);
+}
+
+// Starts an overlapped read, so all reads of a file are in flight at the same time
+static bool IssueRead(IOFileHandle file, IOBatch& batch)
+{
+	batch.Overlapped = {};
+	batch.Overlapped.Offset		= (DWORD)batch.Offset;
+	batch.Overlapped.OffsetHigh	= (DWORD)(batch.Offset >> 32);
+	batch.Overlapped.hEvent		= ::CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	if (::ReadFile(file, batch.pBuffer->Data.data(), (DWORD)batch.Size, nullptr, &batch.Overlapped))
+		return true;
+	if (::GetLastError() == ERROR_IO_PENDING)
+		return true;
+	::CloseHandle(batch.Overlapped.hEvent);
+	return false;
+}
+
+static bool FinishRead(IOFileHandle file, IOBatch& batch)
+{
+	DWORD read = 0;
+	bool success = ::GetOverlappedResult(file, &batch.Overlapped, &read, TRUE) && read == batch.Size;
+	::CloseHandle(batch.Overlapped.hEvent);
+	return success;
+}
+
+static void SetCurrentThreadName(const char* pName)
+{
+	SetThreadDescription(GetCurrentThread(), MULTIBYTE_TO_UNICODE(pName));
+}
+
+#else
+
+using IOFileHandle = int;
+static const IOFileHandle InvalidIOFile = -1;
+
+static IOFileHandle OpenIOFile(const char* pPath, uint64& outSize)
+{
+	int file = ::open(pPath, O_RDONLY);
+	if (file >= 0)
+	{
+		struct stat fileStat;
+		if (::fstat(file, &fileStat) != 0)
+		{
+			::close(file);
+			return InvalidIOFile;
+		}
+		outSize = (uint64)fileStat.st_size;
+	}
+	return file;
+}
+
+static void CloseIOFile(IOFileHandle file)
+{
+	::close(file);
+}
+
+// Reads synchronously. IO threads provide the parallelism
+static bool IssueRead(IOFileHandle file, IOBatch& batch)
+{
+	uint64 totalRead = 0;
+	while (totalRead < batch.Size)
+	{
+		ssize_t read = ::pread(file, batch.pBuffer->Data.data() + totalRead, batch.Size - totalRead, batch.Offset + totalRead);
+		if (read <= 0)
+			return false;
+		totalRead += read;
+	}
+	return true;
+}
+
+static bool FinishRead(IOFileHandle /*file*/, IOBatch& /*batch*/)
+{
+	return true;
+}
+
+static void SetCurrentThreadName(const char* pName)
+{
+	pthread_setname_np(pthread_self(), pName);
+}
+
+#endif
+
+// A read larger than the whole budget is allowed when nothing else is in flight
+static bool HasBudget(uint64 size)
+{
+	return m_BytesInFlight == 0 || m_BytesInFlight + size <= m_MaxBytesInFlight;
+}
+
+static bool TryAcquireBudget(uint64 size)
+{
+	std::scoped_lock lock(m_BudgetMutex);
+	if (!HasBudget(size))
+		return false;
+	m_BytesInFlight += size;
+	m_PeakBytesInFlight = Math::Max(m_PeakBytesInFlight, m_BytesInFlight);
+	return true;
+}
+
+static void AcquireBudget(uint64 size)
+{
+	std::unique_lock lock(m_BudgetMutex);
+	m_BudgetCondition.wait(lock, [size]() { return HasBudget(size); });
+	m_BytesInFlight += size;
+	m_PeakBytesInFlight = Math::Max(m_PeakBytesInFlight, m_BytesInFlight);
+}
+
+static void ReleaseBuffer(IOBuffer* pBuffer)
+{
+	if (pBuffer->NumPending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	uint64 size = pBuffer->Data.size();
+	delete pBuffer;
+	{
+		std::scoped_lock lock(m_BudgetMutex);
+		m_BytesInFlight -= size;
+	}
+	m_BudgetCondition.notify_all();
+}
+
+// Wait for a batch to be read and hand its requests to the TaskQueue
+static void CompleteBatch(IOFileHandle file, IOBatch& batch, Array<IORequest>& requests)
+{
+	if (batch.Issued)
+		batch.Success = FinishRead(file, batch);
+
+	if (batch.Success)
+		m_NumBytesRead.fetch_add(batch.Size, std::memory_order_relaxed);
+	else
+		m_NumFailed.fetch_add(batch.NumRequests, std::memory_order_relaxed);
+
+	IOBuffer* pBuffer = batch.pBuffer;
+	const bool success = batch.Success;
+	for (uint32 i = batch.FirstRequest; i < batch.FirstRequest + batch.NumRequests; ++i)
+	{
+		IORequest& request = requests[i];
+		uint64 offset = success ? request.Offset - batch.Offset : 0;
+		uint32 size = success ? (uint32)request.Size : 0;
+		TaskQueue::Execute([pBuffer, callback = std::move(request.Callback), offset, size, success](int) mutable
+			{
+				AsyncReadResult result{ pBuffer->Path.c_str(), Span<const uint8>(pBuffer->Data.data() + offset, size), success };
+				callback.Execute(result);
+				ReleaseBuffer(pBuffer);
+			}, *request.pContext);
+		TaskQueue::EndExternalWork(*request.pContext);
+	}
+}
+
+static void ProcessFile(const String& path, PendingFile& file)
+{
+	PROFILE_CPU_SCOPE();
+
+	Array<IORequest>& requests = file.Requests;
+
+	uint64 fileSize = 0;
+	IOFileHandle handle = OpenIOFile(path.c_str(), fileSize);
+
+	// Resolve whole file requests and sort so neighbouring ranges end up next to each other.
+	// Larger requests go first, so smaller ones at the same offset fall inside their range.
+	for (IORequest& request : requests)
+	{
+		if (request.Size == AsyncIO::WholeFile)
+			request.Size = request.Offset <= fileSize ? fileSize - request.Offset : 0;
+	}
+	std::sort(requests.begin(), requests.end(), [](const IORequest& a, const IORequest& b)
+		{
+			if (a.Offset != b.Offset)
+				return a.Offset < b.Offset;
+			return a.Size > b.Size;
+		});
+
+	auto IsValid = [&](const IORequest& request)
+		{
+			return handle != InvalidIOFile &&
+				request.Offset + request.Size <= fileSize &&
+				request.Size <= std::numeric_limits<uint32>::max();
+		};
+
+	// Coalesce requests into batches. Invalid requests get a failed batch of their own.
+	Array<IOBatch> batches;
+	for (uint32 i = 0; i < (uint32)requests.size();)
+	{
+		IOBatch& batch = batches.emplace_back();
+		batch.FirstRequest = i;
+		batch.NumRequests = 1;
+		batch.Success = IsValid(requests[i]);
+		if (batch.Success)
+		{
+			batch.Offset = requests[i].Offset;
+			uint64 end = requests[i].Offset + requests[i].Size;
+			for (++i; i < (uint32)requests.size() && IsValid(requests[i]); ++i)
+			{
+				uint64 requestEnd = requests[i].Offset + requests[i].Size;
+				if (requests[i].Offset > end + CoalesceGap)
+					break;
+				// Requests inside the current range are always free to add
+				if (requestEnd - batch.Offset > Math::Max(MaxCoalescedSize, end - batch.Offset))
+					break;
+				end = Math::Max(end, requestEnd);
+				++batch.NumRequests;
+			}
+			batch.Size = end - batch.Offset;
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	// Issue all reads, as far as the budget allows. When it runs out, finish the reads of this file first, since they hold budget too.
+	uint32 numCompleted = 0;
+	for (uint32 i = 0; i < (uint32)batches.size(); ++i)
+	{
+		IOBatch& batch = batches[i];
+		if (!TryAcquireBudget(batch.Size))
+		{
+			while (numCompleted < i)
+				CompleteBatch(handle, batches[numCompleted++], requests);
+			AcquireBudget(batch.Size);
+		}
+
+		batch.pBuffer = new IOBuffer;
+		batch.pBuffer->Path = path;
+		batch.pBuffer->Data.resize(batch.Size);
+		batch.pBuffer->NumPending = batch.NumRequests;
+
+		if (batch.Success && batch.Size > 0)
+		{
+			m_NumReads.fetch_add(1, std::memory_order_relaxed);
+			batch.Issued = IssueRead(handle, batch);
+			batch.Success = batch.Issued;
+		}
+	}
+
+	while (numCompleted < (uint32)batches.size())
+		CompleteBatch(handle, batches[numCompleted++], requests);
+
+	if (handle != InvalidIOFile)
+		CloseIOFile(handle);
+}
+
+// Pop the pending file with the highest priority
+static bool PopPendingFile(String& outPath, PendingFile& outFile)
+{
+	for (int32 priority = (int32)IOPriority::Num - 1; priority >= 0; --priority)
+	{
+		std::deque<String>& queue = m_PathQueues[priority];
+		while (!queue.empty())
+		{
+			String path = std::move(queue.front());
+			queue.pop_front();
+
+			// The file may have been picked up already from a higher priority queue
+			auto it = m_PendingFiles.find(path);
+			if (it == m_PendingFiles.end())
+				continue;
+
+			outFile = std::move(it->second);
+			m_PendingFiles.erase(it);
+			outPath = std::move(path);
+			return true;
+		}
+	}
+	return false;
+}
+
+void AsyncIO::WorkFunction(uint32 threadIndex)
+{
+	char threadName[256];
+	FormatString(threadName, ARRAYSIZE(threadName), "AsyncIO Thread %d", threadIndex);
+	SetCurrentThreadName(threadName);
+
+	while (true)
+	{
+		String path;
+		PendingFile file;
+		{
+			// Pending requests are finished before shutting down
+			std::unique_lock lock(m_QueueMutex);
+			m_QueueCondition.wait(lock, []() { return m_Shutdown || !m_PendingFiles.empty(); });
+			if (!PopPendingFile(path, file))
+				return;
+		}
+		ProcessFile(path, file);
+	}
+}
+
+void AsyncIO::Initialize(uint32 numThreads, uint64 maxBytesInFlight)
+{
+	m_Shutdown = false;
+	m_MaxBytesInFlight = maxBytesInFlight;
+
+	numThreads = Math::Max(numThreads, 1u);
+	for (uint32 i = 0; i < numThreads; ++i)
+		m_Threads.emplace_back(&AsyncIO::WorkFunction, i);
+}
+
+void AsyncIO::Shutdown()
+{
+	{
+		std::scoped_lock lock(m_QueueMutex);
+		m_Shutdown = true;
+	}
+	m_QueueCondition.notify_all();
+
+	for (std::thread& thread : m_Threads)
+		thread.join();
+	m_Threads.clear();
+}
+
+void AsyncIO::AddRequest(const char* pPath, const AsyncReadDelegate& onComplete, TaskContext& context, IOPriority priority, uint64 offset, uint64 size)
+{
+	gAssert(!m_Threads.empty(), "AsyncIO is not initialized");
+	gAssert(size == WholeFile || size <= std::numeric_limits<uint32>::max(), "A single read is limited to 4GB");
+
+	TaskQueue::BeginExternalWork(context);
+	m_NumRequests.fetch_add(1, std::memory_order_relaxed);
+
+	// Normalize so different spellings of the same path coalesce
+	String path = Paths::Normalize(pPath);
+	{
+		std::scoped_lock lock(m_QueueMutex);
+		auto it = m_PendingFiles.find(path);
+		if (it == m_PendingFiles.end())
+		{
+			it = m_PendingFiles.emplace(path, PendingFile{ {}, priority }).first;
+			m_PathQueues[(uint32)priority].push_back(path);
+		}
+		else if (priority > it->second.Priority)
+		{
+			// Requeue at the higher priority. The old queue entry becomes stale.
+			it->second.Priority = priority;
+			m_PathQueues[(uint32)priority].push_back(path);
+		}
+		it->second.Requests.push_back(IORequest{ onComplete, &context, offset, size });
+	}
+	m_QueueCondition.notify_one();
+}
+
+AsyncIOStats AsyncIO::GetStats()
+{
+	AsyncIOStats stats;
+	stats.NumRequests		= m_NumRequests.load(std::memory_order_relaxed);
+	stats.NumReads			= m_NumReads.load(std::memory_order_relaxed);
+	stats.NumFailed			= m_NumFailed.load(std::memory_order_relaxed);
+	stats.NumBytesRead		= m_NumBytesRead.load(std::memory_order_relaxed);
+	{
+		std::scoped_lock lock(m_BudgetMutex);
+		stats.PeakBytesInFlight = m_PeakBytesInFlight;
+	}
+	return stats;
+}
+
+void AsyncIO::ResetStats()
+{
+	m_NumRequests	= 0;
+	m_NumReads		= 0;
+	m_NumFailed		= 0;
+	m_NumBytesRead	= 0;
+	std::scoped_lock lock(m_BudgetMutex);
+	m_PeakBytesInFlight = m_BytesInFlight;
+}
+
+
+// Usage: AsyncIOBenchmark <numFiles> <fileSizeKB>
+// Writes 'numFiles' files to Saved/AsyncIOBenchmark/ and reads each of them as a loader would: a header followed by the whole file.
+// Compares blocking FileStream reads on the calling thread against AsyncIO, where both reads of a file coalesce into one.
+static ConsoleCommand<int, int> gAsyncIOBenchmark("AsyncIOBenchmark", [](int numFiles, int fileSizeKB)
+	{
+		constexpr uint32 HeaderSize = 64;
+		numFiles = Math::Max(numFiles, 1);
+		uint64 fileSize = Math::Max<uint64>((uint64)fileSizeKB << 10, HeaderSize);
+
+		String directory = Sprintf("%sAsyncIOBenchmark/", Paths::SavedDir());
+		Paths::CreateDirectoryTree(directory);
+
+		Array<String> paths(numFiles);
+		Array<uint8> fileData(fileSize);
+		for (int i = 0; i < numFiles; ++i)
+		{
+			for (uint64 j = 0; j < fileSize; ++j)
+				fileData[j] = (uint8)(i + j);
+
+			paths[i] = Sprintf("%sFile_%d.bin", directory, i);
+			FileStream stream;
+			if (!stream.Open(paths[i].c_str(), FileMode::Write | FileMode::Create) || !stream.Write(fileData.data(), fileSize))
+			{
+				E_LOG(Warning, "AsyncIOBenchmark - Failed to write '%s'", paths[i]);
+				return;
+			}
+		}
+
+		auto Checksum = [](Span<const uint8> data)
+			{
+				uint64 sum = 0;
+				for (uint8 value : data)
+					sum += value;
+				return sum;
+			};
+
+		uint64 syncSum = 0;
+		Utils::TimeScope syncTimer;
+		for (const String& path : paths)
+		{
+			FileStream stream;
+			if (!stream.Open(path.c_str(), FileMode::Read))
+				continue;
+			uint8 header[HeaderSize];
+			stream.Read(header, HeaderSize);
+			syncSum += Checksum(header);
+
+			stream.Seek(0, StreamSeekMode::Absolute);
+			Array<uint8> data(stream.GetLength());
+			stream.Read(data.data(), data.size());
+			syncSum += Checksum(data);
+		}
+		float syncTime = syncTimer.Stop();
+
+		AsyncIO::ResetStats();
+		std::atomic<uint64> asyncSum = 0;
+		Utils::TimeScope asyncTimer;
+		{
+			TaskContext context;
+			for (const String& path : paths)
+			{
+				auto OnRead = [&asyncSum, &Checksum](const AsyncReadResult& result)
+					{
+						if (result.Success)
+							asyncSum += Checksum(result.Data);
+					};
+				AsyncIO::ReadFile(path.c_str(), OnRead, context, IOPriority::High, 0, HeaderSize);
+				AsyncIO::ReadFile(path.c_str(), OnRead, context);
+			}
+			TaskQueue::Join(context);
+		}
+		float asyncTime = asyncTimer.Stop();
+		AsyncIOStats stats = AsyncIO::GetStats();
+
+		gAssert(syncSum == asyncSum, "Sync and async reads returned different data");
+
+		float totalMB = Math::BytesToMegaBytes * fileSize * numFiles;
+		E_LOG(Info, "AsyncIOBenchmark - %d files of %.1f KB", numFiles, fileSize / 1024.0f);
+		E_LOG(Info, "\tFileStream: %.2f ms (%.0f files/s, %.0f MB/s)", syncTime * 1000.0f, numFiles / syncTime, totalMB / syncTime);
+		E_LOG(Info, "\tAsyncIO:    %.2f ms (%.0f files/s, %.0f MB/s)", asyncTime * 1000.0f, numFiles / asyncTime, totalMB / asyncTime);
+		E_LOG(Info, "\tAsyncIO: %llu requests, %llu reads, %llu failed, peak %.2f MB in flight",
+			stats.NumRequests, stats.NumReads, stats.NumFailed, Math::BytesToMegaBytes * stats.PeakBytesInFlight);
+	});
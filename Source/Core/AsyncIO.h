@@ -0,0 +1,59 @@
+#pragma once
+
+class TaskContext;
+
+enum class IOPriority : uint8
+{
+	Low,
+	Normal,
+	High,
+	Num,
+};
+
+struct AsyncReadResult
+{
+	const char*			pPath;		///< Path of the file that was read
+	Span<const uint8>	Data;		///< Requested bytes. Only valid during the callback
+	bool				Success;	///< False if the file couldn't be opened or the range couldn't be read
+};
+
+DECLARE_DELEGATE(AsyncReadDelegate, const AsyncReadResult&);
+
+struct AsyncIOStats
+{
+	uint64 NumRequests			= 0;	///< Number of ReadFile() calls
+	uint64 NumReads				= 0;	///< Number of reads issued to the OS after coalescing
+	uint64 NumFailed			= 0;	///< Number of requests completed with Success == false
+	uint64 NumBytesRead			= 0;
+	uint64 PeakBytesInFlight	= 0;	///< Highest amount of memory held by reads and their callbacks
+};
+
+// Asynchronous file reads.
+// Requests are picked up by IO threads in priority order. All pending requests for the same file are handled together
+// and ranges close to each other are coalesced into a single read.
+// The callback of each request runs on the TaskQueue as part of the request's TaskContext, so TaskQueue::Join() waits for both the read and the callback.
+// Read buffers count against a budget of bytes in flight until their callbacks have finished. Callbacks should not block on other reads.
+// Windows issues all reads of a file at once using overlapped I/O. Other platforms use blocking reads on the IO threads.
+class AsyncIO
+{
+public:
+	static constexpr uint64 WholeFile = ~0ull;
+
+	static void Initialize(uint32 numThreads, uint64 maxBytesInFlight = 64ull << 20);
+	static void Shutdown();
+
+	// Read 'size' bytes at 'offset' in 'pPath' and call 'onComplete' with the result on the TaskQueue.
+	// The size of a single request is limited to 4GB.
+	template<typename Callback>
+	static void ReadFile(const char* pPath, Callback&& onComplete, TaskContext& context, IOPriority priority = IOPriority::Normal, uint64 offset = 0, uint64 size = WholeFile)
+	{
+		AddRequest(pPath, AsyncReadDelegate::CreateLambda(std::forward<Callback>(onComplete)), context, priority, offset, size);
+	}
+
+	static AsyncIOStats GetStats();
+	static void ResetStats();
+
+private:
+	static void AddRequest(const char* pPath, const AsyncReadDelegate& onComplete, TaskContext& context, IOPriority priority, uint64 offset, uint64 size);
+	static void WorkFunction(uint32 threadIndex);
+};
@@ -379,6 +379,12 @@ public:
 		return Bits;
 	}
 
+	// The storage words, for code that writes many bits at once
+	Storage* GetData()
+	{
+		return Data;
+	}
+
 private:
 
 	static constexpr uint32 StorageIndexOfBit(uint32 bit)
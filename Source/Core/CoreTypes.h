@@ -99,6 +99,11 @@ inline uint64 gHashCombine(uint64 inA, uint64 inB)
 	return ankerl::unordered_dense::detail::wyhash::mix(inA, inB);
 }
 
+inline uint64 gHash(const void* pData, size_t size)
+{
+	return ankerl::unordered_dense::detail::wyhash::hash(pData, size);
+}
+
 template<typename T>
 inline uint64 gHash(T& value)
 {
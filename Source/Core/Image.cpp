@@ -27,23 +27,39 @@ Image::Image(uint32 width, uint32 height, uint32 depth, ResourceFormat format, u
 	}
 }
 
+Image::~Image() = default;
+
 bool Image::Load(const char* inputStream)
 {
 	const String extension = Paths::GetFileExtenstion(inputStream);
 	bool success = false;
 
-	FileStream stream;
-	if (!stream.Open(inputStream, FileMode::Read))
+	// Drop views into a previous mapping before replacing it
+	m_pNextImage.reset();
+	m_PixelView = {};
+	m_pMappedFile = std::make_unique<MappedFileStream>();
+	if (!m_pMappedFile->Open(inputStream))
+	{
+		m_pMappedFile.reset();
 		return false;
+	}
 
 	if (extension == "dds")
 	{
-		success = LoadDDS(stream);
+		success = LoadDDS(*m_pMappedFile);
 	}
 	//If not one of the above, load with Stbi by default (jpg, png, tga, bmp, ...)
 	else
 	{
-		success = LoadSTB(stream);
+		success = LoadSTB(*m_pMappedFile);
+	}
+
+	// Only keep the mapping alive when the pixels point into it
+	if (!success || m_PixelView.GetSize() == 0)
+	{
+		m_pNextImage.reset();
+		m_PixelView = {};
+		m_pMappedFile.reset();
 	}
 	return success;
 }
@@ -57,23 +73,40 @@ bool Image::Load(Stream& stream, const char* pFormatHint)
 	return LoadSTB(stream);
 }
 
-bool Image::SetSize(uint32 width, uint32 height, uint32 depth, uint32 numMips)
+uint64 Image::SetDimensions(uint32 width, uint32 height, uint32 depth, uint32 numMips)
 {
 	m_Width = Math::Max(1u, width);
 	m_Height = Math::Max(1u, height);
 	m_Depth = Math::Max(1u, depth);
 	m_MipLevels = numMips;
-	m_Pixels.resize(RHI::GetTextureByteSize(m_Format, m_Width, m_Height, m_Depth, numMips));
+	return RHI::GetTextureByteSize(m_Format, m_Width, m_Height, m_Depth, numMips);
+}
+
+bool Image::SetSize(uint32 width, uint32 height, uint32 depth, uint32 numMips)
+{
+	m_PixelView = {};
+	m_Pixels.resize(SetDimensions(width, height, depth, numMips));
 	return true;
 }
 
+void Image::MakePixelsWritable()
+{
+	if (m_PixelView.GetSize() > 0)
+	{
+		m_Pixels.assign(m_PixelView.begin(), m_PixelView.end());
+		m_PixelView = {};
+	}
+}
+
 bool Image::SetData(const void* pPixels)
 {
+	MakePixelsWritable();
 	return SetData(pPixels, 0, (uint32)m_Pixels.size());
 }
 
 bool Image::SetData(const void* pData, uint32 offsetInBytes, uint32 sizeInBytes)
 {
+	MakePixelsWritable();
 	gAssert(offsetInBytes + sizeInBytes <= m_Pixels.size());
 	memcpy(m_Pixels.data() + offsetInBytes, pData, sizeInBytes);
 	return true;
@@ -83,6 +116,7 @@ bool Image::SetPixel(uint32 x, uint32 y, const Color& color)
 {
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	gAssert(!info.IsBC, "Can't get pixel data from block compressed texture");
+	MakePixelsWritable();
 	if (x + y * m_Width >= (uint32)m_Pixels.size())
 	{
 		return false;
@@ -99,6 +133,7 @@ bool Image::SetPixelInt(uint32 x, uint32 y, unsigned int color)
 {
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	gAssert(!info.IsBC, "Can't get pixel data from block compressed texture");
+	MakePixelsWritable();
 	if (x + y * m_Width >= (int)m_Pixels.size())
 	{
 		return false;
@@ -116,11 +151,11 @@ Color Image::GetPixel(uint32 x, uint32 y) const
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	gAssert(!info.IsBC, "Can't get pixel data from block compressed texture");
 	Color c = {};
-	if (x + y * m_Width >= (int)m_Pixels.size())
+	if (x + y * m_Width >= (int)GetPixelsSize())
 	{
 		return c;
 	}
-	const unsigned char* pPixel = &m_Pixels[(x + (y * m_Width)) * info.NumComponents * m_Depth];
+	const unsigned char* pPixel = &GetPixels()[(x + (y * m_Width)) * info.NumComponents * m_Depth];
 	for (uint32 i = 0; i < info.NumComponents; ++i)
 	{
 		reinterpret_cast<float*>(&c)[i] = (float)pPixel[i] / 255.0f;
@@ -133,11 +168,11 @@ uint32 Image::GetPixelInt(uint32 x, uint32 y) const
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	gAssert(!info.IsBC, "Can't get pixel data from block compressed texture");
 	uint32 c = 0;
-	if (x + y * m_Width >= (uint32)m_Pixels.size())
+	if (x + y * m_Width >= (uint32)GetPixelsSize())
 	{
 		return c;
 	}
-	const unsigned char* pPixel = &m_Pixels[(x + (y * m_Width)) * info.NumComponents * m_Depth];
+	const unsigned char* pPixel = &GetPixels()[(x + (y * m_Width)) * info.NumComponents * m_Depth];
 	for (uint32 i = 0; i < info.NumComponents; ++i)
 	{
 		c <<= 8;
@@ -154,23 +189,30 @@ const unsigned char* Image::GetData(uint32 mipLevel) const
 	{
 		offset += RHI::GetTextureMipByteSize(m_Format, m_Width, m_Height, m_Depth, mip);
 	}
-	return m_Pixels.data() + offset;
+	return GetPixels() + offset;
 }
 
 bool Image::LoadSTB(Stream& stream)
 {
 	int components = 0;
 
-	uint32 size = stream.GetLength();
-	Array<uint8> buffer(size);
-	stream.Read(buffer.data(), size);
+	// Decode straight from the stream's memory when possible
+	uint32 size = (uint32)(stream.GetLength() - stream.GetCursor());
+	Array<uint8> buffer;
+	const uint8* pData = stream.ReadView(size).GetData();
+	if (!pData)
+	{
+		buffer.resize(size);
+		stream.Read(buffer.data(), size);
+		pData = buffer.data();
+	}
 
-	m_IsHdr = stbi_is_hdr_from_memory(buffer.data(), size);
+	m_IsHdr = stbi_is_hdr_from_memory(pData, size);
 
 	if (m_IsHdr)
 	{
 		int width, height;
-		float* pPixels = stbi_loadf_from_memory(buffer.data(), size, &width, &height, &components, 4);
+		float* pPixels = stbi_loadf_from_memory(pData, size, &width, &height, &components, 4);
 		if (pPixels == nullptr)
 		{
 			return false;
@@ -187,7 +229,7 @@ bool Image::LoadSTB(Stream& stream)
 	else
 	{
 		int width, height;
-		unsigned char* pPixels = stbi_load_from_memory(buffer.data(), size, &width, &height, &components, 4);
+		unsigned char* pPixels = stbi_load_from_memory(pData, size, &width, &height, &components, 4);
 		if (pPixels == nullptr)
 		{
 			return false;
@@ -363,11 +405,26 @@ bool Image::LoadDDS(Stream& stream)
 			m_IsArray = true;
 		}
 
+		// When reading from our own mapping, point the images into it instead of copying
+		const bool referenceStream = m_pMappedFile && &stream == m_pMappedFile.get();
+
 		Image* pCurrentImage = this;
 		for (uint32 imageIdx = 0; imageIdx < imageChainCount; ++imageIdx)
 		{
-			pCurrentImage->SetSize(header.dwWidth, header.dwHeight, header.dwDepth, header.dwMipMapCount);
-			stream.Read(pCurrentImage->m_Pixels.data(), (uint32)pCurrentImage->m_Pixels.size());
+			if (referenceStream)
+			{
+				uint64 size = pCurrentImage->SetDimensions(header.dwWidth, header.dwHeight, header.dwDepth, header.dwMipMapCount);
+				pCurrentImage->m_PixelView = stream.ReadView(size);
+				if (pCurrentImage->m_PixelView.GetSize() != size)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				pCurrentImage->SetSize(header.dwWidth, header.dwHeight, header.dwDepth, header.dwMipMapCount);
+				stream.Read(pCurrentImage->m_Pixels.data(), pCurrentImage->m_Pixels.size());
+			}
 
 			if (imageIdx < imageChainCount - 1)
 			{
@@ -389,10 +446,10 @@ void Image::Save(const char* pFilePath) const
 	String extension = Paths::GetFileExtenstion(pFilePath);
 	if (extension == "png")
 	{
-		gVerify(stbi_write_png(pFilePath, m_Width, m_Height, info.NumComponents, m_Pixels.data(), m_Width * 4), == 1);
+		gVerify(stbi_write_png(pFilePath, m_Width, m_Height, info.NumComponents, GetPixels(), m_Width * 4), == 1);
 	}
 	else if (extension == "jpg")
 	{
-		gVerify(stbi_write_jpg(pFilePath, m_Width, m_Height, info.NumComponents, m_Pixels.data(), 70), == 1);
+		gVerify(stbi_write_jpg(pFilePath, m_Width, m_Height, info.NumComponents, GetPixels(), 70), == 1);
 	}
 }
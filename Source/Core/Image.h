@@ -2,12 +2,15 @@
 #include "RHI/RHI.h"
 
 class Stream;
+class MappedFileStream;
 
 class Image final
 {
 public:
 	Image(ResourceFormat format = ResourceFormat::Unknown);
 	Image(uint32 width, uint32 height, uint32 depth, ResourceFormat format, uint32 numMips = 1, const void* pInitialData = nullptr);
+	~Image();
+
 	bool Load(const char* filePath);
 	bool Load(Stream& stream, const char* pFormatHint);
 	void Save(const char* pFilePath) const;
@@ -37,6 +40,11 @@ private:
 	bool LoadDDS(Stream& stream);
 	bool LoadSTB(Stream& stream);
 
+	uint64 SetDimensions(uint32 width, uint32 height, uint32 depth, uint32 numMips);
+	const uint8* GetPixels() const { return m_PixelView.GetSize() > 0 ? m_PixelView.GetData() : m_Pixels.data(); }
+	uint64 GetPixelsSize() const { return m_PixelView.GetSize() > 0 ? m_PixelView.GetSize() : m_Pixels.size(); }
+	void MakePixelsWritable();
+
 	uint32 m_Width = 0;
 	uint32 m_Height = 0;
 	uint32 m_Depth = 1;
@@ -48,4 +56,9 @@ private:
 	std::unique_ptr<Image> m_pNextImage;
 	ResourceFormat m_Format = ResourceFormat::Unknown;
 	Array<uint8> m_Pixels;
+
+	// DDS files loaded from disk reference the mapped file directly instead of copying the pixels.
+	// The head of the image chain owns the mapping, the pixels are copied to m_Pixels on the first write.
+	std::unique_ptr<MappedFileStream> m_pMappedFile;
+	Span<const uint8> m_PixelView;
 };
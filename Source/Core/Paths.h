@@ -49,6 +49,7 @@ namespace Paths
 	String ResourcesDir();
 	String ConfigDir();
 	String ShaderCacheDir();
+	String MeshCacheDir();
 	String ShadersDir();
 
 	String GameIniFile();
@@ -1,5 +1,7 @@
 #pragma once
 #include "RHI/D3D.h"
+#include <thread>
+#include <condition_variable>
 
 #ifndef WITH_PROFILING
 #define WITH_PROFILING 1
@@ -18,7 +20,7 @@
 
 /// Usage:
 //		PROFILE_FRAME()
-#define PROFILE_FRAME() gCPUProfiler.Tick(); gGPUProfiler.Tick()
+#define PROFILE_FRAME() gCPUProfiler.Tick(); gGPUProfiler.Tick(); gProfilerCapture.Tick(); gProfilerStats.Tick()
 
 /// Usage:
 ///		PROFILE_EXECUTE_COMMANDLISTS(ID3D12CommandQueue* pQueue, Span<ID3D12CommandLists*> commandLists)
@@ -109,57 +111,68 @@ private:
 
 
 
-// Simple Linear Allocator
-class LinearAllocator
+// Name of a profiler event.
+// String literals (and __FUNCTION__) are stored by pointer.
+// Other strings are interned in the ProfilerStringTable the first time they're seen.
+struct ProfilerName
 {
-public:
-	explicit LinearAllocator(uint32 size)
-		: m_pData(new char[size]), m_Size(size), m_Offset(0)
-	{
-	}
+	// Only constant arrays with static storage, like string literals, are constant expressions.
+	// A const char array on the stack or heap doesn't compile here and must be passed as a pointer, so it gets interned.
+	template<size_t N>
+	consteval ProfilerName(const char (&name)[N])
+		: pName(name), IsStatic(true)
+	{}
 
-	~LinearAllocator()
-	{
-		delete[] m_pData;
-	}
+	template<size_t N>
+	ProfilerName(char (&name)[N])
+		: pName(name), IsStatic(false)
+	{}
 
-	LinearAllocator(LinearAllocator&) = delete;
-	LinearAllocator& operator=(LinearAllocator&) = delete;
+	template<typename T>
+	requires std::is_convertible_v<T, const char*> && (!std::is_array_v<std::remove_reference_t<T>>)
+	ProfilerName(T&& name)
+		: pName(name), IsStatic(false)
+	{}
 
-	void Reset()
-	{
-		m_Offset = 0;
-	}
+	ProfilerName(const char* name, bool isStatic)
+		: pName(name), IsStatic(isStatic)
+	{}
 
-	template<typename T, typename... Args>
-	T* Allocate(Args... args)
-	{
-		void* pData = Allocate(sizeof(T));
-		T* pValue = new (pData) T(std::forward<Args>(args)...);
-		return pValue;
-	}
+	const char* pName;
+	bool		IsStatic;
+};
 
-	void* Allocate(uint32 size)
-	{
-		uint32 offset = m_Offset.fetch_add(size);
-		gAssert(offset + size <= m_Size);
-		return m_pData + offset;
-	}
 
-	const char* String(const char* pStr)
-	{
-		uint32 len = (uint32)strlen(pStr) + 1;
-		char* pData = (char*)Allocate(len);
-		strcpy_s(pData, len, pStr);
-		return pData;
-	}
+
+// Deduplicated storage for event names which lives as long as the process.
+// Lookups are lock-free. Only the first occurrence of a string takes a lock to copy it.
+class ProfilerStringTable
+{
+public:
+	ProfilerStringTable() = default;
+	~ProfilerStringTable();
+
+	ProfilerStringTable(const ProfilerStringTable&) = delete;
+	ProfilerStringTable& operator=(const ProfilerStringTable&) = delete;
+
+	const char* Intern(const char* pStr);
+
+	// Returns a pointer to a string which lives as long as the profiler
+	const char* Resolve(const ProfilerName& name) { return name.IsStatic ? name.pName : Intern(name.pName); }
 
 private:
-	char* m_pData;
-	uint32 m_Size;
-	std::atomic<uint32> m_Offset;
+	static constexpr uint32 Capacity	= 1 << 13;
+	static constexpr uint32 BlockSize	= 1 << 16;
+
+	StaticArray<std::atomic<uint64>, Capacity>		m_Hashes{};					///< Hash of each string. 0 if slot is empty
+	StaticArray<std::atomic<const char*>, Capacity>	m_Strings{};				///< String of each slot
+	std::mutex										m_Lock;						///< Lock for inserting new strings
+	Array<char*>									m_Blocks;					///< Storage for string copies
+	uint32											m_BlockOffset = BlockSize;	///< Offset in the last block
 };
 
+extern ProfilerStringTable gProfilerStringTable;
+
 void DrawProfilerHUD();
 
 
@@ -188,10 +201,6 @@ struct ProfilerEvent
 class ProfilerEventData
 {
 public:
-	ProfilerEventData()
-		: Allocator(1 << 16)
-	{}
-
 	Span<const ProfilerEvent> GetEvents() const						{ return Span<const ProfilerEvent>(Events.data(), NumEvents); }
 	Span<const ProfilerEvent> GetEvents(uint32 trackIndex) const	{ return trackIndex < EventOffsetAndCountPerTrack.size() && EventOffsetAndCountPerTrack[trackIndex].Size > 0 ? Span<const ProfilerEvent>(&Events[EventOffsetAndCountPerTrack[trackIndex].Offset], EventOffsetAndCountPerTrack[trackIndex].Size) : Span<const ProfilerEvent>(); }
 
@@ -205,7 +214,6 @@ private:
 		uint32 Size;
 	};
 
-	LinearAllocator						Allocator;						///< Scratch allocator for frame
 	Array<OffsetAndSize>				EventOffsetAndCountPerTrack;	///< Span of events for each track
 	Array<ProfilerEvent>				Events;							///< Event storage for frame
 	uint32								NumEvents = 0;					///< Total number of recorded events
@@ -245,10 +253,10 @@ public:
 	void Shutdown();
 
 	// Allocate and record a GPU event on the commandlist
-	void BeginEvent(ID3D12GraphicsCommandList* pCmd, const char* pName, uint32 color, const char* pFilePath, uint32 lineNumber);
+	void BeginEvent(ID3D12GraphicsCommandList* pCmd, const ProfilerName& name, uint32 color, const char* pFilePath, uint32 lineNumber);
 
 	// Allocate and record a GPU event on the commandlist
-	void BeginEvent(ID3D12GraphicsCommandList* pCmd, const char* pName, uint32 color = 0) { BeginEvent(pCmd, pName, color, "", 0); }
+	void BeginEvent(ID3D12GraphicsCommandList* pCmd, const ProfilerName& name, uint32 color = 0) { BeginEvent(pCmd, name, color, "", 0); }
 
 	// Record a GPU event end on the commandlist
 	void EndEvent(ID3D12GraphicsCommandList* pCmd);
@@ -422,6 +430,7 @@ private:
 	Array<ActiveEventStack>					m_QueueEventStack;				///< Stack of active events for each command queue
 	Array<QueueInfo>						m_Queues;						///< All registered queues
 	HashMap<ID3D12CommandQueue*, uint32>	m_QueueIndexMap;				///< Map from command queue to index
+	HashMap<const char*, uint32>			m_ColorCache;					///< Color of each interned event name
 	GPUProfilerCallbacks					m_EventCallback;
 };
 
@@ -429,16 +438,16 @@ private:
 // Helper RAII-style structure to push and pop a GPU sample event
 struct GPUProfileScope
 {
-	GPUProfileScope(const char* pFunction, const char* pFilePath, uint32 lineNumber, ID3D12GraphicsCommandList* pCmd, const char* pName)
+	GPUProfileScope(const char* pFunction, const char* pFilePath, uint32 lineNumber, ID3D12GraphicsCommandList* pCmd, const ProfilerName& name)
 		: pCmd(pCmd)
 	{
-		gGPUProfiler.BeginEvent(pCmd, pName, 0, pFilePath, lineNumber);
+		gGPUProfiler.BeginEvent(pCmd, name, 0, pFilePath, lineNumber);
 	}
 
 	GPUProfileScope(const char* pFunction, const char* pFilePath, uint32 lineNumber, ID3D12GraphicsCommandList* pCmd)
 		: pCmd(pCmd)
 	{
-		gGPUProfiler.BeginEvent(pCmd, pFunction, 0, pFilePath, lineNumber);
+		gGPUProfiler.BeginEvent(pCmd, ProfilerName(pFunction, true), 0, pFilePath, lineNumber);
 	}
 
 	~GPUProfileScope()
@@ -481,10 +490,10 @@ public:
 	void Shutdown();
 
 	// Start and push an event on the current thread
-	void BeginEvent(const char* pName, uint32 color, const char* pFilePath, uint32 lineNumber);
+	void BeginEvent(const ProfilerName& name, uint32 color, const char* pFilePath, uint32 lineNumber);
 
 	// Start and push an event on the current thread
-	void BeginEvent(const char* pName, uint32 color = 0) { BeginEvent(pName, color, "", 0); }
+	void BeginEvent(const ProfilerName& name, uint32 color = 0) { BeginEvent(name, color, "", 0); }
 
 	// End and pop the last pushed event on the current thread
 	void EndEvent();
@@ -497,14 +506,23 @@ public:
 	void RegisterThread(const char* pName = nullptr);
 
 	// Thread-local storage to keep track of current depth and event stack
+	// Events are recorded in a fixed size ring buffer, which is drained by Tick().
+	// The recording thread is the only producer and Tick() the only consumer.
+	// Only events of which the outermost scope has ended are published to the consumer.
 	struct TLS
 	{
-		static constexpr int MAX_STACK_DEPTH = 32;
+		static constexpr int MAX_STACK_DEPTH	= 32;
+		static constexpr uint32 MAX_EVENTS		= 1 << 13;
+		static constexpr uint32 InvalidEvent	= 0xFFFFFFFF;
 
 		FixedStack<uint32, MAX_STACK_DEPTH> EventStack;
 		uint32								ThreadIndex		= 0;
 		bool								IsInitialized	= false;
-		Array<ProfilerEvent>				Events;
+		UniquePtr<ProfilerEvent[]>			pEvents;					///< Ring buffer of MAX_EVENTS events
+		uint32								WriteIndex		= 0;		///< Next event to write. Producer only
+		std::atomic<uint32>					PublishedIndex	= 0;		///< Events before this index are complete and can be read
+		std::atomic<uint32>					ReadIndex		= 0;		///< Events before this index are consumed
+		std::atomic<uint32>					NumDropped		= 0;		///< Number of events that didn't fit in the ring buffer
 	};
 
 	// Structure describing a registered thread
@@ -559,6 +577,8 @@ private:
 
 	CPUProfilerCallbacks	m_EventCallback;
 
+	HashMap<const char*, uint32> m_ColorCache;				// Color of each interned event name
+
 	std::mutex				m_ThreadDataLock;				// Mutex for accesing thread data
 	Array<ThreadData>		m_ThreadData;					// Data describing each registered thread
 
@@ -574,14 +594,14 @@ private:
 // Helper RAII-style structure to push and pop a CPU sample region
 struct CPUProfileScope
 {
-	CPUProfileScope(const char* pFunctionName, const char* pFilePath, uint32 lineNumber, const char* pName, uint32 color = 0)
+	CPUProfileScope(const char* pFunctionName, const char* pFilePath, uint32 lineNumber, const ProfilerName& name, uint32 color = 0)
 	{
-		gCPUProfiler.BeginEvent(pName, color, pFilePath, lineNumber);
+		gCPUProfiler.BeginEvent(name, color, pFilePath, lineNumber);
 	}
 
 	CPUProfileScope(const char* pFunctionName, const char* pFilePath, uint32 lineNumber, uint32 color = 0)
 	{
-		gCPUProfiler.BeginEvent(pFunctionName, color, pFilePath, lineNumber);
+		gCPUProfiler.BeginEvent(ProfilerName(pFunctionName, true), color, pFilePath, lineNumber);
 	}
 
 	~CPUProfileScope()
@@ -592,3 +612,222 @@ struct CPUProfileScope
 	CPUProfileScope(const CPUProfileScope&) = delete;
 	CPUProfileScope& operator=(const CPUProfileScope&) = delete;
 };
+
+
+//-----------------------------------------------------------------------------
+// [SECTION] Trace Capture
+//-----------------------------------------------------------------------------
+
+class FileStream;
+
+// Global trace capture
+extern class ProfilerCapture gProfilerCapture;
+
+// Streams all completed CPU and GPU frames to a binary trace file, so captures are not limited by the profiler history size.
+// Tick() copies new frames out of the profilers and a background thread encodes and writes them.
+// Events are delta and varint encoded. Use ConvertProfilerTrace() to turn a capture into Chrome trace JSON (Perfetto, chrome://tracing).
+class ProfilerCapture
+{
+public:
+	~ProfilerCapture();
+
+	// Start capturing to the given file
+	bool Begin(const char* pPath);
+
+	// Stop capturing and wait for all frames to be written
+	void End();
+
+	// Queue frames completed since the last call. Call after the profilers have ticked.
+	void Tick();
+
+	bool IsCapturing() const { return m_IsCapturing; }
+
+	enum class TrackType : uint8
+	{
+		CPU,
+		GPU,
+	};
+
+	// A CPU thread or GPU queue
+	struct Track
+	{
+		TrackType	Type	= TrackType::CPU;
+		uint32		Index	= 0;		///< Thread or queue index
+		uint32		ID		= 0;		///< Thread ID
+		String		Name;
+	};
+
+	// Frame handed from Tick() to the writer thread
+	struct Frame
+	{
+		TrackType				Type		= TrackType::CPU;
+		uint32					FrameIndex	= 0;
+		Array<Track>			NewTracks;			///< Tracks registered since the previous frame
+		Array<ProfilerEvent>	Events;
+	};
+
+private:
+	void QueueFrame(TrackType type, uint32 frameIndex, Span<const ProfilerEvent> events);
+	void WriterThread();
+
+	static constexpr uint32 MaxQueuedFrames = 256;
+
+	bool								m_IsCapturing		= false;
+	UniquePtr<FileStream>				m_pFile;							///< Trace file. Only accessed by the writer thread while capturing
+	std::thread							m_Thread;							///< Thread encoding and writing frames
+	std::mutex							m_QueueLock;						///< Lock for the frame queues
+	std::condition_variable				m_QueueCV;							///< Signaled when a frame is queued or the capture ends
+	std::deque<UniquePtr<Frame>>		m_QueuedFrames;						///< Frames waiting to be written
+	Array<UniquePtr<Frame>>				m_FreeFrames;						///< Written frames, reused to avoid allocations
+	bool								m_StopRequested		= false;
+	uint32								m_NextCPUFrame		= 0;			///< Next CPU frame to capture
+	uint32								m_NextGPUFrame		= 0;			///< Next GPU frame to capture
+	uint32								m_NumCPUTracks		= 0;			///< Number of threads known to the trace
+	uint32								m_NumGPUTracks		= 0;			///< Number of queues known to the trace
+	uint32								m_NumDroppedFrames	= 0;			///< Frames lost because they left the profiler history or the queue was full
+	uint64								m_NumCapturedFrames	= 0;			///< Number of CPU frames queued
+	uint64								m_TickTicks			= 0;			///< Total time spent in Tick(), to report the capture overhead
+	uint64								m_NumBytesWritten	= 0;			///< Written by the writer thread
+	uint64								m_NumEventsWritten	= 0;			///< Written by the writer thread
+};
+
+// Convert a binary trace written by ProfilerCapture to Chrome trace JSON
+bool ConvertProfilerTrace(const char* pTracePath, const char* pJsonPath);
+
+
+//-----------------------------------------------------------------------------
+// [SECTION] Statistics
+//-----------------------------------------------------------------------------
+
+// Log-linear (HDR-style) histogram of durations in ticks.
+// Each power of two is split in SubBucketCount buckets, so values are kept with a relative precision of 1/SubBucketCount.
+class ProfilerHistogram
+{
+public:
+	void AddSample(uint64 ticks);
+
+	// Halve all counts, so older samples fade out
+	void Decay();
+
+	void Reset();
+
+	uint64	GetCount() const		{ return m_Count; }
+	double	GetAverage() const		{ return m_Count > 0 ? m_Sum / m_Count : 0.0; }
+	uint64	GetMin() const;
+	uint64	GetMax() const;
+
+	// Value below which 'percentile' percent of the samples fall
+	uint64	GetPercentile(float percentile) const;
+
+private:
+	static constexpr uint32 SubBucketBits	= 5;
+	static constexpr uint32 SubBucketCount	= 1 << SubBucketBits;
+	static constexpr uint32 MaxValueBits	= 40;
+	static constexpr uint32 NumBuckets		= (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+	static uint32 GetBucketIndex(uint64 ticks);
+	static uint64 GetBucketValue(uint32 bucketIndex);
+
+	StaticArray<uint32, NumBuckets>		m_Buckets{};
+	uint64								m_Count = 0;
+	double								m_Sum	= 0.0;
+};
+
+
+// Statistics of a single scope, identified by name, file, line and whether it's a GPU event
+struct ProfilerScopeStats
+{
+	const char*			pName		= nullptr;
+	const char*			pFilePath	= nullptr;
+	uint32				LineNumber	= 0;
+	bool				IsGPU		= false;
+	ProfilerHistogram	Inclusive;					///< Duration of the scope
+	ProfilerHistogram	Exclusive;					///< Duration of the scope minus its child scopes
+};
+
+
+// Summary of a histogram in milliseconds
+struct ProfilerStatsSummary
+{
+	uint64	Count	= 0;
+	float	Min		= 0;
+	float	Average	= 0;
+	float	P50		= 0;
+	float	P95		= 0;
+	float	P99		= 0;
+	float	Max		= 0;
+};
+
+
+// Global profiler statistics
+extern class ProfilerStats gProfilerStats;
+
+// Aggregates inclusive and exclusive time per scope over the CPU and GPU profiler history.
+// Tick() only processes frames completed since the previous call.
+// Every DecayInterval frames, all histograms are halved so the statistics follow recent frames.
+class ProfilerStats
+{
+public:
+	// Use a tickFrequency of 0 for QueryPerformanceFrequency
+	ProfilerStats(uint64 tickFrequency = 0, uint32 decayInterval = 512);
+
+	// Aggregate frames completed since the last call. Call after the profilers have ticked.
+	void Tick();
+
+	void Reset();
+
+	// Aggregate the events of a single thread or queue
+	void AddTrackEvents(Span<const ProfilerEvent> events, bool isGPU);
+
+	// Advance the frame counter and decay the histograms when required
+	void EndFrame();
+
+	// Find the first scope with the given name
+	const ProfilerScopeStats* FindScope(const char* pName, bool isGPU = false) const;
+
+	Span<const ProfilerScopeStats>	GetScopes() const { return m_Scopes; }
+	ProfilerStatsSummary			GetSummary(const ProfilerHistogram& histogram) const;
+
+	bool ExportCSV(const char* pPath) const;
+	bool ExportJSON(const char* pPath) const;
+
+private:
+	struct ScopeKey
+	{
+		const char* pName;
+		const char* pFilePath;
+		uint32		LineNumber;
+		bool		IsGPU;
+
+		bool operator==(const ScopeKey& rhs) const = default;
+	};
+
+	struct ScopeKeyHash
+	{
+		uint64 operator()(const ScopeKey& key) const
+		{
+			return ((uint64)key.pName * 0x9E3779B97F4A7C15ull) ^ ((uint64)key.pFilePath + ((uint64)key.LineNumber << 1) + key.IsGPU);
+		}
+	};
+
+	// Scope which is waiting for its children to be processed
+	struct OpenScope
+	{
+		uint32	ScopeIndex;
+		uint32	Depth;
+		uint64	Duration;
+		uint64	ChildDuration;
+	};
+
+	uint32 GetScopeIndex(const ProfilerEvent& event, bool isGPU);
+
+	Array<ProfilerScopeStats>					m_Scopes;
+	HashMap<ScopeKey, uint32, ScopeKeyHash>		m_ScopeMap;						///< Maps a scope to its index in m_Scopes
+	Array<ProfilerEvent>						m_SortedEvents;					///< Scratch storage to sort events
+	Array<OpenScope>							m_ScopeStack;					///< Scratch storage for the scope stack
+	double										m_TicksToMs			= 0.0;
+	uint32										m_DecayInterval		= 0;			///< Number of frames between halving the histograms. 0 to never decay
+	uint32										m_NumFrames			= 0;
+	uint32										m_NextCPUFrame		= 0;			///< Next CPU frame to aggregate
+	uint32										m_NextGPUFrame		= 0;			///< Next GPU frame to aggregate
+};
@@ -0,0 +1,393 @@
+#include "stdafx.h"
+#include "Profiler.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
+#include "Core/Stream.h"
+#include "Core/Utils.h"
+#include <bit>
+
+#if WITH_PROFILING
+
+ProfilerStats gProfilerStats;
+
+void ProfilerHistogram::AddSample(uint64 ticks)
+{
+	++m_Buckets[GetBucketIndex(ticks)];
+	++m_Count;
+	m_Sum += (double)ticks;
+}
+
+
+void ProfilerHistogram::Decay()
+{
+	uint64 count = 0;
+	for (uint32& bucket : m_Buckets)
+	{
+		bucket >>= 1;
+		count += bucket;
+	}
+	m_Sum = m_Count > 0 ? m_Sum * count / m_Count : 0.0;
+	m_Count = count;
+}
+
+
+void ProfilerHistogram::Reset()
+{
+	m_Buckets = {};
+	m_Count = 0;
+	m_Sum = 0.0;
+}
+
+
+uint64 ProfilerHistogram::GetMin() const
+{
+	for (uint32 i = 0; i < NumBuckets; ++i)
+	{
+		if (m_Buckets[i] > 0)
+			return GetBucketValue(i);
+	}
+	return 0;
+}
+
+
+uint64 ProfilerHistogram::GetMax() const
+{
+	for (uint32 i = NumBuckets; i > 0; --i)
+	{
+		if (m_Buckets[i - 1] > 0)
+			return GetBucketValue(i - 1);
+	}
+	return 0;
+}
+
+
+uint64 ProfilerHistogram::GetPercentile(float percentile) const
+{
+	if (m_Count == 0)
+		return 0;
+
+	uint64 target = Math::Max<uint64>(1, (uint64)ceil(percentile * 0.01 * m_Count));
+	uint64 count = 0;
+	for (uint32 i = 0; i < NumBuckets; ++i)
+	{
+		count += m_Buckets[i];
+		if (count >= target)
+			return GetBucketValue(i);
+	}
+	return GetMax();
+}
+
+
+// Values below SubBucketCount have a bucket each.
+// Larger values are bucketed by their most significant bit and the SubBucketBits bits below it.
+uint32 ProfilerHistogram::GetBucketIndex(uint64 ticks)
+{
+	ticks = Math::Min<uint64>(ticks, (1ull << MaxValueBits) - 1);
+	if (ticks < SubBucketCount)
+		return (uint32)ticks;
+
+	uint32 msb = 63 - (uint32)std::countl_zero(ticks);
+	uint32 shift = msb - SubBucketBits;
+	uint32 subBucket = (uint32)(ticks >> shift) - SubBucketCount;
+	return (shift + 1) * SubBucketCount + subBucket;
+}
+
+
+// Returns the center of the range of values in the bucket
+uint64 ProfilerHistogram::GetBucketValue(uint32 bucketIndex)
+{
+	if (bucketIndex < SubBucketCount)
+		return bucketIndex;
+
+	uint32 shift = bucketIndex / SubBucketCount - 1;
+	uint64 lowerBound = (uint64)(SubBucketCount + bucketIndex % SubBucketCount) << shift;
+	return lowerBound + ((1ull << shift) >> 1);
+}
+
+
+
+ProfilerStats::ProfilerStats(uint64 tickFrequency, uint32 decayInterval)
+	: m_DecayInterval(decayInterval)
+{
+	if (tickFrequency == 0)
+		QueryPerformanceFrequency((LARGE_INTEGER*)&tickFrequency);
+	m_TicksToMs = 1000.0 / tickFrequency;
+}
+
+
+void ProfilerStats::Tick()
+{
+	PROFILE_CPU_SCOPE();
+
+	// Only new frames are aggregated. Frames which already left the history are skipped.
+	URange cpuRange = gCPUProfiler.GetFrameRange();
+	uint32 numThreads = gCPUProfiler.GetThreads().GetSize();
+	for (m_NextCPUFrame = Math::Max(m_NextCPUFrame, cpuRange.Begin); m_NextCPUFrame < cpuRange.End; ++m_NextCPUFrame)
+	{
+		const ProfilerEventData& eventData = gCPUProfiler.GetEventData(m_NextCPUFrame);
+		for (uint32 threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+			AddTrackEvents(eventData.GetEvents(threadIndex), false);
+		EndFrame();
+	}
+
+	URange gpuRange = gGPUProfiler.GetFrameRange();
+	uint32 numQueues = gGPUProfiler.GetQueues().GetSize();
+	for (m_NextGPUFrame = Math::Max(m_NextGPUFrame, gpuRange.Begin); m_NextGPUFrame < gpuRange.End; ++m_NextGPUFrame)
+	{
+		const ProfilerEventData& eventData = gGPUProfiler.GetEventData(m_NextGPUFrame);
+		for (uint32 queueIndex = 0; queueIndex < numQueues; ++queueIndex)
+			AddTrackEvents(eventData.GetEvents(queueIndex), true);
+	}
+}
+
+
+void ProfilerStats::Reset()
+{
+	m_Scopes.clear();
+	m_ScopeMap.clear();
+	m_NumFrames = 0;
+}
+
+
+void ProfilerStats::AddTrackEvents(Span<const ProfilerEvent> events, bool isGPU)
+{
+	// Children are matched to the last open scope, so parents must come before their children.
+	// CPU events are recorded in that order, GPU events are sorted per queue and lose it.
+	auto IsBefore = [](const ProfilerEvent& a, const ProfilerEvent& b)
+		{
+			return a.TicksBegin < b.TicksBegin || (a.TicksBegin == b.TicksBegin && a.Depth < b.Depth);
+		};
+
+	Span<const ProfilerEvent> orderedEvents = events;
+	if (!std::is_sorted(events.begin(), events.end(), IsBefore))
+	{
+		m_SortedEvents.assign(events.begin(), events.end());
+		std::sort(m_SortedEvents.begin(), m_SortedEvents.end(), IsBefore);
+		orderedEvents = m_SortedEvents;
+	}
+
+	auto CloseScope = [this]()
+		{
+			const OpenScope& scope = m_ScopeStack.back();
+			ProfilerScopeStats& stats = m_Scopes[scope.ScopeIndex];
+			stats.Inclusive.AddSample(scope.Duration);
+			stats.Exclusive.AddSample(scope.Duration - Math::Min(scope.Duration, scope.ChildDuration));
+			m_ScopeStack.pop_back();
+		};
+
+	m_ScopeStack.clear();
+	for (const ProfilerEvent& event : orderedEvents)
+	{
+		if (!event.IsValid())
+			continue;
+
+		while (!m_ScopeStack.empty() && m_ScopeStack.back().Depth >= event.Depth)
+			CloseScope();
+
+		uint64 duration = event.TicksEnd - event.TicksBegin;
+		if (!m_ScopeStack.empty())
+			m_ScopeStack.back().ChildDuration += duration;
+		m_ScopeStack.push_back({ GetScopeIndex(event, isGPU), event.Depth, duration, 0 });
+	}
+
+	while (!m_ScopeStack.empty())
+		CloseScope();
+}
+
+
+void ProfilerStats::EndFrame()
+{
+	++m_NumFrames;
+	if (m_DecayInterval > 0 && m_NumFrames % m_DecayInterval == 0)
+	{
+		for (ProfilerScopeStats& stats : m_Scopes)
+		{
+			stats.Inclusive.Decay();
+			stats.Exclusive.Decay();
+		}
+	}
+}
+
+
+const ProfilerScopeStats* ProfilerStats::FindScope(const char* pName, bool isGPU) const
+{
+	for (const ProfilerScopeStats& stats : m_Scopes)
+	{
+		if (stats.IsGPU == isGPU && strcmp(stats.pName, pName) == 0)
+			return &stats;
+	}
+	return nullptr;
+}
+
+
+ProfilerStatsSummary ProfilerStats::GetSummary(const ProfilerHistogram& histogram) const
+{
+	ProfilerStatsSummary summary;
+	summary.Count	= histogram.GetCount();
+	summary.Min		= (float)(m_TicksToMs * histogram.GetMin());
+	summary.Average	= (float)(m_TicksToMs * histogram.GetAverage());
+	summary.P50		= (float)(m_TicksToMs * histogram.GetPercentile(50.0f));
+	summary.P95		= (float)(m_TicksToMs * histogram.GetPercentile(95.0f));
+	summary.P99		= (float)(m_TicksToMs * histogram.GetPercentile(99.0f));
+	summary.Max		= (float)(m_TicksToMs * histogram.GetMax());
+	return summary;
+}
+
+
+uint32 ProfilerStats::GetScopeIndex(const ProfilerEvent& event, bool isGPU)
+{
+	ScopeKey key{ event.pName, event.pFilePath, event.LineNumber, isGPU };
+	auto it = m_ScopeMap.find(key);
+	if (it != m_ScopeMap.end())
+		return it->second;
+
+	uint32 index = (uint32)m_Scopes.size();
+	ProfilerScopeStats& stats = m_Scopes.emplace_back();
+	stats.pName			= event.pName;
+	stats.pFilePath		= event.pFilePath ? event.pFilePath : "";
+	stats.LineNumber	= event.LineNumber;
+	stats.IsGPU			= isGPU;
+	m_ScopeMap[key] = index;
+	return index;
+}
+
+
+static bool WriteTextFile(const char* pPath, const String& text)
+{
+	FileStream stream;
+	if (!stream.Open(pPath, FileMode::Write | FileMode::Create))
+	{
+		E_LOG(Warning, "ProfilerStats: Failed to open '%s'", pPath);
+		return false;
+	}
+	return stream.Write(text.data(), (uint32)text.size());
+}
+
+
+// Quote a string and escape characters which are not allowed in JSON strings
+static String JsonString(const char* pStr)
+{
+	String result = "\"";
+	for (; *pStr; ++pStr)
+	{
+		if (*pStr == '"' || *pStr == '\\')
+			result += '\\';
+		if ((uint8)*pStr >= 0x20)
+			result += *pStr;
+	}
+	result += '"';
+	return result;
+}
+
+
+bool ProfilerStats::ExportCSV(const char* pPath) const
+{
+	String text = "Name,File,Line,Type,Count,Inclusive Min,Inclusive Avg,Inclusive P50,Inclusive P95,Inclusive P99,Inclusive Max,Exclusive Min,Exclusive Avg,Exclusive P50,Exclusive P95,Exclusive P99,Exclusive Max\n";
+	for (const ProfilerScopeStats& stats : m_Scopes)
+	{
+		ProfilerStatsSummary inclusive = GetSummary(stats.Inclusive);
+		ProfilerStatsSummary exclusive = GetSummary(stats.Exclusive);
+		text += Sprintf("\"%s\",\"%s\",%d,%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+			stats.pName, stats.pFilePath, stats.LineNumber, stats.IsGPU ? "GPU" : "CPU", inclusive.Count,
+			inclusive.Min, inclusive.Average, inclusive.P50, inclusive.P95, inclusive.P99, inclusive.Max,
+			exclusive.Min, exclusive.Average, exclusive.P50, exclusive.P95, exclusive.P99, exclusive.Max);
+	}
+	return WriteTextFile(pPath, text);
+}
+
+
+bool ProfilerStats::ExportJSON(const char* pPath) const
+{
+	auto SummaryToJson = [](const ProfilerStatsSummary& summary)
+		{
+			return Sprintf("{\"min\":%.4f,\"avg\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+				summary.Min, summary.Average, summary.P50, summary.P95, summary.P99, summary.Max);
+		};
+
+	String text = "{\n\"frames\": ";
+	text += Sprintf("%d,\n\"scopes\": [\n", m_NumFrames);
+	for (uint32 i = 0; i < (uint32)m_Scopes.size(); ++i)
+	{
+		const ProfilerScopeStats& stats = m_Scopes[i];
+		text += Sprintf("{\"name\":%s,\"file\":%s,\"line\":%d,\"type\":\"%s\",\"count\":%llu,\"inclusive\":%s,\"exclusive\":%s}%s\n",
+			JsonString(stats.pName), JsonString(stats.pFilePath), stats.LineNumber, stats.IsGPU ? "GPU" : "CPU", stats.Inclusive.GetCount(),
+			SummaryToJson(GetSummary(stats.Inclusive)), SummaryToJson(GetSummary(stats.Exclusive)), i + 1 < (uint32)m_Scopes.size() ? "," : "");
+	}
+	text += "]\n}\n";
+	return WriteTextFile(pPath, text);
+}
+
+
+// Usage: ProfilerStatsExport
+// Writes the statistics of all scopes to CSV and JSON in Saved/Profiling/
+static ConsoleCommand<> gProfilerStatsExport("ProfilerStatsExport", []()
+	{
+		Paths::CreateDirectoryTree(Paths::ProfilingDir());
+		String basePath = Sprintf("%sStats_%s", Paths::ProfilingDir(), Utils::GetTimeString());
+		if (gProfilerStats.ExportCSV((basePath + ".csv").c_str()) && gProfilerStats.ExportJSON((basePath + ".json").c_str()))
+			E_LOG(Info, "Exported statistics of %d scopes to '%s'", gProfilerStats.GetScopes().GetSize(), basePath);
+	});
+
+
+// Usage: ProfilerStatsSelfTest
+// Aggregates a synthetic event stream and verifies the resulting statistics
+static ConsoleCommand<> gProfilerStatsSelfTest("ProfilerStatsSelfTest", []()
+	{
+		// 1 tick is 1 ms
+		ProfilerStats stats(1000, 0);
+
+		// Frame [0, 1000]
+		//	Update [100, 300]
+		//	Render [400, 400 + d], d in [100, 199]
+		//		Draw [400, 450]
+		constexpr uint32 NumFrames = 1000;
+		Array<ProfilerEvent> events;
+		for (uint32 frame = 0; frame < NumFrames; ++frame)
+		{
+			uint64 renderTime = 100 + frame % 100;
+			events.clear();
+			events.push_back({ .pName = "Frame",	.Depth = 0, .TicksBegin = 1,	.TicksEnd = 1001 });
+			events.push_back({ .pName = "Update",	.Depth = 1, .TicksBegin = 101,	.TicksEnd = 301 });
+			events.push_back({ .pName = "Render",	.Depth = 1, .TicksBegin = 401,	.TicksEnd = 401 + renderTime });
+			events.push_back({ .pName = "Draw",		.Depth = 2, .TicksBegin = 401,	.TicksEnd = 451 });
+			stats.AddTrackEvents(events, false);
+
+			// GPU events are not ordered
+			std::reverse(events.begin(), events.end());
+			stats.AddTrackEvents(events, true);
+			stats.EndFrame();
+		}
+
+		uint32 numErrors = 0;
+		auto Check = [&](const char* pName, bool isGPU, bool inclusive, float average, float p95, float tolerance)
+			{
+				const ProfilerScopeStats* pScope = stats.FindScope(pName, isGPU);
+				if (!pScope)
+				{
+					E_LOG(Warning, "Scope '%s' not found", pName);
+					++numErrors;
+					return;
+				}
+				ProfilerStatsSummary summary = stats.GetSummary(inclusive ? pScope->Inclusive : pScope->Exclusive);
+				if (summary.Count != NumFrames || fabs(summary.Average - average) > average * tolerance || fabs(summary.P95 - p95) > p95 * tolerance)
+				{
+					E_LOG(Warning, "Scope '%s' (%s, %s): Count %llu, Avg %.2f, P95 %.2f. Expected Avg %.2f, P95 %.2f",
+						pName, isGPU ? "GPU" : "CPU", inclusive ? "inclusive" : "exclusive", summary.Count, summary.Average, summary.P95, average, p95);
+					++numErrors;
+				}
+			};
+
+		for (bool isGPU : { false, true })
+		{
+			Check("Frame",	isGPU, true,	1000.0f,	1000.0f,	0.04f);
+			Check("Frame",	isGPU, false,	650.5f,		695.0f,		0.04f);
+			Check("Update",	isGPU, true,	200.0f,		200.0f,		0.04f);
+			Check("Render",	isGPU, true,	149.5f,		194.0f,		0.04f);
+			Check("Render",	isGPU, false,	99.5f,		144.0f,		0.04f);
+			Check("Draw",	isGPU, false,	50.0f,		50.0f,		0.04f);
+		}
+
+		E_LOG(Info, "ProfilerStatsSelfTest: %s. %d scopes, %d errors.", numErrors == 0 ? "Passed" : "FAILED", stats.GetScopes().GetSize(), numErrors);
+	});
+
+#endif
@@ -0,0 +1,702 @@
+#include "stdafx.h"
+#include "Profiler.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
+#include "Core/Stream.h"
+#include "Core/Utils.h"
+
+#if WITH_PROFILING
+
+ProfilerCapture gProfilerCapture;
+
+// Binary trace layout:
+//	Header:	Magic, Version, CPU tick frequency
+//	Followed by records, each starting with a RecordType byte. All values in records are LEB128 varints.
+//		String:	ID, Length, Characters. Written before the first record referencing it.
+//		Track:	Type, Index, Thread ID, Name string ID
+//		Frame:	Type, Frame index, Event count, Events
+//	Event:	Track index, Name string ID, Depth, Begin ticks (zigzag delta to the previous event), Duration in ticks
+namespace ProfilerTrace
+{
+	static constexpr uint32 Magic	= 0x43525450; // "PTRC"
+	static constexpr uint32 Version	= 1;
+
+	using TrackType = ProfilerCapture::TrackType;
+
+	enum class RecordType : uint8
+	{
+		String,
+		Track,
+		Frame,
+	};
+
+	struct Header
+	{
+		uint32 Magic			= 0;
+		uint32 Version			= 0;
+		uint64 TickFrequency	= 0;
+	};
+
+	static uint64 ZigZagEncode(int64 value) { return ((uint64)value << 1) ^ (uint64)(value >> 63); }
+	static int64 ZigZagDecode(uint64 value) { return (int64)(value >> 1) ^ -(int64)(value & 1); }
+
+	// Encodes records into a memory buffer
+	class Writer
+	{
+	public:
+		void WriteHeader(uint64 tickFrequency)
+		{
+			Header header;
+			header.Magic			= Magic;
+			header.Version			= Version;
+			header.TickFrequency	= tickFrequency;
+			const uint8* pHeader = reinterpret_cast<const uint8*>(&header);
+			m_Data.insert(m_Data.end(), pHeader, pHeader + sizeof(Header));
+		}
+
+		void WriteTrack(const ProfilerCapture::Track& track)
+		{
+			uint32 nameID = WriteString(track.Name.c_str());
+			WriteRecordType(RecordType::Track);
+			WriteVarint((uint64)track.Type);
+			WriteVarint(track.Index);
+			WriteVarint(track.ID);
+			WriteVarint(nameID);
+		}
+
+		void WriteFrame(const ProfilerCapture::Frame& frame)
+		{
+			// Event names are interned, so the pointer identifies the string
+			for (const ProfilerEvent& event : frame.Events)
+			{
+				if (!m_StringMap.contains(event.pName))
+					m_StringMap[event.pName] = WriteString(event.pName);
+			}
+
+			WriteRecordType(RecordType::Frame);
+			WriteVarint((uint64)frame.Type);
+			WriteVarint(frame.FrameIndex);
+			WriteVarint(frame.Events.size());
+			for (const ProfilerEvent& event : frame.Events)
+			{
+				WriteVarint(frame.Type == TrackType::CPU ? event.ThreadIndex : event.QueueIndex);
+				WriteVarint(m_StringMap.at(event.pName));
+				WriteVarint(event.Depth);
+				WriteVarint(ZigZagEncode((int64)(event.TicksBegin - m_LastTicks)));
+				WriteVarint(event.TicksEnd - event.TicksBegin);
+				m_LastTicks = event.TicksBegin;
+			}
+		}
+
+		Span<const uint8>	GetData() const		{ return m_Data; }
+		void				Clear()				{ m_Data.clear(); }
+
+	private:
+		uint32 WriteString(const char* pStr)
+		{
+			uint32 id = m_NumStrings++;
+			uint32 length = CString::StrLen(pStr);
+			WriteRecordType(RecordType::String);
+			WriteVarint(id);
+			WriteVarint(length);
+			m_Data.insert(m_Data.end(), pStr, pStr + length);
+			return id;
+		}
+
+		void WriteRecordType(RecordType type)
+		{
+			m_Data.push_back((uint8)type);
+		}
+
+		void WriteVarint(uint64 value)
+		{
+			while (value >= 0x80)
+			{
+				m_Data.push_back((uint8)(value | 0x80));
+				value >>= 7;
+			}
+			m_Data.push_back((uint8)value);
+		}
+
+		Array<uint8>					m_Data;
+		HashMap<const char*, uint32>	m_StringMap;		///< String ID of each event name
+		uint32							m_NumStrings = 0;
+		uint64							m_LastTicks = 0;	///< Begin ticks of the previous event
+	};
+
+	// Decoded event
+	struct Event
+	{
+		TrackType	Type		= TrackType::CPU;
+		uint32		FrameIndex	= 0;
+		uint32		TrackIndex	= 0;
+		uint32		NameID		= 0;
+		uint32		Depth		= 0;
+		uint64		TicksBegin	= 0;
+		uint64		TicksEnd	= 0;
+	};
+
+	// Decodes records from a stream, reading it in chunks
+	class Reader
+	{
+	public:
+		Reader(Stream& stream)
+			: m_Stream(stream)
+		{}
+
+		// Decode all records. Returns false if the trace is malformed.
+		// onTrack is called with each ProfilerCapture::Track, onEvent with each Event.
+		template<typename TrackFn, typename EventFn>
+		bool ReadTrace(Header& header, Array<String>& strings, TrackFn&& onTrack, EventFn&& onEvent)
+		{
+			if (!Read(&header, sizeof(Header)) || header.Magic != Magic || header.Version != Version)
+				return false;
+
+			uint64 lastTicks = 0;
+			uint8 recordType = 0;
+			while (Read(&recordType, sizeof(uint8)))
+			{
+				switch ((RecordType)recordType)
+				{
+				case RecordType::String:
+				{
+					uint64 id, length;
+					if (!ReadVarint(id) || !ReadVarint(length) || id != strings.size() || length > ChunkSize)
+						return false;
+					String& str = strings.emplace_back();
+					str.resize(length);
+					if (!Read(str.data(), (uint32)length))
+						return false;
+					break;
+				}
+				case RecordType::Track:
+				{
+					uint64 type, index, id, nameID;
+					if (!ReadVarint(type) || !ReadVarint(index) || !ReadVarint(id) || !ReadVarint(nameID) || nameID >= strings.size())
+						return false;
+					ProfilerCapture::Track track;
+					track.Type	= (TrackType)type;
+					track.Index	= (uint32)index;
+					track.ID	= (uint32)id;
+					track.Name	= strings[nameID];
+					onTrack(track);
+					break;
+				}
+				case RecordType::Frame:
+				{
+					uint64 type, frameIndex, numEvents;
+					if (!ReadVarint(type) || !ReadVarint(frameIndex) || !ReadVarint(numEvents))
+						return false;
+					for (uint64 i = 0; i < numEvents; ++i)
+					{
+						uint64 trackIndex, nameID, depth, delta, duration;
+						if (!ReadVarint(trackIndex) || !ReadVarint(nameID) || !ReadVarint(depth) || !ReadVarint(delta) || !ReadVarint(duration) || nameID >= strings.size())
+							return false;
+						Event event;
+						event.Type			= (TrackType)type;
+						event.FrameIndex	= (uint32)frameIndex;
+						event.TrackIndex	= (uint32)trackIndex;
+						event.NameID		= (uint32)nameID;
+						event.Depth			= (uint32)depth;
+						event.TicksBegin	= lastTicks + ZigZagDecode(delta);
+						event.TicksEnd		= event.TicksBegin + duration;
+						lastTicks			= event.TicksBegin;
+						onEvent(event);
+					}
+					break;
+				}
+				default:
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		bool Read(void* pData, uint32 size)
+		{
+			if (!Ensure(size))
+				return false;
+			memcpy(pData, &m_Buffer[m_Offset], size);
+			m_Offset += size;
+			return true;
+		}
+
+		bool ReadVarint(uint64& value)
+		{
+			value = 0;
+			for (uint32 shift = 0; shift < 64; shift += 7)
+			{
+				uint8 byte;
+				if (!Read(&byte, sizeof(uint8)))
+					return false;
+				value |= (uint64)(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return true;
+			}
+			return false;
+		}
+
+		// Make sure at least 'size' bytes are buffered
+		bool Ensure(uint32 size)
+		{
+			if (m_Offset + size <= m_Size)
+				return true;
+
+			uint32 remaining = m_Size - m_Offset;
+			if (m_Buffer.size() < remaining + ChunkSize)
+				m_Buffer.resize(remaining + ChunkSize);
+			memmove(m_Buffer.data(), m_Buffer.data() + m_Offset, remaining);
+			m_Offset = 0;
+			m_Size = remaining;
+
+			uint64 toRead = Math::Min<uint64>(m_Buffer.size() - m_Size, m_Stream.GetLength() - m_Stream.GetCursor());
+			uint64 read = 0;
+			if (toRead > 0)
+				m_Stream.Read(&m_Buffer[m_Size], toRead, &read);
+			m_Size += (uint32)read;
+			return size <= m_Size;
+		}
+
+		static constexpr uint32 ChunkSize = 1 << 20;
+
+		Stream&			m_Stream;
+		Array<uint8>	m_Buffer;
+		uint32			m_Offset = 0;	///< Read position in the buffer
+		uint32			m_Size = 0;		///< Number of valid bytes in the buffer
+	};
+}
+
+
+ProfilerCapture::~ProfilerCapture()
+{
+	End();
+}
+
+
+bool ProfilerCapture::Begin(const char* pPath)
+{
+	if (m_IsCapturing)
+		return false;
+
+	Paths::CreateDirectoryTree(Paths::GetDirectoryPath(pPath));
+	m_pFile = std::make_unique<FileStream>();
+	if (!m_pFile->Open(pPath, FileMode::Write | FileMode::Create))
+	{
+		E_LOG(Warning, "ProfilerCapture: Failed to open '%s'", pPath);
+		m_pFile.reset();
+		return false;
+	}
+
+	// Only capture frames which complete from now on
+	m_NextCPUFrame			= gCPUProfiler.GetFrameRange().End;
+	m_NextGPUFrame			= gGPUProfiler.GetFrameRange().End;
+	m_NumCPUTracks			= 0;
+	m_NumGPUTracks			= 0;
+	m_NumDroppedFrames		= 0;
+	m_NumCapturedFrames		= 0;
+	m_TickTicks				= 0;
+	m_NumBytesWritten		= 0;
+	m_NumEventsWritten		= 0;
+	m_StopRequested			= false;
+	m_IsCapturing			= true;
+	m_Thread				= std::thread(&ProfilerCapture::WriterThread, this);
+
+	E_LOG(Info, "ProfilerCapture: Capturing to '%s'", pPath);
+	return true;
+}
+
+
+void ProfilerCapture::End()
+{
+	if (!m_IsCapturing)
+		return;
+
+	{
+		std::scoped_lock lock(m_QueueLock);
+		m_StopRequested = true;
+	}
+	m_QueueCV.notify_one();
+	m_Thread.join();
+
+	m_pFile->Close();
+	m_pFile.reset();
+	m_FreeFrames.clear();
+	m_IsCapturing = false;
+
+	uint64 frequency = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	double tickTime = m_NumCapturedFrames > 0 ? 1000.0 * m_TickTicks / frequency / m_NumCapturedFrames : 0.0;
+	E_LOG(Info, "ProfilerCapture: Captured %llu frames, %llu events, %.2f MB (%.1f bytes/event). Capture cost %.3f ms/frame.",
+		m_NumCapturedFrames, m_NumEventsWritten, m_NumBytesWritten * Math::BytesToMegaBytes, m_NumEventsWritten > 0 ? (double)m_NumBytesWritten / m_NumEventsWritten : 0.0, tickTime);
+	if (m_NumDroppedFrames > 0)
+		E_LOG(Warning, "ProfilerCapture: Dropped %d frames. The writer thread could not keep up.", m_NumDroppedFrames);
+}
+
+
+void ProfilerCapture::Tick()
+{
+	if (!m_IsCapturing)
+		return;
+
+	PROFILE_CPU_SCOPE();
+
+	uint64 ticksBegin = 0;
+	QueryPerformanceCounter((LARGE_INTEGER*)&ticksBegin);
+
+	// Frames which already left the profiler history are lost
+	URange cpuRange = gCPUProfiler.GetFrameRange();
+	if (m_NextCPUFrame < cpuRange.Begin)
+	{
+		m_NumDroppedFrames += cpuRange.Begin - m_NextCPUFrame;
+		m_NextCPUFrame = cpuRange.Begin;
+	}
+	for (; m_NextCPUFrame < cpuRange.End; ++m_NextCPUFrame)
+	{
+		QueueFrame(TrackType::CPU, m_NextCPUFrame, gCPUProfiler.GetEventData(m_NextCPUFrame).GetEvents());
+		++m_NumCapturedFrames;
+	}
+
+	URange gpuRange = gGPUProfiler.GetFrameRange();
+	if (m_NextGPUFrame < gpuRange.Begin)
+	{
+		m_NumDroppedFrames += gpuRange.Begin - m_NextGPUFrame;
+		m_NextGPUFrame = gpuRange.Begin;
+	}
+	for (; m_NextGPUFrame < gpuRange.End; ++m_NextGPUFrame)
+		QueueFrame(TrackType::GPU, m_NextGPUFrame, gGPUProfiler.GetEventData(m_NextGPUFrame).GetEvents());
+
+	uint64 ticksEnd = 0;
+	QueryPerformanceCounter((LARGE_INTEGER*)&ticksEnd);
+	m_TickTicks += ticksEnd - ticksBegin;
+}
+
+
+void ProfilerCapture::QueueFrame(TrackType type, uint32 frameIndex, Span<const ProfilerEvent> events)
+{
+	UniquePtr<Frame> pFrame;
+	{
+		std::scoped_lock lock(m_QueueLock);
+		if (m_QueuedFrames.size() >= MaxQueuedFrames)
+		{
+			++m_NumDroppedFrames;
+			return;
+		}
+		if (!m_FreeFrames.empty())
+		{
+			pFrame = std::move(m_FreeFrames.back());
+			m_FreeFrames.pop_back();
+		}
+	}
+	if (!pFrame)
+		pFrame = std::make_unique<Frame>();
+
+	pFrame->Type		= type;
+	pFrame->FrameIndex	= frameIndex;
+
+	// Describe threads and queues the first time they show up
+	pFrame->NewTracks.clear();
+	if (type == TrackType::CPU)
+	{
+		Span<const CPUProfiler::ThreadData> threads = gCPUProfiler.GetThreads();
+		for (; m_NumCPUTracks < threads.GetSize(); ++m_NumCPUTracks)
+		{
+			const CPUProfiler::ThreadData& thread = threads[m_NumCPUTracks];
+			pFrame->NewTracks.push_back({ TrackType::CPU, thread.Index, thread.ThreadID, thread.Name });
+		}
+	}
+	else
+	{
+		Span<const GPUProfiler::QueueInfo> queues = gGPUProfiler.GetQueues();
+		for (; m_NumGPUTracks < queues.GetSize(); ++m_NumGPUTracks)
+		{
+			const GPUProfiler::QueueInfo& queue = queues[m_NumGPUTracks];
+			pFrame->NewTracks.push_back({ TrackType::GPU, queue.Index, 0, queue.Name });
+		}
+	}
+
+	pFrame->Events.clear();
+	for (const ProfilerEvent& event : events)
+	{
+		if (event.IsValid())
+			pFrame->Events.push_back(event);
+	}
+
+	{
+		std::scoped_lock lock(m_QueueLock);
+		m_QueuedFrames.push_back(std::move(pFrame));
+	}
+	m_QueueCV.notify_one();
+}
+
+
+void ProfilerCapture::WriterThread()
+{
+	constexpr uint32 FlushSize = 1 << 20;
+
+	uint64 frequency = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	ProfilerTrace::Writer writer;
+	writer.WriteHeader(frequency);
+
+	auto FlushData = [&]()
+		{
+			Span<const uint8> data = writer.GetData();
+			m_pFile->Write(data.GetData(), data.GetSize());
+			m_NumBytesWritten += data.GetSize();
+			writer.Clear();
+		};
+
+	while (true)
+	{
+		UniquePtr<Frame> pFrame;
+		{
+			std::unique_lock lock(m_QueueLock);
+			m_QueueCV.wait(lock, [this]() { return !m_QueuedFrames.empty() || m_StopRequested; });
+
+			// Only stop once all queued frames are written
+			if (m_QueuedFrames.empty())
+				break;
+			pFrame = std::move(m_QueuedFrames.front());
+			m_QueuedFrames.pop_front();
+		}
+
+		for (const Track& track : pFrame->NewTracks)
+			writer.WriteTrack(track);
+		writer.WriteFrame(*pFrame);
+		m_NumEventsWritten += pFrame->Events.size();
+
+		if (writer.GetData().GetSize() >= FlushSize)
+			FlushData();
+
+		std::scoped_lock lock(m_QueueLock);
+		m_FreeFrames.push_back(std::move(pFrame));
+	}
+
+	FlushData();
+}
+
+
+// Appends to a buffer which is written to a stream in chunks
+class JsonWriter
+{
+public:
+	JsonWriter(Stream& stream)
+		: m_Stream(stream)
+	{}
+
+	~JsonWriter()
+	{
+		Flush();
+	}
+
+	template<typename... Args>
+	void Print(const char* pFormat, Args&&... args)
+	{
+		char buffer[256];
+		int length = FormatString(buffer, ARRAYSIZE(buffer), pFormat, std::forward<Args>(args)...);
+		Append(buffer, length);
+	}
+
+	// Write a quoted and escaped string
+	void PrintString(const char* pStr)
+	{
+		Append("\"", 1);
+		for (; *pStr; ++pStr)
+		{
+			if (*pStr == '"' || *pStr == '\\')
+				Append("\\", 1);
+			if ((uint8)*pStr >= 0x20)
+				Append(pStr, 1);
+		}
+		Append("\"", 1);
+	}
+
+	void Flush()
+	{
+		m_Stream.Write(m_Buffer.data(), (uint32)m_Buffer.size());
+		m_Buffer.clear();
+	}
+
+private:
+	void Append(const char* pData, int length)
+	{
+		m_Buffer.insert(m_Buffer.end(), pData, pData + length);
+		if (m_Buffer.size() >= (1 << 20))
+			Flush();
+	}
+
+	Stream&		m_Stream;
+	Array<char>	m_Buffer;
+};
+
+
+// Writes the events of a trace as Chrome trace JSON
+static bool ConvertProfilerTrace(Stream& input, Stream& output)
+{
+	ProfilerTrace::Reader reader(input);
+	JsonWriter json(output);
+
+	constexpr uint32 GPUProcess = 0;
+	constexpr uint32 CPUProcess = 1;
+
+	json.Print("{\n\"traceEvents\": [\n");
+	json.Print("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"GPU\"}},\n", GPUProcess);
+	json.Print("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CPU\"}},\n", CPUProcess);
+
+	ProfilerTrace::Header header;
+	Array<String> strings;
+	uint64 baseTicks = 0;
+	bool result = reader.ReadTrace(header, strings,
+		[&](const ProfilerCapture::Track& track)
+		{
+			json.Print("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", track.Type == ProfilerCapture::TrackType::CPU ? CPUProcess : GPUProcess, track.Index);
+			json.PrintString(track.Name.c_str());
+			json.Print("}},\n");
+		},
+		[&](const ProfilerTrace::Event& event)
+		{
+			if (baseTicks == 0)
+				baseTicks = event.TicksBegin;
+			double ticksToUs = 1000000.0 / header.TickFrequency;
+			json.Print("{\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"ph\":\"X\",\"name\":",
+				event.Type == ProfilerCapture::TrackType::CPU ? CPUProcess : GPUProcess,
+				event.TrackIndex,
+				((int64)event.TicksBegin - (int64)baseTicks) * ticksToUs,
+				(event.TicksEnd - event.TicksBegin) * ticksToUs);
+			json.PrintString(strings[event.NameID].c_str());
+			json.Print("},\n");
+		});
+
+	json.Print("{}]\n}");
+	return result;
+}
+
+
+bool ConvertProfilerTrace(const char* pTracePath, const char* pJsonPath)
+{
+	FileStream input;
+	if (!input.Open(pTracePath, FileMode::Read))
+	{
+		E_LOG(Warning, "ConvertProfilerTrace: Failed to open '%s'", pTracePath);
+		return false;
+	}
+
+	FileStream output;
+	if (!output.Open(pJsonPath, FileMode::Write | FileMode::Create))
+	{
+		E_LOG(Warning, "ConvertProfilerTrace: Failed to open '%s'", pJsonPath);
+		return false;
+	}
+
+	if (!ConvertProfilerTrace(input, output))
+	{
+		E_LOG(Warning, "ConvertProfilerTrace: '%s' is not a valid trace or is truncated", pTracePath);
+		return false;
+	}
+	return true;
+}
+
+
+// Usage: ProfilerCapture
+// Toggles streaming all profiler frames to Saved/Profiling/
+static ConsoleCommand<> gProfilerCaptureCommand("ProfilerCapture", []()
+	{
+		if (gProfilerCapture.IsCapturing())
+			gProfilerCapture.End();
+		else
+			gProfilerCapture.Begin(Sprintf("%sCapture_%s.ptrace", Paths::ProfilingDir(), Utils::GetTimeString()).c_str());
+	});
+
+
+// Usage: ConvertProfilerTrace <trace> <json>
+static ConsoleCommand<const char*, const char*> gConvertProfilerTrace("ConvertProfilerTrace", [](const char* pTracePath, const char* pJsonPath)
+	{
+		Utils::TimeScope timer;
+		if (ConvertProfilerTrace(pTracePath, pJsonPath))
+			E_LOG(Info, "Converted '%s' to '%s' in %.2f s", pTracePath, pJsonPath, timer.Stop());
+	});
+
+
+// Usage: ProfilerTraceRoundTrip
+// Encodes synthetic frames, decodes them and verifies all events survive. Also reports the encoding throughput.
+static ConsoleCommand<> gProfilerTraceRoundTrip("ProfilerTraceRoundTrip", []()
+	{
+		constexpr uint32 NumFrames = 64;
+		constexpr uint32 NumThreads = 8;
+		constexpr uint32 NumEventsPerThread = 256;
+		const char* pNames[] = { "Update", "Render", "Culling", "Dynamic Name \"Quoted\"" };
+
+		ProfilerCapture::Track track;
+		track.Type = ProfilerCapture::TrackType::CPU;
+		track.Name = "Main Thread";
+
+		// Generate frames with nested events, including events which start before previous events on other threads
+		Array<ProfilerCapture::Frame> frames(NumFrames);
+		uint64 ticks = 1ull << 40;
+		for (uint32 frameIndex = 0; frameIndex < NumFrames; ++frameIndex)
+		{
+			ProfilerCapture::Frame& frame = frames[frameIndex];
+			frame.Type = frameIndex % 2 == 0 ? ProfilerCapture::TrackType::CPU : ProfilerCapture::TrackType::GPU;
+			frame.FrameIndex = frameIndex / 2;
+			for (uint32 threadIndex = 0; threadIndex < NumThreads; ++threadIndex)
+			{
+				uint64 threadTicks = ticks + threadIndex * 7;
+				for (uint32 i = 0; i < NumEventsPerThread; ++i)
+				{
+					ProfilerEvent& event = frame.Events.emplace_back();
+					event.pName			= pNames[(i + threadIndex) % ARRAYSIZE(pNames)];
+					event.Depth			= i % 4;
+					event.ThreadIndex	= threadIndex;
+					event.QueueIndex	= threadIndex % 4;
+					event.TicksBegin	= threadTicks + i * 131;
+					event.TicksEnd		= event.TicksBegin + 100 + (i * 7919) % 100000;
+				}
+			}
+			ticks += 1000000;
+		}
+
+		ProfilerTrace::Writer writer;
+		writer.WriteHeader(10000000);
+		writer.WriteTrack(track);
+
+		Utils::TimeScope timer;
+		for (const ProfilerCapture::Frame& frame : frames)
+			writer.WriteFrame(frame);
+		float encodeTime = timer.Stop();
+
+		Span<const uint8> data = writer.GetData();
+		MemoryStream stream(false, data.GetData(), data.GetSize());
+		ProfilerTrace::Reader reader(stream);
+		ProfilerTrace::Header header;
+		Array<String> strings;
+		uint32 numTracks = 0;
+		uint32 numEvents = 0;
+		uint32 numMismatches = 0;
+		bool result = reader.ReadTrace(header, strings,
+			[&](const ProfilerCapture::Track& decodedTrack)
+			{
+				if (decodedTrack.Name != track.Name || decodedTrack.Type != track.Type)
+					++numMismatches;
+				++numTracks;
+			},
+			[&](const ProfilerTrace::Event& event)
+			{
+				const ProfilerCapture::Frame& frame = frames[numEvents / (NumThreads * NumEventsPerThread)];
+				const ProfilerEvent& expected = frame.Events[numEvents % (NumThreads * NumEventsPerThread)];
+				uint32 expectedTrack = frame.Type == ProfilerCapture::TrackType::CPU ? expected.ThreadIndex : expected.QueueIndex;
+				if (event.Type != frame.Type || event.FrameIndex != frame.FrameIndex || event.TrackIndex != expectedTrack || strings[event.NameID] != expected.pName ||
+					event.Depth != expected.Depth || event.TicksBegin != expected.TicksBegin || event.TicksEnd != expected.TicksEnd)
+					++numMismatches;
+				++numEvents;
+			});
+
+		uint32 expectedEvents = NumFrames * NumThreads * NumEventsPerThread;
+		bool success = result && header.TickFrequency == 10000000 && numTracks == 1 && numEvents == expectedEvents && numMismatches == 0;
+		E_LOG(Info, "ProfilerTraceRoundTrip: %s. %d/%d events, %d mismatches. %.1f bytes/event (%d bytes uncompressed). Encoded %.1f M events/s.",
+			success ? "Passed" : "FAILED", numEvents, expectedEvents, numMismatches,
+			(float)data.GetSize() / expectedEvents, (int)sizeof(ProfilerEvent), expectedEvents / encodeTime / 1.0e6f);
+	});
+
+#endif
@@ -16,6 +16,11 @@ public:
 		m_pValue(v.data()), m_Count((uint32)v.size())
 	{}
 
+	template<typename Allocator>
+	Span(const std::vector<std::remove_cv_t<T>, Allocator>& v) :
+		m_pValue(v.data()), m_Count((uint32)v.size())
+	{}
+
 	template<size_t N>
 	Span(const StaticArray<std::remove_cv_t<T>, N>& v) :
 		m_pValue(v.data()), m_Count((uint32)v.size())
@@ -1,5 +1,14 @@
 #include "stdafx.h"
 #include "Stream.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Utils.h"
+
+#if !PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 bool Stream::ReadLine(char* pOutStr, uint32 maxLength)
@@ -30,7 +39,7 @@ bool Stream::ReadLine(char* pOutStr, uint32 maxLength)
 
 
 
-MemoryStream::MemoryStream(bool isWriting, const void* pMemory, uint32 size)
+MemoryStream::MemoryStream(bool isWriting, const void* pMemory, uint64 size)
 	: Stream(isWriting)
 {
 	SetBuffer(pMemory, size);
@@ -42,20 +51,21 @@ MemoryStream::~MemoryStream()
 		delete[] m_pDataBase;
 }
 
-bool MemoryStream::Write(const void* pData, uint32 size)
+bool MemoryStream::Write(const void* pData, uint64 size)
 {
-	assert(IsWriting());
-	EnsureBufferSize(size);
+	gAssert(IsWriting());
+	EnsureBufferSize(GetCursor() + size);
 	memcpy(m_pData, pData, size);
 	m_pData += size;
+	m_Length = Math::Max(m_Length, GetCursor());
 	return true;
 }
 
-void MemoryStream::Seek(int offset, StreamSeekMode mode)
+void MemoryStream::Seek(int64 offset, StreamSeekMode mode)
 {
 	if (mode == StreamSeekMode::Absolute)
 	{
-		gAssert((uint32)offset < GetLength());
+		gAssert((uint64)offset <= GetLength());
 		m_pData = m_pDataBase + offset;
 	}
 	else if (mode == StreamSeekMode::Relative)
@@ -65,7 +75,7 @@ void MemoryStream::Seek(int offset, StreamSeekMode mode)
 	}
 }
 
-bool MemoryStream::Read(void* pData, uint32 size, uint32* pRead)
+bool MemoryStream::Read(void* pData, uint64 size, uint64* pRead)
 {
 	gAssert(GetCursor() + size <= GetLength());
 
@@ -76,48 +86,70 @@ bool MemoryStream::Read(void* pData, uint32 size, uint32* pRead)
 	return true;
 }
 
-void MemoryStream::SetBuffer(const void* pBuffer, uint32 length)
+Span<const uint8> MemoryStream::ReadView(uint64 size)
+{
+	if (IsWriting() || GetCursor() + size > GetLength() || size > std::numeric_limits<uint32>::max())
+		return {};
+
+	Span<const uint8> view((const uint8*)m_pData, (uint32)size);
+	m_pData += size;
+	return view;
+}
+
+void MemoryStream::SetBuffer(const void* pBuffer, uint64 length)
 {
 	if (pBuffer)
 	{
 		m_pDataBase = (char*)pBuffer;
 		m_pData = m_pDataBase;
+		m_Length = length;
 		m_Capacity = length;
 	}
 	else
 	{
 		m_pDataBase = nullptr;
 		m_pData = nullptr;
+		m_Length = 0;
 		m_Capacity = 0;
 	}
 }
 
-void MemoryStream::SetLength(uint32 length)
+void MemoryStream::SetLength(uint64 length)
 {
-	uint32 pos = GetCursor();
-
-	char* pNewData = new char[length];
-	if (m_pDataBase)
-	{
-		memcpy(pNewData, m_pDataBase, GetCursor());
-		delete[] m_pDataBase;
-	}
-
-	m_pDataBase = pNewData;
-	m_pData = m_pDataBase + pos;
-	m_Capacity = length;
+	gAssert(IsWriting());
+	EnsureBufferSize(length);
+	if (length > m_Length)
+		memset(m_pDataBase + m_Length, 0, length - m_Length);
+	m_Length = length;
+	m_pData = m_pDataBase + Math::Min(GetCursor(), length);
 }
 
-void MemoryStream::EnsureBufferSize(uint32 length)
+void MemoryStream::EnsureBufferSize(uint64 length)
 {
 	if (length <= m_Capacity)
 		return;
 
-	uint32 newCapacity = 256;
+	uint64 newCapacity = 256;
 	while (length > newCapacity)
 		newCapacity *= 2;
 
-	SetLength(length);
+	Reallocate(newCapacity);
+}
+
+void MemoryStream::Reallocate(uint64 capacity)
+{
+	uint64 pos = GetCursor();
+
+	char* pNewData = new char[capacity];
+	if (m_pDataBase)
+	{
+		memcpy(pNewData, m_pDataBase, m_Length);
+		delete[] m_pDataBase;
+	}
+
+	m_pDataBase = pNewData;
+	m_pData = m_pDataBase + pos;
+	m_Capacity = capacity;
 }
 
 
@@ -150,13 +182,18 @@ bool FileStream::Open(const char* pFile, FileMode mode)
 		disposition = OPEN_EXISTING;
 
 	m_pFile = ::CreateFileA(pFile, access, 0, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (m_pFile != INVALID_HANDLE_VALUE)
+	if (m_pFile == INVALID_HANDLE_VALUE)
 	{
-		m_Length = ::GetFileSize(m_pFile, nullptr);
-		m_Position = 0;
-		m_Mode = mode;
+		m_pFile = nullptr;
+		return false;
 	}
-	return m_pFile != INVALID_HANDLE_VALUE;
+
+	LARGE_INTEGER fileSize;
+	::GetFileSizeEx(m_pFile, &fileSize);
+	m_Length = fileSize.QuadPart;
+	m_Position = 0;
+	m_Mode = mode;
+	return true;
 }
 
 bool FileStream::Close()
@@ -179,41 +216,239 @@ bool FileStream::Flush()
 	return ::FlushFileBuffers(m_pFile) == TRUE;
 }
 
-bool FileStream::Write(const void* pData, uint32 size)
+// ReadFile/WriteFile take 32-bit sizes, so large requests are split up
+static constexpr uint64 MaxFileIOSize = 1u << 30;
+
+bool FileStream::Write(const void* pData, uint64 size)
 {
 	gAssert(IsOpen());
 	gAssert(m_Mode & FileMode::Write);
 
-	DWORD written = 0;
-	BOOL result = ::WriteFile(m_pFile, pData, size, &written, nullptr);
-	m_Position += written;
-	return result == TRUE;
+	const char* pCurrent = (const char*)pData;
+	while (size > 0)
+	{
+		DWORD written = 0;
+		BOOL result = ::WriteFile(m_pFile, pCurrent, (DWORD)Math::Min(size, MaxFileIOSize), &written, nullptr);
+		m_Position += written;
+		m_Length = Math::Max(m_Length, m_Position);
+		if (result != TRUE || written == 0)
+			return false;
+		pCurrent += written;
+		size -= written;
+	}
+	return true;
 }
 
-bool FileStream::Read(void* pData, uint32 size, uint32* pRead)
+bool FileStream::Read(void* pData, uint64 size, uint64* pRead)
 {
 	gAssert(IsOpen());
 	gAssert(m_Mode & FileMode::Read);
 
-	DWORD read = 0;
-	BOOL result = ::ReadFile(m_pFile, pData, size, &read, nullptr);
+	char* pCurrent = (char*)pData;
+	uint64 totalRead = 0;
+	BOOL result = TRUE;
+	while (totalRead < size)
+	{
+		DWORD read = 0;
+		result = ::ReadFile(m_pFile, pCurrent + totalRead, (DWORD)Math::Min(size - totalRead, MaxFileIOSize), &read, nullptr);
+		totalRead += read;
+		if (result != TRUE || read == 0)
+			break;
+	}
 	if (pRead)
-		*pRead = (uint32)read;
-	m_Position += read;
+		*pRead = totalRead;
+	m_Position += totalRead;
 	return result == TRUE;
 }
 
-void FileStream::Seek(int offset, StreamSeekMode mode)
+void FileStream::Seek(int64 offset, StreamSeekMode mode)
 {
 	gAssert(IsOpen());
-	if (mode == StreamSeekMode::Absolute)
+	LARGE_INTEGER distance;
+	distance.QuadPart = offset;
+	LARGE_INTEGER newPosition;
+	::SetFilePointerEx(m_pFile, distance, &newPosition, mode == StreamSeekMode::Absolute ? FILE_BEGIN : FILE_CURRENT);
+	m_Position = newPosition.QuadPart;
+}
+
+
+
+MappedFileStream::MappedFileStream()
+	: Stream(false)
+{}
+
+MappedFileStream::~MappedFileStream()
+{
+	Close();
+}
+
+bool MappedFileStream::Open(const char* pFile)
+{
+	Close();
+
+#if PLATFORM_WINDOWS
+	HANDLE pFileHandle = ::CreateFileA(pFile, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (pFileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	::GetFileSizeEx(pFileHandle, &fileSize);
+	m_Length = fileSize.QuadPart;
+
+	// Mapping an empty file fails, but it's still a valid stream
+	if (m_Length > 0)
 	{
-		::SetFilePointer(m_pFile, offset, nullptr, FILE_BEGIN);
-		m_Position = offset;
+		m_pMapping = ::CreateFileMappingA(pFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_pMapping)
+			m_pData = (const uint8*)::MapViewOfFile(m_pMapping, FILE_MAP_READ, 0, 0, 0);
 	}
-	else if (mode == StreamSeekMode::Relative)
+
+	// The mapping keeps the file open
+	::CloseHandle(pFileHandle);
+#else
+	int fileDescriptor = ::open(pFile, O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat fileStat;
+	if (::fstat(fileDescriptor, &fileStat) == 0)
 	{
-		::SetFilePointer(m_pFile, offset, nullptr, FILE_CURRENT);
-		m_Position += offset;
+		m_Length = (uint64)fileStat.st_size;
+		if (m_Length > 0)
+		{
+			void* pMapped = ::mmap(nullptr, m_Length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+			if (pMapped != MAP_FAILED)
+				m_pData = (const uint8*)pMapped;
+		}
+	}
+
+	// The mapping keeps the file open
+	::close(fileDescriptor);
+#endif
+
+	if (m_Length > 0 && !m_pData)
+	{
+		Close();
+		return false;
 	}
+
+	m_Position = 0;
+	m_IsOpen = true;
+	return true;
 }
+
+void MappedFileStream::Close()
+{
+#if PLATFORM_WINDOWS
+	if (m_pData)
+		::UnmapViewOfFile(m_pData);
+	if (m_pMapping)
+		::CloseHandle(m_pMapping);
+#else
+	if (m_pData)
+		::munmap((void*)m_pData, m_Length);
+#endif
+	m_pData		= nullptr;
+	m_pMapping	= nullptr;
+	m_Length	= 0;
+	m_Position	= 0;
+	m_IsOpen	= false;
+}
+
+bool MappedFileStream::Write(const void* /*pData*/, uint64 /*size*/)
+{
+	gAssert(false, "MappedFileStream is read-only");
+	return false;
+}
+
+bool MappedFileStream::Read(void* pData, uint64 size, uint64* pRead)
+{
+	gAssert(IsOpen());
+
+	uint64 read = Math::Min(size, m_Length - m_Position);
+	if (read > 0)
+		memcpy(pData, m_pData + m_Position, read);
+	m_Position += read;
+	if (pRead)
+		*pRead = read;
+	return read == size;
+}
+
+Span<const uint8> MappedFileStream::ReadView(uint64 size)
+{
+	gAssert(IsOpen());
+
+	if (m_Position + size > m_Length || size > std::numeric_limits<uint32>::max())
+		return {};
+
+	Span<const uint8> view(m_pData + m_Position, (uint32)size);
+	m_Position += size;
+	return view;
+}
+
+void MappedFileStream::Seek(int64 offset, StreamSeekMode mode)
+{
+	gAssert(IsOpen());
+	if (mode == StreamSeekMode::Absolute)
+		m_Position = (uint64)offset;
+	else if (mode == StreamSeekMode::Relative)
+		m_Position += offset;
+	gAssert(m_Position <= m_Length);
+}
+
+
+
+// Usage: StreamBenchmark <file> <iterations>
+// Compares reading a whole file through a FileStream copy against a MappedFileStream view
+static ConsoleCommand<const char*, int> gStreamBenchmark("StreamBenchmark", [](const char* pFilePath, int iterations)
+	{
+		iterations = Math::Max(iterations, 1);
+
+		// Sum the data so the read isn't optimized away and all pages get touched
+		auto Checksum = [](const uint8* pData, uint64 size)
+			{
+				uint64 sum = 0;
+				for (uint64 i = 0; i < size; i += 64)
+					sum += pData[i];
+				return sum;
+			};
+
+		uint64 fileSize = 0;
+		uint64 copySum = 0;
+		Utils::TimeScope copyTimer;
+		for (int i = 0; i < iterations; ++i)
+		{
+			FileStream stream;
+			if (!stream.Open(pFilePath, FileMode::Read))
+			{
+				E_LOG(Warning, "StreamBenchmark - Failed to open '%s'", pFilePath);
+				return;
+			}
+			fileSize = stream.GetLength();
+			Array<uint8> buffer(fileSize);
+			stream.Read(buffer.data(), fileSize);
+			copySum += Checksum(buffer.data(), fileSize);
+		}
+		float copyTime = copyTimer.Stop();
+
+		uint64 mappedSum = 0;
+		Utils::TimeScope mappedTimer;
+		for (int i = 0; i < iterations; ++i)
+		{
+			MappedFileStream stream;
+			if (!stream.Open(pFilePath))
+			{
+				E_LOG(Warning, "StreamBenchmark - Failed to map '%s'", pFilePath);
+				return;
+			}
+			mappedSum += Checksum(stream.GetData(), stream.GetLength());
+		}
+		float mappedTime = mappedTimer.Stop();
+
+		gAssert(copySum == mappedSum, "FileStream and MappedFileStream returned different data");
+
+		float totalMB = Math::BytesToMegaBytes * fileSize * iterations;
+		E_LOG(Info, "StreamBenchmark - '%s' (%.2f MB) x %d", pFilePath, Math::BytesToMegaBytes * fileSize, iterations);
+		E_LOG(Info, "\tFileStream:       %.3f ms per read (%.0f MB/s)", copyTime * 1000.0f / iterations, totalMB / copyTime);
+		E_LOG(Info, "\tMappedFileStream: %.3f ms per read (%.0f MB/s)", mappedTime * 1000.0f / iterations, totalMB / mappedTime);
+	});
@@ -15,8 +15,12 @@ public:
 
 	virtual ~Stream() = default;
 
-	virtual bool Write(const void* pData, uint32 size) = 0;
-	virtual bool Read(void* pData, uint32 size, uint32* pRead = nullptr) = 0;
+	virtual bool Write(const void* pData, uint64 size) = 0;
+	virtual bool Read(void* pData, uint64 size, uint64* pRead = nullptr) = 0;
+
+	// Returns a view of the next 'size' bytes and advances the cursor, without copying.
+	// Returns an empty span if the stream is not backed by memory or doesn't have 'size' bytes left. Use Read() in that case.
+	virtual Span<const uint8> ReadView(uint64 /*size*/) { return {}; }
 
 	bool ReadLine(char* pOutStr, uint32 maxLength);
 
@@ -28,9 +32,9 @@ public:
 		return value;
 	}
 
-	virtual uint32	GetLength() const = 0;
-	virtual void	Seek(int offset, StreamSeekMode mode) = 0;
-	virtual uint32	GetCursor() const = 0;
+	virtual uint64	GetLength() const = 0;
+	virtual void	Seek(int64 offset, StreamSeekMode mode) = 0;
+	virtual uint64	GetCursor() const = 0;
 	virtual bool	Flush() { return true; }
 
 	bool IsWriting() const { return m_IsWriting; }
@@ -53,7 +57,7 @@ inline Stream& operator<<(Stream& stream, float value)	{ stream.Write(&value, si
 inline Stream& operator<<(Stream& stream, const String value)
 {
 	stream << (uint32)value.length();
-	stream.Write(&value[0], (uint32)value.length());
+	stream.Write(&value[0], value.length());
 	return stream;
 }
 
@@ -120,26 +124,29 @@ inline Stream& operator>>(Stream& stream, T(&value)[N])
 class MemoryStream : public Stream
 {
 public:
-	MemoryStream(bool isWriting, const void* pMemory = nullptr, uint32 size = 0);
+	MemoryStream(bool isWriting, const void* pMemory = nullptr, uint64 size = 0);
 	~MemoryStream();
 
-	bool	Write(const void* pData, uint32 size) override;
-	void	Seek(int offset, StreamSeekMode mode) override;
-	bool	Read(void* pData, uint32 size, uint32* pRead = nullptr) override;
+	bool	Write(const void* pData, uint64 size) override;
+	void	Seek(int64 offset, StreamSeekMode mode) override;
+	bool	Read(void* pData, uint64 size, uint64* pRead = nullptr) override;
+	Span<const uint8> ReadView(uint64 size) override;
 
-	void	SetBuffer(const void* pBuffer, uint32 length);
-	void	SetLength(uint32 length);
+	void	SetBuffer(const void* pBuffer, uint64 length);
+	void	SetLength(uint64 length);
 
-	uint32	GetCursor() const override	{ return m_pData ? (uint32)(m_pData - m_pDataBase) : 0; }
-	uint32	GetLength() const override	{ return m_Capacity; }
+	uint64	GetCursor() const override	{ return m_pData ? (uint64)(m_pData - m_pDataBase) : 0; }
+	uint64	GetLength() const override	{ return m_Length; }
 	void*	GetData() const				{ return m_pDataBase; }
 
 private:
-	void	EnsureBufferSize(uint32 length);
+	void	EnsureBufferSize(uint64 length);
+	void	Reallocate(uint64 capacity);
 
 	char* m_pDataBase = nullptr;
 	char* m_pData = nullptr;
-	uint32 m_Capacity;
+	uint64 m_Length = 0;		///< Number of bytes in the stream. When writing, the end of the furthest write
+	uint64 m_Capacity = 0;		///< Size of the buffer. Grows ahead of the length when writing
 };
 
 
@@ -163,17 +170,54 @@ public:
 	bool Close();
 
 	bool Flush() override;
-	bool Write(const void* pData, uint32 size) override;
-	bool Read(void* pData, uint32 size, uint32* pRead = nullptr) override;
-	void Seek(int offset, StreamSeekMode mode) override;
+	bool Write(const void* pData, uint64 size) override;
+	bool Read(void* pData, uint64 size, uint64* pRead = nullptr) override;
+	void Seek(int64 offset, StreamSeekMode mode) override;
 
-	uint32 GetLength() const override	{ return m_Length; }
-	uint32 GetCursor() const override	{ return m_Position; }
+	uint64 GetLength() const override	{ return m_Length; }
+	uint64 GetCursor() const override	{ return m_Position; }
 	bool IsOpen() const					{ return m_pFile != nullptr; }
 
 private:
 	HANDLE m_pFile		= nullptr;
-	uint32 m_Length		= 0;
-	uint32 m_Position	= 0;
+	uint64 m_Length		= 0;
+	uint64 m_Position	= 0;
 	FileMode m_Mode		= FileMode::None;
 };
+
+
+
+// Read-only stream over a file which is mapped into memory.
+// ReadView() returns pointers into the mapping, so loaders can use file contents without copying them.
+// Views stay valid until the stream is closed.
+class MappedFileStream : public Stream
+{
+public:
+	MappedFileStream();
+	~MappedFileStream();
+
+	MappedFileStream(const MappedFileStream&) = delete;
+	MappedFileStream& operator=(const MappedFileStream&) = delete;
+
+	bool Open(const char* pFile);
+	void Close();
+
+	bool Write(const void* pData, uint64 size) override;
+	bool Read(void* pData, uint64 size, uint64* pRead = nullptr) override;
+	Span<const uint8> ReadView(uint64 size) override;
+	void Seek(int64 offset, StreamSeekMode mode) override;
+
+	uint64 GetLength() const override	{ return m_Length; }
+	uint64 GetCursor() const override	{ return m_Position; }
+	bool IsOpen() const					{ return m_IsOpen; }
+
+	// Pointer to the whole file. Spans are limited to 4GB, so use this with GetLength() for larger files.
+	const uint8* GetData() const		{ return m_pData; }
+
+private:
+	const uint8*	m_pData		= nullptr;	///< Start of the mapping. nullptr for empty files
+	HANDLE			m_pMapping	= nullptr;	///< File mapping object (Windows only)
+	uint64			m_Length	= 0;
+	uint64			m_Position	= 0;
+	bool			m_IsOpen	= false;
+};
@@ -1,114 +1,414 @@
 #include "stdafx.h"
 #include "TaskQueue.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Utils.h"
+
+#include <thread>
+#include <condition_variable>
+
+#if !PLATFORM_WINDOWS
+#include <pthread.h>
+#endif
 
 struct AsyncTask
 {
 	AsyncTaskDelegate Action;
 	TaskContext* pCounter;
+	std::atomic<uint32> NumDependencies = 0;
 };
 
-static std::deque<AsyncTask> m_Queue;
-static std::condition_variable m_WakeUpCondition;
-static std::mutex m_QueueMutex;
-static std::mutex m_SleepMutex;
-static bool m_Shutdown = false;
-static Array<Thread> m_Threads;
+// Shared state of a ParallelFor. Freed by the last range to finish.
+struct RangeJob
+{
+	AsyncRangeDelegate Action;
+	TaskContext* pContext;
+	uint32 GrainSize;
+	std::atomic<uint32> NumRanges;
+};
 
-TaskQueue::~TaskQueue()
+// Node in the list of tasks waiting for a TaskContext
+struct TaskDependent
 {
-	Shutdown();
+	AsyncTask* pTask;
+	TaskDependent* pNext;
+};
+
+// Chase-Lev work stealing deque.
+// The owning thread pushes and pops at the bottom (LIFO), other threads steal from the top (FIFO).
+// Based on "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al. 2013).
+class WorkStealingDeque
+{
+public:
+	static constexpr int64 Capacity = 1 << 12;
+
+	// Owner thread only. Returns false when the deque is full.
+	bool Push(AsyncTask* pTask)
+	{
+		int64 bottom = m_Bottom.load(std::memory_order_relaxed);
+		int64 top = m_Top.load(std::memory_order_acquire);
+		if (bottom - top >= Capacity)
+			return false;
+		m_Tasks[bottom & (Capacity - 1)].store(pTask, std::memory_order_relaxed);
+		m_Bottom.store(bottom + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Owner thread only.
+	AsyncTask* Pop()
+	{
+		int64 bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 top = m_Top.load(std::memory_order_relaxed);
+
+		AsyncTask* pTask = nullptr;
+		if (top <= bottom)
+		{
+			pTask = m_Tasks[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (top == bottom)
+			{
+				// Last task in the deque. Race against thieves for it.
+				if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					pTask = nullptr;
+				m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+		}
+		else
+		{
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return pTask;
+	}
+
+	// Any thread. Approximate.
+	bool IsEmpty() const
+	{
+		return m_Bottom.load(std::memory_order_relaxed) <= m_Top.load(std::memory_order_relaxed);
+	}
+
+	// Any thread.
+	AsyncTask* Steal()
+	{
+		int64 top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 bottom = m_Bottom.load(std::memory_order_acquire);
+
+		if (top < bottom)
+		{
+			AsyncTask* pTask = m_Tasks[top & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return pTask;
+		}
+		return nullptr;
+	}
+
+private:
+	alignas(64) std::atomic<int64> m_Top = 0;
+	alignas(64) std::atomic<int64> m_Bottom = 0;
+	alignas(64) std::atomic<AsyncTask*> m_Tasks[Capacity]{};
+};
+
+// Each worker owns a deque. Index 0 belongs to the thread that called Initialize().
+struct alignas(64) Worker
+{
+	WorkStealingDeque	Queue;
+	std::thread			Thread;
+	uint32				RandomState = 0;
+};
+
+// Index of the worker owned by the current thread. Threads not owned by the TaskQueue submit through the injection queue.
+static constexpr uint32 InvalidWorkerIndex = 0xFFFFFFFF;
+static thread_local uint32 tWorkerIndex = InvalidWorkerIndex;
+
+static Array<UniquePtr<Worker>>	m_Workers;
+
+// Fallback queue for tasks submitted from non-worker threads or when a deque overflows
+static std::deque<AsyncTask*>	m_InjectionQueue;
+static std::mutex				m_InjectionMutex;
+static std::atomic<uint32>		m_NumInjected = 0;
+
+// Sleeping is tracked with an epoch that is bumped on every submission, so a worker going to sleep can't miss a wake up.
+static std::mutex				m_SleepMutex;
+static std::condition_variable	m_WakeUpCondition;
+static std::atomic<uint32>		m_WorkEpoch = 0;
+static std::atomic<uint32>		m_NumSleeping = 0;
+static std::atomic<bool>		m_Shutdown = false;
+
+static void SetCurrentThreadName(const char* pName)
+{
+#if PLATFORM_WINDOWS
+	SetThreadDescription(GetCurrentThread(), MULTIBYTE_TO_UNICODE(pName));
+#else
+	pthread_setname_np(pthread_self(), pName);
+#endif
 }
 
-void TaskQueue::Initialize(uint32 threads)
+static void NotifyWork(uint32 numTasks)
 {
-	CreateThreads(threads);
+	m_WorkEpoch.fetch_add(1, std::memory_order_seq_cst);
+	if (m_NumSleeping.load(std::memory_order_seq_cst) > 0)
+	{
+		std::scoped_lock lock(m_SleepMutex);
+		if (numTasks > 1)
+			m_WakeUpCondition.notify_all();
+		else
+			m_WakeUpCondition.notify_one();
+	}
 }
 
-void TaskQueue::Shutdown()
+static void PushTask(AsyncTask* pTask)
 {
-	m_Shutdown = true;
-	m_WakeUpCondition.notify_all();
+	uint32 workerIndex = tWorkerIndex;
+	if (workerIndex != InvalidWorkerIndex && m_Workers[workerIndex]->Queue.Push(pTask))
+		return;
+
+	std::scoped_lock lock(m_InjectionMutex);
+	m_InjectionQueue.push_back(pTask);
+	m_NumInjected.fetch_add(1, std::memory_order_release);
 }
 
-bool DoWork(uint32 threadIndex)
+static AsyncTask* PopInjected()
 {
-	m_QueueMutex.lock();
-	if (!m_Queue.empty())
+	if (m_NumInjected.load(std::memory_order_acquire) == 0)
+		return nullptr;
+
+	std::scoped_lock lock(m_InjectionMutex);
+	if (m_InjectionQueue.empty())
+		return nullptr;
+	AsyncTask* pTask = m_InjectionQueue.front();
+	m_InjectionQueue.pop_front();
+	m_NumInjected.fetch_sub(1, std::memory_order_relaxed);
+	return pTask;
+}
+
+// True if nothing is queued locally, meaning other threads stole the work or are about to run out
+static bool IsLocalQueueEmpty()
+{
+	uint32 workerIndex = tWorkerIndex;
+	if (workerIndex != InvalidWorkerIndex)
+		return m_Workers[workerIndex]->Queue.IsEmpty();
+	return m_NumInjected.load(std::memory_order_relaxed) == 0;
+}
+
+static AsyncTask* FindTask(uint32 workerIndex)
+{
+	Worker& worker = *m_Workers[workerIndex];
+	if (AsyncTask* pTask = worker.Queue.Pop())
+		return pTask;
+
+	if (AsyncTask* pTask = PopInjected())
+		return pTask;
+
+	// Steal from a random victim, then walk the rest
+	uint32 numWorkers = (uint32)m_Workers.size();
+	worker.RandomState = worker.RandomState * 1664525u + 1013904223u;
+	uint32 start = (worker.RandomState >> 16) % numWorkers;
+	for (uint32 i = 0; i < numWorkers; ++i)
 	{
-		AsyncTask task = m_Queue.front();
-		m_Queue.pop_front();
-		m_QueueMutex.unlock();
-		task.Action.Execute(threadIndex);
-		task.pCounter->fetch_sub(1);
-		return true;
+		uint32 victim = (start + i) % numWorkers;
+		if (victim == workerIndex)
+			continue;
+		if (AsyncTask* pTask = m_Workers[victim]->Queue.Steal())
+			return pTask;
 	}
-	else
-	{
-		m_QueueMutex.unlock();
+	return nullptr;
+}
+
+bool TaskQueue::DoWork(uint32 workerIndex)
+{
+	AsyncTask* pTask = workerIndex != InvalidWorkerIndex ? FindTask(workerIndex) : PopInjected();
+	if (!pTask)
 		return false;
-	}
+
+	pTask->Action.Execute(workerIndex != InvalidWorkerIndex ? workerIndex : 0);
+	TaskContext& context = *pTask->pCounter;
+	delete pTask;
+	CompleteTask(context);
+	return true;
 }
 
-DWORD WINAPI WorkFunction(LPVOID lpParameter)
+void TaskQueue::WorkFunction(uint32 workerIndex)
 {
-	wchar_t* pDescription;
-	GetThreadDescription(GetCurrentThread(), &pDescription);
+	char threadName[256];
+	FormatString(threadName, ARRAYSIZE(threadName), "TaskQueue Thread %d", workerIndex);
+	SetCurrentThreadName(threadName);
+
+	tWorkerIndex = workerIndex;
 
-	size_t threadIndex = reinterpret_cast<size_t>(lpParameter);
-	while (!m_Shutdown)
+	constexpr uint32 NumSpinsBeforeSleep = 64;
+	uint32 numFailedAttempts = 0;
+	while (!m_Shutdown.load(std::memory_order_relaxed))
 	{
-		bool didWork = DoWork((uint32)threadIndex);
-		if (!didWork)
+		if (DoWork(workerIndex))
+		{
+			numFailedAttempts = 0;
+			continue;
+		}
+
+		if (++numFailedAttempts < NumSpinsBeforeSleep)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Announce going to sleep, then check once more for work that was submitted in the meantime
+		m_NumSleeping.fetch_add(1, std::memory_order_seq_cst);
+		uint32 epoch = m_WorkEpoch.load(std::memory_order_seq_cst);
+		if (DoWork(workerIndex))
+		{
+			m_NumSleeping.fetch_sub(1, std::memory_order_relaxed);
+			numFailedAttempts = 0;
+			continue;
+		}
+
 		{
 			std::unique_lock lock(m_SleepMutex);
-			m_WakeUpCondition.wait(lock);
+			m_WakeUpCondition.wait(lock, [epoch]() { return m_WorkEpoch.load() != epoch || m_Shutdown.load(); });
 		}
+		m_NumSleeping.fetch_sub(1, std::memory_order_relaxed);
+		numFailedAttempts = 0;
+	}
+}
+
+TaskQueue::~TaskQueue()
+{
+	Shutdown();
+}
+
+void TaskQueue::Initialize(uint32 threads)
+{
+	CreateThreads(threads);
+}
+
+void TaskQueue::Shutdown()
+{
+	{
+		std::scoped_lock lock(m_SleepMutex);
+		m_Shutdown = true;
+		m_WakeUpCondition.notify_all();
+	}
+
+	for (uint32 i = 1; i < (uint32)m_Workers.size(); ++i)
+	{
+		if (m_Workers[i]->Thread.joinable())
+			m_Workers[i]->Thread.join();
 	}
-	return 0;
 }
 
 void TaskQueue::CreateThreads(uint32 count)
 {
-	m_Threads.resize(count);
-	for (uint32 i = 1; i < count; ++i)
+	count = Math::Max(count, 1u);
+	m_Workers.resize(count);
+	for (uint32 i = 0; i < count; ++i)
 	{
-		Thread& thread = m_Threads[i];
-		thread.RunThread(WorkFunction, reinterpret_cast<LPVOID>((size_t)i));
+		m_Workers[i] = std::make_unique<Worker>();
+		m_Workers[i]->RandomState = i + 1;
+	}
 
-		char threadName[256];
-		FormatString(threadName, ARRAYSIZE(threadName), "TaskQueue Thread %d", i);
-		thread.SetName(threadName);
+	// The thread initializing the TaskQueue owns worker 0 and does work while joining
+	tWorkerIndex = 0;
+	for (uint32 i = 1; i < count; ++i)
+	{
+		m_Workers[i]->Thread = std::thread(&TaskQueue::WorkFunction, i);
 	}
 }
 
-void TaskQueue::AddWorkItem(const AsyncTaskDelegate& action, TaskContext& context)
+void TaskQueue::AddWorkItem(const AsyncTaskDelegate& action, TaskContext& context, Span<TaskContext*> dependencies)
 {
-	AsyncTask task;
-	task.pCounter = &context;
-	task.Action = action;
+	AsyncTask* pTask = new AsyncTask{ action, &context };
+	context.m_Counter.fetch_add(1);
 
-	std::scoped_lock lock(m_QueueMutex);
-	m_Queue.push_back(task);
-	context.fetch_add(1);
+	// If there are pending dependencies, the task gets scheduled by the last one to complete
+	if (dependencies.GetSize() > 0 && !AddDependencies(pTask, dependencies))
+		return;
 
-	m_WakeUpCondition.notify_one();
+	PushTask(pTask);
+	NotifyWork(1);
 }
 
-void TaskQueue::Join(TaskContext& context)
+bool TaskQueue::AddDependencies(AsyncTask* pTask, Span<TaskContext*> dependencies)
 {
-	if (context > 0)
+	// Hold an extra dependency while registering so the task can't be released halfway through
+	pTask->NumDependencies.store(dependencies.GetSize() + 1);
+	uint32 numSatisfied = 1;
+
+	for (TaskContext* pDependency : dependencies)
 	{
-		m_WakeUpCondition.notify_all();
-		while (context.load() > 0)
+		while (pDependency->m_DependentsLock.test_and_set(std::memory_order_acquire))
+			std::this_thread::yield();
+
+		// The bit may only be set while tasks are outstanding. CompleteTask doesn't take the lock unless it sees the bit,
+		// so if the last task completes first, the dependency is satisfied instead.
+		uint32 counter = pDependency->m_Counter.load(std::memory_order_acquire);
+		bool isPending = false;
+		while ((counter & TaskContext::CounterMask) != 0 && !isPending)
+			isPending = pDependency->m_Counter.compare_exchange_weak(counter, counter | TaskContext::HasDependentsBit, std::memory_order_acq_rel, std::memory_order_acquire);
+
+		if (isPending)
+			pDependency->m_pDependents = new TaskDependent{ pTask, pDependency->m_pDependents };
+		else
+			++numSatisfied;
+		pDependency->m_DependentsLock.clear(std::memory_order_release);
+	}
+
+	// Returns true if the task is ready to run
+	return pTask->NumDependencies.fetch_sub(numSatisfied) == numSatisfied;
+}
+
+void TaskQueue::CompleteTask(TaskContext& context)
+{
+	// If this was the last task and nothing depends on the context, the context must not be touched anymore.
+	// When there are dependents, the context is kept alive for joiners until the dependents bit is cleared.
+	uint32 previous = context.m_Counter.fetch_sub(1, std::memory_order_acq_rel);
+	if (previous != (TaskContext::HasDependentsBit | 1))
+		return;
+
+	while (context.m_DependentsLock.test_and_set(std::memory_order_acquire))
+		std::this_thread::yield();
+	TaskDependent* pDependent = context.m_pDependents;
+	context.m_pDependents = nullptr;
+	context.m_DependentsLock.clear(std::memory_order_release);
+	context.m_Counter.fetch_and(TaskContext::CounterMask, std::memory_order_release);
+
+	uint32 numReady = 0;
+	while (pDependent)
+	{
+		if (pDependent->pTask->NumDependencies.fetch_sub(1) == 1)
 		{
-			DoWork(0);
+			PushTask(pDependent->pTask);
+			++numReady;
 		}
+		TaskDependent* pNext = pDependent->pNext;
+		delete pDependent;
+		pDependent = pNext;
+	}
+	if (numReady > 0)
+		NotifyWork(numReady);
+}
+
+void TaskQueue::Join(TaskContext& context)
+{
+	uint32 workerIndex = tWorkerIndex;
+	while (context.m_Counter.load(std::memory_order_acquire) != 0)
+	{
+		if (!DoWork(workerIndex))
+			std::this_thread::yield();
 	}
 }
 
 uint32 TaskQueue::ThreadCount()
 {
-	return (uint32)m_Threads.size() + 1;
+	return Math::Max((uint32)m_Workers.size(), 1u);
+}
+
+void TaskQueue::BeginExternalWork(TaskContext& context)
+{
+	context.m_Counter.fetch_add(1);
+}
+
+void TaskQueue::EndExternalWork(TaskContext& context)
+{
+	CompleteTask(context);
 }
 
 void TaskQueue::Distribute(TaskContext& context, const AsyncDistributeDelegate& action, uint32 count, int32 groupSize /*= -1*/)
@@ -122,25 +422,275 @@ void TaskQueue::Distribute(TaskContext& context, const AsyncDistributeDelegate&
 		groupSize = ThreadCount();
 	}
 	uint32 jobs = (uint32)Math::Ceil((float)count / groupSize);
-	context.fetch_add(jobs);
+	context.m_Counter.fetch_add(jobs);
 
+	// Push in reverse so the owner pops the first group first. Thieves take from the other end.
+	for (int32 i = (int32)jobs - 1; i >= 0; --i)
 	{
-		std::scoped_lock lock(m_QueueMutex);
-		for (uint32 i = 0; i < jobs; ++i)
-		{
-			AsyncTask task;
-			task.pCounter = &context;
-			task.Action = AsyncTaskDelegate::CreateLambda([action, i, count, groupSize](int threadIndex)
+		AsyncTask* pTask = new AsyncTask;
+		pTask->pCounter = &context;
+		pTask->Action = AsyncTaskDelegate::CreateLambda([action, i, count, groupSize](int threadIndex)
+			{
+				uint32 start = i * groupSize;
+				uint32 end = Math::Min(start + groupSize, count);
+				for (uint32 j = start; j < end; ++j)
 				{
-					uint32 start = i * groupSize;
-					uint32 end = Math::Min(start + groupSize, count);
-					for (uint32 j = start; j < end; ++j)
-					{
-						action.Execute(TaskDistributeArgs{ (int)j, threadIndex });
-					}
-				});
-			m_Queue.push_back(task);
+					action.Execute(TaskDistributeArgs{ (int)j, threadIndex });
+				}
+			});
+		PushTask(pTask);
+	}
+	NotifyWork(jobs);
+}
+
+void TaskQueue::SplitRange(TaskContext& context, const AsyncRangeDelegate& action, uint32 count, uint32 grainSize)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	RangeJob* pJob = new RangeJob{ action, &context, Math::Max(grainSize, 1u), 1 };
+	context.m_Counter.fetch_add(1);
+	PushTask(new AsyncTask{ AsyncTaskDelegate::CreateLambda([pJob, count](int threadIndex) { ExecuteRange(pJob, 0, count, threadIndex); }), &context });
+	NotifyWork(1);
+}
+
+void TaskQueue::ExecuteRange(RangeJob* pJob, uint32 begin, uint32 end, uint32 threadIndex)
+{
+	while (begin < end)
+	{
+		// Lazy binary splitting. Hand off half of the remaining range only when the local queue is empty.
+		// Once the split off half is stolen, the queue is empty again and the next split happens.
+		if (end - begin > pJob->GrainSize && IsLocalQueueEmpty())
+		{
+			uint32 middle = begin + (end - begin) / 2;
+			pJob->NumRanges.fetch_add(1);
+			pJob->pContext->m_Counter.fetch_add(1);
+			PushTask(new AsyncTask{ AsyncTaskDelegate::CreateLambda([pJob, middle, end](int threadIndex) { ExecuteRange(pJob, middle, end, threadIndex); }), pJob->pContext });
+			NotifyWork(1);
+			end = middle;
 		}
+
+		uint32 chunkEnd = Math::Min(begin + pJob->GrainSize, end);
+		pJob->Action.Execute(TaskRangeArgs{ begin, chunkEnd, (int)threadIndex });
+		begin = chunkEnd;
 	}
-	m_WakeUpCondition.notify_all();
+
+	if (pJob->NumRanges.fetch_sub(1) == 1)
+		delete pJob;
 }
+
+
+// Usage: TaskQueueBenchmark <num jobs>
+// Measures scheduling overhead of empty jobs and fine-grained ExecuteMany
+static ConsoleCommand<int> gTaskQueueBenchmark("TaskQueueBenchmark", [](int numJobs)
+	{
+		numJobs = Math::Max(numJobs, 1);
+
+		{
+			Utils::TimeScope timer;
+			TaskContext context;
+			for (int i = 0; i < numJobs; ++i)
+				TaskQueue::Execute([](int) {}, context);
+			TaskQueue::Join(context);
+			float time = timer.Stop();
+			E_LOG(Info, "Execute: %d empty jobs in %.3f ms (%.1f ns/job)", numJobs, time * 1000.0f, time * 1.0e9f / numJobs);
+		}
+
+		for (int groupSize : { 1, 16, 256 })
+		{
+			std::atomic<uint64> sum = 0;
+			Utils::TimeScope timer;
+			TaskContext context;
+			TaskQueue::ExecuteMany([&sum](TaskDistributeArgs args) { sum.fetch_add(args.JobIndex, std::memory_order_relaxed); }, context, numJobs, groupSize);
+			TaskQueue::Join(context);
+			float time = timer.Stop();
+			E_LOG(Info, "ExecuteMany: %d items, group size %d in %.3f ms (%.1f ns/item)", numJobs, groupSize, time * 1000.0f, time * 1.0e9f / numJobs);
+		}
+	});
+
+
+// Usage: TaskGraphBenchmark
+// Runs a synthetic frame (animation -> skinning -> per-view culling -> batch sort -> upload, plus an independent particle chain)
+// once with a Join after every stage and once expressed as a dependency graph.
+// The graph is then run many times without any work, so tasks complete while their dependents are being registered,
+// and every task checks that the stages it depends on have finished.
+static ConsoleCommand<> gTaskGraphBenchmark("TaskGraphBenchmark", []()
+	{
+		auto SpinFor = [](float microseconds)
+			{
+				Utils::TimeScope timer;
+				while (timer.Stop() * 1.0e6f < microseconds) {}
+			};
+
+		constexpr uint32 NumCharacters		= 64;
+		constexpr uint32 NumViews			= 6;
+		constexpr uint32 NumBatches			= 512;
+		constexpr uint32 NumParticleJobs	= 32;
+		constexpr uint32 NumValidationRuns	= 10000;
+
+		float serialTime = 0;
+		{
+			auto Animate	= [&](TaskDistributeArgs) { SpinFor(20.0f); };
+			auto Skin		= [&](TaskDistributeArgs) { SpinFor(15.0f); };
+			auto Cull		= [&](TaskDistributeArgs) { SpinFor(1.0f); };
+			auto Sort		= [&](int) { SpinFor(150.0f); };
+			auto Upload		= [&](int) { SpinFor(200.0f); };
+			auto Particles	= [&](TaskDistributeArgs) { SpinFor(50.0f); };
+
+			Utils::TimeScope timer;
+			TaskContext context;
+			TaskQueue::ExecuteMany(Animate, context, NumCharacters, 1);
+			TaskQueue::Join(context);
+			TaskQueue::ExecuteMany(Skin, context, NumCharacters, 1);
+			TaskQueue::Join(context);
+			for (uint32 view = 0; view < NumViews; ++view)
+				TaskQueue::ExecuteMany(Cull, context, NumBatches, 32);
+			TaskQueue::Join(context);
+			for (uint32 view = 0; view < NumViews; ++view)
+				TaskQueue::Execute(Sort, context);
+			TaskQueue::Join(context);
+			TaskQueue::Execute(Upload, context);
+			TaskQueue::ExecuteMany(Particles, context, NumParticleJobs, 1);
+			TaskQueue::Join(context);
+			serialTime = timer.Stop();
+		}
+
+		// Each task counts itself as done when it finishes, and checks the counts of the stages it depends on when it starts
+		struct StageCounts
+		{
+			std::atomic<uint32> Animation = 0;
+			std::atomic<uint32> Skinning = 0;
+			StaticArray<std::atomic<uint32>, NumViews> Culling{};
+			std::atomic<uint32> Sorting = 0;
+			std::atomic<uint32> NumViolations = 0;
+		};
+
+		auto RunGraph = [&](float workScale, StageCounts& done)
+			{
+				auto Expect = [&](uint32 numDone, uint32 numExpected)
+					{
+						if (numDone != numExpected)
+							done.NumViolations.fetch_add(1);
+					};
+				auto Animate = [&](TaskDistributeArgs)
+					{
+						SpinFor(20.0f * workScale);
+						done.Animation.fetch_add(1);
+					};
+				auto Skin = [&](TaskDistributeArgs)
+					{
+						Expect(done.Animation.load(), NumCharacters);
+						SpinFor(15.0f * workScale);
+						done.Skinning.fetch_add(1);
+					};
+				auto Particles = [&](TaskDistributeArgs) { SpinFor(50.0f * workScale); };
+
+				TaskContext animation, skinning, upload, particles;
+				StaticArray<TaskContext, NumViews> culling, sorting;
+				TaskQueue::ExecuteMany(Particles, particles, NumParticleJobs, 1);
+				TaskQueue::ExecuteMany(Animate, animation, NumCharacters, 1);
+				TaskQueue::ExecuteMany(Skin, skinning, NumCharacters, 1, &animation);
+				StaticArray<TaskContext*, NumViews> sortDependencies;
+				for (uint32 view = 0; view < NumViews; ++view)
+				{
+					TaskQueue::ExecuteMany([&, view](TaskDistributeArgs)
+						{
+							Expect(done.Skinning.load(), NumCharacters);
+							SpinFor(1.0f * workScale);
+							done.Culling[view].fetch_add(1);
+						}, culling[view], NumBatches, 32, &skinning);
+					TaskQueue::Execute([&, view](int)
+						{
+							Expect(done.Culling[view].load(), NumBatches);
+							SpinFor(150.0f * workScale);
+							done.Sorting.fetch_add(1);
+						}, sorting[view], &culling[view]);
+					sortDependencies[view] = &sorting[view];
+				}
+				TaskQueue::Execute([&](int)
+					{
+						Expect(done.Sorting.load(), NumViews);
+						SpinFor(200.0f * workScale);
+					}, upload, sortDependencies);
+				TaskQueue::Join(upload);
+				TaskQueue::Join(particles);
+				TaskQueue::Join(animation);
+				TaskQueue::Join(skinning);
+				for (uint32 view = 0; view < NumViews; ++view)
+				{
+					TaskQueue::Join(culling[view]);
+					TaskQueue::Join(sorting[view]);
+				}
+			};
+
+		float graphTime = 0;
+		uint32 numViolations = 0;
+		{
+			StageCounts done;
+			Utils::TimeScope timer;
+			RunGraph(1.0f, done);
+			graphTime = timer.Stop();
+			numViolations += done.NumViolations;
+		}
+
+		E_LOG(Info, "Synthetic frame on %d threads. Join per stage: %.3f ms. Dependency graph: %.3f ms", TaskQueue::ThreadCount(), serialTime * 1000.0f, graphTime * 1000.0f);
+
+		for (uint32 run = 0; run < NumValidationRuns; ++run)
+		{
+			StageCounts done;
+			RunGraph(0.0f, done);
+			numViolations += done.NumViolations;
+		}
+
+		if (numViolations > 0)
+			E_LOG(Warning, "Dependency graph: %d tasks started before their dependencies finished", numViolations);
+		else
+			E_LOG(Info, "Dependency graph: all dependencies were honored in %d runs", NumValidationRuns + 1);
+	});
+
+
+// Usage: ParallelForBenchmark
+// Sweeps item count and item cost and compares ExecuteMany with the default group size against ParallelFor
+static ConsoleCommand<> gParallelForBenchmark("ParallelForBenchmark", []()
+	{
+		auto Work = [](uint32 iterations, uint32 seed)
+			{
+				float value = (float)seed;
+				for (uint32 i = 0; i < iterations; ++i)
+					value = sqrtf(value + 1.0f);
+				return value;
+			};
+
+		for (uint32 count : { 64u, 4096u, 262144u })
+		{
+			for (uint32 cost : { 1u, 32u, 1024u, 32768u })
+			{
+				if ((uint64)count * cost > (1ull << 26))
+					continue;
+
+				std::atomic<uint32> sink = 0;
+				Utils::TimeScope executeManyTimer;
+				{
+					TaskContext context;
+					TaskQueue::ExecuteMany([&](TaskDistributeArgs args) { if (Work(cost, args.JobIndex) < 0.0f) sink++; }, context, count);
+					TaskQueue::Join(context);
+				}
+				float executeManyTime = executeManyTimer.Stop();
+
+				Utils::TimeScope parallelForTimer;
+				{
+					TaskContext context;
+					TaskQueue::ParallelFor([&](TaskDistributeArgs args) { if (Work(cost, args.JobIndex) < 0.0f) sink++; }, context, count);
+					TaskQueue::Join(context);
+				}
+				float parallelForTime = parallelForTimer.Stop();
+
+				E_LOG(Info, "%7d items, cost %5d: ExecuteMany %8.3f ms, ParallelFor %8.3f ms", count, cost, executeManyTime * 1000.0f, parallelForTime * 1000.0f);
+			}
+		}
+
+		uint64 sum = TaskQueue::ParallelReduce(1000000u, 0ull, [](uint32 i) { return (uint64)i; }, [](uint64 a, uint64 b) { return a + b; }, 256);
+		E_LOG(Info, "ParallelReduce sum of [0, 1000000): %llu (expected %llu)", sum, 1000000ull * 999999ull / 2);
+	});
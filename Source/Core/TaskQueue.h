@@ -8,10 +8,42 @@ struct TaskDistributeArgs
 	int ThreadIndex;
 };
 
+struct TaskRangeArgs
+{
+	uint32 Begin;
+	uint32 End;
+	int ThreadIndex;
+};
+
 DECLARE_DELEGATE(AsyncTaskDelegate, int);
 DECLARE_DELEGATE(AsyncDistributeDelegate, TaskDistributeArgs);
+DECLARE_DELEGATE(AsyncRangeDelegate, TaskRangeArgs);
+
+// Counter of outstanding tasks.
+// Tasks can depend on contexts and are scheduled once all of them reach zero.
+// Dependencies are resolved when the counter first reaches zero,
+// so all work of a context should be submitted before other tasks depend on it.
+class TaskContext
+{
+public:
+	TaskContext() = default;
+	~TaskContext() { gAssert(m_Counter.load() == 0, "TaskContext destroyed with outstanding tasks"); }
+
+	TaskContext(const TaskContext&) = delete;
+	TaskContext& operator=(const TaskContext&) = delete;
 
-using TaskContext = std::atomic<uint32>;
+	bool IsComplete() const { return (m_Counter.load(std::memory_order_acquire) & CounterMask) == 0; }
+
+private:
+	friend class TaskQueue;
+
+	static constexpr uint32 HasDependentsBit	= 1u << 31;
+	static constexpr uint32 CounterMask			= ~HasDependentsBit;
+
+	std::atomic<uint32>		m_Counter = 0;				///< Number of outstanding tasks. Top bit is set while dependents are waiting
+	std::atomic_flag		m_DependentsLock;			///< Protects m_pDependents
+	struct TaskDependent*	m_pDependents = nullptr;	///< Tasks waiting for this context to complete
+};
 
 class TaskQueue
 {
@@ -23,19 +55,95 @@ public:
 	template<typename Callback>
 	static void Execute(Callback&& action, TaskContext& context)
 	{
-		AddWorkItem(AsyncTaskDelegate::CreateLambda(std::forward<Callback>(action)), context);
+		AddWorkItem(AsyncTaskDelegate::CreateLambda(std::forward<Callback>(action)), context, {});
+	}
+	// Execute a task once all dependencies have completed.
+	// A task with a single dependency acts as a continuation and runs on the thread completing the dependency.
+	template<typename Callback>
+	static void Execute(Callback&& action, TaskContext& context, Span<TaskContext*> dependencies)
+	{
+		AddWorkItem(AsyncTaskDelegate::CreateLambda(std::forward<Callback>(action)), context, dependencies);
 	}
 	template<typename Callback>
 	static void ExecuteMany(Callback&& action, TaskContext& context, uint32 count, int32 groupSize = -1)
 	{
 		Distribute(context, AsyncDistributeDelegate::CreateLambda(std::forward<Callback>(action)), count, groupSize);
 	}
+	// Distribute the work once all dependencies have completed
+	template<typename Callback>
+	static void ExecuteMany(Callback&& action, TaskContext& context, uint32 count, int32 groupSize, Span<TaskContext*> dependencies)
+	{
+		AsyncDistributeDelegate distributeAction = AsyncDistributeDelegate::CreateLambda(std::forward<Callback>(action));
+		AddWorkItem(AsyncTaskDelegate::CreateLambda([distributeAction, &context, count, groupSize](int)
+			{
+				Distribute(context, distributeAction, count, groupSize);
+			}), context, dependencies);
+	}
+
+	// Execute 'action' for each item in [0, count).
+	// The range is split lazily: a worker only splits off half of its remaining range when its own queue ran dry,
+	// so the number of jobs adapts to how many workers are idle instead of a fixed group size.
+	// 'grainSize' is the minimum number of items processed without checking whether to split.
+	template<typename Callback>
+	static void ParallelFor(Callback&& action, TaskContext& context, uint32 count, uint32 grainSize = 1)
+	{
+		SplitRange(context, AsyncRangeDelegate::CreateLambda([action](TaskRangeArgs range)
+			{
+				for (uint32 i = range.Begin; i < range.End; ++i)
+					action(TaskDistributeArgs{ (int)i, range.ThreadIndex });
+			}), count, grainSize);
+	}
+
+	// Reduce all items in [0, count) using ParallelFor and wait for the result.
+	// 'map' returns the value of a single item, 'reduce' combines two values and must be associative and commutative.
+	// Every chunk of 'grainSize' items has its own partial result on its own cache line, so no thread shares one with another,
+	// and the partials are combined in order, so the result doesn't depend on which threads did the work.
+	template<typename T, typename MapFn, typename ReduceFn>
+	static T ParallelReduce(uint32 count, const T& identity, MapFn&& map, ReduceFn&& reduce, uint32 grainSize = 1)
+	{
+		struct alignas(64) Partial
+		{
+			T Value;
+		};
+
+		grainSize = Math::Max(grainSize, 1u);
+		Array<Partial> partials(Math::DivideAndRoundUp(count, grainSize), Partial{ identity });
+		TaskContext context;
+		ParallelFor([&](TaskDistributeArgs args)
+			{
+				uint32 begin = (uint32)args.JobIndex * grainSize;
+				uint32 end = Math::Min(begin + grainSize, count);
+				T value = identity;
+				for (uint32 i = begin; i < end; ++i)
+					value = reduce(value, map(i));
+				partials[args.JobIndex].Value = value;
+			}, context, (uint32)partials.size());
+		Join(context);
+
+		T result = identity;
+		for (const Partial& partial : partials)
+			result = reduce(result, partial.Value);
+		return result;
+	}
+
 	static void Join(TaskContext& context);
 	static uint32 ThreadCount();
 
+	// Keep 'context' from completing until the matching EndExternalWork().
+	// Used for work that runs outside of the task queue, like asynchronous file reads.
+	static void BeginExternalWork(TaskContext& context);
+	static void EndExternalWork(TaskContext& context);
+
 private:
 	TaskQueue();
 	static void Distribute(TaskContext& context, const AsyncDistributeDelegate& action, uint32 count, int32 groupSize = -1);
-	static void AddWorkItem(const AsyncTaskDelegate& action, TaskContext& context);
+	static void SplitRange(TaskContext& context, const AsyncRangeDelegate& action, uint32 count, uint32 grainSize);
+	static void ExecuteRange(struct RangeJob* pJob, uint32 begin, uint32 end, uint32 threadIndex);
+	static void AddWorkItem(const AsyncTaskDelegate& action, TaskContext& context, Span<TaskContext*> dependencies);
 	static void CreateThreads(uint32 count);
+
+	static bool DoWork(uint32 workerIndex);
+	static void WorkFunction(uint32 workerIndex);
+	static bool AddDependencies(AsyncTask* pTask, Span<TaskContext*> dependencies);
+	static void CompleteTask(TaskContext& context);
 };
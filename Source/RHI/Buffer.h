@@ -13,6 +13,7 @@ enum class BufferFlag : uint8
 	ByteAddress =			1 << 4,
 	AccelerationStructure = 1 << 5,
 	IndirectArguments =		1 << 6,
+	RawUnorderedAccess =	1 << 7,		///< The UAV is raw, even if the buffer is structured. Raw UAVs have no counter
 };
 DECLARE_BITMASK_TYPE(BufferFlag)
 
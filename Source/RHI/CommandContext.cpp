@@ -53,7 +53,7 @@ void CommandContext::Reset()
 		m_pCommandList->Reset(m_pAllocator, nullptr);
 	}
 
-	gAssert(m_BatchedBarriers.empty());
+	gAssert(m_BatchedBarriers.empty() && m_BatchedBufferBarriers.empty() && m_BatchedTextureBarriers.empty());
 	gAssert(m_PendingBarriers.empty());
 	m_ResourceStates.clear();
 
@@ -93,7 +93,7 @@ void CommandContext::ClearState()
 }
 
 
-void CommandContext::InsertResourceBarrier(DeviceResource* pResource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState, uint32 subResource /*= D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES*/)
+void CommandContext::InsertResourceBarrier(DeviceResource* pResource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState, uint32 subResource /*= D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES*/, D3D12_RESOURCE_BARRIER_FLAGS flags /*= D3D12_RESOURCE_BARRIER_FLAG_NONE*/)
 {
 	gAssert(!m_InRenderPass);
 	gAssert(pResource && pResource->GetResource());
@@ -101,6 +101,8 @@ void CommandContext::InsertResourceBarrier(DeviceResource* pResource, D3D12_RESO
 	gAssert(D3D::IsTransitionAllowed(m_Type, beforeState), "Before state (%s) is not valid on this commandlist type (%s)", D3D::ResourceStateToString(beforeState).c_str(), D3D::CommandlistTypeToString(m_Type));
 	gAssert(D3D::IsTransitionAllowed(m_Type, afterState), "After state (%s) is not valid on this commandlist type (%s)", D3D::ResourceStateToString(afterState).c_str(), D3D::CommandlistTypeToString(m_Type));
 
+	gAssert(flags == D3D12_RESOURCE_BARRIER_FLAG_NONE || beforeState != D3D12_RESOURCE_STATE_UNKNOWN, "Split barriers require a known before state");
+
 	if (beforeState == afterState)
 		return;
 
@@ -126,11 +128,12 @@ void CommandContext::InsertResourceBarrier(DeviceResource* pResource, D3D12_RESO
 	{
 		if (D3D::NeedsTransition(beforeState, afterState, true))
 		{
-			if (!m_BatchedBarriers.empty())
+			if (!m_BatchedBarriers.empty() && flags == D3D12_RESOURCE_BARRIER_FLAG_NONE)
 			{
 				// If the previous barrier is for the same resource, see if we can combine the barrier.
 				D3D12_RESOURCE_BARRIER& last = m_BatchedBarriers.back();
 				if (last.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION
+					&& last.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE
 					&& last.Transition.pResource == pResource->GetResource()
 					&& last.Transition.StateBefore == beforeState
 					&& D3D::CanCombineResourceState(afterState, last.Transition.StateAfter))
@@ -143,14 +146,50 @@ void CommandContext::InsertResourceBarrier(DeviceResource* pResource, D3D12_RESO
 						beforeState,
 						afterState,
 						subResource,
-						D3D12_RESOURCE_BARRIER_FLAG_NONE)
+						flags)
 			);
 
-			localResourceState.Set(afterState, subResource);
+			// The resource stays in the before state until the split barrier ends
+			if (flags != D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+				localResourceState.Set(afterState, subResource);
 		}
 	}
 }
 
+void CommandContext::InsertEnhancedBarrier(DeviceResource* pResource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_BARRIER_FLAGS flags /*= D3D12_RESOURCE_BARRIER_FLAG_NONE*/)
+{
+	gAssert(!m_InRenderPass);
+	gAssert(pResource && pResource->GetResource());
+	gAssert(beforeState != D3D12_RESOURCE_STATE_UNKNOWN, "Enhanced barriers require a known before state");
+	gAssert(D3D::IsTransitionAllowed(m_Type, beforeState), "Before state (%s) is not valid on this commandlist type (%s)", D3D::ResourceStateToString(beforeState).c_str(), D3D::CommandlistTypeToString(m_Type));
+	gAssert(D3D::IsTransitionAllowed(m_Type, afterState), "After state (%s) is not valid on this commandlist type (%s)", D3D::ResourceStateToString(afterState).c_str(), D3D::CommandlistTypeToString(m_Type));
+
+	ResourceState& localResourceState = m_ResourceStates[pResource];
+	D3D12_RESOURCE_STATES localBeforeState = localResourceState.Get(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+	gAssert(localBeforeState == D3D12_RESOURCE_STATE_UNKNOWN || localBeforeState == beforeState, "Provided before state %s of resource %s does not match with tracked resource state %s",
+		D3D::ResourceStateToString(beforeState), pResource->GetName(), D3D::ResourceStateToString(localBeforeState));
+
+	if (!D3D::NeedsTransition(beforeState, afterState, true))
+		return;
+
+	// Split barriers synchronize with SYNC_SPLIT instead of the work on the other side of the split
+	const D3D12_BARRIER_SYNC syncBefore = flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY ? D3D12_BARRIER_SYNC_SPLIT : D3D::GetBarrierSync(beforeState);
+	const D3D12_BARRIER_SYNC syncAfter	= flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY ? D3D12_BARRIER_SYNC_SPLIT : D3D::GetBarrierSync(afterState);
+
+	if (pResource->GetResource()->GetDesc().Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+	{
+		m_BatchedBufferBarriers.push_back(CD3DX12_BUFFER_BARRIER(syncBefore, syncAfter, D3D::GetBarrierAccess(beforeState), D3D::GetBarrierAccess(afterState), pResource->GetResource()));
+	}
+	else
+	{
+		m_BatchedTextureBarriers.push_back(CD3DX12_TEXTURE_BARRIER(syncBefore, syncAfter, D3D::GetBarrierAccess(beforeState), D3D::GetBarrierAccess(afterState),
+			D3D::GetBarrierLayout(beforeState), D3D::GetBarrierLayout(afterState), pResource->GetResource(), CD3DX12_BARRIER_SUBRESOURCE_RANGE(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)));
+	}
+
+	if (flags != D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+		localResourceState.Set(afterState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+}
+
 void CommandContext::InsertAliasingBarrier(const DeviceResource* pResource)
 {
 	AddBarrier(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, pResource->GetResource()));
@@ -168,6 +207,20 @@ void CommandContext::FlushResourceBarriers()
 		m_pCommandList->ResourceBarrier((UINT)m_BatchedBarriers.size(), m_BatchedBarriers.data());
 		m_BatchedBarriers.clear();
 	}
+
+	// Enhanced barriers are recorded after the legacy barriers, so transitions still come after the aliasing barriers of the same batch
+	if (!m_BatchedBufferBarriers.empty() || !m_BatchedTextureBarriers.empty())
+	{
+		StaticArray<D3D12_BARRIER_GROUP, 2> groups;
+		uint32 numGroups = 0;
+		if (!m_BatchedBufferBarriers.empty())
+			groups[numGroups++] = CD3DX12_BARRIER_GROUP((UINT32)m_BatchedBufferBarriers.size(), m_BatchedBufferBarriers.data());
+		if (!m_BatchedTextureBarriers.empty())
+			groups[numGroups++] = CD3DX12_BARRIER_GROUP((UINT32)m_BatchedTextureBarriers.size(), m_BatchedTextureBarriers.data());
+		m_pCommandList->Barrier(numGroups, groups.data());
+		m_BatchedBufferBarriers.clear();
+		m_BatchedTextureBarriers.clear();
+	}
 }
 
 void CommandContext::CopyResource(const DeviceResource* pSource, const DeviceResource* pTarget)
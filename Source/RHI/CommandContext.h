@@ -107,7 +107,10 @@ public:
 	void Free(const SyncPoint& syncPoint);
 	void ClearState();
 
-	void InsertResourceBarrier(DeviceResource* pResource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState, uint32 subResource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+	// A split barrier (BEGIN_ONLY/END_ONLY) requires a known before state. The resource may not be used between the begin and the end.
+	void InsertResourceBarrier(DeviceResource* pResource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState, uint32 subResource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	// Same as InsertResourceBarrier() for all subresources, but records an enhanced barrier. Requires GraphicsCapabilities::SupportsEnhancedBarriers()
+	void InsertEnhancedBarrier(DeviceResource* pResource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
 	void InsertAliasingBarrier(const DeviceResource* pResource);
 	void InsertUAVBarrier(const DeviceResource* pResource = nullptr);
 	void FlushResourceBarriers();
@@ -216,6 +219,8 @@ private:
 	Ref<ID3D12DescriptorHeap>									m_pDSVHeap;
 
 	Array<D3D12_RESOURCE_BARRIER>								m_BatchedBarriers;
+	Array<D3D12_BUFFER_BARRIER>									m_BatchedBufferBarriers;
+	Array<D3D12_TEXTURE_BARRIER>								m_BatchedTextureBarriers;
 	Array<PendingBarrier>										m_PendingBarriers;
 	HashMap<const DeviceResource*, ResourceState>				m_ResourceStates;
 
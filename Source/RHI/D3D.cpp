@@ -166,6 +166,97 @@ String BarrierToString(const D3D12_RESOURCE_BARRIER& barrier)
 	return "[Invalid]";
 }
 
+D3D12_BARRIER_SYNC GetBarrierSync(D3D12_RESOURCE_STATES state)
+{
+	if (state == D3D12_RESOURCE_STATE_COMMON)
+		return D3D12_BARRIER_SYNC_ALL;
+
+	D3D12_BARRIER_SYNC sync = D3D12_BARRIER_SYNC_NONE;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
+		sync |= D3D12_BARRIER_SYNC_ALL_SHADING;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_INDEX_BUFFER))
+		sync |= D3D12_BARRIER_SYNC_INDEX_INPUT;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RENDER_TARGET))
+		sync |= D3D12_BARRIER_SYNC_RENDER_TARGET;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_DEPTH_WRITE | D3D12_RESOURCE_STATE_DEPTH_READ))
+		sync |= D3D12_BARRIER_SYNC_DEPTH_STENCIL;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE))
+		sync |= D3D12_BARRIER_SYNC_NON_PIXEL_SHADING;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE))
+		sync |= D3D12_BARRIER_SYNC_PIXEL_SHADING;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT))
+		sync |= D3D12_BARRIER_SYNC_EXECUTE_INDIRECT;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE))
+		sync |= D3D12_BARRIER_SYNC_COPY;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RESOLVE_DEST | D3D12_RESOURCE_STATE_RESOLVE_SOURCE))
+		sync |= D3D12_BARRIER_SYNC_RESOLVE;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE))
+		sync |= D3D12_BARRIER_SYNC_ALL_SHADING | D3D12_BARRIER_SYNC_BUILD_RAYTRACING_ACCELERATION_STRUCTURE;
+	return sync == D3D12_BARRIER_SYNC_NONE ? D3D12_BARRIER_SYNC_ALL : sync;
+}
+
+D3D12_BARRIER_ACCESS GetBarrierAccess(D3D12_RESOURCE_STATES state)
+{
+	if (state == D3D12_RESOURCE_STATE_COMMON)
+		return D3D12_BARRIER_ACCESS_COMMON;
+
+	D3D12_BARRIER_ACCESS access = D3D12_BARRIER_ACCESS_COMMON;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER))
+		access |= D3D12_BARRIER_ACCESS_VERTEX_BUFFER | D3D12_BARRIER_ACCESS_CONSTANT_BUFFER;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_INDEX_BUFFER))
+		access |= D3D12_BARRIER_ACCESS_INDEX_BUFFER;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RENDER_TARGET))
+		access |= D3D12_BARRIER_ACCESS_RENDER_TARGET;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
+		access |= D3D12_BARRIER_ACCESS_UNORDERED_ACCESS;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_DEPTH_WRITE))
+		access |= D3D12_BARRIER_ACCESS_DEPTH_STENCIL_WRITE;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_DEPTH_READ))
+		access |= D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE))
+		access |= D3D12_BARRIER_ACCESS_SHADER_RESOURCE;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT))
+		access |= D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_COPY_DEST))
+		access |= D3D12_BARRIER_ACCESS_COPY_DEST;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_COPY_SOURCE))
+		access |= D3D12_BARRIER_ACCESS_COPY_SOURCE;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RESOLVE_DEST))
+		access |= D3D12_BARRIER_ACCESS_RESOLVE_DEST;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RESOLVE_SOURCE))
+		access |= D3D12_BARRIER_ACCESS_RESOLVE_SOURCE;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE))
+		access |= D3D12_BARRIER_ACCESS_RAYTRACING_ACCELERATION_STRUCTURE_READ;
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE))
+		access |= D3D12_BARRIER_ACCESS_SHADING_RATE_SOURCE;
+	return access;
+}
+
+D3D12_BARRIER_LAYOUT GetBarrierLayout(D3D12_RESOURCE_STATES state)
+{
+	switch (state)
+	{
+	case D3D12_RESOURCE_STATE_COMMON:					return D3D12_BARRIER_LAYOUT_COMMON;
+	case D3D12_RESOURCE_STATE_RENDER_TARGET:			return D3D12_BARRIER_LAYOUT_RENDER_TARGET;
+	case D3D12_RESOURCE_STATE_UNORDERED_ACCESS:			return D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS;
+	case D3D12_RESOURCE_STATE_DEPTH_WRITE:				return D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_WRITE;
+	case D3D12_RESOURCE_STATE_COPY_DEST:				return D3D12_BARRIER_LAYOUT_COPY_DEST;
+	case D3D12_RESOURCE_STATE_COPY_SOURCE:				return D3D12_BARRIER_LAYOUT_COPY_SOURCE;
+	case D3D12_RESOURCE_STATE_RESOLVE_DEST:				return D3D12_BARRIER_LAYOUT_RESOLVE_DEST;
+	case D3D12_RESOURCE_STATE_RESOLVE_SOURCE:			return D3D12_BARRIER_LAYOUT_RESOLVE_SOURCE;
+	case D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE:		return D3D12_BARRIER_LAYOUT_SHADING_RATE_SOURCE;
+	default:
+		break;
+	}
+
+	// Combined read states
+	if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_DEPTH_READ))
+		return D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ;
+	if ((state & D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE) == state)
+		return D3D12_BARRIER_LAYOUT_SHADER_RESOURCE;
+	return D3D12_BARRIER_LAYOUT_GENERIC_READ;
+}
+
 void GetResourceAllocationInfo(ID3D12Device* pDevice, const D3D12_RESOURCE_DESC& resourceDesc, uint64& outSize, uint64& outAlignment)
 {
 	if (resourceDesc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
@@ -116,6 +116,11 @@ static constexpr bool NeedsTransition(D3D12_RESOURCE_STATES before, D3D12_RESOUR
 	return true;
 }
 
+// Translate a legacy resource state to its enhanced barrier equivalent
+D3D12_BARRIER_SYNC GetBarrierSync(D3D12_RESOURCE_STATES state);
+D3D12_BARRIER_ACCESS GetBarrierAccess(D3D12_RESOURCE_STATES state);
+D3D12_BARRIER_LAYOUT GetBarrierLayout(D3D12_RESOURCE_STATES state);
+
 void SetObjectName(ID3D12Object* pObject, const char* pName);
 
 String GetObjectName(ID3D12Object* pObject);
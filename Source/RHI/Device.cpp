@@ -744,7 +744,8 @@ Ref<Buffer> GraphicsDevice::CreateBuffer(const BufferDesc& desc, ID3D12Heap* pHe
 	}
 
 	bool isRaw = EnumHasAnyFlags(desc.Flags, BufferFlag::ByteAddress);
-	bool withCounter = !isRaw && desc.Format == ResourceFormat::Unknown;
+	bool isRawUAV = isRaw || EnumHasAnyFlags(desc.Flags, BufferFlag::RawUnorderedAccess);
+	bool withCounter = !isRawUAV && desc.Format == ResourceFormat::Unknown;
 
 	//#todo: Temp code. Pull out views from buffer
 	if (EnumHasAnyFlags(desc.Flags, BufferFlag::ShaderResource | BufferFlag::AccelerationStructure))
@@ -753,7 +754,7 @@ Ref<Buffer> GraphicsDevice::CreateBuffer(const BufferDesc& desc, ID3D12Heap* pHe
 	}
 	if (EnumHasAnyFlags(desc.Flags, BufferFlag::UnorderedAccess))
 	{
-		pBuffer->m_UAV = CreateUAV(pBuffer, BufferUAVDesc(desc.Format, isRaw, withCounter));
+		pBuffer->m_UAV = CreateUAV(pBuffer, BufferUAVDesc(desc.Format, isRawUAV, withCounter));
 		pBuffer->m_pResourceState = std::make_unique<ResourceState>();
 	}
 
@@ -48,9 +48,19 @@ public:
 	}
 	D3D12_RESOURCE_STATES Get(uint32 subResource) const
 	{
-		gAssert(m_AllSameState || subResource < (uint32)m_ResourceStates.size());
 		if (m_AllSameState)
 			return m_ResourceStates[0];
+		if (subResource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+		{
+			// Only known if the subresources that were transitioned separately ended up in the same state again
+			for (D3D12_RESOURCE_STATES state : m_ResourceStates)
+			{
+				if (state != m_ResourceStates[0])
+					return D3D12_RESOURCE_STATE_UNKNOWN;
+			}
+			return m_ResourceStates[0];
+		}
+		gAssert(subResource < (uint32)m_ResourceStates.size());
 		return m_ResourceStates[subResource];
 	}
 
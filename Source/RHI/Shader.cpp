@@ -119,8 +119,9 @@ namespace ShaderCompiler
 		if (!TestFileTime(shaderFullPath.c_str()))
 			return false;
 
-		FileStream fs;
-		fs.Open(pCachePath, FileMode::Read);
+		MappedFileStream fs;
+		if (!fs.Open(pCachePath))
+			return false;
 		uint32 version = 0;
 		fs >> version;
 		if (version != CompileResult::Version)
@@ -142,10 +143,11 @@ namespace ShaderCompiler
 		uint32 size;
 		fs >> size;
 
-		char* pData = new char[size];
-		fs.Read(pData, size);
-		pUtils->CreateBlob(pData, size, DXC_CP_ACP, (IDxcBlobEncoding**)result.pBlob.GetAddressOf());
-		delete[] pData;
+		// Create the blob straight from the mapped cache file
+		Span<const uint8> data = fs.ReadView(size);
+		if (data.GetSize() != size)
+			return false;
+		pUtils->CreateBlob(data.GetData(), size, DXC_CP_ACP, (IDxcBlobEncoding**)result.pBlob.GetAddressOf());
 
 		return true;
 	}
@@ -169,7 +171,7 @@ namespace ShaderCompiler
 		return true;
 	}
 
-	static String CustomPreprocess(const char* pFileName, const String& input)
+	static String CustomPreprocess(const char* pFileName, StringView input)
 	{
 		// Search for `TEXT("Foo")` and gather all characters in a const int array
 		// static const int cStringArray_2430948[] = { 'F', 'o', 'o' };
@@ -225,7 +227,7 @@ namespace ShaderCompiler
 		}
 
 		if (stringOffset == 0)
-			return input;
+			return String(input);
 
 		// Prepend shader content with string array
 		output = Sprintf("static const uint %s[] = { %s };\n", stringArrayName, stringArrayText) + output;
@@ -256,13 +258,11 @@ namespace ShaderCompiler
 			}
 		}
 
-		FileStream stream;
-		if(stream.Open(pFileName, FileMode::Read))
+		MappedFileStream stream;
+		if(stream.Open(pFileName))
 		{
-			// +1 null terminator
-			Array<char> charBuffer(stream.GetLength() + 1);
-			stream.Read(charBuffer.data(), (uint32)charBuffer.size());
-			String buffer = CustomPreprocess(pFileName, charBuffer.data());
+			StringView source((const char*)stream.GetData(), stream.GetLength());
+			String buffer = CustomPreprocess(pFileName, source);
 
 			CachedFile file;
 			file.Timestamp = fileTime;
@@ -1,15 +1,28 @@
 #include "stdafx.h"
 #include "RenderGraph.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
 #include "Core/Profiler.h"
 #include "Core/TaskQueue.h"
+#include "Core/Utils.h"
 #include "RHI/Device.h"
 #include "RHI/CommandContext.h"
 #include "RHI/CommandQueue.h"
 #include "RenderGraph/RenderGraphAllocator.h"
 
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
 #define RG_TRACK_RESOURCE_EVENTS 0
 #define RG_BREAK_ON_TRANSITION 0
 
+static bool sRecordNextGraph = false;
+
+// Usage: RGRecordGraph
+// Saves the structure of the next graph to Saved/Profiling/, to compare pass orders with RGBenchmarkReorder
+static ConsoleCommand<> gRecordRGGraph("RGRecordGraph", []() { sRecordNextGraph = true; });
+
 #if RG_BREAK_ON_TRANSITION
 #define TRANSITION_BREAK __debugbreak()
 #else
@@ -39,6 +52,190 @@ static bool sDoLogTransition(const RGPass* pPass, const RGResource* pResource)
 #define RG_LOG_RESOURCE_EVENT(fmt, ...) do { UNUSED_VAR(pResource); UNUSED_VAR(pPass); } while (0)
 #endif
 
+// Resource state of each access flag
+static constexpr std::pair<RGAccess, D3D12_RESOURCE_STATES> sAccessStates[] = {
+	{ RGAccess::VertexConstantBuffer,	D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER },
+	{ RGAccess::IndexBuffer,			D3D12_RESOURCE_STATE_INDEX_BUFFER },
+	{ RGAccess::RenderTarget,			D3D12_RESOURCE_STATE_RENDER_TARGET },
+	{ RGAccess::UnorderedAccess,		D3D12_RESOURCE_STATE_UNORDERED_ACCESS },
+	{ RGAccess::DepthWrite,				D3D12_RESOURCE_STATE_DEPTH_WRITE },
+	{ RGAccess::DepthRead,				D3D12_RESOURCE_STATE_DEPTH_READ },
+	{ RGAccess::NonPixelShaderRead,		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE },
+	{ RGAccess::PixelShaderRead,		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE },
+	{ RGAccess::IndirectArgs,			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT },
+	{ RGAccess::CopyDest,				D3D12_RESOURCE_STATE_COPY_DEST },
+	{ RGAccess::CopySource,				D3D12_RESOURCE_STATE_COPY_SOURCE },
+	{ RGAccess::ResolveDest,			D3D12_RESOURCE_STATE_RESOLVE_DEST },
+	{ RGAccess::ResolveSource,			D3D12_RESOURCE_STATE_RESOLVE_SOURCE },
+	{ RGAccess::AccelerationStructure,	D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE },
+	{ RGAccess::ShadingRateSource,		D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE },
+};
+
+static D3D12_RESOURCE_STATES ToD3DState(RGAccess access)
+{
+	if (access == RGAccess::Unknown)
+		return D3D12_RESOURCE_STATE_UNKNOWN;
+
+	D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+	for (const auto& [flag, flagState] : sAccessStates)
+	{
+		if (EnumHasAllFlags(access, flag))
+			state |= flagState;
+	}
+	return state;
+}
+
+static RGAccess FromD3DState(D3D12_RESOURCE_STATES state)
+{
+	if (state == D3D12_RESOURCE_STATE_UNKNOWN)
+		return RGAccess::Unknown;
+
+	RGAccess access = RGAccess::Common;
+	for (const auto& [flag, flagState] : sAccessStates)
+	{
+		if (EnumHasAllFlags(state, flagState))
+			access |= flag;
+	}
+	gAssert(ToD3DState(access) == state, "Resource state %s can't be used by the render graph", D3D::ResourceStateToString(state).c_str());
+	return access;
+}
+
+static_assert(RGCoreGraph::AllSubresources == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+
+// Number of mips and array slices of which the render graph tracks the state separately.
+// Buffers, depth-stencil textures and textures with more subresources than a DeviceResource can track are tracked as a whole
+static void GetTrackedSubresources(const RGResource* pResource, uint32& outNumMips, uint32& outNumSlices)
+{
+	outNumMips	 = 1;
+	outNumSlices = 1;
+	if (pResource->GetType() != RGResourceType::Texture)
+		return;
+
+	const TextureDesc& desc = static_cast<const RGTexture*>(pResource)->GetDesc();
+	const FormatInfo& formatInfo = RHI::GetFormatInfo(desc.Format);
+	if (formatInfo.IsDepth || formatInfo.IsStencil)
+		return;
+
+	uint32 numSlices = desc.ArraySize;
+	if (desc.Type == TextureType::TextureCube || desc.Type == TextureType::TextureCubeArray)
+		numSlices *= 6;
+	else if (desc.Type == TextureType::Texture3D)
+		numSlices = 1;
+
+	if (desc.Mips * numSlices > D3D12_REQ_MIP_LEVELS)
+		return;
+
+	outNumMips	 = desc.Mips;
+	outNumSlices = numSlices;
+}
+
+static uint32 GetNumTrackedSubresources(const RGResource* pResource)
+{
+	uint32 numMips, numSlices;
+	GetTrackedSubresources(pResource, numMips, numSlices);
+	return numMips * numSlices;
+}
+
+// State of each tracked subresource of a physical resource, or a single state if they are all in the same state.
+// UNKNOWN if the resource is not tracked
+static void GetSubresourceStates(const DeviceResource* pPhysical, uint32 numSubresources, Array<D3D12_RESOURCE_STATES>& outStates)
+{
+	outStates.clear();
+	if (!pPhysical->UseStateTracking())
+	{
+		outStates.push_back(D3D12_RESOURCE_STATE_UNKNOWN);
+		return;
+	}
+	if (numSubresources == 1)
+	{
+		outStates.push_back(pPhysical->GetResourceState(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES));
+		return;
+	}
+
+	for (uint32 subresource = 0; subresource < numSubresources; ++subresource)
+		outStates.push_back(pPhysical->GetResourceState(subresource));
+	if (std::all_of(outStates.begin(), outStates.end(), [&](D3D12_RESOURCE_STATES state) { return state == outStates[0]; }))
+		outStates.resize(1);
+}
+
+static void SetSubresourceStates(DeviceResource* pPhysical, Span<const D3D12_RESOURCE_STATES> states)
+{
+	if (states.GetSize() == 1)
+	{
+		pPhysical->SetResourceState(states[0], D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+		return;
+	}
+	for (uint32 subresource = 0; subresource < states.GetSize(); ++subresource)
+		pPhysical->SetResourceState(states[subresource], subresource);
+}
+
+// Backs the core graph with the device resources of the render graph allocator
+class RGDevicePhysicalResources : public IRGPhysicalResources
+{
+public:
+	RGDevicePhysicalResources(Span<RGResource*> resources, Array<Array<D3D12_RESOURCE_STATES>>* pInitialStates)
+		: m_Resources(resources), m_pInitialStates(pInitialStates)
+	{}
+
+	virtual void Allocate(const RGCoreGraph& graph) override
+	{
+		// Apply lifetimes and usage flags
+		for (RGResource* pResource : m_Resources)
+		{
+			const RGCoreGraph::Resource& resource = graph.Resources[pResource->ID.GetIndex()];
+			pResource->IsAccessed  = resource.IsAccessed;
+			pResource->FirstAccess = resource.FirstAccess != RGCoreGraph::InvalidIndex ? RGPassID((uint16)resource.FirstAccess) : RGPassID();
+			pResource->LastAccess  = resource.LastAccess != RGCoreGraph::InvalidIndex ? RGPassID((uint16)resource.LastAccess) : RGPassID();
+
+			if (pResource->GetType() == RGResourceType::Buffer)
+			{
+				BufferDesc& desc = static_cast<RGBuffer*>(pResource)->Desc;
+				if (EnumHasAnyFlags(resource.Usage, RGAccess::UnorderedAccess))
+					desc.Flags |= BufferFlag::UnorderedAccess;
+				if (EnumHasAnyFlags(resource.Usage, RGAccess::ShaderRead))
+					desc.Flags |= BufferFlag::ShaderResource;
+			}
+			else if (pResource->GetType() == RGResourceType::Texture)
+			{
+				TextureDesc& desc = static_cast<RGTexture*>(pResource)->Desc;
+				if (EnumHasAnyFlags(resource.Usage, RGAccess::UnorderedAccess))
+					desc.Flags |= TextureFlag::UnorderedAccess;
+				if (EnumHasAnyFlags(resource.Usage, RGAccess::ShaderRead))
+					desc.Flags |= TextureFlag::ShaderResource;
+				if (EnumHasAnyFlags(resource.Usage, RGAccess::DepthRead | RGAccess::DepthWrite))
+					desc.Flags |= TextureFlag::DepthStencil;
+				if (EnumHasAnyFlags(resource.Usage, RGAccess::RenderTarget))
+					desc.Flags |= TextureFlag::RenderTarget;
+			}
+		}
+
+		gRenderGraphAllocator.AllocateResources(m_Resources);
+
+		if (m_pInitialStates)
+		{
+			m_pInitialStates->resize(m_Resources.GetSize());
+			for (const RGResource* pResource : m_Resources)
+			{
+				Array<D3D12_RESOURCE_STATES>& states = (*m_pInitialStates)[pResource->ID.GetIndex()];
+				if (pResource->IsAccessed)
+					GetSubresourceStates(pResource->GetPhysicalUnsafe(), RGCore::GetNumSubresources(graph.Resources[pResource->ID.GetIndex()]), states);
+				else
+					states = { D3D12_RESOURCE_STATE_UNKNOWN };
+			}
+		}
+	}
+
+	virtual uint64 GetPhysical(uint32 resource) const override				{ return (uint64)m_Resources[resource]->GetPhysicalUnsafe(); }
+	virtual bool IsTracked(uint32 resource) const override					{ return m_Resources[resource]->GetPhysicalUnsafe()->UseStateTracking(); }
+	virtual RGAccess GetState(uint32 resource, uint32 subresource) const override		{ return FromD3DState(m_Resources[resource]->GetPhysicalUnsafe()->GetResourceState(subresource)); }
+	virtual void SetState(uint32 resource, uint32 subresource, RGAccess state) override	{ m_Resources[resource]->GetPhysicalUnsafe()->SetResourceState(ToD3DState(state), subresource); }
+
+private:
+	Span<RGResource*>						m_Resources;
+	Array<Array<D3D12_RESOURCE_STATES>>*	m_pInitialStates;
+};
+
+
 RGPass& RGPass::Read(Span<RGResource*> resources)
 {
 	D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE;
@@ -74,6 +271,20 @@ RGPass& RGPass::Write(Span<RGResource*> resources)
 	return *this;
 }
 
+RGPass& RGPass::Read(const RGTextureSubresources& subresources)
+{
+	gAssert(subresources.Range.FirstMip < subresources.pTexture->GetDesc().Mips, "Mip %d of '%s' is out of range", subresources.Range.FirstMip, subresources.pTexture->GetName());
+	AddAccess(subresources.pTexture, EnumHasAnyFlags(Flags, RGPassFlag::Copy) ? D3D12_RESOURCE_STATE_COPY_SOURCE : D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, subresources.Range);
+	return *this;
+}
+
+RGPass& RGPass::Write(const RGTextureSubresources& subresources)
+{
+	gAssert(subresources.Range.FirstMip < subresources.pTexture->GetDesc().Mips, "Mip %d of '%s' is out of range", subresources.Range.FirstMip, subresources.pTexture->GetName());
+	AddAccess(subresources.pTexture, EnumHasAnyFlags(Flags, RGPassFlag::Copy) ? D3D12_RESOURCE_STATE_COPY_DEST : D3D12_RESOURCE_STATE_UNORDERED_ACCESS, subresources.Range);
+	return *this;
+}
+
 RGPass& RGPass::RenderTarget(RGTexture* pResource, RenderPassColorFlags flags, RGTexture* pResolveTarget)
 {
 	gAssert(EnumHasAllFlags(Flags, RGPassFlag::Raster));
@@ -94,12 +305,21 @@ RGPass& RGPass::DepthStencil(RGTexture* pResource, RenderPassDepthFlags flags)
 	return *this;
 }
 
-void RGPass::AddAccess(RGResource* pResource, D3D12_RESOURCE_STATES state)
+void RGPass::AddAccess(RGResource* pResource, D3D12_RESOURCE_STATES state, const RGSubresourceRange& range)
 {
 	gAssert(pResource);
-	auto it = std::find_if(Accesses.begin(), Accesses.end(), [=](const ResourceAccess& access) { return pResource == access.pResource; });
+
+	uint32 numMips, numSlices;
+	GetTrackedSubresources(pResource, numMips, numSlices);
+	gAssert(range.IsWhole() || pResource->GetType() == RGResourceType::Texture, "Only textures can be accessed partially ('%s')", pResource->GetName());
+
+	// Resources that are tracked as a whole are always accessed as a whole
+	RGSubresourceRange accessRange = numMips * numSlices > 1 ? range : RGSubresourceRange();
+
+	auto it = std::find_if(Accesses.begin(), Accesses.end(), [&](const ResourceAccess& access) { return pResource == access.pResource && access.Range.Overlaps(accessRange); });
 	if (it != Accesses.end())
 	{
+		gAssert(it->Range == accessRange, "Resource '%s' is accessed with overlapping subresource ranges", pResource->GetName());
 		if (EnumHasAllFlags(it->Access, state))
 			return;
 
@@ -109,12 +329,108 @@ void RGPass::AddAccess(RGResource* pResource, D3D12_RESOURCE_STATES state)
 	}
 	else
 	{
-		Accesses.push_back({ pResource, state });
+		Accesses.push_back({ pResource, state, accessRange });
+	}
+}
+
+// Chunks of graph allocators that were destroyed, to be reused by the next graph
+struct RGChunkPool
+{
+	static constexpr uint64 cMaxSize = 64 * Math::MegaBytesToBytes;	///< Chunks beyond this size are released to the system
+
+	~RGChunkPool()
+	{
+		while (pChunks)
+		{
+			RGGraphAllocator::Chunk* pChunk = pChunks;
+			pChunks = pChunk->pNext;
+			delete[] (char*)pChunk;
+		}
+	}
+
+	std::mutex					Lock;
+	RGGraphAllocator::Chunk*	pChunks				= nullptr;
+	uint64						Size				= 0;
+	uint64						NumChunkAllocations = 0;
+};
+static RGChunkPool sChunkPool;
+
+RGGraphAllocator::RGGraphAllocator(uint64 chunkSize)
+	: m_ChunkSize(chunkSize)
+{
+}
+
+RGGraphAllocator::~RGGraphAllocator()
+{
+	for (AllocatedObject* pObject = m_pNonPODAllocations; pObject;)
+	{
+		AllocatedObject* pNext = pObject->pNext;
+		pObject->~AllocatedObject();
+		pObject = pNext;
+	}
+
+	std::lock_guard lock(sChunkPool.Lock);
+	while (m_pChunks)
+	{
+		Chunk* pChunk = m_pChunks;
+		m_pChunks = pChunk->pNext;
+		if (sChunkPool.Size + pChunk->Size <= RGChunkPool::cMaxSize)
+		{
+			pChunk->pNext = sChunkPool.pChunks;
+			sChunkPool.pChunks = pChunk;
+			sChunkPool.Size += pChunk->Size;
+		}
+		else
+		{
+			delete[] (char*)pChunk;
+		}
+	}
+}
+
+void RGGraphAllocator::AddChunk(uint64 minSize)
+{
+	uint64 size = Math::Max(m_ChunkSize, minSize + sizeof(Chunk));
+
+	Chunk* pChunk = nullptr;
+	{
+		std::lock_guard lock(sChunkPool.Lock);
+		for (Chunk** ppChunk = &sChunkPool.pChunks; *ppChunk; ppChunk = &(*ppChunk)->pNext)
+		{
+			if ((*ppChunk)->Size >= size)
+			{
+				pChunk = *ppChunk;
+				*ppChunk = pChunk->pNext;
+				sChunkPool.Size -= pChunk->Size;
+				break;
+			}
+		}
+		if (!pChunk)
+			++sChunkPool.NumChunkAllocations;
+	}
+
+	if (!pChunk)
+	{
+		pChunk = (Chunk*)new char[size];
+		pChunk->Size = size;
 	}
+
+	pChunk->pNext = m_pChunks;
+	m_pChunks	  = pChunk;
+	m_pCurrent	  = (char*)pChunk + sizeof(Chunk);
+	m_pEnd		  = (char*)pChunk + pChunk->Size;
+	m_Capacity	 += pChunk->Size;
 }
 
-RGGraph::RGGraph(uint64 allocatorSize /*= 0xFFFF*/)
-	: m_Allocator(allocatorSize)
+uint64 RGGraphAllocator::GetNumChunkAllocations()
+{
+	std::lock_guard lock(sChunkPool.Lock);
+	return sChunkPool.NumChunkAllocations;
+}
+
+RGGraph::RGGraph(uint64 allocatorChunkSize)
+	: m_Allocator(allocatorChunkSize),
+	m_PendingEvents(m_Allocator), m_Events(m_Allocator), m_PassExecuteGroups(m_Allocator), m_ScheduledPasses(m_Allocator), m_EntryTransitions(m_Allocator),
+	m_Passes(m_Allocator), m_Resources(m_Allocator), m_ExportTextures(m_Allocator), m_ExportBuffers(m_Allocator), m_Histories(m_Allocator)
 {
 }
 
@@ -131,292 +447,601 @@ void RGGraph::Compile(const RGGraphOptions& options)
 
 	m_Options = options;
 
-	if (options.PassCulling)
+	// Identify passes in the cost history by name. Passes with the same name are told apart by their order
+	if (options.pPassCosts)
 	{
-		PROFILE_CPU_SCOPE("Pass Culling");
-
-		Array<RGPassID> cullStack;
-		cullStack.reserve(m_Passes.size());
-
+		HashMap<uint64, uint32> nameCounts;
 		for (RGPass* pPass : m_Passes)
 		{
-			for (const RGPass::ResourceAccess& access : pPass->Accesses)
-			{
-				// Add a pass dependency to the last pass that wrote to this resource
-				if (access.pResource->LastWrite.IsValid())
-				{
-					if (std::find_if(pPass->PassDependencies.begin(), pPass->PassDependencies.end(), [&](RGPassID id) { return access.pResource->LastWrite == id; }) == pPass->PassDependencies.end())
-						pPass->PassDependencies.push_back(access.pResource->LastWrite);
-				}
-
-				// If the resource is written to in this pass, update the LastWrite pass
-				if (D3D::HasWriteResourceState(access.Access))
-					access.pResource->LastWrite = pPass->ID;
-			}
-
-			// If pass is marked for never cull, immediately add it to the stack
-			if (EnumHasAllFlags(pPass->Flags, RGPassFlag::NeverCull))
-				cullStack.push_back(pPass->ID);
-		}
-
-		for (RGResource* pResource : m_Resources)
-		{
-			if (pResource->LastWrite.IsValid() && (pResource->IsExported || pResource->IsImported))
-				cullStack.push_back(pResource->LastWrite);
+			uint64 nameHash	  = gHash(pPass->GetName(), strlen(pPass->GetName()));
+			uint32 occurrence = nameCounts[nameHash]++;
+			pPass->CostKey	  = gHashCombine(nameHash, gHash(&occurrence, sizeof(occurrence)));
 		}
+	}
 
-		while (!cullStack.empty())
+	// Skip compilation if an earlier graph had the same structure
+	uint64 cacheHash = 0;
+	Array<uint32> cacheKey;
+	if (options.pCompileCache)
+	{
+		GetCacheKey(cacheKey);
+		cacheHash = gHash(cacheKey.data(), cacheKey.size() * sizeof(uint32));
+		// A recording needs the core graph, which is only built on a full compile
+		if (!sRecordNextGraph && CompileFromCache(*options.pCompileCache, cacheHash, cacheKey))
 		{
-			RGPassID pass = cullStack.back();
-			cullStack.pop_back();
-
-			RGPass* pPass = m_Passes[pass.GetIndex()];
-			if (pPass->IsCulled)
-			{
-				cullStack.insert(cullStack.end(), pPass->PassDependencies.begin(), pPass->PassDependencies.end());
-				pPass->IsCulled = false;
-			}
+			m_IsCompiled = true;
+			return;
 		}
 	}
-	else
-	{
-		for (RGPass* pPass : m_Passes)
-			pPass->IsCulled = false;
-	}
 
+	RGCoreGraph coreGraph;
 	{
-		PROFILE_CPU_SCOPE("Compute Resource Usage");
-
-		RGPassID firstPass(0xFFFF);
-		RGPassID lastPass(0);
+		PROFILE_CPU_SCOPE("Build Core Graph");
 
-		// Tell the resources when they're first/last accessed and apply usage flags
+		coreGraph.Passes.resize(m_Passes.size());
 		for (const RGPass* pPass : m_Passes)
 		{
-			if (pPass->IsCulled)
-				continue;
-
-			firstPass = pPass->ID.GetIndex() < firstPass.GetIndex() ? pPass->ID : firstPass;
-			lastPass  = pPass->ID.GetIndex() > lastPass.GetIndex() ? pPass->ID : lastPass;
-
+			RGCoreGraph::Pass& pass = coreGraph.Passes[pPass->ID.GetIndex()];
+			pass.pName			= pPass->GetName();
+			pass.Flags			= pPass->Flags;
+			pass.NumEventsToEnd = pPass->NumEventsToEnd;
+			pass.RecordCost		= options.pPassCosts ? options.pPassCosts->GetCost(pPass->CostKey) : 0.0f;
+			pass.MaxParts		= pPass->MaxParts;
+			for (RGEventID eventIndex : pPass->EventsToStart)
+				pass.EventsToStart.push_back(eventIndex.GetIndex());
+			pass.Accesses.reserve(pPass->Accesses.size());
 			for (const RGPass::ResourceAccess& access : pPass->Accesses)
-			{
-				RGResource* pResource  = access.pResource;
-				pResource->FirstAccess = pResource->FirstAccess.IsValid() ? pResource->FirstAccess : pPass->ID;
-				pResource->LastAccess  = pPass->ID;
-				pResource->IsAccessed  = true;
-
-				D3D12_RESOURCE_STATES state = access.Access;
-				if (pResource->GetType() == RGResourceType::Buffer)
-				{
-					BufferDesc& desc = static_cast<RGBuffer*>(pResource)->Desc;
-					if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
-						desc.Flags |= BufferFlag::UnorderedAccess;
-					if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE))
-						desc.Flags |= BufferFlag::ShaderResource;
-				}
-				else if (pResource->GetType() == RGResourceType::Texture)
-				{
-					TextureDesc& desc = static_cast<RGTexture*>(pResource)->Desc;
-					if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
-						desc.Flags |= TextureFlag::UnorderedAccess;
-					if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE))
-						desc.Flags |= TextureFlag::ShaderResource;
-					if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_DEPTH_WRITE))
-						desc.Flags |= TextureFlag::DepthStencil;
-					if (EnumHasAnyFlags(state, D3D12_RESOURCE_STATE_RENDER_TARGET))
-						desc.Flags |= TextureFlag::RenderTarget;
-				}
-			}
+				pass.Accesses.push_back({ access.pResource->ID.GetIndex(), FromD3DState(access.Access), access.Range });
 		}
 
-		// Extend the lifetime of Imported and Exported resources
-		for (RGResource* pResource : m_Resources)
+		coreGraph.Resources.resize(m_Resources.size());
+		for (const RGResource* pResource : m_Resources)
 		{
-			if (pResource->IsExported)
+			RGCoreGraph::Resource& resource = coreGraph.Resources[pResource->ID.GetIndex()];
+			resource.pName		= pResource->GetName();
+			resource.IsImported = pResource->IsImported;
+			resource.IsExported = pResource->IsExported;
+			resource.IsTexture	= pResource->GetType() == RGResourceType::Texture;
+			GetTrackedSubresources(pResource, resource.NumMips, resource.NumSlices);
+			if (resource.IsTexture)
 			{
-				//pResource->FirstAccess = firstPass;
-				pResource->LastAccess  = lastPass;
+				TextureFlag flags = static_cast<const RGTexture*>(pResource)->GetDesc().Flags;
+				if (EnumHasAnyFlags(flags, TextureFlag::RenderTarget))
+					resource.DescUsage |= RGAccess::RenderTarget;
+				if (EnumHasAnyFlags(flags, TextureFlag::DepthStencil))
+					resource.DescUsage |= RGAccess::DepthWrite;
+
+				const TextureDesc& desc = static_cast<const RGTexture*>(pResource)->GetDesc();
+				resource.Size = RHI::GetTextureByteSize(desc.Format, desc.Width, desc.Height, desc.Depth * desc.ArraySize, desc.Mips) * desc.SampleCount;
 			}
-			if (pResource->IsImported)
+			else
 			{
-				pResource->FirstAccess = firstPass;
-				//pResource->LastAccess  = lastPass;
+				resource.Size = static_cast<const RGBuffer*>(pResource)->GetDesc().Size;
 			}
 		}
+
+		coreGraph.IsEventOrdered.resize(m_Events.size());
+		for (uint32 eventIndex = 0; eventIndex < (uint32)m_Events.size(); ++eventIndex)
+			coreGraph.IsEventOrdered[eventIndex] = m_Events[eventIndex].PreserveOrder;
 	}
 
+	if (sRecordNextGraph)
 	{
-		PROFILE_CPU_SCOPE("Resource Allocation");
+		sRecordNextGraph = false;
 
-		// Release refs of export targets
-		// If there is only one ref to the export target, that means nothing else still needs this resource and it can be returned to the allocator
-		for (ExportedTexture& exportResource : m_ExportTextures)
-			*exportResource.pTarget = nullptr;
-		for (ExportedBuffer& exportResource : m_ExportBuffers)
-			*exportResource.pTarget = nullptr;
+		RGCoreGraphRecording recording;
+		recording.Graph = coreGraph;
+		for (const RGResource* pResource : m_Resources)
+		{
+			const DeviceResource* pPhysical = pResource->IsImported ? pResource->GetPhysicalUnsafe() : nullptr;
+			recording.Sizes.push_back(Math::Max(coreGraph.Resources[pResource->ID.GetIndex()].Size, (uint64)1));
+			recording.ImportedStates.push_back(pPhysical && pPhysical->UseStateTracking() ? FromD3DState(pPhysical->GetResourceState(0)) : RGAccess::Common);
+		}
 
-		gRenderGraphAllocator.AllocateResources(m_Resources);
+		Paths::CreateDirectoryTree(Paths::ProfilingDir());
+		String path = Sprintf("%sRenderGraph_%s.rggraph", Paths::ProfilingDir(), Utils::GetTimeString());
+		if (recording.Save(path.c_str()))
+			E_LOG(Info, "Recorded render graph to '%s'", path);
+		else
+			E_LOG(Warning, "Failed to record render graph to '%s'", path);
+	}
 
-		for (RGPass* pPass : m_Passes)
+	// State of the physical resources before the graph, required to reuse the compile result
+	Array<Array<D3D12_RESOURCE_STATES>> initialStates;
+
+	ReleaseExportTargets();
+
+	RGDevicePhysicalResources physicalResources(m_Resources, options.pCompileCache ? &initialStates : nullptr);
+	RGCore::Compile(coreGraph, options, physicalResources);
+
+	{
+		PROFILE_CPU_SCOPE("Apply Core Graph");
+
+		// All pass indices of the core graph are in the reordered order
+		if (!coreGraph.InputPassIndices.empty())
+			ApplyPassOrder(coreGraph.InputPassIndices);
+
+		auto ToTransition = [this](const RGCoreGraph::Transition& transition) -> RGPass::ResourceTransition
 		{
-			if (pPass->IsCulled)
-				continue;
+			return { m_Resources[transition.Resource], ToD3DState(transition.Before), ToD3DState(transition.After), transition.Subresource, transition.IsSplitEnd ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY : D3D12_RESOURCE_BARRIER_FLAG_NONE };
+		};
 
-			for (const RGPass::ResourceAccess& access : pPass->Accesses)
+		for (RGPass* pPass : m_Passes)
+		{
+			const RGCoreGraph::Pass& pass = coreGraph.Passes[pPass->ID.GetIndex()];
+			pPass->IsCulled			 = pass.IsCulled;
+			pPass->Queue			 = pass.Queue;
+			pPass->Signal			 = pass.Signal;
+			pPass->NumEventsToEnd	 = pass.NumEventsToEnd;
+			pPass->NumCPUEventsToEnd = pass.NumCPUEventsToEnd;
+
+			pPass->EventsToStart.clear();
+			for (uint32 eventIndex : pass.EventsToStart)
+				pPass->EventsToStart.push_back(RGEventID((uint16)eventIndex));
+			for (uint32 eventIndex : pass.CPUEventsToStart)
+				pPass->CPUEventsToStart.push_back(RGEventID((uint16)eventIndex));
+			for (uint32 wait : pass.Waits)
+				pPass->Waits.push_back(RGPassID((uint16)wait));
+
+			// Queue scheduling may have changed the access states
+			for (uint32 i = 0; i < (uint32)pPass->Accesses.size(); ++i)
+				pPass->Accesses[i].Access = ToD3DState(pass.Accesses[i].Access);
+
+			for (const RGCoreGraph::Transition& transition : pass.Transitions)
+				pPass->Transitions.push_back(ToTransition(transition));
+			for (const RGCoreGraph::Transition& transition : pass.ExitTransitions)
+				pPass->ExitTransitions.push_back(ToTransition(transition));
+			for (const RGCoreGraph::Transition& transition : pass.BeginTransitions)
 			{
-				// Record resource transition
-				RGResource*			  pResource	 = access.pResource;
-				uint32				  subResource = 0xFFFFFFFF;
-				D3D12_RESOURCE_STATES finalState = access.Access;
-				D3D12_RESOURCE_STATES afterState = finalState;
-				DeviceResource*		  pPhysical	 = pResource->GetPhysicalUnsafe();
-
-				D3D12_RESOURCE_STATES currentState = D3D12_RESOURCE_STATE_UNKNOWN; 
-				if (pPhysical->UseStateTracking())
-				{
-					currentState = pPhysical->GetResourceState(subResource);
-					D3D::NeedsTransition(currentState, finalState, true);
-				}
+				RGPass::ResourceTransition& beginTransition = pPass->BeginTransitions.emplace_back(ToTransition(transition));
+				beginTransition.Flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+			}
+			for (const RGCoreGraph::AliasBarrier& barrier : pass.AliasBarriers)
+				pPass->AliasBarriers.push_back({ m_Resources[barrier.Resource], barrier.NeedsDiscard, ToD3DState(barrier.PostDiscardBefore), ToD3DState(barrier.PostDiscardAfter) });
+		}
 
-				// If the resource is not imported, it will require an aliasing barrier on the first use
-				if (!pResource->IsImported && pResource->FirstAccess == pPass->ID)
-				{
-					gAssert(D3D::HasWriteResourceState(finalState), "First access of resource '%s' in '%s' should be a write", pResource->GetName(), pPass->GetName());
+		for (const RGCoreGraph::Transition& transition : coreGraph.EntryTransitions)
+			m_EntryTransitions.push_back(ToTransition(transition));
 
-					RGPass::AliasBarrier barrier;
-					barrier.pResource = pResource;
+		// Groups point into this array so it may not reallocate
+		m_ScheduledPasses.reserve(coreGraph.ScheduledPasses.size());
+		for (uint32 passIndex : coreGraph.ScheduledPasses)
+			m_ScheduledPasses.push_back(m_Passes[passIndex]);
+		for (const RGCoreGraph::Group& group : coreGraph.Groups)
+		{
+			// A pass recorded in multiple parts is alone in its group
+			Span<const RGPass*> passes(&m_ScheduledPasses[group.FirstPass], group.NumPasses);
+			uint32 numParts = coreGraph.Passes[passes[0]->ID.GetIndex()].NumParts;
+			for (uint32 partIndex = 0; partIndex < numParts; ++partIndex)
+				m_PassExecuteGroups.push_back({ passes, group.Queue, partIndex, numParts, group.RecordCost });
+		}
 
-					// If the resource is a rendertarget/depthstencil, it will need a discard
-					if (pResource->GetType() == RGResourceType::Texture)
-					{
-						RGTexture* pTexture = static_cast<RGTexture*>(access.pResource);
-						if (EnumHasAnyFlags(pTexture->GetDesc().Flags, TextureFlag::RenderTarget | TextureFlag::DepthStencil))
-						{
-							barrier.NeedsDiscard = true;
-
-							// Resource must be transitioned to a discardable state
-							afterState = EnumHasAnyFlags(pTexture->GetDesc().Flags, TextureFlag::RenderTarget) ? D3D12_RESOURCE_STATE_RENDER_TARGET : D3D12_RESOURCE_STATE_DEPTH_WRITE;
-							D3D::NeedsTransition(currentState, afterState, true);
-
-							// Store the transition to do after the discard to put the resource in the final desired state
-							finalState = access.Access;
-							if (D3D::NeedsTransition(afterState, finalState, true))
-							{
-								barrier.PostDiscardBeforeState = afterState;
-								barrier.PostDiscardAfterState  = finalState;
-							}
+		m_UsesAsyncCompute = coreGraph.UsesAsyncCompute;
+	}
 
-							RG_LOG_RESOURCE_EVENT("Recorded discard transition from %s to %s", D3D::ResourceStateToString(barrier.PostDiscardBeforeState), D3D::ResourceStateToString(barrier.PostDiscardAfterState));
-							RG_LOG_RESOURCE_EVENT("Recorded discard");
-						}
-					}
-					pPass->AliasBarriers.push_back(barrier);
+	if (options.pCompileCache)
+		StoreInCache(*options.pCompileCache, cacheHash, std::move(cacheKey), initialStates, coreGraph.InputPassIndices);
 
-					RG_LOG_RESOURCE_EVENT("Recorded aliasing barrier", pPass->pName);
-				}
+	m_IsCompiled = true;
+}
 
 
-				if (pPhysical->UseStateTracking())
-				{
-					if (D3D::NeedsTransition(currentState, afterState, true))
-					{
-						RG_LOG_RESOURCE_EVENT("Recorded transition from %s to %s", D3D::ResourceStateToString(currentState), D3D::ResourceStateToString(afterState));
+struct RGCompileCache::Entry
+{
+	struct Transition
+	{
+		RGResourceID			Resource;
+		D3D12_RESOURCE_STATES	BeforeState;
+		D3D12_RESOURCE_STATES	AfterState;
+		uint32					SubResource;
+		D3D12_RESOURCE_BARRIER_FLAGS Flags;
+	};
+
+	struct AliasBarrier
+	{
+		RGResourceID			Resource;
+		bool					NeedsDiscard;
+		D3D12_RESOURCE_STATES	PostDiscardBeforeState;
+		D3D12_RESOURCE_STATES	PostDiscardAfterState;
+	};
 
-						gAssert(currentState != D3D12_RESOURCE_STATE_UNKNOWN);
-						pPass->Transitions.push_back({ .pResource = pResource, .BeforeState = currentState, .AfterState = afterState, .SubResource = subResource });
-					}
+	struct Pass
+	{
+		bool							IsCulled;
+		RGQueueType						Queue;
+		bool							Signal;
+		Array<RGPassID>					Waits;
+		Array<RGEventID>				EventsToStart;
+		Array<RGEventID>				CPUEventsToStart;
+		uint32							NumEventsToEnd;
+		uint32							NumCPUEventsToEnd;
+		Array<D3D12_RESOURCE_STATES>	Accesses;			///< Access states after queue scheduling
+		Array<Transition>				Transitions;
+		Array<Transition>				ExitTransitions;
+		Array<Transition>				BeginTransitions;
+		Array<AliasBarrier>				AliasBarriers;
+	};
+
+	struct Resource
+	{
+		bool					IsAccessed;
+		RGPassID				FirstAccess;
+		RGPassID				LastAccess;
+		TextureDesc				ResourceTextureDesc;	///< Desc including the usage flags added during compilation
+		BufferDesc				ResourceBufferDesc;
+		Array<D3D12_RESOURCE_STATES> InitialStates;	///< State of each subresource of the physical resource before the graph. A single state if uniform, UNKNOWN if not tracked
+		Array<D3D12_RESOURCE_STATES> FinalStates;	///< State of each subresource of the physical resource after the graph. A single state if uniform
+	};
+
+	struct Group
+	{
+		uint32					FirstPass;			///< Index in ScheduledPasses
+		uint32					NumPasses;
+		RGQueueType				Queue;
+		uint32					PartIndex;
+		uint32					NumParts;
+		float					RecordCost;
+	};
+
+	uint64						Hash;
+	Array<uint32>				Key;				///< Structure of the graph. Compared in full so a hash collision can't cause a false hit
+	Array<Pass>					Passes;
+	Array<Resource>				Resources;
+	Array<uint64>				Placements;			///< Physical resource of each transient resource
+	Array<Transition>			EntryTransitions;
+	Array<RGPassID>				ScheduledPasses;
+	Array<Group>				Groups;
+	Array<uint32>				PassOrder;			///< Input index of each pass if passes were reordered
+	bool						UsesAsyncCompute;
+};
+
+RGCompileCache::RGCompileCache() = default;
+RGCompileCache::~RGCompileCache() = default;
+
+void RGCompileCache::Clear()
+{
+	m_Entries.clear();
+	m_NumHits	= 0;
+	m_NumMisses = 0;
+}
 
-					pPhysical->SetResourceState(finalState, subResource);
-				}
-			}
-		}
-	}
+float RGPassCostHistory::GetCost(uint64 key) const
+{
+	auto it = m_Entries.find(key);
+	return it != m_Entries.end() ? it->second.Average : 0.0f;
+}
+
+void RGPassCostHistory::Clear()
+{
+	m_Entries.clear();
+	++m_Version;
+}
 
+void RGPassCostHistory::AddSample(uint64 key, float time)
+{
+	// A pass recorded in multiple parts adds a sample for each part
+	Entry& entry = m_Entries[key];
+	if (entry.LastUsed != m_NumExecutes)
 	{
-		PROFILE_CPU_SCOPE("Event Resolving");
+		entry.Sample   = 0.0f;
+		entry.LastUsed = m_NumExecutes;
+	}
+	entry.Sample += time;
+}
 
-		// Move events from passes that are culled
-		Array<RGEventID> eventsToStart;
-		uint32 eventsToEnd = 0;
-		RGPass* pLastActivePass = nullptr;
-		for (RGPass* pPass : m_Passes)
+void RGPassCostHistory::EndExecute()
+{
+	bool regroup = false;
+	for (auto it = m_Entries.begin(); it != m_Entries.end();)
+	{
+		Entry& entry = it->second;
+		if (entry.LastUsed == m_NumExecutes)
 		{
-			if (pPass->IsCulled)
+			if (entry.IsNew)
 			{
-				while (pPass->NumEventsToEnd > 0 && pPass->EventsToStart.size() > 0)
-				{
-					--pPass->NumEventsToEnd;
-					pPass->EventsToStart.pop_back();
-				}
-				for (RGEventID eventIndex : pPass->EventsToStart)
-					eventsToStart.push_back(eventIndex);
-				eventsToEnd += pPass->NumEventsToEnd;
+				entry.Average = entry.Sample;
+				entry.IsNew	  = false;
+				regroup		  = true;
 			}
 			else
 			{
-				for (RGEventID eventIndex : eventsToStart)
-					pPass->EventsToStart.push_back(eventIndex);
-				pPass->NumEventsToEnd += eventsToEnd;
-				eventsToStart.clear();
-				eventsToEnd = 0;
-				pLastActivePass = pPass;
+				entry.Average += (entry.Sample - entry.Average) * cSmoothing;
+				float drift = fabs(entry.Average - entry.Grouped);
+				regroup |= drift > cRegroupMinTime && drift > entry.Grouped * cRegroupRatio;
 			}
 		}
-		if (pLastActivePass)
-			pLastActivePass->NumEventsToEnd += eventsToEnd;
-		gAssert(eventsToStart.empty());
+		else if (m_NumExecutes - entry.LastUsed > cMaxUnusedAge)
+		{
+			it = m_Entries.erase(it);
+			continue;
+		}
+		++it;
 	}
 
+	if (regroup)
 	{
-		PROFILE_CPU_SCOPE("Pass Grouping");
+		for (auto& [key, entry] : m_Entries)
+			entry.Grouped = entry.Average;
+		++m_Version;
+	}
+	++m_NumExecutes;
+}
 
-		// Group passes in jobs
-		const uint32 maxPassesPerJob = options.Jobify ? options.CommandlistGroupSize : 0xFFFFFFFF;
+void RGGraph::ReleaseExportTargets()
+{
+	// Release refs of export targets
+	// If there is only one ref to the export target, that means nothing else still needs this resource and it can be returned to the allocator
+	for (ExportedTexture& exportResource : m_ExportTextures)
+		*exportResource.pTarget = nullptr;
+	for (ExportedBuffer& exportResource : m_ExportBuffers)
+		*exportResource.pTarget = nullptr;
+}
 
-		// Duplicate profile events that cross the border of jobs to retain event hierarchy
-		RGPassID firstPass;
-		uint32 currentGroupSize = 0;
-		Array<RGEventID> activeEvents;
-		RGPass* pLastPass = nullptr;
+void RGGraph::GetCacheKey(Array<uint32>& outKey) const
+{
+	PROFILE_CPU_SCOPE();
 
-		for (uint32 passIndex = 0; passIndex < (uint32)m_Passes.size(); ++passIndex)
+	// Everything that the compile result depends on. Execute callbacks and render target flags are not part of it.
+	// Names are only part of it when passes are grouped by their recording cost.
+	auto Add = [&outKey](auto value) { outKey.push_back((uint32)value); };
+	bool costGuided = m_Options.Jobify && m_Options.CostGuidedGrouping && m_Options.pPassCosts;
+
+	Add(m_Options.PassCulling);
+	Add(m_Options.AsyncCompute);
+	Add(m_Options.AutoAsyncCompute);
+	Add(m_Options.AsyncComputeMinOverlap);
+	Add(m_Options.Jobify ? m_Options.CommandlistGroupSize : 0xFFFFFFFF);
+	Add(m_Options.SplitBarriers);
+	Add(m_Options.ReorderPasses);
+	Add(costGuided ? m_Options.NumRecordingJobs : 0);
+	Add(costGuided ? m_Options.pPassCosts->GetVersion() : 0);
+
+	Add(m_Events.size());
+	if (m_Options.ReorderPasses)
+	{
+		for (const RGEvent& event : m_Events)
+			Add(event.PreserveOrder);
+	}
+	Add(m_Resources.size());
+	for (const RGResource* pResource : m_Resources)
+	{
+		Add(pResource->GetType());
+		Add(pResource->IsImported);
+		Add(pResource->IsExported);
+		Add(pResource->IsHistory);
+		if (pResource->IsImported)
+			Add(pResource->GetPhysicalUnsafe()->UseStateTracking());
+
+		if (pResource->GetType() == RGResourceType::Texture)
 		{
-			RGPass* pPass = m_Passes[passIndex];
-			if (!pPass->IsCulled)
-			{
-				pPass->CPUEventsToStart = pPass->EventsToStart;
-				pPass->NumCPUEventsToEnd = pPass->NumEventsToEnd;
+			const TextureDesc& desc = static_cast<const RGTexture*>(pResource)->GetDesc();
+			Add(desc.Width);
+			Add(desc.Height);
+			Add(desc.Depth);
+			Add(desc.ArraySize);
+			Add(desc.Mips);
+			Add(desc.SampleCount);
+			Add(desc.Type);
+			Add(desc.Format);
+			Add(desc.Flags);
+		}
+		else
+		{
+			const BufferDesc& desc = static_cast<const RGBuffer*>(pResource)->GetDesc();
+			Add(desc.Size);
+			Add(desc.Size >> 32);
+			Add(desc.ElementSize);
+			Add(desc.Flags);
+			Add(desc.Format);
+		}
+	}
 
-				for (RGEventID event : pPass->CPUEventsToStart)
-					activeEvents.push_back(event);
+	Add(m_Passes.size());
+	for (const RGPass* pPass : m_Passes)
+	{
+		Add(pPass->Flags);
+		Add(pPass->NumEventsToEnd);
+		if (costGuided)
+		{
+			Add(pPass->CostKey);
+			Add(pPass->CostKey >> 32);
+			Add(pPass->MaxParts);
+		}
+		Add(pPass->EventsToStart.size());
+		for (RGEventID eventIndex : pPass->EventsToStart)
+			Add(eventIndex.GetIndex());
+		Add(pPass->Accesses.size());
+		for (const RGPass::ResourceAccess& access : pPass->Accesses)
+		{
+			Add(access.pResource->ID.GetIndex());
+			Add(access.Access);
+			Add(access.Range.FirstMip | (access.Range.NumMips << 16));
+			Add(access.Range.FirstSlice | (access.Range.NumSlices << 16));
+		}
+	}
+}
 
-				if (currentGroupSize == 0)
-				{
-					firstPass = pPass->ID;
-					pPass->CPUEventsToStart = activeEvents;
-				}
+bool RGGraph::CompileFromCache(RGCompileCache& cache, uint64 hash, const Array<uint32>& key)
+{
+	PROFILE_CPU_SCOPE();
 
-				for (uint32 i = 0; i < pPass->NumCPUEventsToEnd; ++i)
-					activeEvents.pop_back();
+	bool resourceUsageApplied = false;
+	for (uint32 entryIndex = 0; entryIndex < (uint32)cache.m_Entries.size(); ++entryIndex)
+	{
+		const RGCompileCache::Entry& entry = *cache.m_Entries[entryIndex];
+		if (entry.Hash != hash || entry.Key != key)
+			continue;
 
-				++currentGroupSize;
-				if (currentGroupSize >= maxPassesPerJob)
-				{
-					pPass->NumCPUEventsToEnd += (uint32)activeEvents.size();
-					m_PassExecuteGroups.push_back(Span<const RGPass*>(&m_Passes[firstPass.GetIndex()], passIndex - firstPass.GetIndex() + 1));
-					currentGroupSize = 0;
-				}
-				pLastPass = pPass;
+		// Entries with the same key only differ in placements and physical states, so resource usage only has to be applied once.
+		// If no entry can be used, the full compile computes the same values again.
+		if (!resourceUsageApplied)
+		{
+			for (RGResource* pResource : m_Resources)
+			{
+				const RGCompileCache::Entry::Resource& resource = entry.Resources[pResource->ID.GetIndex()];
+				pResource->IsAccessed  = resource.IsAccessed;
+				pResource->FirstAccess = resource.FirstAccess;
+				pResource->LastAccess  = resource.LastAccess;
+				if (pResource->GetType() == RGResourceType::Texture)
+					static_cast<RGTexture*>(pResource)->Desc = resource.ResourceTextureDesc;
+				else
+					static_cast<RGBuffer*>(pResource)->Desc = resource.ResourceBufferDesc;
+			}
+			ReleaseExportTargets();
+			resourceUsageApplied = true;
+		}
+
+		// The transitions are only valid if all physical resources start in the same state
+		Array<DeviceResource*> physicalResources;
+		if (!gRenderGraphAllocator.FindPlacements(m_Resources, entry.Placements, physicalResources))
+			continue;
+
+		bool statesMatch = true;
+		Array<D3D12_RESOURCE_STATES> states;
+		for (const RGResource* pResource : m_Resources)
+		{
+			if (!pResource->IsAccessed)
+				continue;
+
+			const DeviceResource* pPhysical = pResource->IsImported ? pResource->GetPhysicalUnsafe() : physicalResources[pResource->ID.GetIndex()];
+			GetSubresourceStates(pPhysical, GetNumTrackedSubresources(pResource), states);
+			if (states != entry.Resources[pResource->ID.GetIndex()].InitialStates)
+			{
+				statesMatch = false;
+				break;
 			}
 		}
-		if (currentGroupSize > 0)
-			m_PassExecuteGroups.push_back(Span<const RGPass*>(&m_Passes[firstPass.GetIndex()], (uint32)m_Passes.size() - firstPass.GetIndex()));
-		if (pLastPass)
-			pLastPass->NumCPUEventsToEnd += (uint32)activeEvents.size();
+		if (!statesMatch)
+			continue;
+
+		gRenderGraphAllocator.ReusePlacements(m_Resources, entry.Placements);
+
+		if (!entry.PassOrder.empty())
+			ApplyPassOrder(entry.PassOrder);
+
+		for (RGPass* pPass : m_Passes)
+		{
+			const RGCompileCache::Entry::Pass& pass = entry.Passes[pPass->ID.GetIndex()];
+			pPass->IsCulled			 = pass.IsCulled;
+			pPass->Queue			 = pass.Queue;
+			pPass->Signal			 = pass.Signal;
+			pPass->Waits.assign(pass.Waits.begin(), pass.Waits.end());
+			pPass->EventsToStart.assign(pass.EventsToStart.begin(), pass.EventsToStart.end());
+			pPass->CPUEventsToStart.assign(pass.CPUEventsToStart.begin(), pass.CPUEventsToStart.end());
+			pPass->NumEventsToEnd	 = pass.NumEventsToEnd;
+			pPass->NumCPUEventsToEnd = pass.NumCPUEventsToEnd;
+
+			for (uint32 i = 0; i < (uint32)pPass->Accesses.size(); ++i)
+				pPass->Accesses[i].Access = pass.Accesses[i];
+			for (const RGCompileCache::Entry::Transition& transition : pass.Transitions)
+				pPass->Transitions.push_back({ m_Resources[transition.Resource.GetIndex()], transition.BeforeState, transition.AfterState, transition.SubResource, transition.Flags });
+			for (const RGCompileCache::Entry::Transition& transition : pass.ExitTransitions)
+				pPass->ExitTransitions.push_back({ m_Resources[transition.Resource.GetIndex()], transition.BeforeState, transition.AfterState, transition.SubResource, transition.Flags });
+			for (const RGCompileCache::Entry::Transition& transition : pass.BeginTransitions)
+				pPass->BeginTransitions.push_back({ m_Resources[transition.Resource.GetIndex()], transition.BeforeState, transition.AfterState, transition.SubResource, transition.Flags });
+			for (const RGCompileCache::Entry::AliasBarrier& barrier : pass.AliasBarriers)
+				pPass->AliasBarriers.push_back({ m_Resources[barrier.Resource.GetIndex()], barrier.NeedsDiscard, barrier.PostDiscardBeforeState, barrier.PostDiscardAfterState });
+		}
+
+		for (const RGCompileCache::Entry::Transition& transition : entry.EntryTransitions)
+			m_EntryTransitions.push_back({ m_Resources[transition.Resource.GetIndex()], transition.BeforeState, transition.AfterState, transition.SubResource, transition.Flags });
+
+		m_ScheduledPasses.reserve(entry.ScheduledPasses.size());
+		for (RGPassID passID : entry.ScheduledPasses)
+			m_ScheduledPasses.push_back(m_Passes[passID.GetIndex()]);
+		for (const RGCompileCache::Entry::Group& group : entry.Groups)
+			m_PassExecuteGroups.push_back({ Span<const RGPass*>(&m_ScheduledPasses[group.FirstPass], group.NumPasses), group.Queue, group.PartIndex, group.NumParts, group.RecordCost });
+		m_UsesAsyncCompute = entry.UsesAsyncCompute;
+
+		// Leave the physical resources in the state the graph leaves them in
+		for (const RGResource* pResource : m_Resources)
+		{
+			DeviceResource* pPhysical = pResource->GetPhysicalUnsafe();
+			if (pResource->IsAccessed && pPhysical->UseStateTracking())
+				SetSubresourceStates(pPhysical, entry.Resources[pResource->ID.GetIndex()].FinalStates);
+		}
+
+		std::rotate(cache.m_Entries.begin(), cache.m_Entries.begin() + entryIndex, cache.m_Entries.begin() + entryIndex + 1);
+		++cache.m_NumHits;
+		return true;
 	}
 
-	m_IsCompiled = true;
+	++cache.m_NumMisses;
+	return false;
+}
+
+void RGGraph::StoreInCache(RGCompileCache& cache, uint64 hash, Array<uint32>&& key, Span<const Array<D3D12_RESOURCE_STATES>> initialStates, Span<const uint32> passOrder) const
+{
+	PROFILE_CPU_SCOPE();
+
+	UniquePtr<RGCompileCache::Entry> pEntry = std::make_unique<RGCompileCache::Entry>();
+	RGCompileCache::Entry& entry = *pEntry;
+	entry.Hash			   = hash;
+	entry.Key			   = std::move(key);
+	entry.PassOrder.assign(passOrder.begin(), passOrder.end());
+	entry.UsesAsyncCompute = m_UsesAsyncCompute;
+
+	auto StoreTransition = [](const RGPass::ResourceTransition& transition) -> RGCompileCache::Entry::Transition
+	{
+		return { transition.pResource->ID, transition.BeforeState, transition.AfterState, transition.SubResource, transition.Flags };
+	};
+
+	entry.Passes.resize(m_Passes.size());
+	for (const RGPass* pPass : m_Passes)
+	{
+		RGCompileCache::Entry::Pass& pass = entry.Passes[pPass->ID.GetIndex()];
+		pass.IsCulled		   = pPass->IsCulled;
+		pass.Queue			   = pPass->Queue;
+		pass.Signal			   = pPass->Signal;
+		pass.Waits.assign(pPass->Waits.begin(), pPass->Waits.end());
+		pass.EventsToStart.assign(pPass->EventsToStart.begin(), pPass->EventsToStart.end());
+		pass.CPUEventsToStart.assign(pPass->CPUEventsToStart.begin(), pPass->CPUEventsToStart.end());
+		pass.NumEventsToEnd	   = pPass->NumEventsToEnd;
+		pass.NumCPUEventsToEnd = pPass->NumCPUEventsToEnd;
+
+		for (const RGPass::ResourceAccess& access : pPass->Accesses)
+			pass.Accesses.push_back(access.Access);
+		for (const RGPass::ResourceTransition& transition : pPass->Transitions)
+			pass.Transitions.push_back(StoreTransition(transition));
+		for (const RGPass::ResourceTransition& transition : pPass->ExitTransitions)
+			pass.ExitTransitions.push_back(StoreTransition(transition));
+		for (const RGPass::ResourceTransition& transition : pPass->BeginTransitions)
+			pass.BeginTransitions.push_back(StoreTransition(transition));
+		for (const RGPass::AliasBarrier& barrier : pPass->AliasBarriers)
+			pass.AliasBarriers.push_back({ barrier.pResource->ID, barrier.NeedsDiscard, barrier.PostDiscardBeforeState, barrier.PostDiscardAfterState });
+	}
+
+	entry.Resources.resize(m_Resources.size());
+	for (const RGResource* pResource : m_Resources)
+	{
+		RGCompileCache::Entry::Resource& resource = entry.Resources[pResource->ID.GetIndex()];
+		resource.IsAccessed	  = pResource->IsAccessed;
+		resource.FirstAccess  = pResource->FirstAccess;
+		resource.LastAccess	  = pResource->LastAccess;
+		resource.InitialStates = initialStates[pResource->ID.GetIndex()];
+		if (pResource->GetType() == RGResourceType::Texture)
+			resource.ResourceTextureDesc = static_cast<const RGTexture*>(pResource)->GetDesc();
+		else
+			resource.ResourceBufferDesc = static_cast<const RGBuffer*>(pResource)->GetDesc();
+
+		const DeviceResource* pPhysical = pResource->GetPhysicalUnsafe();
+		if (pResource->IsAccessed && pPhysical->UseStateTracking())
+			GetSubresourceStates(pPhysical, GetNumTrackedSubresources(pResource), resource.FinalStates);
+	}
+
+	gRenderGraphAllocator.GetPlacements(m_Resources, entry.Placements);
+
+	for (const RGPass::ResourceTransition& transition : m_EntryTransitions)
+		entry.EntryTransitions.push_back(StoreTransition(transition));
+
+	for (const RGPass* pPass : m_ScheduledPasses)
+		entry.ScheduledPasses.push_back(pPass->ID);
+	for (const ExecuteGroup& group : m_PassExecuteGroups)
+		entry.Groups.push_back({ (uint32)(group.Passes.GetData() - m_ScheduledPasses.data()), group.Passes.GetSize(), group.Queue, group.PartIndex, group.NumParts, group.RecordCost });
+
+	cache.m_Entries.insert(cache.m_Entries.begin(), std::move(pEntry));
+	if (cache.m_Entries.size() > RGCompileCache::cMaxEntries)
+		cache.m_Entries.pop_back();
 }
 
 void RGGraph::Export(RGTexture* pTexture, Ref<Texture>* pTarget, TextureFlag additionalFlags)
@@ -437,9 +1062,111 @@ void RGGraph::Export(RGBuffer* pBuffer, Ref<Buffer>* pTarget, BufferFlag additio
 	m_ExportBuffers.push_back({ pBuffer, pTarget });
 }
 
-void RGGraph::PushEvent(const char* pName, const char* pFilePath, uint32 lineNumber)
+RGTexture* RGGraph::CreateHistory(RGTextureHistory& history, const char* pName, const TextureDesc& desc, bool* pOutIsNew)
+{
+	return CreateHistoryResource<Texture>(history, pName, desc, pOutIsNew);
+}
+
+RGBuffer* RGGraph::CreateHistory(RGBufferHistory& history, const char* pName, const BufferDesc& desc, bool* pOutIsNew)
+{
+	return CreateHistoryResource<Buffer>(history, pName, desc, pOutIsNew);
+}
+
+RGTexture* RGGraph::TryImportHistory(const RGTextureHistory& history, Texture* pFallback, uint32 framesAgo)
 {
-	m_PendingEvents.push_back(AddEvent(pName, pFilePath, lineNumber));
+	return ImportHistoryResource<Texture>(history, pFallback, framesAgo);
+}
+
+RGBuffer* RGGraph::TryImportHistory(const RGBufferHistory& history, Buffer* pFallback, uint32 framesAgo)
+{
+	return ImportHistoryResource<Buffer>(history, pFallback, framesAgo);
+}
+
+template<typename T>
+RGResourceT<T>* RGGraph::CreateHistoryResource(RGHistoryBase& history, const char* pName, const typename RGResourceT<T>::TDesc& desc, bool* pOutIsNew)
+{
+	auto it = std::find_if(m_Histories.begin(), m_Histories.end(), [&](const History& entry) { return entry.pHistory == &history; });
+	gAssert(it == m_Histories.end(), "History of '%s' is already created by '%s'.", pName, it->pResource->GetName());
+
+	// A single frame history updates the resource of the previous frame in place if it still matches
+	RGResourceT<T>* pResource = nullptr;
+	if (history.m_NumFrames == 1)
+	{
+		T* pPrevious = (T*)gRenderGraphAllocator.FindHistory(history.m_PhysicalIDs[0], &history);
+		if (pPrevious && pPrevious->GetDesc().IsCompatible(desc))
+			pResource = Import(pPrevious);
+	}
+	if (pOutIsNew)
+		*pOutIsNew = pResource == nullptr;
+	if (!pResource)
+		pResource = Create(pName, desc);
+
+	// Exported resources are kept alive until the end of the graph
+	pResource->IsExported = true;
+	pResource->IsHistory  = true;
+	m_Histories.push_back({ &history, pResource });
+	return pResource;
+}
+
+template<typename T>
+RGResourceT<T>* RGGraph::ImportHistoryResource(const RGHistoryBase& history, T* pFallback, uint32 framesAgo)
+{
+	gAssert(framesAgo >= 1 && framesAgo < history.m_NumFrames, "History of %d frames doesn't keep the version of %d frames ago", history.m_NumFrames, framesAgo);
+
+	// The versions only shift when the graph executes, so the newest one is from the previous frame
+	if (T* pResource = (T*)gRenderGraphAllocator.FindHistory(history.m_PhysicalIDs[framesAgo - 1], &history))
+		return Import(pResource);
+	return pFallback ? Import(pFallback) : nullptr;
+}
+
+void RGGraph::UpdateHistories()
+{
+	PROFILE_CPU_SCOPE();
+
+	for (const History& entry : m_Histories)
+	{
+		RGHistoryBase& history = *entry.pHistory;
+		StaticArray<uint64, RGHistoryBase::MaxFrames>& ids = history.m_PhysicalIDs;
+
+		// A culled resource has no new version, the history keeps the earlier ones
+		if (entry.pResource->IsAccessed)
+		{
+			uint64 id = gRenderGraphAllocator.GetPhysicalID(entry.pResource->GetPhysicalUnsafe());
+			gAssert(id != 0, "History resource '%s' is not allocated by the allocator", entry.pResource->GetName());
+			if (id != ids[0])
+			{
+				std::rotate(ids.rbegin(), ids.rbegin() + 1, ids.rend());
+				ids[0] = id;
+			}
+		}
+
+		// Retain the versions that the next frame can import. The oldest version is only imported during this frame and can be released
+		uint32 numRetained = Math::Max(history.m_NumFrames - 1, 1u);
+		for (uint32 i = 0; i < RGHistoryBase::MaxFrames; ++i)
+		{
+			if (i >= numRetained || !gRenderGraphAllocator.RetainHistory(ids[i], &history))
+				ids[i] = 0;
+		}
+	}
+}
+
+void RGGraph::ApplyPassOrder(Span<const uint32> inputPassIndices)
+{
+	gAssert(inputPassIndices.GetSize() == m_Passes.size());
+
+	RGArray<RGPass*> passes(m_Allocator);
+	passes.reserve(m_Passes.size());
+	for (uint32 inputIndex : inputPassIndices)
+		passes.push_back(m_Passes[inputIndex]);
+	m_Passes.swap(passes);
+
+	for (uint32 passIndex = 0; passIndex < (uint32)m_Passes.size(); ++passIndex)
+		m_Passes[passIndex]->ID = RGPassID((uint16)passIndex);
+}
+
+void RGGraph::PushEvent(const char* pName, const char* pFilePath, uint32 lineNumber, bool preserveOrder)
+{
+	m_PendingEvents.push_back(AddEvent(pName, pFilePath, lineNumber, preserveOrder));
 }
 
 void RGGraph::PopEvent()
@@ -456,8 +1183,50 @@ void RGGraph::Execute(GraphicsDevice* pDevice)
 
 	gAssert(m_IsCompiled);
 
+	m_UseEnhancedBarriers = m_Options.EnhancedBarriers && pDevice->GetCapabilities().SupportsEnhancedBarriers();
+
+	auto AllocateContext = [pDevice](RGQueueType queue)
+	{
+		return pDevice->AllocateCommandContext(queue == RGQueueType::Compute ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT);
+	};
+
+	// Contexts are in submission order
 	Array<CommandContext*> contexts;
 	contexts.reserve(m_PassExecuteGroups.size());
+	for (const ExecuteGroup& group : m_PassExecuteGroups)
+		contexts.push_back(AllocateContext(group.Queue));
+
+	// Recording time in ms of each pass of each group. Each group writes to its own range
+	Array<float> passTimes;
+	Array<uint32> passTimeOffsets;
+	if (m_Options.pPassCosts)
+	{
+		passTimeOffsets.reserve(m_PassExecuteGroups.size());
+		uint32 numPassTimes = 0;
+		for (const ExecuteGroup& group : m_PassExecuteGroups)
+		{
+			passTimeOffsets.push_back(numPassTimes);
+			numPassTimes += group.Passes.GetSize();
+		}
+		passTimes.resize(numPassTimes);
+	}
+
+	auto RecordGroup = [&](uint32 groupIndex)
+	{
+		const ExecuteGroup& group = m_PassExecuteGroups[groupIndex];
+		Utils::TimeScope timer;
+		float passStart = 0.0f;
+		for (uint32 i = 0; i < group.Passes.GetSize(); ++i)
+		{
+			ExecutePass(group.Passes[i], *contexts[groupIndex], group.PartIndex, group.NumParts);
+			if (!passTimes.empty())
+			{
+				float passEnd = timer.Stop();
+				passTimes[passTimeOffsets[groupIndex] + i] = (passEnd - passStart) * 1000.0f;
+				passStart = passEnd;
+			}
+		}
+	};
 
 	if (m_PassExecuteGroups.size() > 1)
 	{
@@ -465,16 +1234,16 @@ void RGGraph::Execute(GraphicsDevice* pDevice)
 
 		{
 			PROFILE_CPU_SCOPE("Schedule Render Jobs");
-			for (Span<const RGPass*> passGroup : m_PassExecuteGroups)
+
+			// Expensive groups are recorded first, so that the last job to finish is a short one
+			Array<uint32> recordOrder(m_PassExecuteGroups.size());
+			for (uint32 groupIndex = 0; groupIndex < (uint32)recordOrder.size(); ++groupIndex)
+				recordOrder[groupIndex] = groupIndex;
+			std::stable_sort(recordOrder.begin(), recordOrder.end(), [this](uint32 a, uint32 b) { return m_PassExecuteGroups[a].RecordCost > m_PassExecuteGroups[b].RecordCost; });
+
+			for (uint32 groupIndex : recordOrder)
 			{
-				CommandContext* pContext  = pDevice->AllocateCommandContext();
-				auto			executeFn = [this, passGroup, pContext](int) {
-					   for (const RGPass* pPass : passGroup)
-					   {
-						   if (!pPass->IsCulled)
-							   ExecutePass(pPass, *pContext);
-					   };
-				};
+				auto executeFn = [&RecordGroup, groupIndex](int) { RecordGroup(groupIndex); };
 #if RG_TRACK_RESOURCE_EVENTS
 				executeFn(0);
 #else
@@ -484,7 +1253,6 @@ void RGGraph::Execute(GraphicsDevice* pDevice)
 				else
 					TaskQueue::Execute(executeFn, context);
 #endif
-				contexts.push_back(pContext);
 			}
 		}
 
@@ -496,17 +1264,83 @@ void RGGraph::Execute(GraphicsDevice* pDevice)
 	else
 	{
 		PROFILE_CPU_SCOPE("Schedule Render Jobs");
+		RecordGroup(0);
+	}
 
-		CommandContext* pContext = pDevice->AllocateCommandContext();
-		for (const RGPass* pPass : m_PassExecuteGroups[0])
+	if (m_Options.pPassCosts)
+	{
+		for (uint32 groupIndex = 0; groupIndex < (uint32)m_PassExecuteGroups.size(); ++groupIndex)
 		{
-			if (!pPass->IsCulled)
-				ExecutePass(pPass, *pContext);
+			const ExecuteGroup& group = m_PassExecuteGroups[groupIndex];
+			for (uint32 i = 0; i < group.Passes.GetSize(); ++i)
+				m_Options.pPassCosts->AddSample(group.Passes[i]->CostKey, passTimes[passTimeOffsets[groupIndex] + i]);
 		}
-		contexts.push_back(pContext);
+		m_Options.pPassCosts->EndExecute();
 	}
 
-	pDevice->GetGraphicsQueue()->ExecuteCommandLists(contexts);
+	{
+		PROFILE_CPU_SCOPE("Submit");
+
+		CommandQueue* pQueues[] = { pDevice->GetGraphicsQueue(), pDevice->GetComputeQueue() };
+		static_assert(ARRAYSIZE(pQueues) == (int)RGQueueType::Num);
+		CommandQueue* pGraphicsQueue = pQueues[(int)RGQueueType::Graphics];
+		CommandQueue* pComputeQueue	 = pQueues[(int)RGQueueType::Compute];
+
+		if (m_UsesAsyncCompute)
+		{
+			// Resources the compute queue can't transition itself are released on the graphics queue first
+			if (!m_EntryTransitions.empty())
+			{
+				CommandContext* pContext = AllocateContext(RGQueueType::Graphics);
+				for (const RGPass::ResourceTransition& transition : m_EntryTransitions)
+					pContext->InsertResourceBarrier(transition.pResource->GetPhysicalUnsafe(), transition.BeforeState, transition.AfterState, transition.SubResource);
+				pGraphicsQueue->ExecuteCommandLists(pContext);
+			}
+
+			// Everything submitted before the graph has to be complete before the compute queue starts
+			pComputeQueue->InsertWait(pGraphicsQueue);
+		}
+
+		// Consecutive groups on the same queue are submitted together, up to the next wait or signal
+		Array<SyncPoint> passSyncPoints(m_UsesAsyncCompute ? m_Passes.size() : 0);
+		uint32 batchStart = 0;
+		for (uint32 groupIndex = 0; groupIndex < (uint32)m_PassExecuteGroups.size(); ++groupIndex)
+		{
+			const ExecuteGroup& group = m_PassExecuteGroups[groupIndex];
+			CommandQueue* pQueue = pQueues[(int)group.Queue];
+
+			if (groupIndex == batchStart)
+			{
+				for (RGPassID wait : group.Passes[0]->Waits)
+				{
+					gAssert(passSyncPoints[wait.GetIndex()].IsValid(), "Pass '%s' waits for pass '%s' which wasn't submitted yet", group.Passes[0]->GetName(), m_Passes[wait.GetIndex()]->GetName());
+					pQueue->InsertWait(passSyncPoints[wait.GetIndex()]);
+				}
+			}
+
+			// A pass recorded in multiple parts waits before its first part and signals after its last part
+			const RGPass* pLastPass = group.Passes[group.Passes.GetSize() - 1];
+			bool signals = pLastPass->Signal && group.PartIndex + 1 == group.NumParts;
+			bool isLastInBatch = groupIndex + 1 == (uint32)m_PassExecuteGroups.size() || signals;
+			if (!isLastInBatch)
+			{
+				const ExecuteGroup& nextGroup = m_PassExecuteGroups[groupIndex + 1];
+				isLastInBatch = nextGroup.Queue != group.Queue || (nextGroup.PartIndex == 0 && !nextGroup.Passes[0]->Waits.empty());
+			}
+
+			if (isLastInBatch)
+			{
+				SyncPoint syncPoint = pQueue->ExecuteCommandLists(Span<CommandContext* const>(&contexts[batchStart], groupIndex - batchStart + 1));
+				if (signals)
+					passSyncPoints[pLastPass->ID.GetIndex()] = syncPoint;
+				batchStart = groupIndex + 1;
+			}
+		}
+
+		// Work after the graph may depend on anything that ran on the compute queue
+		if (m_UsesAsyncCompute)
+			pGraphicsQueue->InsertWait(pComputeQueue);
+	}
 
 	// Export resources at the end of execution
 	for (ExportedTexture& exportResource : m_ExportTextures)
@@ -524,15 +1358,25 @@ void RGGraph::Execute(GraphicsDevice* pDevice)
 		*exportResource.pTarget = pBuffer;
 	}
 
+	UpdateHistories();
+
 	DestroyData();
 }
 
-void RGGraph::ExecutePass(const RGPass* pPass, CommandContext& context) const
+void RGGraph::ExecutePass(const RGPass* pPass, CommandContext& context, uint32 partIndex, uint32 numParts) const
 {
-	for (RGEventID eventIndex : pPass->EventsToStart)
+	// A pass recorded in multiple parts prepares its resources in the first part and releases them in the last part.
+	// CPU events are per commandlist, so each part has all of them.
+	bool isFirstPart = partIndex == 0;
+	bool isLastPart	 = partIndex + 1 == numParts;
+
+	if (isFirstPart)
 	{
-		const RGEvent& event = m_Events[eventIndex.GetIndex()];
-		gGPUProfiler.BeginEvent(context.GetCommandList(), event.pName, 0, event.pFilePath, event.LineNumber);
+		for (RGEventID eventIndex : pPass->EventsToStart)
+		{
+			const RGEvent& event = m_Events[eventIndex.GetIndex()];
+			gGPUProfiler.BeginEvent(context.GetCommandList(), event.pName, 0, event.pFilePath, event.LineNumber);
+		}
 	}
 	for (RGEventID eventIndex : pPass->CPUEventsToStart)
 	{
@@ -544,7 +1388,8 @@ void RGGraph::ExecutePass(const RGPass* pPass, CommandContext& context) const
 		PROFILE_GPU_SCOPE(context.GetCommandList(), pPass->GetName());
 		PROFILE_CPU_SCOPE(pPass->GetName());
 
-		PrepareResources(pPass, context);
+		if (isFirstPart)
+			PrepareResources(pPass, context);
 
 		if (pPass->pExecuteCallback)
 		{
@@ -552,9 +1397,22 @@ void RGGraph::ExecutePass(const RGPass* pPass, CommandContext& context) const
 
 			bool useRenderPass = EnumHasAllFlags(pPass->Flags, RGPassFlag::Raster);
 			if (useRenderPass)
-				context.BeginRenderPass(resources.GetRenderPassInfo());
+			{
+				// Only the first part clears the targets and only the last part resolves them
+				RenderPassInfo passInfo = resources.GetRenderPassInfo();
+				for (uint32 i = 0; i < passInfo.RenderTargetCount; ++i)
+				{
+					if (!isFirstPart)
+						passInfo.RenderTargets[i].Flags &= ~RenderPassColorFlags::Clear;
+					if (!isLastPart)
+						passInfo.RenderTargets[i].Flags &= ~RenderPassColorFlags::Resolve;
+				}
+				if (!isFirstPart)
+					passInfo.DepthStencilTarget.Flags &= ~RenderPassDepthFlags::Clear;
+				context.BeginRenderPass(passInfo);
+			}
 
-			pPass->pExecuteCallback->Execute(context, resources);
+			pPass->pExecuteCallback->Execute(context, resources, partIndex, numParts);
 
 			if (useRenderPass)
 				context.EndRenderPass();
@@ -564,10 +1422,35 @@ void RGGraph::ExecutePass(const RGPass* pPass, CommandContext& context) const
 			context.ClearState();
 #endif
 		}
+
+		if (isLastPart && !pPass->ExitTransitions.empty())
+		{
+			for (const RGPass::ResourceTransition& transition : pPass->ExitTransitions)
+			{
+				const RGResource* pResource = transition.pResource;
+				InsertTransition(transition, context);
+				RG_LOG_RESOURCE_EVENT("Executed release to the compute queue from %s", D3D::ResourceStateToString(transition.BeforeState));
+			}
+			context.FlushResourceBarriers();
+		}
+
+		// Not flushed here: the begin of a split transition is batched with the barriers of the next pass
+		if (isLastPart)
+		{
+			for (const RGPass::ResourceTransition& transition : pPass->BeginTransitions)
+			{
+				const RGResource* pResource = transition.pResource;
+				InsertTransition(transition, context);
+				RG_LOG_RESOURCE_EVENT("Began split transition from %s to %s", D3D::ResourceStateToString(transition.BeforeState), D3D::ResourceStateToString(transition.AfterState));
+			}
+		}
 	}
 
-	for(uint32 i = 0; i < pPass->NumEventsToEnd; ++i)
-		gGPUProfiler.EndEvent(context.GetCommandList());
+	if (isLastPart)
+	{
+		for (uint32 i = 0; i < pPass->NumEventsToEnd; ++i)
+			gGPUProfiler.EndEvent(context.GetCommandList());
+	}
 	for (uint32 i = 0; i < pPass->NumCPUEventsToEnd; ++i)
 		gCPUProfiler.EndEvent();
 }
@@ -589,9 +1472,9 @@ void RGGraph::PrepareResources(const RGPass* pPass, CommandContext& context) con
 
 		gAssert(pResource->GetPhysicalUnsafe(), "Resource was not allocated during the graph compile phase");
 
-		context.InsertResourceBarrier(pResource->GetPhysicalUnsafe(), transition.BeforeState, transition.AfterState, transition.SubResource);
+		InsertTransition(transition, context);
 
-		RG_LOG_RESOURCE_EVENT("Executed transition from %s to %s", D3D::ResourceStateToString(transition.BeforeState), D3D::ResourceStateToString(transition.AfterState));
+		RG_LOG_RESOURCE_EVENT("%s transition from %s to %s", transition.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY ? "Ended split" : "Executed", D3D::ResourceStateToString(transition.BeforeState), D3D::ResourceStateToString(transition.AfterState));
 	}
 
 	context.FlushResourceBarriers();
@@ -646,12 +1529,22 @@ void RGGraph::PrepareResources(const RGPass* pPass, CommandContext& context) con
 	}
 }
 
+void RGGraph::InsertTransition(const RGPass::ResourceTransition& transition, CommandContext& context) const
+{
+	DeviceResource* pPhysical = transition.pResource->GetPhysicalUnsafe();
+	if (m_UseEnhancedBarriers && transition.SubResource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+		context.InsertEnhancedBarrier(pPhysical, transition.BeforeState, transition.AfterState, transition.Flags);
+	else
+		context.InsertResourceBarrier(pPhysical, transition.BeforeState, transition.AfterState, transition.SubResource, transition.Flags);
+}
+
 void RGGraph::DestroyData()
 {
 	m_Passes.clear();
 	m_Resources.clear();
 	m_ExportTextures.clear();
 	m_ExportBuffers.clear();
+	m_Histories.clear();
 }
 
 RenderPassInfo RGResources::GetRenderPassInfo() const
@@ -765,4 +1658,93 @@ namespace RGUtils
 					context.CopyBuffer(alloc.pBackingResource, resources.Get(pTarget), size, alloc.Offset, 0);
 				});
 	}
+
+	// Counts heap allocations made on the benchmark thread. Only the debug CRT supports allocation hooks.
+#ifdef _DEBUG
+	static uint32 sNumHeapAllocations = 0;
+	static DWORD  sHeapAllocationThread = 0;
+
+	static int CountHeapAllocation(int allocType, void*, size_t, int blockType, long, const unsigned char*, int)
+	{
+		if ((allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC) && blockType != _CRT_BLOCK && GetCurrentThreadId() == sHeapAllocationThread)
+			++sNumHeapAllocations;
+		return TRUE;
+	}
+#endif
+
+	void RunRecordingBenchmark(uint32 numPasses)
+	{
+		constexpr uint32 NumFrames		  = 4;
+		constexpr uint32 PassesPerTexture = 4;
+		constexpr uint32 PassesPerScope	  = 10;
+
+		// Names are created up front so only the allocations of the graph are counted
+		Array<String> passNames, textureNames;
+		for (uint32 i = 0; i < numPasses; ++i)
+			passNames.push_back(Sprintf("Pass %d", i));
+		for (uint32 i = 0; i < numPasses / PassesPerTexture + 1; ++i)
+			textureNames.push_back(Sprintf("Texture %d", i));
+
+		// Every pass reads the two textures written before it, which is about as many accesses as the passes of the renderer have
+		auto Record = [&](RGGraph& graph)
+			{
+				RGTexture* textures[3]{};
+				for (uint32 i = 0; i < numPasses; ++i)
+				{
+					if (i % PassesPerScope == 0)
+						graph.PushEvent("Scope");
+					if (i % PassesPerTexture == 0)
+					{
+						textures[2] = textures[1];
+						textures[1] = textures[0];
+						textures[0] = graph.Create(textureNames[i / PassesPerTexture].c_str(), TextureDesc::Create2D(1920, 1080, ResourceFormat::RGBA16_FLOAT));
+					}
+
+					RGTexture* pTarget = textures[0];
+					graph.AddPass(passNames[i].c_str(), RGPassFlag::Compute)
+						.Read({ textures[1], textures[2] })
+						.Write(pTarget)
+						.Bind([=](CommandContext& context, const RGResources& resources)
+							{
+								context.ClearTextureFloat(resources.Get(pTarget));
+							});
+
+					if (i % PassesPerScope == PassesPerScope - 1)
+						graph.PopEvent();
+				}
+				if (numPasses % PassesPerScope != 0)
+					graph.PopEvent();
+			};
+
+		// The first frame fills the chunk pool that the next frames reuse
+		for (uint32 frame = 0; frame < NumFrames; ++frame)
+		{
+			uint64 numChunkAllocations = RGGraphAllocator::GetNumChunkAllocations();
+#ifdef _DEBUG
+			sNumHeapAllocations	  = 0;
+			sHeapAllocationThread = GetCurrentThreadId();
+			_CRT_ALLOC_HOOK pPreviousHook = _CrtSetAllocHook(CountHeapAllocation);
+#endif
+
+			Utils::TimeScope timer;
+			uint64 size, capacity;
+			{
+				RGGraph graph;
+				Record(graph);
+				size	 = graph.GetAllocator().GetSize();
+				capacity = graph.GetAllocator().GetCapacity();
+			}
+			float time = timer.Stop();
+
+#ifdef _DEBUG
+			_CrtSetAllocHook(pPreviousHook);
+			String heapAllocations = Sprintf("%d", sNumHeapAllocations);
+#else
+			String heapAllocations = "(requires a debug build)";
+#endif
+			E_LOG(Info, "RGGraph - Frame %d: recorded %d passes in %.3f ms. Heap allocations: %s, new chunks: %llu, %s used of %s",
+				frame, numPasses, time * 1000.0f, heapAllocations, RGGraphAllocator::GetNumChunkAllocations() - numChunkAllocations,
+				Math::PrettyPrintDataSize(size), Math::PrettyPrintDataSize(capacity));
+		}
+	}
 }
@@ -1,25 +1,39 @@
 #pragma once
 #include "RenderGraphDefinitions.h"
+#include "RenderGraphCore.h"
 #include "RHI/Fence.h"
 #include "RHI/CommandContext.h"
 #include "Blackboard.h"
 
 #define RG_GRAPH_SCOPE(name, graph) RGGraphScope MACRO_CONCAT(rgScope_,__COUNTER__)(name, graph, __FILE__, __LINE__)
+// Scope of which the passes keep their relative order when the graph reorders passes
+#define RG_GRAPH_SCOPE_ORDERED(name, graph) RGGraphScope MACRO_CONCAT(rgScope_,__COUNTER__)(name, graph, __FILE__, __LINE__, true)
 
 class RGGraph;
 class RGPass;
 class RGResourceAllocator;
 
-// Flags assigned to a pass that can determine various things
-enum class RGPassFlag : uint8
+// A range of mips or array slices of a texture, to access only part of it in a pass.
+// Passes may access different subresources of the same texture, for example to read one mip while writing the next.
+struct RGTextureSubresources
 {
-	None =		0,
-	Raster =	1 << 0,		///< Raster pass
-	Compute =	1 << 1,		///< Compute pass
-	Copy =		1 << 2,		///< Pass that performs a copy resource operation. Does not play well with Raster/Compute passes
-	NeverCull = 1 << 3,		///< Makes a pass never be culled when not referenced.
+	RGTextureSubresources(RGTexture* pTexture, const RGSubresourceRange& range)
+		: pTexture(pTexture), Range(range)
+	{}
+
+	static RGTextureSubresources Mips(RGTexture* pTexture, uint32 firstMip, uint32 numMips = 1)
+	{
+		return RGTextureSubresources(pTexture, { (uint16)firstMip, (uint16)numMips, 0, RGSubresourceRange::Remaining });
+	}
+
+	static RGTextureSubresources Slices(RGTexture* pTexture, uint32 firstSlice, uint32 numSlices = 1)
+	{
+		return RGTextureSubresources(pTexture, { 0, RGSubresourceRange::Remaining, (uint16)firstSlice, (uint16)numSlices });
+	}
+
+	RGTexture*			pTexture;
+	RGSubresourceRange	Range;
 };
-DECLARE_BITMASK_TYPE(RGPassFlag);
 
 class RGResources
 {
@@ -50,12 +64,15 @@ private:
 	const RGPass& m_Pass;
 };
 
+// Linear allocator for the data of a graph. Grows in chunks and returns them to a global pool when it is destroyed,
+// so recording the graph of the next frame reuses the same memory instead of allocating it again.
 class RGGraphAllocator
 {
 public:
 	struct AllocatedObject
 	{
 		virtual ~AllocatedObject() = default;
+		AllocatedObject* pNext = nullptr;
 	};
 
 	template<typename T>
@@ -68,24 +85,17 @@ public:
 		T Object;
 	};
 
-	RGGraphAllocator(uint64 size)
-		: m_Size(size), m_pData(new char[size]), m_pCurrentOffset(m_pData)
-	{}
+	RGGraphAllocator(uint64 chunkSize);
+	~RGGraphAllocator();
 
-	~RGGraphAllocator()
-	{
-		for (size_t i = 0; i < m_NonPODAllocations.size(); ++i)
-		{
-			m_NonPODAllocations[i]->~AllocatedObject();
-		}
-		delete[] m_pData;
-	}
+	RGGraphAllocator(const RGGraphAllocator& other) = delete;
+	RGGraphAllocator& operator=(const RGGraphAllocator& other) = delete;
 
 	template<typename T, typename ...Args>
 	NO_DISCARD T* AllocateObject(Args&&... args)
 	{
 		using AllocatedType = std::conditional_t<std::is_trivial_v<T>, T, TAllocatedObject<T>>;
-		void* pData = Allocate(sizeof(AllocatedType));
+		void* pData = Allocate(sizeof(AllocatedType), alignof(AllocatedType));
 		AllocatedType* pAllocation = new (pData) AllocatedType(std::forward<Args&&>(args)...);
 
 		if constexpr (std::is_trivial_v<T>)
@@ -94,7 +104,8 @@ public:
 		}
 		else
 		{
-			m_NonPODAllocations.push_back(pAllocation);
+			pAllocation->pNext = m_pNonPODAllocations;
+			m_pNonPODAllocations = pAllocation;
 			return &pAllocation->Object;
 		}
 	}
@@ -102,45 +113,88 @@ public:
 	NO_DISCARD const char* AllocateString(const char* pStr)
 	{
 		uint32 len = CString::StrLen(pStr);
-		char* pAlloc = (char*)Allocate(len + 1);
+		char* pAlloc = (char*)Allocate(len + 1, 1);
 		strcpy_s(pAlloc, len + 1, pStr);
 		return pAlloc;
 	}
 
-	NO_DISCARD void* Allocate(uint64 size)
+	NO_DISCARD void* Allocate(uint64 size, uint64 alignment = 16)
 	{
-		gAssert(m_pCurrentOffset - m_pData + size < m_Size);
-		void* pData = m_pCurrentOffset;
-		m_pCurrentOffset += size;
-
-		// For debugging allocations
-#if 0
-		E_LOG(Info, "Allocating %s (%s / %s - %.0f%%)",
-			Math::PrettyPrintDataSize(size).c_str(),
-			Math::PrettyPrintDataSize(GetSize()).c_str(),
-			Math::PrettyPrintDataSize(GetCapacity()).c_str(),
-			(float)GetSize() / GetCapacity() * 100.0f
-		);
-#endif
-
+		char* pData = (char*)Math::AlignUp((uint64)m_pCurrent, alignment);
+		if ((uint64)pData + size > (uint64)m_pEnd)
+		{
+			AddChunk(size + alignment);
+			pData = (char*)Math::AlignUp((uint64)m_pCurrent, alignment);
+		}
+		m_pCurrent = pData + size;
+		m_Size += size;
 		return pData;
 	}
 
-	uint64 GetSize() const { return m_pCurrentOffset - m_pData; }
-	uint64 GetCapacity() const { return m_Size; }
+	uint64 GetSize() const { return m_Size; }
+	uint64 GetCapacity() const { return m_Capacity; }
+
+	// Number of chunks that all allocators had to allocate because the pool had no chunk to reuse
+	static uint64 GetNumChunkAllocations();
 
 private:
-	Array<AllocatedObject*> m_NonPODAllocations;
-	uint64 m_Size;
-	char* m_pData;
-	char* m_pCurrentOffset;
+	friend struct RGChunkPool;
+
+	struct Chunk
+	{
+		Chunk*	pNext;
+		uint64	Size;		///< Including this header
+	};
+
+	void AddChunk(uint64 minSize);
+
+	AllocatedObject*	m_pNonPODAllocations	= nullptr;	///< Destroyed in reverse order of allocation
+	Chunk*				m_pChunks				= nullptr;
+	char*				m_pCurrent				= nullptr;
+	char*				m_pEnd					= nullptr;
+	uint64				m_ChunkSize;
+	uint64				m_Size					= 0;
+	uint64				m_Capacity				= 0;
 };
 
+// STL allocator that allocates from a RGGraphAllocator. Memory is only released when the RGGraphAllocator is destroyed.
+template<typename T>
+class RGArenaAllocator
+{
+public:
+	using value_type = T;
+
+	RGArenaAllocator(RGGraphAllocator& allocator)
+		: m_pAllocator(&allocator)
+	{}
+
+	template<typename U>
+	RGArenaAllocator(const RGArenaAllocator<U>& other)
+		: m_pAllocator(other.m_pAllocator)
+	{}
+
+	T* allocate(size_t count)				{ return static_cast<T*>(m_pAllocator->Allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T* pData, size_t count)	{}
+
+	bool operator==(const RGArenaAllocator& other) const = default;
+
+private:
+	template<typename U>
+	friend class RGArenaAllocator;
+
+	RGGraphAllocator* m_pAllocator;
+};
+
+// Array of which the memory is owned by the graph
+template<typename T>
+using RGArray = std::vector<T, RGArenaAllocator<T>>;
+
 struct RGEvent
 {
 	const char*		pName		= "";
 	const char*		pFilePath	= nullptr;
 	uint32			LineNumber	= 0;
+	bool			PreserveOrder = false;	///< Passes in the scope keep their relative order when passes are reordered
 };
 using RGEventID = RGHandle<RGEvent, uint16>;
 
@@ -150,7 +204,7 @@ private:
 	struct IRGPassCallback
 	{
 		virtual ~IRGPassCallback() = default;
-		virtual void Execute(CommandContext& context, const RGResources& resources) = 0;
+		virtual void Execute(CommandContext& context, const RGResources& resources, uint32 partIndex, uint32 numParts) = 0;
 	};
 
 	template<typename TLambda>
@@ -160,7 +214,7 @@ private:
 			: Lambda(std::forward<TLambda&&>(lambda))
 		{}
 
-		virtual void Execute(CommandContext& context, const RGResources& resources)
+		virtual void Execute(CommandContext& context, const RGResources& resources, uint32 partIndex, uint32 numParts)
 		{
 			(Lambda)(context, resources);
 		}
@@ -168,6 +222,21 @@ private:
 		TLambda Lambda;
 	};
 
+	template<typename TLambda>
+	struct RGParallelPassCallback : public IRGPassCallback
+	{
+		RGParallelPassCallback(TLambda&& lambda)
+			: Lambda(std::forward<TLambda&&>(lambda))
+		{}
+
+		virtual void Execute(CommandContext& context, const RGResources& resources, uint32 partIndex, uint32 numParts)
+		{
+			(Lambda)(context, resources, partIndex, numParts);
+		}
+
+		TLambda Lambda;
+	};
+
 public:
 	friend class RGGraph;
 	friend class RGResources;
@@ -187,7 +256,9 @@ public:
 	};
 
 	RGPass(RGGraph& graph, RGGraphAllocator& allocator, const char* pName, RGPassFlag flags, RGPassID id)
-		: Graph(graph), Allocator(allocator), pName(pName), ID(id), Flags(flags)
+		: pName(pName), Graph(graph), Allocator(allocator), ID(id), Flags(flags),
+		Waits(allocator), EventsToStart(allocator), CPUEventsToStart(allocator), RenderTargets(allocator),
+		Transitions(allocator), ExitTransitions(allocator), BeginTransitions(allocator), AliasBarriers(allocator), Accesses(allocator)
 	{
 	}
 
@@ -203,21 +274,39 @@ public:
 		return *this;
 	}
 
+	// Binds a callback that can record the pass in up to 'maxParts' commandlists in parallel, if recording the pass is expensive.
+	// The callback is invoked once per part with signature (CommandContext&, const RGResources&, uint32 partIndex, uint32 numParts)
+	// and records its share of the work. Each part starts with a new commandlist, so it must set all the state it needs.
+	template<typename ExecuteFn>
+	RGPass& BindParallel(uint32 maxParts, ExecuteFn&& callback)
+	{
+		static_assert(sizeof(ExecuteFn) < 1024, "The Execute callback exceeds the maximum size");
+		gAssert(!pExecuteCallback, "Pass is already bound! This may be unintentional");
+		gAssert(maxParts > 0);
+		pExecuteCallback = Allocator.AllocateObject<RGParallelPassCallback<ExecuteFn>>(std::forward<ExecuteFn&&>(callback));
+		MaxParts = maxParts;
+		return *this;
+	}
+
 	RGPass& Write(Span<RGResource*> resources);
 	RGPass& Read(Span<RGResource*> resources);
+	RGPass& Write(const RGTextureSubresources& subresources);
+	RGPass& Read(const RGTextureSubresources& subresources);
 	RGPass& RenderTarget(RGTexture* pResource, RenderPassColorFlags flags = RenderPassColorFlags::None, RGTexture* pResolveTarget = nullptr);
 	RGPass& DepthStencil(RGTexture* pResource, RenderPassDepthFlags flags = RenderPassDepthFlags::None);
 
 	NO_DISCARD const char* GetName() const { return pName; }
+	NO_DISCARD RGQueueType GetQueue() const { return Queue; }
 
 private:
 	struct ResourceAccess
 	{
 		RGResource* pResource;
 		D3D12_RESOURCE_STATES Access;
+		RGSubresourceRange Range;
 	};
 
-	void AddAccess(RGResource* pResource, D3D12_RESOURCE_STATES state);
+	void AddAccess(RGResource* pResource, D3D12_RESOURCE_STATES state, const RGSubresourceRange& range = {});
 
 	struct ResourceTransition
 	{
@@ -225,6 +314,7 @@ private:
 		D3D12_RESOURCE_STATES	BeforeState;
 		D3D12_RESOURCE_STATES	AfterState;
 		uint32					SubResource;
+		D3D12_RESOURCE_BARRIER_FLAGS Flags	= D3D12_RESOURCE_BARRIER_FLAG_NONE;	///< BEGIN_ONLY/END_ONLY for split transitions
 	};
 
 	struct AliasBarrier
@@ -241,36 +331,109 @@ private:
 	RGPassID						ID;
 	RGPassFlag						Flags;
 	bool							IsCulled			= true;
+	uint64							CostKey				= 0;		///< Identifies the pass in RGPassCostHistory
+	uint32							MaxParts			= 1;		///< Number of commandlists the pass can be recorded in
+
+	// Queue scheduling
+	RGQueueType						Queue				= RGQueueType::Graphics;
+	bool							Signal				= false;	///< A pass on another queue waits for this pass
+	RGArray<RGPassID>				Waits;							///< Passes on other queues to wait for before this pass starts
 
 	// Profiling
-	Array<RGEventID>				EventsToStart;
-	Array<RGEventID>				CPUEventsToStart;
+	RGArray<RGEventID>				EventsToStart;
+	RGArray<RGEventID>				CPUEventsToStart;
 	uint32							NumEventsToEnd		= 0;
 	uint32							NumCPUEventsToEnd	= 0;
 
-	Array<RenderTargetAccess>		RenderTargets;
+	RGArray<RenderTargetAccess>		RenderTargets;
 	DepthStencilAccess				DepthStencilTarget{};
 	IRGPassCallback*				pExecuteCallback = nullptr;
 
-	Array<ResourceTransition>		Transitions;
-	Array<AliasBarrier>				AliasBarriers;
-	Array<ResourceAccess>			Accesses;
-	Array<RGPassID>					PassDependencies;
+	RGArray<ResourceTransition>		Transitions;
+	RGArray<ResourceTransition>		ExitTransitions;	///< Releases resources to the compute queue after the pass has executed
+	RGArray<ResourceTransition>		BeginTransitions;	///< Split transitions begun after the pass has executed
+	RGArray<AliasBarrier>			AliasBarriers;
+	RGArray<ResourceAccess>			Accesses;
 };
 
-struct RGGraphOptions
+// Keeps the result of graph compiles, keyed by the structure of the graph.
+// A graph is recorded every frame, but its structure rarely changes. A graph with the same passes, accesses, resources and options
+// reuses the culling, resource placements, transitions and pass groups of an earlier compile, as long as the physical resources are still available and in the same state.
+class RGCompileCache
 {
-	bool   Jobify				 = true;
-	bool   SingleThread			 = false;
-	bool   PassCulling			 = true;
-	bool   TrashAliasedResources = false;
-	uint32 CommandlistGroupSize	 = 10;
+public:
+	RGCompileCache();
+	~RGCompileCache();
+
+	RGCompileCache(const RGCompileCache& other) = delete;
+	RGCompileCache& operator=(const RGCompileCache& other) = delete;
+
+	void Clear();
+
+	uint32 GetNumHits() const	{ return m_NumHits; }
+	uint32 GetNumMisses() const	{ return m_NumMisses; }
+
+private:
+	friend class RGGraph;
+
+	struct Entry;
+
+	static constexpr uint32		cMaxEntries = 8;
+
+	Array<UniquePtr<Entry>>		m_Entries;		///< Most recently used first
+	uint32						m_NumHits	= 0;
+	uint32						m_NumMisses = 0;
+};
+
+// Keeps the CPU time it takes to record each pass, averaged over the frames.
+// A pass is identified by its name and the number of earlier passes with the same name.
+// Passes are grouped into recording jobs of similar cost, so that the jobs finish close together.
+class RGPassCostHistory
+{
+public:
+	RGPassCostHistory() = default;
+
+	RGPassCostHistory(const RGPassCostHistory& other) = delete;
+	RGPassCostHistory& operator=(const RGPassCostHistory& other) = delete;
+
+	// Average recording time in ms. 0 if the pass was never recorded
+	float GetCost(uint64 key) const;
+
+	// Changes when the average cost of a pass drifted away from the cost that the passes were last grouped with.
+	// Part of the compile cache key, so cached compile results are regrouped.
+	uint32 GetVersion() const { return m_Version; }
+
+	void Clear();
+
+private:
+	friend class RGGraph;
+
+	void AddSample(uint64 key, float time);
+	void EndExecute();
+
+	struct Entry
+	{
+		float	Average		= 0.0f;
+		float	Grouped		= 0.0f;		///< Average when the version last changed
+		float	Sample		= 0.0f;		///< Recording time in the current execute
+		uint32	LastUsed	= 0;		///< Execute of the last sample
+		bool	IsNew		= true;
+	};
+
+	static constexpr float	cSmoothing		= 0.1f;		///< Weight of a new sample in the average
+	static constexpr float	cRegroupRatio	= 0.25f;	///< Relative change of the average that causes a regroup
+	static constexpr float	cRegroupMinTime = 0.02f;	///< Changes in ms smaller than this never cause a regroup
+	static constexpr uint32 cMaxUnusedAge	= 256;		///< Number of executes without a sample after which an entry is removed
+
+	HashMap<uint64, Entry>	m_Entries;
+	uint32					m_Version		= 0;
+	uint32					m_NumExecutes	= 1;		///< Starts at 1 so an entry that was never sampled doesn't match
 };
 
 class RGGraph
 {
 public:
-	RGGraph(uint64 allocatorSize = 1024 * 256);
+	RGGraph(uint64 allocatorChunkSize = 1024 * 256);
 	~RGGraph();
 
 	RGGraph(const RGGraph& other) = delete;
@@ -293,6 +456,9 @@ public:
 		return m_Allocator.Allocate(size);
 	}
 
+	const RGGraphAllocator& GetAllocator() const { return m_Allocator; }
+	RGGraphAllocator& GetAllocator() { return m_Allocator; }
+
 	RGPass& AddPass(const char* pName, RGPassFlag flags)
 	{
 		RGPass* pPass = Allocate<RGPass>(std::ref(*this), m_Allocator, m_Allocator.AllocateString(pName), flags, RGPassID((uint16)m_Passes.size()));
@@ -352,6 +518,15 @@ public:
 	void Export(RGTexture* pTexture, Ref<Texture>* pTarget, TextureFlag additionalFlags = TextureFlag::None);
 	void Export(RGBuffer* pBuffer, Ref<Buffer>* pTarget, BufferFlag additionalFlags = BufferFlag::None);
 
+	// Creates the version of a history for this frame. It stays alive until the graph of the frame after is executed, or longer for histories of more frames.
+	// 'pOutIsNew' is false if a history of a single frame reuses the resource of the previous frame.
+	NO_DISCARD RGTexture* CreateHistory(RGTextureHistory& history, const char* pName, const TextureDesc& desc, bool* pOutIsNew = nullptr);
+	NO_DISCARD RGBuffer* CreateHistory(RGBufferHistory& history, const char* pName, const BufferDesc& desc, bool* pOutIsNew = nullptr);
+
+	// Imports the version of a history from 'framesAgo' frames ago. Falls back to 'pFallback' if that version doesn't exist
+	NO_DISCARD RGTexture* TryImportHistory(const RGTextureHistory& history, Texture* pFallback = nullptr, uint32 framesAgo = 1);
+	NO_DISCARD RGBuffer* TryImportHistory(const RGBufferHistory& history, Buffer* pFallback = nullptr, uint32 framesAgo = 1);
+
 	NO_DISCARD RGTexture* FindTexture(const char* pName) const
 	{
 		for (RGResource* pResource : m_Resources)
@@ -368,55 +543,88 @@ public:
 	void DrawResourceTracker(bool& enabled) const;
 	void DrawPassView(bool& enabled) const;
 
-	void PushEvent(const char* pName, const char* pFilePath = "", uint32 lineNumber = 0);
+	void PushEvent(const char* pName, const char* pFilePath = "", uint32 lineNumber = 0, bool preserveOrder = false);
 	void PopEvent();
 
 	RGBlackboard Blackboard;
 
 private:
-	RGEventID AddEvent(const char* pName, const char* pFilePath, uint32 lineNumber)
+	RGEventID AddEvent(const char* pName, const char* pFilePath, uint32 lineNumber, bool preserveOrder)
 	{
-		m_Events.push_back(RGEvent{ m_Allocator.AllocateString(pName), pFilePath, lineNumber });
+		m_Events.push_back(RGEvent{ m_Allocator.AllocateString(pName), pFilePath, lineNumber, preserveOrder });
 		return RGEventID((uint16)(m_Events.size() - 1));
 	}
 
-	void ExecutePass(const RGPass* pPass, CommandContext& context) const;
+	template<typename T>
+	RGResourceT<T>* CreateHistoryResource(RGHistoryBase& history, const char* pName, const typename RGResourceT<T>::TDesc& desc, bool* pOutIsNew);
+	template<typename T>
+	RGResourceT<T>* ImportHistoryResource(const RGHistoryBase& history, T* pFallback, uint32 framesAgo);
+	void UpdateHistories();
+
+	void ReleaseExportTargets();
+	void GetCacheKey(Array<uint32>& outKey) const;
+	bool CompileFromCache(RGCompileCache& cache, uint64 hash, const Array<uint32>& key);
+	void StoreInCache(RGCompileCache& cache, uint64 hash, Array<uint32>&& key, Span<const Array<D3D12_RESOURCE_STATES>> initialStates, Span<const uint32> passOrder) const;
+	void ApplyPassOrder(Span<const uint32> inputPassIndices);
+	void ExecutePass(const RGPass* pPass, CommandContext& context, uint32 partIndex, uint32 numParts) const;
 	void PrepareResources(const RGPass* pPass, CommandContext& context) const;
+	void InsertTransition(const RGPass::ResourceTransition& transition, CommandContext& context) const;
 	void DestroyData();
 
 	bool						m_IsCompiled		= false;
+	bool						m_UsesAsyncCompute	= false;
+	bool						m_UseEnhancedBarriers = false;
 	RGGraphOptions				m_Options{};
-	Array<RGEventID>			m_PendingEvents;
-	Array<RGEvent>				m_Events;
+	RGGraphAllocator			m_Allocator;			///< Owns the passes, resources and all arrays below
 
-	RGGraphAllocator			m_Allocator;
+	RGArray<RGEventID>			m_PendingEvents;
+	RGArray<RGEvent>			m_Events;
 
-	Array<Span<const RGPass*>>	m_PassExecuteGroups;
-	Array<RGPass*>				m_Passes;
-	Array<RGResource*>			m_Resources;
+	// Passes that are recorded in a single commandlist.
+	// A pass that is recorded in multiple commandlists has a group for each part.
+	struct ExecuteGroup
+	{
+		Span<const RGPass*>		Passes;
+		RGQueueType				Queue;
+		uint32					PartIndex	= 0;
+		uint32					NumParts	= 1;
+		float					RecordCost	= 0.0f;		///< Estimated recording time in ms. Expensive groups are recorded first
+	};
+	RGArray<ExecuteGroup>		m_PassExecuteGroups;	///< In submission order
+	RGArray<const RGPass*>		m_ScheduledPasses;		///< Active passes ordered by queue. Backs the groups
+	RGArray<RGPass::ResourceTransition> m_EntryTransitions;	///< Releases resources to the compute queue before any pass executes
+	RGArray<RGPass*>			m_Passes;
+	RGArray<RGResource*>		m_Resources;
 
 	struct ExportedTexture
 	{
 		RGTexture*		pTexture;
 		Ref<Texture>*	pTarget;
 	};
-	Array<ExportedTexture>		m_ExportTextures;
+	RGArray<ExportedTexture>	m_ExportTextures;
 
 	struct ExportedBuffer
 	{
 		RGBuffer*		pBuffer;
 		Ref<Buffer>*	pTarget;
 	};
-	Array<ExportedBuffer>		m_ExportBuffers;
+	RGArray<ExportedBuffer>		m_ExportBuffers;
+
+	struct History
+	{
+		RGHistoryBase*	pHistory;
+		RGResource*		pResource;		///< Version of the current frame
+	};
+	RGArray<History>			m_Histories;
 };
 
 class RGGraphScope
 {
 public:
-	RGGraphScope(const char* pName, RGGraph& graph, const char* pFilePath = "", uint32 lineNumber = 0)
+	RGGraphScope(const char* pName, RGGraph& graph, const char* pFilePath = "", uint32 lineNumber = 0, bool preserveOrder = false)
 		: m_Graph(graph)
 	{
-		graph.PushEvent(pName, pFilePath, lineNumber);
+		graph.PushEvent(pName, pFilePath, lineNumber, preserveOrder);
 	}
 	~RGGraphScope()
 	{
@@ -434,4 +642,7 @@ namespace RGUtils
 	RGBuffer*	CreatePersistent(RGGraph& graph, const char* pName, const BufferDesc& bufferDesc, Ref<Buffer>* pStorageTarget, bool* pOutIsNew = nullptr);
 	RGTexture*	CreatePersistent(RGGraph& graph, const char* pName, const TextureDesc& textureDesc, Ref<Texture>* pStorageTarget, bool* pOutIsNew = nullptr);
 	void		DoUpload(RGGraph& graph, RGBuffer* pTarget, const void* pSource, uint32 size);
+
+	// Records graphs of 'numPasses' passes without compiling them and logs the allocations made for each
+	void		RunRecordingBenchmark(uint32 numPasses);
 }
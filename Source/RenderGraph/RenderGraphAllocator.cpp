@@ -1,5 +1,8 @@
 #include "stdafx.h"
 #include "RenderGraphAllocator.h"
+#include "RenderGraphPlacement.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
 #include "Core/Profiler.h"
 #include "Core/Utils.h"
 #include "RHI/Device.h"
@@ -8,9 +11,15 @@
 
 RGResourceAllocator gRenderGraphAllocator;
 
+// Usage: RGRecordPlacement
+// Saves the transient resources of the next graph to Saved/Profiling/, to replay with RGReplayPlacement
+static ConsoleCommand<> gRecordRGPlacement("RGRecordPlacement", []() { gRenderGraphAllocator.RecordNextPlacement(); });
+
 static constexpr uint32 cHeapCleanupLatency		= 3;
 static constexpr uint32 cResourceCleanupLatency = 120;
 
+static uint64 sNextPhysicalResourceID = 1;
+
 static constexpr uint32 sGetMinHeapSize(D3D12_HEAP_TYPE heapType)
 {
 	switch (heapType)
@@ -55,8 +64,8 @@ static D3D12_RESOURCE_DESC sGetResourceDesc(const RGResource* pResource)
 }
 
 
-RGResourceAllocator::RGHeap::RGHeap(GraphicsDevice* pDevice, uint32 size, D3D12_HEAP_TYPE heapType)
-	: Size(Math::AlignUp(size, sGetMinHeapSize(heapType))), HeapType(heapType)
+RGResourceAllocator::RGHeap::RGHeap(GraphicsDevice* pDevice, uint32 size, D3D12_HEAP_TYPE heapType, bool isHistory)
+	: Size(Math::AlignUp(size, sGetMinHeapSize(heapType))), HeapType(heapType), IsHistoryHeap(isHistory)
 {
 	D3D12_HEAP_DESC heapDesc{
 		.SizeInBytes = Size,
@@ -130,127 +139,94 @@ uint32 RGResourceAllocator::RGHeap::GetUsedSize() const
 }
 
 
-bool RGResourceAllocator::RGHeap::TryAllocate(GraphicsDevice* pDevice, uint32 frameIndex, RGResource* pResource)
+void RGResourceAllocator::RGHeap::Allocate(GraphicsDevice* pDevice, uint32 frameIndex, RGResource* pResource, uint32 offset)
 {
-	if (pResource->Size > Size)
-		return false;
+	gAssert(sGetHeapType(pResource) == HeapType);
+	gAssert(pResource->IsHistory == IsHistoryHeap);
+	gAssert(offset + pResource->Size <= Size);
+	gAssert(Math::IsAligned(offset, pResource->Alignment));
 
-	if (sGetHeapType(pResource) != HeapType)
-		return false;
+	RGPhysicalResource* pPhysicalResource = nullptr;
 
-	// Shrinking: If the found heap has no allocations and it's very large for the resource, don't allocate into it and instead continue searching so this heap has the chance to be released
-	if (Allocations.empty() && Math::AlignUp<uint64>(pResource->Size, sGetMinHeapSize(HeapType)) < Size)
-		return false;
-
-	FreeRanges.clear();
-
-	// Mark the start as free
-	FreeRanges.push_back({ 0, true });
-
-	// For each allocated resource, if the lifetime overlaps, mark it as "not free"
-	for (RGPhysicalResource* pAllocatedResource : Allocations)
+	// Try to find an already existing physical resource that fits the space and description
+	gAssert(pHeap || Allocations.empty(), "Heap can't have physical resources without an allocated heap");
+	for (uint32 i = 0; i < (uint32)ResourceCache.size(); ++i)
 	{
-		if (pAllocatedResource->Lifetime.Overlaps(pResource->GetLifetime()) || pAllocatedResource->IsExternal)
+		RGPhysicalResource* pCachedResource = ResourceCache[i];
+		if (pCachedResource->Offset == offset && // The physical resource must be at the placed offset
+			pCachedResource->IsCompatible(pResource))	// The physical resource description must match the vritual resource
 		{
-			FreeRanges.push_back({ pAllocatedResource->Offset, false });
-			FreeRanges.push_back({ pAllocatedResource->Offset + pAllocatedResource->Size, true });
+			pPhysicalResource = pCachedResource;
+			Utils::gSwapRemove(ResourceCache, i);
+			break;
 		}
 	}
 
-	// Close the open free range
-	FreeRanges.push_back({ Size, false });
-
-	// Sort the markup by offset.
-	std::sort(FreeRanges.begin(), FreeRanges.end(), [](const RGHeap::HeapOffset& a, const RGHeap::HeapOffset& b) { return a.Offset < b.Offset; });
-
-	// Algorithm: Keep track of how many "free" marks we've come across
-	// If we hit the end of a free mark and the range is closed (== 0), then this range is free
-	uint32 freeRangeCounter = 0;
-	uint32 lastBeginOffset	= 0;
-	for (const RGHeap::HeapOffset& heapOffset : FreeRanges)
+	if (!pPhysicalResource)
 	{
-		if (heapOffset.IsFreeBegin)
+		pPhysicalResource		  = new RGPhysicalResource();
+		pPhysicalResource->ID	  = sNextPhysicalResourceID++;
+		pPhysicalResource->Offset = offset;
+		pPhysicalResource->Size	  = pResource->Size;
+		pPhysicalResource->Type	  = pResource->GetType();
+
+		if (pResource->GetType() == RGResourceType::Texture)
 		{
-			// Keep track of how many open ranges there are and where it started
-			lastBeginOffset = heapOffset.Offset;
-			++freeRangeCounter;
+			RGTexture* pTexture					   = static_cast<RGTexture*>(pResource);
+			pPhysicalResource->ResourceTextureDesc = pTexture->GetDesc();
+			pPhysicalResource->pResource		   = pDevice->CreateTexture(pTexture->GetDesc(), pHeap, offset, "");
+		}
+		else if (pResource->GetType() == RGResourceType::Buffer)
+		{
+			RGBuffer* pBuffer					  = static_cast<RGBuffer*>(pResource);
+			pPhysicalResource->ResourceBufferDesc = pBuffer->GetDesc();
+			pPhysicalResource->pResource		  = pDevice->CreateBuffer(pBuffer->GetDesc(), pHeap, offset, "");
 		}
 		else
 		{
-			--freeRangeCounter;
-			if (freeRangeCounter == 0)
-			{
-				// Test whether the free region is large enough
-				uint32 alignedOffset = Math::AlignUp(lastBeginOffset, pResource->Alignment);
-				if (alignedOffset + pResource->Size <= heapOffset.Offset)
-				{
-					LastUsedFrame = frameIndex;
+			gAssert(false);
+		}
+	}
 
-					// Sanity check
-					gAssert(alignedOffset + pResource->Size <= Size);
-					gAssert(Math::IsAligned(alignedOffset, pResource->Alignment));
+	Assign(frameIndex, pPhysicalResource, pResource);
+}
 
-					RGPhysicalResource* pPhysicalResource = nullptr;
 
-					// Try to find an already existing physical resource that fits the space and description
-					gAssert(pHeap || Allocations.empty(), "Heap can't have physical resources without an allocated heap");
-					for (uint32 i = 0; i < (uint32)ResourceCache.size(); ++i)
-					{
-						RGPhysicalResource* pCachedResource = ResourceCache[i];
-						if (pCachedResource->Offset == alignedOffset && // The physical resource must be within the region of the free range
-							pCachedResource->IsCompatible(pResource))	// The physical resource description must match the vritual resource
-						{
-							pPhysicalResource = pCachedResource;
-							Utils::gSwapRemove(ResourceCache, i);
-							break;
-						}
-					}
+void RGResourceAllocator::RGHeap::Reuse(uint32 frameIndex, RGPhysicalResource* pPhysicalResource, RGResource* pResource)
+{
+	auto it = std::find(ResourceCache.begin(), ResourceCache.end(), pPhysicalResource);
+	gAssert(it != ResourceCache.end(), "Physical resource is not available for reuse");
+	Utils::gSwapRemove(ResourceCache, (uint32)(it - ResourceCache.begin()));
+	Assign(frameIndex, pPhysicalResource, pResource);
+}
 
-					if (!pPhysicalResource)
-					{
-						pPhysicalResource		  = new RGPhysicalResource();
-						pPhysicalResource->Offset = alignedOffset;
-						pPhysicalResource->Size	  = pResource->Size;
-						pPhysicalResource->Type	  = pResource->GetType();
-
-						if (pResource->GetType() == RGResourceType::Texture)
-						{
-							RGTexture* pTexture					   = static_cast<RGTexture*>(pResource);
-							pPhysicalResource->ResourceTextureDesc = pTexture->GetDesc();
-							pPhysicalResource->pResource		   = pDevice->CreateTexture(pTexture->GetDesc(), pHeap, alignedOffset, "");
-						}
-						else if (pResource->GetType() == RGResourceType::Buffer)
-						{
-							RGBuffer* pBuffer					  = static_cast<RGBuffer*>(pResource);
-							pPhysicalResource->ResourceBufferDesc = pBuffer->GetDesc();
-							pPhysicalResource->pResource		  = pDevice->CreateBuffer(pBuffer->GetDesc(), pHeap, alignedOffset, "");
-						}
-						else
-						{
-							gAssert(false);
-						}
-					}
 
-					pPhysicalResource->LastUsedFrame = frameIndex;
-					pPhysicalResource->Lifetime		 = pResource->GetLifetime();
-					Allocations.push_back(pPhysicalResource);
-					pResource->SetResource(pPhysicalResource->pResource);
-					if (pPhysicalResource->Name != pResource->GetName())
-					{
-						pPhysicalResource->Name = pResource->GetName();
-						pResource->GetPhysicalUnsafe()->SetName(pResource->GetName());
-					}
+RGResourceAllocator::RGPhysicalResource* RGResourceAllocator::RGHeap::FindCachedResource(uint64 id) const
+{
+	for (RGPhysicalResource* pCachedResource : ResourceCache)
+	{
+		if (pCachedResource->ID == id)
+			return pCachedResource;
+	}
+	return nullptr;
+}
 
-					gAssert(pResource->IsAllocated());
 
-					// E_LOG(Warning, "[%s] Placed Resource in Heap %d - Lifetime [%d, %d] - Memory [%llu, %llu]", pResource->pName, heap.ID, pResource->GetLifetime().Begin, pResource->GetLifetime().End, pResource->GetMemoryRange().Begin, pResource->GetMemoryRange().End);
+void RGResourceAllocator::RGHeap::Assign(uint32 frameIndex, RGPhysicalResource* pPhysicalResource, RGResource* pResource)
+{
+	LastUsedFrame = frameIndex;
 
-					return true;
-				}
-			}
-		}
+	pPhysicalResource->LastUsedFrame = frameIndex;
+	pPhysicalResource->Lifetime		 = pResource->GetLifetime();
+	Allocations.push_back(pPhysicalResource);
+	pResource->SetResource(pPhysicalResource->pResource);
+	if (pPhysicalResource->Name != pResource->GetName())
+	{
+		pPhysicalResource->Name = pResource->GetName();
+		pResource->GetPhysicalUnsafe()->SetName(pResource->GetName());
 	}
-	return false;
+
+	gAssert(pResource->IsAllocated());
 }
 
 
@@ -258,10 +234,10 @@ bool RGResourceAllocator::RGHeap::IsUnused(uint32 frameIndex) const
 {
 	if (LastUsedFrame + cHeapCleanupLatency < frameIndex)
 	{
-		// Can't delete a heap if it has resources inside it that are still references
+		// Can't delete a heap if it has resources inside it that are still references or retained by a history
 		for (const RGPhysicalResource* pRes : Allocations)
 		{
-			if (pRes->IsExternal)
+			if (pRes->IsExternal || pRes->IsRetained)
 				return false;
 		}
 		return true;
@@ -276,10 +252,16 @@ void RGResourceAllocator::RGHeap::FreeUnused(uint32 frameIndex)
 
 	for (uint32 i = 0; i < (uint32)Allocations.size(); ++i)
 	{
-		// If an allocation has no external refs, it can be forfeited and moved back into the cache
+		// If an allocation has no external refs and no history retained it, it can be forfeited and moved back into the cache.
+		// Histories have to retain their resources again every frame.
 		RGPhysicalResource* pResource = Allocations[i];
-		if (!pResource->IsExternal)
+		if (pResource->IsRetained)
 		{
+			pResource->IsRetained = false;
+		}
+		else if (!pResource->IsExternal)
+		{
+			pResource->pHistory = nullptr;
 			Utils::gSwapRemove(Allocations, i);
 			i--;
 			ResourceCache.push_back(pResource);
@@ -338,70 +320,95 @@ void RGResourceAllocator::AllocateResources(Span<RGResource*> graphResources)
 		pResource->Alignment = (int)alignment;
 	}
 
-	// If the resource is imported, find whether the physical resource was allocated by this allocated to mark it as used
-	// Also assign the correct lifetime
-	for (RGResource* pResource : resources)
-	{
-		if (pResource->IsImported && pResource->IsAccessed)
-		{
-			gAssert(pResource->pPhysicalResource);
+	UpdateImportedResources(resources);
 
-			RGHeap*				pHeap			  = nullptr;
-			RGPhysicalResource* pPhysicalResource = FindAllocation(pResource->GetPhysicalUnsafe(), &pHeap);
-			if (pPhysicalResource)
-			{
-				pPhysicalResource->Lifetime		 = pResource->GetLifetime();
-				pPhysicalResource->LastUsedFrame = m_FrameIndex;
-				// E_LOG(Warning, "[%s] Existing Imported Resource. Heap %d - Lifetime [%d, %d] - Memory [%llu, %llu]", pResource->pName, pHeap->ID, pResource->GetLifetime().Begin, pResource->GetLifetime().End, pResource->GetMemoryRange().Begin, pResource->GetMemoryRange().End);
-			}
-		}
-	}
-
-	// Sort resources largest to smallest, then largest alignment to smallest.
-	// Exported resources always come first so that they don't cause fragmentation
-	std::sort(resources.begin(), resources.end(), [](const RGResource* a, const RGResource* b) {
+	RGPlacementRecording recording;
+	m_PlacementStats = {};
 
-		if (a->IsExported	!= b->IsExported)	return a->IsExported > b->IsExported;
-		if (a->Size			!= b->Size)			return a->Size > b->Size;
-		if (a->Alignment	!= b->Alignment)	return a->Alignment > b->Alignment;
-		return a->ID.GetIndex() < b->ID.GetIndex();
-	});
+	// Resources can only share a heap of the same heap type. All resources of a heap type are placed at once.
+	// History resources live across frames and get their own heaps, so they don't keep heaps of transient resources alive.
+	const D3D12_HEAP_TYPE heapTypes[] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_TYPE_READBACK };
+	for (uint32 poolIndex = 0; poolIndex < ARRAYSIZE(heapTypes) * 2; ++poolIndex)
+	{
+		D3D12_HEAP_TYPE heapType  = heapTypes[poolIndex / 2];
+		bool			isHistory = poolIndex % 2 == 1;
 
-	// Sort heaps largest to smallest, so smaller heaps can be removed.
-	std::sort(m_Heaps.begin(), m_Heaps.end(), [](const UniquePtr<RGHeap>& a, const UniquePtr<RGHeap>& b) {
-		return a->GetSize() > b->GetSize();
-	});
+		Array<RGResource*>			poolResources;
+		Array<RGPlacementResource>	placements;
+		for (RGResource* pResource : resources)
+		{
+			if (pResource->IsAllocated() || !pResource->IsAccessed || sGetHeapType(pResource) != heapType || pResource->IsHistory != isHistory)
+				continue;
+
+			gAssert(pResource->Size != 0);
+
+			RGPlacementResource& placement = placements.emplace_back();
+			placement.Size				   = pResource->Size;
+			placement.Alignment			   = pResource->Alignment;
+			placement.Begin				   = pResource->GetLifetime().Begin;
+			placement.End				   = pResource->GetLifetime().End;
+			placement.IsPersistent		   = pResource->IsExported;
+			poolResources.push_back(pResource);
+		}
 
-	for (RGResource* pResource : resources)
-	{
-		if (pResource->IsAllocated() || !pResource->IsAccessed)
+		if (placements.empty())
 			continue;
 
-		gAssert(pResource->Size != 0);
-
-		bool success = false;
+		// Everything that is still allocated is referenced outside of the graph
+		Array<RGHeap*>			heaps;
+		Array<RGPlacementHeap>	placementHeaps;
+		uint64					reservedSize = 0;
 		for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
 		{
-			// If the resource is larger than the heap, bail out. Heaps are sorted by size so if this one doesn't fit, none will
-			if (pResource->Size > pHeap->GetSize())
-				break;
+			if (pHeap->GetHeapType() != heapType || pHeap->IsHistory() != isHistory)
+				continue;
 
-			if (pHeap->TryAllocate(m_pDevice, m_FrameIndex, pResource))
+			RGPlacementHeap& placementHeap = placementHeaps.emplace_back();
+			placementHeap.Size			   = pHeap->GetSize();
+			for (const RGPhysicalResource* pAllocation : pHeap->GetAllocations())
 			{
-				success = true;
-				break;
+				placementHeap.Reserved.push_back({ pAllocation->GetMemoryRange().Begin, pAllocation->GetMemoryRange().End });
+				reservedSize += pAllocation->Size;
 			}
+			heaps.push_back(pHeap.get());
 		}
 
-		// If no heap was found, that means the resource wasn't placed and a new heap is needed
-		if (!success)
+		if (m_RecordNextPlacement)
 		{
-			m_Heaps.push_back(std::make_unique<RGHeap>(m_pDevice, pResource->Size, sGetHeapType(pResource)));
-			RGHeap* pHeap = m_Heaps.back().get();
-			// E_LOG(Warning, "New Heap %d - Size: %s", heap.ID, Math::PrettyPrintDataSize(heap.Size));
+			RGPlacementRecording::Pool& pool = recording.Pools.emplace_back();
+			pool.MinHeapSize				 = sGetMinHeapSize(heapType);
+			pool.Resources					 = placements;
+		}
+
+		RGPlacement::Place(placements, placementHeaps, sGetMinHeapSize(heapType));
+
+		for (uint32 heapIndex = (uint32)heaps.size(); heapIndex < (uint32)placementHeaps.size(); ++heapIndex)
+		{
+			gAssert(placementHeaps[heapIndex].IsNew);
+			m_Heaps.push_back(std::make_unique<RGHeap>(m_pDevice, (uint32)placementHeaps[heapIndex].Size, heapType, isHistory));
+			heaps.push_back(m_Heaps.back().get());
+		}
 
-			gVerify(pHeap->TryAllocate(m_pDevice, m_FrameIndex, pResource), == true);
+		for (uint32 i = 0; i < (uint32)placements.size(); ++i)
+		{
+			const RGPlacementResource& placement = placements[i];
+			heaps[placement.Heap]->Allocate(m_pDevice, m_FrameIndex, poolResources[i], (uint32)placement.Offset);
 		}
+
+		m_PlacementStats.PeakMemory += RGPlacement::GetPeakMemory(placements, placementHeaps);
+		m_PlacementStats.LowerBound += RGPlacement::GetLowerBound(placements) + reservedSize;
+	}
+
+	if (m_RecordNextPlacement)
+	{
+		m_RecordNextPlacement = false;
+
+		Paths::CreateDirectoryTree(Paths::ProfilingDir());
+		String path = Sprintf("%sRenderGraph_%s.rgplacement", Paths::ProfilingDir(), Utils::GetTimeString());
+		if (recording.Save(path.c_str()))
+			E_LOG(Info, "Recorded render graph placement to '%s'", path);
+		else
+			E_LOG(Warning, "Failed to record render graph placement to '%s'", path);
 	}
 
 #ifdef _DEBUG
@@ -433,6 +440,100 @@ void RGResourceAllocator::AllocateResources(Span<RGResource*> graphResources)
 }
 
 
+void RGResourceAllocator::GetPlacements(Span<RGResource*> graphResources, Array<uint64>& outPlacements)
+{
+	outPlacements.assign(graphResources.GetSize(), 0);
+	for (uint32 i = 0; i < graphResources.GetSize(); ++i)
+	{
+		const RGResource* pResource = graphResources[i];
+		if (pResource->IsImported || !pResource->IsAccessed)
+			continue;
+
+		RGHeap*				pHeap			  = nullptr;
+		RGPhysicalResource* pPhysicalResource = FindAllocation(pResource->GetPhysicalUnsafe(), &pHeap);
+		gAssert(pPhysicalResource, "Resource '%s' is not allocated by the allocator", pResource->GetName());
+		outPlacements[i] = pPhysicalResource->ID;
+	}
+}
+
+
+bool RGResourceAllocator::FindPlacements(Span<RGResource*> graphResources, Span<const uint64> placements, Array<DeviceResource*>& outResources)
+{
+	PROFILE_CPU_SCOPE();
+
+	gAssert(graphResources.GetSize() == placements.GetSize());
+
+	for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
+		pHeap->UpdateExternals();
+
+	outResources.assign(graphResources.GetSize(), nullptr);
+	for (uint32 i = 0; i < graphResources.GetSize(); ++i)
+	{
+		const RGResource* pResource = graphResources[i];
+		if (pResource->IsImported || !pResource->IsAccessed)
+			continue;
+
+		RGHeap*				pHeap			  = nullptr;
+		RGPhysicalResource* pPhysicalResource = FindCachedResource(placements[i], &pHeap);
+		if (!pPhysicalResource || !pPhysicalResource->IsCompatible(pResource))
+			return false;
+
+		// Everything still allocated is in use outside of the graph
+		for (const RGPhysicalResource* pAllocation : pHeap->GetAllocations())
+		{
+			if (pAllocation->GetMemoryRange().Overlaps(pPhysicalResource->GetMemoryRange()))
+				return false;
+		}
+
+		outResources[i] = pPhysicalResource->pResource;
+	}
+	return true;
+}
+
+
+void RGResourceAllocator::ReusePlacements(Span<RGResource*> graphResources, Span<const uint64> placements)
+{
+	PROFILE_CPU_SCOPE();
+
+	UpdateImportedResources(graphResources);
+
+	for (uint32 i = 0; i < graphResources.GetSize(); ++i)
+	{
+		RGResource* pResource = graphResources[i];
+		if (pResource->IsImported || !pResource->IsAccessed)
+			continue;
+
+		RGHeap*				pHeap			  = nullptr;
+		RGPhysicalResource* pPhysicalResource = FindCachedResource(placements[i], &pHeap);
+		gAssert(pPhysicalResource, "Placement of resource '%s' was not found. FindPlacements() must succeed first", pResource->GetName());
+		pHeap->Reuse(m_FrameIndex, pPhysicalResource, pResource);
+	}
+}
+
+
+void RGResourceAllocator::UpdateImportedResources(Span<RGResource*> graphResources)
+{
+	// If the resource is imported, find whether the physical resource was allocated by this allocated to mark it as used
+	// Also assign the correct lifetime
+	for (RGResource* pResource : graphResources)
+	{
+		if (pResource->IsImported && pResource->IsAccessed)
+		{
+			gAssert(pResource->pPhysicalResource);
+
+			RGHeap*				pHeap			  = nullptr;
+			RGPhysicalResource* pPhysicalResource = FindAllocation(pResource->GetPhysicalUnsafe(), &pHeap);
+			if (pPhysicalResource)
+			{
+				pPhysicalResource->Lifetime		 = pResource->GetLifetime();
+				pPhysicalResource->LastUsedFrame = m_FrameIndex;
+				// E_LOG(Warning, "[%s] Existing Imported Resource. Heap %d - Lifetime [%d, %d] - Memory [%llu, %llu]", pResource->pName, pHeap->ID, pResource->GetLifetime().Begin, pResource->GetLifetime().End, pResource->GetMemoryRange().Begin, pResource->GetMemoryRange().End);
+			}
+		}
+	}
+}
+
+
 void RGResourceAllocator::Tick()
 {
 	ClearUnusedResources();
@@ -459,6 +560,58 @@ void RGResourceAllocator::ClearUnusedResources()
 }
 
 
+uint64 RGResourceAllocator::GetPhysicalID(const DeviceResource* pResource)
+{
+	RGHeap*				pHeap			  = nullptr;
+	RGPhysicalResource* pPhysicalResource = FindAllocation(pResource, &pHeap);
+	return pPhysicalResource ? pPhysicalResource->ID : 0;
+}
+
+
+DeviceResource* RGResourceAllocator::FindHistory(uint64 id, const RGHistoryBase* pHistory)
+{
+	if (id == 0)
+		return nullptr;
+
+	for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
+	{
+		if (!pHeap->IsHistory())
+			continue;
+
+		for (const RGPhysicalResource* pAllocatedResource : pHeap->GetAllocations())
+		{
+			if (pAllocatedResource->ID == id)
+				return pAllocatedResource->pHistory == pHistory ? pAllocatedResource->pResource.Get() : nullptr;
+		}
+	}
+	return nullptr;
+}
+
+
+bool RGResourceAllocator::RetainHistory(uint64 id, const RGHistoryBase* pHistory)
+{
+	if (id == 0)
+		return false;
+
+	for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
+	{
+		if (!pHeap->IsHistory())
+			continue;
+
+		for (RGPhysicalResource* pAllocatedResource : pHeap->GetAllocations())
+		{
+			if (pAllocatedResource->ID == id)
+			{
+				pAllocatedResource->IsRetained = true;
+				pAllocatedResource->pHistory   = pHistory;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
 RGResourceAllocator::RGPhysicalResource* RGResourceAllocator::FindAllocation(const DeviceResource* pResource, RGHeap** pOutHeap)
 {
 	for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
@@ -476,6 +629,20 @@ RGResourceAllocator::RGPhysicalResource* RGResourceAllocator::FindAllocation(con
 }
 
 
+RGResourceAllocator::RGPhysicalResource* RGResourceAllocator::FindCachedResource(uint64 id, RGHeap** pOutHeap)
+{
+	for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
+	{
+		if (RGPhysicalResource* pCachedResource = pHeap->FindCachedResource(id))
+		{
+			*pOutHeap = pHeap.get();
+			return pCachedResource;
+		}
+	}
+	return nullptr;
+}
+
+
 void RGResourceAllocator::DrawDebugView(bool& enabled) const
 {
 	if (!enabled)
@@ -508,6 +675,7 @@ void RGResourceAllocator::DrawDebugView(bool& enabled) const
 		uint32 totalHeapSize			 = 0;
 		uint32 totalResourcesSize		 = 0;
 		uint32 totalAliasedResourcesSize = 0;
+		uint32 totalHistorySize			 = 0;
 
 		for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
 		{
@@ -518,16 +686,21 @@ void RGResourceAllocator::DrawDebugView(bool& enabled) const
 				if (!pResource->IsExternal)
 					lastPassID = Math::Max(pResource->Lifetime.End, lastPassID);
 				totalResourcesSize += pResource->Size;
+				if (pHeap->IsHistory())
+					totalHistorySize += pResource->Size;
 			}
 		}
 
-		if (ImGui::BeginTable("Size Stats", 4))
+		if (ImGui::BeginTable("Size Stats", 7))
 		{
 			ImGui::TableHeader("Header");
 			ImGui::TableSetupColumn("Heap Size");
 			ImGui::TableSetupColumn("Resources Size");
 			ImGui::TableSetupColumn("Aliased Resources Size");
 			ImGui::TableSetupColumn("Difference");
+			ImGui::TableSetupColumn("Peak");
+			ImGui::TableSetupColumn("Lower Bound");
+			ImGui::TableSetupColumn("History");
 			ImGui::TableHeadersRow();
 
 			ImGui::TableNextColumn();
@@ -541,6 +714,12 @@ void RGResourceAllocator::DrawDebugView(bool& enabled) const
 				ImGui::Text("%s", Math::PrettyPrintDataSize(totalResourcesSize - totalHeapSize).c_str());
 			else
 				ImGui::Text("+%s", Math::PrettyPrintDataSize(totalHeapSize - totalResourcesSize).c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text(Math::PrettyPrintDataSize(m_PlacementStats.PeakMemory).c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text(Math::PrettyPrintDataSize(m_PlacementStats.LowerBound).c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text(Math::PrettyPrintDataSize(totalHistorySize).c_str());
 			ImGui::EndTable();
 		}
 
@@ -548,7 +727,7 @@ void RGResourceAllocator::DrawDebugView(bool& enabled) const
 		float widthScale = width / (float)lastPassID;
 		for (const UniquePtr<RGHeap>& pHeap : m_Heaps)
 		{
-			ImGui::Text("Heap (Size: %s - Allocations: %d - Resources: %d)", Math::PrettyPrintDataSize(pHeap->GetSize()).c_str(), pHeap->GetAllocations().GetSize(), pHeap->GetNumResources());
+			ImGui::Text("%s (Size: %s - Allocations: %d - Resources: %d)", pHeap->IsHistory() ? "History Heap" : "Heap", Math::PrettyPrintDataSize(pHeap->GetSize()).c_str(), pHeap->GetAllocations().GetSize(), pHeap->GetNumResources());
 			ImDrawList* pDraw = ImGui::GetWindowDrawList();
 
 			ImVec2 cursor = ImGui::GetCursorScreenPos();
@@ -2,6 +2,8 @@
 
 #include "RenderGraphDefinitions.h"
 
+class RGHistoryBase;
+
 class RGResourceAllocator
 {
 private:
@@ -9,6 +11,7 @@ private:
 	struct RGPhysicalResource
 	{
 		String				Name;
+		uint64				ID = 0;				///< Unique for the lifetime of the allocator. Identifies a placement across frames
 		Ref<DeviceResource> pResource;
 		uint32				Offset;
 		uint32				Size;
@@ -18,6 +21,8 @@ private:
 		BufferDesc			ResourceBufferDesc;
 		URange				Lifetime;
 		bool				IsExternal = false;
+		bool				IsRetained = false;		///< Kept by a history until the next ClearUnusedResources()
+		const RGHistoryBase* pHistory = nullptr;	///< History that retained this resource last
 
 		URange GetMemoryRange() const
 		{
@@ -39,10 +44,12 @@ private:
 	class RGHeap
 	{
 	public:
-		RGHeap(GraphicsDevice* pDevice, uint32 size, D3D12_HEAP_TYPE heapType);
+		RGHeap(GraphicsDevice* pDevice, uint32 size, D3D12_HEAP_TYPE heapType, bool isHistory);
 		~RGHeap();
 
-		bool						TryAllocate(GraphicsDevice* pDevice, uint32 frameIndex, RGResource* pResource);
+		void						Allocate(GraphicsDevice* pDevice, uint32 frameIndex, RGResource* pResource, uint32 offset);
+		void						Reuse(uint32 frameIndex, RGPhysicalResource* pPhysicalResource, RGResource* pResource);
+		RGPhysicalResource*			FindCachedResource(uint64 id) const;
 		void						FreeUnused(uint32 frameIndex);
 		bool						IsUnused(uint32 frameIndex) const;
 		void						UpdateExternals();
@@ -52,9 +59,13 @@ private:
 		Span<RGPhysicalResource*>	GetAllocations() const { return Allocations; }
 		uint32						GetNumResources() const { return (uint32)Allocations.size() + (uint32)ResourceCache.size(); }
 		D3D12_HEAP_TYPE				GetHeapType() const { return HeapType; }
+		bool						IsHistory() const { return IsHistoryHeap; }
 
 	private:
+		void						Assign(uint32 frameIndex, RGPhysicalResource* pPhysicalResource, RGResource* pResource);
+
 		D3D12_HEAP_TYPE				HeapType;
+		bool						IsHistoryHeap = false;	///< Only holds history resources, so long-lived resources don't keep transient heaps alive
 		uint32						LastUsedFrame = 0;
 		uint32						Size = 0;
 		Ref<ID3D12Heap>				pHeap;
@@ -62,7 +73,7 @@ private:
 		Array<RGPhysicalResource*>	ResourceCache;
 		Array<RGPhysicalResource*>	Allocations;
 
-		// Keep track of which memory ranges in the heap for the lifetime of the current resource are free
+		// Scratch list to find which memory ranges in the heap are in use
 		struct HeapOffset
 		{
 			uint32 Offset	   : 31;
@@ -75,19 +86,47 @@ public:
 	void						Init(GraphicsDevice* pDevice);
 	void						Shutdown();
 	void						AllocateResources(Span<RGResource*> graphResources);
+
+	// Placements identify the physical resource assigned to each transient resource, so a later graph with the same structure can skip allocation.
+	// 0 for imported and unused resources.
+	void						GetPlacements(Span<RGResource*> graphResources, Array<uint64>& outPlacements);
+	// Finds the physical resources of earlier placements without assigning them.
+	// Fails if any of them was released, doesn't match its resource anymore or overlaps memory that is still in use.
+	bool						FindPlacements(Span<RGResource*> graphResources, Span<const uint64> placements, Array<DeviceResource*>& outResources);
+	// Assigns the physical resources of placements that were found with FindPlacements()
+	void						ReusePlacements(Span<RGResource*> graphResources, Span<const uint64> placements);
 	void						Tick();
 
+	// History resources stay allocated across frames for as long as their history retains them every frame.
+	// A history identifies its resources by their ID and owner, so a resource that was released and reused for something else isn't found.
+	uint64						GetPhysicalID(const DeviceResource* pResource);
+	DeviceResource*				FindHistory(uint64 id, const RGHistoryBase* pHistory);
+	bool						RetainHistory(uint64 id, const RGHistoryBase* pHistory);
+
+	// Saves the transient resources of the next AllocateResources() call, to compare placement algorithms offline with RGPlacement::RunReplay()
+	void						RecordNextPlacement() { m_RecordNextPlacement = true; }
+
 	void						DrawDebugView(bool& enabled) const;
 
 private:
 	void						ClearUnusedResources();
+	void						UpdateImportedResources(Span<RGResource*> graphResources);
 	RGPhysicalResource*			FindAllocation(const DeviceResource* pResource, RGHeap** pOutHeap);
+	RGPhysicalResource*			FindCachedResource(uint64 id, RGHeap** pOutHeap);
 
 
 	GraphicsDevice*				m_pDevice		= nullptr;
 	uint32						m_FrameIndex	= 0;
 	Array<UniquePtr<RGHeap>>	m_Heaps;
+	bool						m_RecordNextPlacement = false;
 
+	// Memory of the last AllocateResources() call
+	struct PlacementStats
+	{
+		uint64					PeakMemory = 0;		///< Per heap, the end of the highest allocation
+		uint64					LowerBound = 0;		///< The largest total size of allocations alive at the same time
+	};
+	PlacementStats				m_PlacementStats;
 };
 
 extern RGResourceAllocator gRenderGraphAllocator;
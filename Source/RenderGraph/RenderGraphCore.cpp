@@ -0,0 +1,2667 @@
+#include "stdafx.h"
+#include "RenderGraphCore.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Stream.h"
+#include "Core/Utils.h"
+
+#include <random>
+
+namespace RGCore
+{
+	static constexpr uint32 InvalidIndex = RGCoreGraph::InvalidIndex;
+
+	// The compute queue can't transition resources out of graphics-only states. Those resources are released to Common on the graphics queue first.
+	static bool NeedsComputeQueueRelease(RGQueueType queue, RGAccess state)
+	{
+		return queue == RGQueueType::Compute && state != RGAccess::Unknown && !IsAllowedOnQueue(RGQueueType::Compute, state);
+	}
+
+	// Shader reads on the compute queue can't include the pixel shader state
+	static RGAccess GetComputeQueueAccess(RGAccess access)
+	{
+		if (EnumHasAnyFlags(access, RGAccess::PixelShaderRead))
+			access = (access & ~RGAccess::PixelShaderRead) | RGAccess::NonPixelShaderRead;
+		return access;
+	}
+
+	// Transient render targets and depth stencils are discarded on first use
+	static bool NeedsDiscard(const RGCoreGraph::Resource& resource)
+	{
+		return resource.IsTexture && EnumHasAnyFlags(resource.DescUsage | resource.Usage, RGAccess::RenderTarget | RGAccess::DepthWrite | RGAccess::DepthRead);
+	}
+
+	// The state a resource must be in to be discarded
+	static RGAccess GetDiscardAccess(const RGCoreGraph::Resource& resource)
+	{
+		return EnumHasAnyFlags(resource.DescUsage | resource.Usage, RGAccess::RenderTarget) ? RGAccess::RenderTarget : RGAccess::DepthWrite;
+	}
+
+	// Whether the access starts the lifetime of a transient resource. The content of every subresource is undefined until then,
+	// so the aliasing barrier, discard and transition of this access cover the whole resource.
+	static bool IsFirstAccess(const RGCoreGraph& graph, uint32 passIndex, const RGCoreGraph::Access& access)
+	{
+		const RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+		if (resource.IsImported || resource.FirstAccess != passIndex)
+			return false;
+
+		const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+		return std::find_if(pass.Accesses.data(), &access, [&](const RGCoreGraph::Access& other) { return other.Resource == access.Resource; }) == &access;
+	}
+
+	// Calls 'fn' with the index of every subresource in the range. Resources with a single subresource only have RGCoreGraph::AllSubresources
+	template<typename Fn>
+	static void ForEachSubresource(const RGCoreGraph::Resource& resource, const RGSubresourceRange& range, Fn&& fn)
+	{
+		if (GetNumSubresources(resource) == 1)
+		{
+			fn(RGCoreGraph::AllSubresources);
+			return;
+		}
+
+		auto End = [](uint32 first, uint32 num, uint32 count) { return num == RGSubresourceRange::Remaining ? count : Math::Min(count, first + num); };
+		const uint32 lastMip   = End(range.FirstMip, range.NumMips, resource.NumMips);
+		const uint32 lastSlice = End(range.FirstSlice, range.NumSlices, resource.NumSlices);
+		for (uint32 slice = range.FirstSlice; slice < lastSlice; ++slice)
+		{
+			for (uint32 mip = range.FirstMip; mip < lastMip; ++mip)
+				fn(mip + slice * resource.NumMips);
+		}
+	}
+
+	// Adds the transitions of the subresources of a resource. A single transition is used when every subresource makes the same transition.
+	static void AddSubresourceTransitions(Array<RGCoreGraph::Transition>& outTransitions, const RGCoreGraph::Resource& resource, Span<const RGCoreGraph::Transition> transitions)
+	{
+		if (transitions.GetSize() == 0)
+			return;
+
+		const RGCoreGraph::Transition& first = transitions[0];
+		bool isUniform = transitions.GetSize() == GetNumSubresources(resource);
+		for (const RGCoreGraph::Transition& transition : transitions)
+			isUniform &= transition.Before == first.Before && transition.After == first.After;
+
+		if (isUniform)
+			outTransitions.push_back({ first.Resource, first.Before, first.After });
+		else
+			outTransitions.insert(outTransitions.end(), transitions.begin(), transitions.end());
+	}
+
+	// Tracks the state of the whole resource again once its subresources are all in the same state
+	static void CollapseSubresourceStates(IRGPhysicalResources& physicalResources, uint32 resourceIndex, const RGCoreGraph::Resource& resource)
+	{
+		const uint32 numSubresources = GetNumSubresources(resource);
+		if (numSubresources == 1)
+			return;
+
+		const RGAccess state = physicalResources.GetState(resourceIndex, 0);
+		for (uint32 subresource = 1; subresource < numSubresources; ++subresource)
+		{
+			if (physicalResources.GetState(resourceIndex, subresource) != state)
+				return;
+		}
+		physicalResources.SetState(resourceIndex, RGCoreGraph::AllSubresources, state);
+	}
+
+	bool NeedsTransition(RGAccess before, RGAccess& after)
+	{
+		if (before == after)
+			return false;
+
+		// Can read from a depth target that is written to
+		if (before == RGAccess::DepthWrite && after == RGAccess::DepthRead)
+			return false;
+
+		if (after == RGAccess::Common)
+			return true;
+
+		// Combine read states that are already set
+		if (!IsWrite(before) && !IsWrite(after) && !EnumHasAllFlags(before, after))
+			after |= before;
+
+		return true;
+	}
+
+	static void ComputeDependencies(RGCoreGraph& graph)
+	{
+		PROFILE_CPU_SCOPE("Pass Dependencies");
+
+		// Used for pass culling and to decide which passes can run on the async compute queue
+		for (uint32 passIndex = 0; passIndex < (uint32)graph.Passes.size(); ++passIndex)
+		{
+			RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				// Add a pass dependency to the last pass that wrote to this resource
+				RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+				if (resource.LastWrite != InvalidIndex && resource.LastWrite != passIndex)
+				{
+					if (std::find(pass.Dependencies.begin(), pass.Dependencies.end(), resource.LastWrite) == pass.Dependencies.end())
+						pass.Dependencies.push_back(resource.LastWrite);
+				}
+
+				// If the resource is written to in this pass, update the LastWrite pass
+				if (IsWrite(access.Access))
+					resource.LastWrite = passIndex;
+			}
+		}
+	}
+
+	static void CullPasses(RGCoreGraph& graph, const RGGraphOptions& options)
+	{
+		PROFILE_CPU_SCOPE("Pass Culling");
+
+		if (!options.PassCulling)
+		{
+			for (RGCoreGraph::Pass& pass : graph.Passes)
+				pass.IsCulled = false;
+			return;
+		}
+
+		Array<uint32> cullStack;
+		cullStack.reserve(graph.Passes.size());
+
+		// If pass is marked for never cull, immediately add it to the stack
+		for (uint32 passIndex = 0; passIndex < (uint32)graph.Passes.size(); ++passIndex)
+		{
+			if (EnumHasAllFlags(graph.Passes[passIndex].Flags, RGPassFlag::NeverCull))
+				cullStack.push_back(passIndex);
+		}
+
+		for (const RGCoreGraph::Resource& resource : graph.Resources)
+		{
+			if (resource.LastWrite != InvalidIndex && (resource.IsExported || resource.IsImported))
+				cullStack.push_back(resource.LastWrite);
+		}
+
+		while (!cullStack.empty())
+		{
+			RGCoreGraph::Pass& pass = graph.Passes[cullStack.back()];
+			cullStack.pop_back();
+
+			if (pass.IsCulled)
+			{
+				cullStack.insert(cullStack.end(), pass.Dependencies.begin(), pass.Dependencies.end());
+				pass.IsCulled = false;
+			}
+		}
+	}
+
+	// Orders passes with a greedy list schedule over the dependencies between passes.
+	// Out of the first few passes that are ready, the one with the lowest cost is picked, so the order stays close to the author order.
+	// Cost: transitions the pass needs, transient memory it starts to use minus the memory it releases, and a bonus for work that can run on the compute queue.
+	// Only the first ready pass may increase memory. Otherwise passes that create resources keep getting postponed, while the resources their consumers need stay alive.
+	static void ReorderPasses(RGCoreGraph& graph, const RGGraphOptions& options)
+	{
+		PROFILE_CPU_SCOPE("Pass Reordering");
+
+		constexpr uint32 MaxCandidates		= 32;
+		constexpr float  TransitionCost		= 1.0f;
+		constexpr float  MemoryCost			= 1.0f;		///< Per transient resource of average size
+		constexpr float  AsyncComputeBonus	= 0.5f;
+
+		const uint32 numPasses	  = (uint32)graph.Passes.size();
+		const uint32 numResources = (uint32)graph.Resources.size();
+
+		// Events each pass is in, outermost first
+		Array<Array<uint32>> eventStacks(numPasses);
+		{
+			Array<uint32> stack;
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+				stack.insert(stack.end(), pass.EventsToStart.begin(), pass.EventsToStart.end());
+				eventStacks[passIndex] = stack;
+				stack.resize(stack.size() - Math::Min(pass.NumEventsToEnd, (uint32)stack.size()));
+			}
+		}
+
+		// Passes must stay ordered when they access the same resource and one of them writes it, or when they are in a scope that keeps its order.
+		// Passes that can't be culled may have side effects outside of the graph, like writing the mesh buffers that later passes read bindlessly,
+		// so no pass is moved across them.
+		// Culled passes are ordered as well so culling gives the same result on the new order.
+		Array<Array<uint32>> successors(numPasses);
+		Array<uint32> numPredecessors(numPasses, 0);
+		{
+			auto AddEdge = [&](uint32 from, uint32 to)
+			{
+				if (from != InvalidIndex && from != to)
+				{
+					successors[from].push_back(to);
+					++numPredecessors[to];
+				}
+			};
+
+			Array<uint32> lastWrite(numResources, InvalidIndex);
+			Array<Array<uint32>> readsSinceWrite(numResources);
+			Array<uint32> lastInOrderedEvent(graph.IsEventOrdered.size(), InvalidIndex);
+			uint32 lastNeverCull = InvalidIndex;
+			Array<uint32> sinceNeverCull;
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+				for (const RGCoreGraph::Access& access : pass.Accesses)
+				{
+					AddEdge(lastWrite[access.Resource], passIndex);
+					if (IsWrite(access.Access))
+					{
+						for (uint32 read : readsSinceWrite[access.Resource])
+							AddEdge(read, passIndex);
+						readsSinceWrite[access.Resource].clear();
+						lastWrite[access.Resource] = passIndex;
+					}
+					else
+					{
+						readsSinceWrite[access.Resource].push_back(passIndex);
+					}
+				}
+
+				for (uint32 event : eventStacks[passIndex])
+				{
+					if (event < (uint32)graph.IsEventOrdered.size() && graph.IsEventOrdered[event])
+					{
+						AddEdge(lastInOrderedEvent[event], passIndex);
+						lastInOrderedEvent[event] = passIndex;
+					}
+				}
+
+				// The passes before the previous pass that can't be culled are already ordered before it
+				AddEdge(lastNeverCull, passIndex);
+				if (EnumHasAllFlags(pass.Flags, RGPassFlag::NeverCull))
+				{
+					for (uint32 earlier : sinceNeverCull)
+						AddEdge(earlier, passIndex);
+					sinceNeverCull.clear();
+					lastNeverCull = passIndex;
+				}
+				else
+				{
+					sinceNeverCull.push_back(passIndex);
+				}
+			}
+		}
+
+		// Transient memory is weighed relative to the average transient resource. Resources without a size count as average.
+		Array<uint32> remainingAccesses(numResources, 0);
+		for (const RGCoreGraph::Pass& pass : graph.Passes)
+		{
+			if (pass.IsCulled)
+				continue;
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+				++remainingAccesses[access.Resource];
+		}
+
+		Array<float> memoryCost(numResources, 0.0f);
+		{
+			uint64 totalSize = 0;
+			uint32 numTransients = 0;
+			uint32 numSized = 0;
+			for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+			{
+				const RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+				if (resource.IsImported || remainingAccesses[resourceIndex] == 0)
+					continue;
+				++numTransients;
+				if (resource.Size > 0)
+				{
+					totalSize += resource.Size;
+					++numSized;
+				}
+			}
+			const double averageSize = numSized > 0 ? (double)totalSize / numSized : 1.0;
+			for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+			{
+				const RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+				if (!resource.IsImported)
+					memoryCost[resourceIndex] = MemoryCost * (resource.Size > 0 ? (float)(resource.Size / averageSize) : 1.0f);
+			}
+		}
+
+		auto IsAsyncComputeCandidate = [&](const RGCoreGraph::Pass& pass)
+		{
+			if (!options.AsyncCompute || !EnumHasAllFlags(pass.Flags, RGPassFlag::Compute) || EnumHasAnyFlags(pass.Flags, RGPassFlag::Raster | RGPassFlag::Copy))
+				return false;
+			return options.AutoAsyncCompute || EnumHasAllFlags(pass.Flags, RGPassFlag::AsyncCompute);
+		};
+
+		Array<RGAccess> states(numResources, RGAccess::Unknown);
+		auto GetCost = [&](const RGCoreGraph::Pass& pass, float& outMemoryCost)
+		{
+			float cost = IsAsyncComputeCandidate(pass) ? -AsyncComputeBonus : 0.0f;
+			outMemoryCost = 0.0f;
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				const RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+				RGAccess after = access.Access;
+				if (states[access.Resource] != RGAccess::Unknown && NeedsTransition(states[access.Resource], after))
+					cost += TransitionCost;
+				if (states[access.Resource] == RGAccess::Unknown)
+					outMemoryCost += memoryCost[access.Resource];
+				if (remainingAccesses[access.Resource] == 1 && !resource.IsExported)
+					outMemoryCost -= memoryCost[access.Resource];
+			}
+			return cost + outMemoryCost;
+		};
+
+		// Ready passes, sorted by input index
+		Array<uint32> ready;
+		for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+		{
+			if (numPredecessors[passIndex] == 0)
+				ready.push_back(passIndex);
+		}
+
+		Array<uint32> order;
+		order.reserve(numPasses);
+		while (!ready.empty())
+		{
+			// Culled passes don't execute, so they are placed as early as possible
+			uint32 bestCandidate = 0;
+			float bestCost = FLT_MAX;
+			const uint32 numCandidates = Math::Min(MaxCandidates, (uint32)ready.size());
+			for (uint32 candidate = 0; candidate < numCandidates; ++candidate)
+			{
+				const RGCoreGraph::Pass& pass = graph.Passes[ready[candidate]];
+				float passMemoryCost = 0.0f;
+				const float cost = pass.IsCulled ? -FLT_MAX : GetCost(pass, passMemoryCost);
+				if (candidate > 0 && passMemoryCost > 0.0f)
+					continue;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestCandidate = candidate;
+				}
+			}
+
+			const uint32 passIndex = ready[bestCandidate];
+			ready.erase(ready.begin() + bestCandidate);
+			order.push_back(passIndex);
+
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (!pass.IsCulled)
+			{
+				for (const RGCoreGraph::Access& access : pass.Accesses)
+				{
+					RGAccess after = access.Access;
+					if (states[access.Resource] == RGAccess::Unknown || NeedsTransition(states[access.Resource], after))
+						states[access.Resource] = after;
+					--remainingAccesses[access.Resource];
+				}
+			}
+
+			for (uint32 successor : successors[passIndex])
+			{
+				if (--numPredecessors[successor] == 0)
+					ready.insert(std::lower_bound(ready.begin(), ready.end(), successor), successor);
+			}
+		}
+		gAssert(order.size() == numPasses);
+
+		bool isReordered = false;
+		for (uint32 i = 0; i < numPasses && !isReordered; ++i)
+			isReordered = order[i] != i;
+		if (!isReordered)
+			return;
+
+		Array<RGCoreGraph::Pass> passes;
+		passes.reserve(numPasses);
+		for (uint32 passIndex : order)
+			passes.push_back(std::move(graph.Passes[passIndex]));
+
+		// Rebuild the events from the event stacks. A scope that is split up by other passes is started again.
+		for (uint32 i = 0; i < numPasses; ++i)
+		{
+			const Array<uint32>& stack = eventStacks[order[i]];
+			uint32 numShared = 0;
+			if (i > 0)
+			{
+				const Array<uint32>& previousStack = eventStacks[order[i - 1]];
+				while (numShared < (uint32)stack.size() && numShared < (uint32)previousStack.size() && stack[numShared] == previousStack[numShared])
+					++numShared;
+				passes[i - 1].NumEventsToEnd = (uint32)previousStack.size() - numShared;
+			}
+			passes[i].EventsToStart.assign(stack.begin() + numShared, stack.end());
+			passes[i].NumEventsToEnd = (uint32)stack.size();
+		}
+
+		graph.Passes = std::move(passes);
+		graph.InputPassIndices = std::move(order);
+
+		// Dependencies are indices of passes, so they are computed again for the new order
+		for (RGCoreGraph::Pass& pass : graph.Passes)
+			pass.Dependencies.clear();
+		for (RGCoreGraph::Resource& resource : graph.Resources)
+			resource.LastWrite = InvalidIndex;
+		ComputeDependencies(graph);
+	}
+
+	static void ComputeResourceUsage(RGCoreGraph& graph)
+	{
+		PROFILE_CPU_SCOPE("Compute Resource Usage");
+
+		uint32 firstPass = InvalidIndex;
+		uint32 lastPass = 0;
+
+		// Tell the resources when they're first/last accessed and gather their usage
+		for (uint32 passIndex = 0; passIndex < (uint32)graph.Passes.size(); ++passIndex)
+		{
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (pass.IsCulled)
+				continue;
+
+			firstPass = Math::Min(firstPass, passIndex);
+			lastPass  = Math::Max(lastPass, passIndex);
+
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+				resource.FirstAccess = resource.FirstAccess != InvalidIndex ? resource.FirstAccess : passIndex;
+				resource.LastAccess	 = passIndex;
+				resource.IsAccessed	 = true;
+				resource.Usage		|= access.Access;
+			}
+		}
+
+		// Extend the lifetime of Imported and Exported resources
+		for (RGCoreGraph::Resource& resource : graph.Resources)
+		{
+			if (resource.IsExported)
+				resource.LastAccess = lastPass;
+			if (resource.IsImported)
+				resource.FirstAccess = firstPass;
+		}
+	}
+
+	static void ScheduleQueues(RGCoreGraph& graph, const RGGraphOptions& options, const IRGPhysicalResources& physicalResources)
+	{
+		PROFILE_CPU_SCOPE("Queue Scheduling");
+
+		const uint32 numPasses = (uint32)graph.Passes.size();
+
+		auto CanUseComputeQueue = [&](uint32 passIndex)
+		{
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (!EnumHasAllFlags(pass.Flags, RGPassFlag::Compute) || EnumHasAnyFlags(pass.Flags, RGPassFlag::Raster | RGPassFlag::Copy))
+				return false;
+
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				if (!IsAllowedOnQueue(RGQueueType::Compute, GetComputeQueueAccess(access.Access)))
+					return false;
+
+				// Transient render targets and depth stencils are discarded on first use, which requires a graphics state
+				const RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+				if (!resource.IsImported && resource.FirstAccess == passIndex && NeedsDiscard(resource))
+					return false;
+			}
+			return true;
+		};
+
+		// Assign queues back to front so the first graphics pass that needs the result of each pass is known.
+		// Compute passes in between pass it on to their own dependencies.
+		Array<uint32> firstGraphicsConsumer(numPasses, numPasses);
+		for (int32 passIndex = (int32)numPasses - 1; passIndex >= 0; --passIndex)
+		{
+			RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (pass.IsCulled)
+				continue;
+
+			bool useComputeQueue = false;
+			if (CanUseComputeQueue(passIndex))
+			{
+				if (EnumHasAllFlags(pass.Flags, RGPassFlag::AsyncCompute))
+					useComputeQueue = true;
+				else if (options.AutoAsyncCompute)
+					useComputeQueue = firstGraphicsConsumer[passIndex] - passIndex >= options.AsyncComputeMinOverlap;
+			}
+
+			pass.Queue = useComputeQueue ? RGQueueType::Compute : RGQueueType::Graphics;
+			const uint32 consumer = useComputeQueue ? firstGraphicsConsumer[passIndex] : (uint32)passIndex;
+			for (uint32 dependency : pass.Dependencies)
+				firstGraphicsConsumer[dependency] = Math::Min(firstGraphicsConsumer[dependency], consumer);
+
+			if (useComputeQueue)
+			{
+				for (RGCoreGraph::Access& access : pass.Accesses)
+					access.Access = GetComputeQueueAccess(access.Access);
+				graph.UsesAsyncCompute = true;
+			}
+		}
+
+		if (!graph.UsesAsyncCompute)
+			return;
+
+		// Find the cross-queue dependencies.
+		// Next to read-after-write and write-after-write, a pass on another queue must also wait for earlier readers when it writes the resource
+		// or when it changes the state of the resource. Resource states are followed the same way the transitions are recorded during compilation.
+		// Only the first access of a transient resource is unknown here, but that's always a write.
+		struct ResourceSchedule
+		{
+			Array<RGAccess> States;								///< Per subresource
+			bool		IsTracked	= true;
+			int32		LastWrite	= RGSchedulePass::InvalidIndex;
+			int32		LastRead[(int)RGQueueType::Num];		///< Per queue, the last read since LastWrite
+			int32		LastAccess[(int)RGQueueType::Num];
+		};
+
+		Array<ResourceSchedule> resources(graph.Resources.size());
+		for (uint32 resourceIndex = 0; resourceIndex < (uint32)graph.Resources.size(); ++resourceIndex)
+		{
+			ResourceSchedule& resource = resources[resourceIndex];
+			for (int32 queue = 0; queue < (int32)RGQueueType::Num; ++queue)
+			{
+				resource.LastRead[queue]   = RGSchedulePass::InvalidIndex;
+				resource.LastAccess[queue] = RGSchedulePass::InvalidIndex;
+			}
+
+			const RGCoreGraph::Resource& graphResource = graph.Resources[resourceIndex];
+			resource.States.assign(GetNumSubresources(graphResource), RGAccess::Unknown);
+			if (graphResource.IsImported)
+			{
+				resource.IsTracked = physicalResources.IsTracked(resourceIndex);
+				if (resource.IsTracked)
+				{
+					ForEachSubresource(graphResource, RGSubresourceRange(), [&](uint32 subresource)
+						{
+							resource.States[subresource == RGCoreGraph::AllSubresources ? 0 : subresource] = physicalResources.GetState(resourceIndex, subresource);
+						});
+				}
+			}
+		}
+
+		Array<RGSchedulePass> schedule(numPasses);
+		for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+		{
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			RGSchedulePass& schedulePass = schedule[passIndex];
+			schedulePass.Queue = pass.Queue;
+			schedulePass.IsActive = !pass.IsCulled;
+			if (pass.IsCulled)
+				continue;
+
+			const int32 queue = (int32)pass.Queue;
+			auto AddDependency = [&](int32 dependency)
+			{
+				if (dependency != RGSchedulePass::InvalidIndex && schedule[dependency].Queue != pass.Queue &&
+					std::find(schedulePass.Dependencies.begin(), schedulePass.Dependencies.end(), (uint32)dependency) == schedulePass.Dependencies.end())
+				{
+					schedulePass.Dependencies.push_back((uint32)dependency);
+				}
+			};
+
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				ResourceSchedule& resource = resources[access.Resource];
+				const RGCoreGraph::Resource& graphResource = graph.Resources[access.Resource];
+				const bool isWrite = IsWrite(access.Access);
+
+				bool changesState = false;
+				if (resource.IsTracked)
+				{
+					ForEachSubresource(graphResource, IsFirstAccess(graph, passIndex, access) ? RGSubresourceRange() : access.Range, [&](uint32 subresource)
+						{
+							RGAccess& currentState = resource.States[subresource == RGCoreGraph::AllSubresources ? 0 : subresource];
+							RGAccess state = access.Access;
+							if (currentState == RGAccess::Unknown)
+							{
+								changesState = true;
+							}
+							else if (NeedsComputeQueueRelease(pass.Queue, currentState))
+							{
+								changesState = true;
+								NeedsTransition(RGAccess::Common, state);
+							}
+							else
+							{
+								changesState |= NeedsTransition(currentState, state);
+							}
+							currentState = state;
+						});
+				}
+
+				AddDependency(resource.LastWrite);
+				if (isWrite || changesState)
+				{
+					for (int32 lastRead : resource.LastRead)
+						AddDependency(lastRead);
+				}
+
+				if (isWrite)
+				{
+					resource.LastWrite = (int32)passIndex;
+					for (int32& lastRead : resource.LastRead)
+						lastRead = RGSchedulePass::InvalidIndex;
+				}
+				else
+				{
+					resource.LastRead[queue] = (int32)passIndex;
+				}
+				resource.LastAccess[queue] = (int32)passIndex;
+			}
+		}
+
+		RGScheduler::ResolveSyncPoints(schedule);
+		gAssert(RGScheduler::Validate(schedule));
+
+		for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+		{
+			RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			pass.Signal = schedule[passIndex].Signal;
+			pass.Waits	= schedule[passIndex].Waits;
+		}
+
+		// Memory can only be aliased once every queue is done with the resource.
+		// Extend lifetimes up to the last pass that may still run at the same time as one of the accesses.
+		for (uint32 resourceIndex = 0; resourceIndex < (uint32)graph.Resources.size(); ++resourceIndex)
+		{
+			RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+			if (!resource.IsAccessed)
+				continue;
+
+			for (int32 access : resources[resourceIndex].LastAccess)
+			{
+				if (access != RGSchedulePass::InvalidIndex)
+					resource.LastAccess = Math::Max(resource.LastAccess, RGScheduler::GetLastOverlappingPass(schedule, (uint32)access));
+			}
+		}
+	}
+
+	static void RecordBarriers(RGCoreGraph& graph, IRGPhysicalResources& physicalResources)
+	{
+		PROFILE_CPU_SCOPE("Barriers");
+
+		// Last graphics pass that used each physical resource. Used to release resources to the compute queue.
+		// Compute passes after it may have used other subresources, but they can't have left the released subresources in a graphics state.
+		HashMap<uint64, uint32> lastGraphicsAccess;
+
+		// Transitions of the subresources of a single access
+		Array<RGCoreGraph::Transition> releases;
+		Array<RGCoreGraph::Transition> transitions;
+
+		for (uint32 passIndex = 0; passIndex < (uint32)graph.Passes.size(); ++passIndex)
+		{
+			RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (pass.IsCulled)
+				continue;
+
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				const uint32				 resourceIndex = access.Resource;
+				const RGCoreGraph::Resource& resource	   = graph.Resources[resourceIndex];
+				const bool					 isTracked	   = physicalResources.IsTracked(resourceIndex);
+				const bool					 isFirstAccess = IsFirstAccess(graph, passIndex, access);
+				const bool					 needsDiscard  = isFirstAccess && NeedsDiscard(resource);
+
+				// If the resource is not imported, it will require an aliasing barrier on the first use
+				if (isFirstAccess)
+				{
+					gAssert(IsWrite(access.Access), "First access of resource '%s' in '%s' should be a write", resource.pName, pass.pName);
+
+					RGCoreGraph::AliasBarrier barrier;
+					barrier.Resource = resourceIndex;
+
+					// If the resource is a rendertarget/depthstencil, it will need a discard.
+					// The resource is transitioned to a discardable state first, and to the desired state after the discard.
+					if (needsDiscard)
+					{
+						barrier.NeedsDiscard = true;
+
+						RGAccess finalState = access.Access;
+						if (NeedsTransition(GetDiscardAccess(resource), finalState))
+						{
+							barrier.PostDiscardBefore = GetDiscardAccess(resource);
+							barrier.PostDiscardAfter  = finalState;
+						}
+					}
+					pass.AliasBarriers.push_back(barrier);
+				}
+
+				if (isTracked)
+				{
+					// Record the transition of every subresource in the range
+					releases.clear();
+					transitions.clear();
+					ForEachSubresource(resource, isFirstAccess ? RGSubresourceRange() : access.Range, [&](uint32 subresource)
+						{
+							RGAccess currentState = physicalResources.GetState(resourceIndex, subresource);
+							if (NeedsComputeQueueRelease(pass.Queue, currentState))
+							{
+								releases.push_back({ resourceIndex, currentState, RGAccess::Common, subresource });
+								currentState = RGAccess::Common;
+							}
+
+							RGAccess afterState = needsDiscard ? GetDiscardAccess(resource) : access.Access;
+							if (NeedsTransition(currentState, afterState))
+							{
+								gAssert(currentState != RGAccess::Unknown);
+								transitions.push_back({ resourceIndex, currentState, afterState, subresource });
+							}
+							physicalResources.SetState(resourceIndex, subresource, afterState);
+						});
+
+					if (!releases.empty())
+					{
+						// The resource is released to Common on the graphics queue, after the last pass that used it or before the graph executes.
+						// Queue scheduling made this pass wait for that last pass.
+						auto it = lastGraphicsAccess.find(physicalResources.GetPhysical(resourceIndex));
+						if (it != lastGraphicsAccess.end())
+						{
+							AddSubresourceTransitions(graph.Passes[it->second].ExitTransitions, resource, releases);
+						}
+						else
+						{
+							AddSubresourceTransitions(graph.EntryTransitions, resource, releases);
+						}
+					}
+					AddSubresourceTransitions(pass.Transitions, resource, transitions);
+
+					if (needsDiscard && pass.AliasBarriers.back().PostDiscardAfter != RGAccess::Unknown)
+						physicalResources.SetState(resourceIndex, RGCoreGraph::AllSubresources, pass.AliasBarriers.back().PostDiscardAfter);
+					CollapseSubresourceStates(physicalResources, resourceIndex, resource);
+				}
+
+				if (graph.UsesAsyncCompute && pass.Queue == RGQueueType::Graphics)
+					lastGraphicsAccess[physicalResources.GetPhysical(resourceIndex)] = passIndex;
+			}
+		}
+	}
+
+	static void SplitBarriers(RGCoreGraph& graph, const IRGPhysicalResources& physicalResources)
+	{
+		PROFILE_CPU_SCOPE("Split Barriers");
+
+		// Split barriers can't cross commandlists, so only passes recorded in the same group qualify
+		Array<uint32> passGroup(graph.Passes.size(), InvalidIndex);
+		Array<uint32> passPosition(graph.Passes.size(), InvalidIndex);
+		for (uint32 groupIndex = 0; groupIndex < (uint32)graph.Groups.size(); ++groupIndex)
+		{
+			const RGCoreGraph::Group& group = graph.Groups[groupIndex];
+			for (uint32 i = group.FirstPass; i < group.FirstPass + group.NumPasses; ++i)
+			{
+				passGroup[graph.ScheduledPasses[i]] = groupIndex;
+				passPosition[graph.ScheduledPasses[i]] = i;
+			}
+		}
+
+		// Last active pass on any queue that used each physical resource
+		HashMap<uint64, uint32> lastPhysicalAccess;
+
+		for (uint32 passIndex = 0; passIndex < (uint32)graph.Passes.size(); ++passIndex)
+		{
+			RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (pass.IsCulled)
+				continue;
+
+			for (RGCoreGraph::Transition& transition : pass.Transitions)
+			{
+				// The memory of a resource that gets an aliasing barrier was owned by another resource until this pass
+				const bool hasAliasBarrier = std::find_if(pass.AliasBarriers.begin(), pass.AliasBarriers.end(), [&](const RGCoreGraph::AliasBarrier& barrier) { return barrier.Resource == transition.Resource; }) != pass.AliasBarriers.end();
+				if (hasAliasBarrier)
+					continue;
+
+				auto it = lastPhysicalAccess.find(physicalResources.GetPhysical(transition.Resource));
+				if (it == lastPhysicalAccess.end())
+					continue;
+
+				// Without a pass in between, the begin and end would be flushed in the same batch
+				const uint32 lastPassIndex = it->second;
+				if (passGroup[lastPassIndex] == passGroup[passIndex] && passPosition[passIndex] - passPosition[lastPassIndex] >= 2)
+				{
+					graph.Passes[lastPassIndex].BeginTransitions.push_back(transition);
+					transition.IsSplitEnd = true;
+				}
+			}
+
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+				lastPhysicalAccess[physicalResources.GetPhysical(access.Resource)] = passIndex;
+		}
+	}
+
+	static void ResolveEvents(RGCoreGraph& graph)
+	{
+		PROFILE_CPU_SCOPE("Event Resolving");
+
+		// Move events from passes that are culled or run on the compute queue.
+		// Events can't span queues, so passes on the compute queue only have their own pass event.
+		Array<uint32> eventsToStart;
+		uint32 eventsToEnd = 0;
+		RGCoreGraph::Pass* pLastActivePass = nullptr;
+		for (RGCoreGraph::Pass& pass : graph.Passes)
+		{
+			if (pass.IsCulled || pass.Queue != RGQueueType::Graphics)
+			{
+				// Events that start and end within moved passes are dropped
+				for (uint32 eventIndex : pass.EventsToStart)
+					eventsToStart.push_back(eventIndex);
+				for (uint32 i = 0; i < pass.NumEventsToEnd; ++i)
+				{
+					if (!eventsToStart.empty())
+						eventsToStart.pop_back();
+					else
+						++eventsToEnd;
+				}
+				pass.EventsToStart.clear();
+				pass.NumEventsToEnd = 0;
+			}
+			else
+			{
+				for (uint32 eventIndex : eventsToStart)
+					pass.EventsToStart.push_back(eventIndex);
+				pass.NumEventsToEnd += eventsToEnd;
+				eventsToStart.clear();
+				eventsToEnd = 0;
+				pLastActivePass = &pass;
+			}
+		}
+		if (pLastActivePass)
+			pLastActivePass->NumEventsToEnd += eventsToEnd;
+		gAssert(eventsToStart.empty());
+	}
+
+	// Recording cost each group should have when passes are grouped by cost. 0 if passes are grouped by count.
+	// Passes with an unknown cost are assumed to cost as much as the average pass with a known cost.
+	static float GetGroupCostBudget(const RGCoreGraph& graph, const RGGraphOptions& options, float& outDefaultCost)
+	{
+		outDefaultCost = 0.0f;
+		if (!options.Jobify || !options.CostGuidedGrouping)
+			return 0.0f;
+
+		float knownCost = 0.0f;
+		uint32 numKnown = 0;
+		uint32 numActive = 0;
+		for (const RGCoreGraph::Pass& pass : graph.Passes)
+		{
+			if (pass.IsCulled)
+				continue;
+			++numActive;
+			if (pass.RecordCost > 0.0f)
+			{
+				knownCost += pass.RecordCost;
+				++numKnown;
+			}
+		}
+		if (numKnown == 0)
+			return 0.0f;
+
+		outDefaultCost = knownCost / numKnown;
+		const float totalCost = knownCost + (numActive - numKnown) * outDefaultCost;
+		return totalCost / Math::Max(options.NumRecordingJobs, 1u);
+	}
+
+	static void GroupPasses(RGCoreGraph& graph, const RGGraphOptions& options)
+	{
+		PROFILE_CPU_SCOPE("Pass Grouping");
+
+		// Group passes in jobs. Without known recording costs, groups have a fixed number of passes.
+		const uint32 maxPassesPerJob = options.Jobify ? options.CommandlistGroupSize : 0xFFFFFFFF;
+		float defaultCost = 0.0f;
+		const float costBudget = GetGroupCostBudget(graph, options, defaultCost);
+
+		graph.ScheduledPasses.reserve(graph.Passes.size());
+
+		for (uint32 queueIndex = 0; queueIndex < (uint32)RGQueueType::Num; ++queueIndex)
+		{
+			const RGQueueType queue = (RGQueueType)queueIndex;
+
+			// Duplicate profile events that cross the border of jobs to retain event hierarchy
+			uint32 groupStart = (uint32)graph.ScheduledPasses.size();
+			float groupCost = 0.0f;
+			Array<uint32> activeEvents;
+			RGCoreGraph::Pass* pLastPass = nullptr;
+
+			auto CloseGroup = [&]()
+			{
+				uint32 groupSize = (uint32)graph.ScheduledPasses.size() - groupStart;
+				if (groupSize > 0)
+				{
+					pLastPass->NumCPUEventsToEnd += (uint32)activeEvents.size();
+					graph.Groups.push_back({ groupStart, groupSize, queue, costBudget > 0.0f ? groupCost / pLastPass->NumParts : 0.0f });
+					groupStart = (uint32)graph.ScheduledPasses.size();
+					groupCost = 0.0f;
+				}
+			};
+
+			for (uint32 passIndex = 0; passIndex < (uint32)graph.Passes.size(); ++passIndex)
+			{
+				RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+				if (pass.IsCulled || pass.Queue != queue)
+					continue;
+
+				// A wait can only be inserted between submissions
+				if (!pass.Waits.empty())
+					CloseGroup();
+
+				// A pass that costs more than a group is split over multiple commandlists if it supports it.
+				// Otherwise a pass starts a new group if the group would be closer to the budget without it.
+				const float passCost = pass.RecordCost > 0.0f ? pass.RecordCost : defaultCost;
+				pass.NumParts = 1;
+				if (costBudget > 0.0f)
+				{
+					if (pass.MaxParts > 1 && passCost > costBudget)
+					{
+						pass.NumParts = Math::Min(pass.MaxParts, (uint32)std::ceil(passCost / costBudget));
+						CloseGroup();
+					}
+					else if (groupCost > 0.0f && groupCost + passCost * 0.5f > costBudget)
+					{
+						CloseGroup();
+					}
+				}
+
+				pass.CPUEventsToStart = pass.EventsToStart;
+				pass.NumCPUEventsToEnd = pass.NumEventsToEnd;
+
+				for (uint32 event : pass.CPUEventsToStart)
+					activeEvents.push_back(event);
+
+				if (graph.ScheduledPasses.size() == groupStart)
+					pass.CPUEventsToStart = activeEvents;
+
+				for (uint32 i = 0; i < pass.NumCPUEventsToEnd; ++i)
+					activeEvents.pop_back();
+
+				graph.ScheduledPasses.push_back(passIndex);
+				pLastPass = &pass;
+				groupCost += passCost;
+
+				const bool isFull = costBudget > 0.0f ? groupCost >= costBudget || pass.NumParts > 1 : graph.ScheduledPasses.size() - groupStart >= maxPassesPerJob;
+
+				// A signal is inserted after the submission that ends with this pass
+				if (isFull || pass.Signal)
+					CloseGroup();
+			}
+			CloseGroup();
+		}
+
+		// Submit groups in pass order. A group only waits on passes that come before it, which end their group.
+		std::sort(graph.Groups.begin(), graph.Groups.end(), [&](const RGCoreGraph::Group& a, const RGCoreGraph::Group& b)
+			{
+				return graph.ScheduledPasses[a.FirstPass] < graph.ScheduledPasses[b.FirstPass];
+			});
+	}
+
+	void Compile(RGCoreGraph& graph, const RGGraphOptions& options, IRGPhysicalResources& physicalResources)
+	{
+		PROFILE_CPU_SCOPE();
+
+		ComputeDependencies(graph);
+		CullPasses(graph, options);
+
+		if (options.ReorderPasses)
+			ReorderPasses(graph, options);
+
+		ComputeResourceUsage(graph);
+
+		if (options.AsyncCompute)
+			ScheduleQueues(graph, options, physicalResources);
+
+		{
+			PROFILE_CPU_SCOPE("Resource Allocation");
+			physicalResources.Allocate(graph);
+		}
+
+		RecordBarriers(graph, physicalResources);
+		ResolveEvents(graph);
+		GroupPasses(graph, options);
+
+		if (options.SplitBarriers)
+			SplitBarriers(graph, physicalResources);
+	}
+}
+
+
+void RGNullPhysicalResources::SetResources(Span<const uint64> sizes, Span<const RGAccess> importedStates, const RGCoreGraph& graph)
+{
+	gAssert(sizes.GetSize() == graph.Resources.size() && importedStates.GetSize() == graph.Resources.size());
+
+	// Physical resources of imported resources only live for a single graph
+	m_Physical.erase(std::remove_if(m_Physical.begin(), m_Physical.end(), [](const PhysicalResource& physical) { return physical.IsImported; }), m_Physical.end());
+
+	m_Sizes.assign(sizes.begin(), sizes.end());
+	m_ResourceToPhysical.assign(graph.Resources.size(), RGCoreGraph::InvalidIndex);
+	for (uint32 resourceIndex = 0; resourceIndex < (uint32)graph.Resources.size(); ++resourceIndex)
+	{
+		if (!graph.Resources[resourceIndex].IsImported)
+			continue;
+
+		PhysicalResource& physical = m_Physical.emplace_back();
+		physical.Size			 = sizes[resourceIndex];
+		physical.NumSubresources = RGCore::GetNumSubresources(graph.Resources[resourceIndex]);
+		physical.States			 = { importedStates[resourceIndex] };
+		physical.IsImported		 = true;
+		m_ResourceToPhysical[resourceIndex] = (uint32)m_Physical.size() - 1;
+	}
+}
+
+void RGNullPhysicalResources::Allocate(const RGCoreGraph& graph)
+{
+	PROFILE_CPU_SCOPE();
+
+	struct Placement
+	{
+		uint32 Resource;
+		uint64 Offset;
+	};
+
+	// Place resources in order of first use, each at the lowest offset that isn't used by a resource that is still alive
+	Array<uint32> resources;
+	for (uint32 resourceIndex = 0; resourceIndex < (uint32)graph.Resources.size(); ++resourceIndex)
+	{
+		const RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+		if (resource.IsAccessed && !resource.IsImported)
+			resources.push_back(resourceIndex);
+	}
+	std::sort(resources.begin(), resources.end(), [&](uint32 a, uint32 b)
+		{
+			return graph.Resources[a].FirstAccess != graph.Resources[b].FirstAccess ? graph.Resources[a].FirstAccess < graph.Resources[b].FirstAccess : a < b;
+		});
+
+	Array<Placement> placements;
+	placements.reserve(resources.size());
+	Array<Placement> alive;		///< Sorted by offset
+	m_PeakMemory = 0;
+	for (uint32 resourceIndex : resources)
+	{
+		const RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+		const uint64 size = m_Sizes[resourceIndex];
+
+		alive.erase(std::remove_if(alive.begin(), alive.end(), [&](const Placement& placement) { return graph.Resources[placement.Resource].LastAccess < resource.FirstAccess; }), alive.end());
+
+		uint64 offset = 0;
+		uint32 insertIndex = 0;
+		for (; insertIndex < (uint32)alive.size(); ++insertIndex)
+		{
+			const Placement& placement = alive[insertIndex];
+			if (placement.Offset >= offset + size)
+				break;
+			offset = Math::Max(offset, placement.Offset + m_Sizes[placement.Resource]);
+		}
+		alive.insert(alive.begin() + insertIndex, { resourceIndex, offset });
+		placements.push_back({ resourceIndex, offset });
+		m_PeakMemory = Math::Max(m_PeakMemory, offset + size);
+	}
+
+	// Reuse the physical resource at the same place, so its state carries over
+	HashMap<uint64, Array<uint32>> freePhysical;
+	for (uint32 i = 0; i < (uint32)m_Physical.size(); ++i)
+	{
+		if (!m_Physical[i].IsImported)
+			freePhysical[m_Physical[i].Offset].push_back(i);
+	}
+
+	for (const Placement& placement : placements)
+	{
+		const uint64 size = m_Sizes[placement.Resource];
+		const uint32 numSubresources = RGCore::GetNumSubresources(graph.Resources[placement.Resource]);
+		uint32 physicalIndex = RGCoreGraph::InvalidIndex;
+		auto it = freePhysical.find(placement.Offset);
+		if (it != freePhysical.end())
+		{
+			auto physicalIt = std::find_if(it->second.begin(), it->second.end(), [&](uint32 i) { return m_Physical[i].Size == size && m_Physical[i].NumSubresources == numSubresources; });
+			if (physicalIt != it->second.end())
+			{
+				physicalIndex = *physicalIt;
+				it->second.erase(physicalIt);
+			}
+		}
+
+		if (physicalIndex == RGCoreGraph::InvalidIndex)
+		{
+			PhysicalResource& physical = m_Physical.emplace_back();
+			physical.Offset			 = placement.Offset;
+			physical.Size			 = size;
+			physical.NumSubresources = numSubresources;
+			physical.States			 = { RGAccess::Common };
+			physicalIndex			 = (uint32)m_Physical.size() - 1;
+		}
+		m_ResourceToPhysical[placement.Resource] = physicalIndex;
+	}
+
+	for (PhysicalResource& physical : m_Physical)
+		physical.StatesBefore = physical.States;
+}
+
+void RGNullPhysicalResources::SetState(uint32 resource, uint32 subresource, RGAccess state)
+{
+	PhysicalResource& physical = m_Physical[m_ResourceToPhysical[resource]];
+	if (subresource == RGCoreGraph::AllSubresources)
+	{
+		physical.States.assign(1, state);
+		return;
+	}
+
+	gAssert(subresource < physical.NumSubresources);
+	if (physical.States.size() == 1)
+	{
+		const RGAccess wholeState = physical.States[0];
+		physical.States.assign(physical.NumSubresources, wholeState);
+	}
+	physical.States[subresource] = state;
+}
+
+RGAccess RGNullPhysicalResources::PhysicalResource::GetState(const Array<RGAccess>& states, uint32 subresource)
+{
+	if (states.size() == 1)
+		return states[0];
+	gAssert(subresource < (uint32)states.size(), "Subresources of the resource are in different states");
+	return states[subresource];
+}
+
+
+namespace RGCore
+{
+	static constexpr uint32 RecordingMagic	 = 'RGCG';
+	static constexpr uint32 RecordingVersion = 3;
+}
+
+bool RGCoreGraphRecording::Save(const char* pPath) const
+{
+	FileStream stream;
+	if (!stream.Open(pPath, FileMode::Write | FileMode::Create))
+		return false;
+
+	stream << RGCore::RecordingMagic << RGCore::RecordingVersion;
+
+	stream << (uint32)Graph.Resources.size();
+	for (uint32 resourceIndex = 0; resourceIndex < (uint32)Graph.Resources.size(); ++resourceIndex)
+	{
+		const RGCoreGraph::Resource& resource = Graph.Resources[resourceIndex];
+		stream << (uint32)resource.IsImported << (uint32)resource.IsExported << (uint32)resource.IsTexture << (uint32)resource.DescUsage << resource.Size;
+		stream << Sizes[resourceIndex] << (uint32)ImportedStates[resourceIndex] << resource.NumMips << resource.NumSlices;
+	}
+
+	stream << (uint32)Graph.Passes.size();
+	for (const RGCoreGraph::Pass& pass : Graph.Passes)
+	{
+		stream << (uint32)pass.Flags << pass.NumEventsToEnd << pass.RecordCost << pass.MaxParts << pass.EventsToStart << (uint32)pass.Accesses.size();
+		for (const RGCoreGraph::Access& access : pass.Accesses)
+		{
+			stream << access.Resource << (uint32)access.Access;
+			stream << ((uint32)access.Range.FirstMip | (uint32)access.Range.NumMips << 16) << ((uint32)access.Range.FirstSlice | (uint32)access.Range.NumSlices << 16);
+		}
+	}
+
+	stream << (uint32)Graph.IsEventOrdered.size();
+	for (bool isOrdered : Graph.IsEventOrdered)
+		stream << (uint32)isOrdered;
+	return stream.Flush();
+}
+
+bool RGCoreGraphRecording::Load(const char* pPath)
+{
+	FileStream stream;
+	if (!stream.Open(pPath, FileMode::Read))
+		return false;
+
+	// Counts are checked against the remaining file size before anything is allocated
+	auto HasData = [&](uint32 count, uint64 elementSize) { return stream.GetCursor() + count * elementSize <= stream.GetLength(); };
+
+	uint32 magic = 0, version = 0;
+	stream >> magic >> version;
+	if (magic != RGCore::RecordingMagic || version != RGCore::RecordingVersion)
+		return false;
+
+	*this = {};
+
+	uint32 numResources = 0;
+	stream >> numResources;
+	if (!HasData(numResources, 8 * sizeof(uint32) + 2 * sizeof(uint64)))
+		return false;
+	Graph.Resources.resize(numResources);
+	Sizes.resize(numResources);
+	ImportedStates.resize(numResources);
+	for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+	{
+		RGCoreGraph::Resource& resource = Graph.Resources[resourceIndex];
+		uint32 isImported = 0, isExported = 0, isTexture = 0, descUsage = 0, importedState = 0;
+		stream >> isImported >> isExported >> isTexture >> descUsage >> resource.Size >> Sizes[resourceIndex] >> importedState >> resource.NumMips >> resource.NumSlices;
+		resource.IsImported				= isImported != 0;
+		resource.IsExported				= isExported != 0;
+		resource.IsTexture				= isTexture != 0;
+		resource.DescUsage				= (RGAccess)descUsage;
+		ImportedStates[resourceIndex]	= (RGAccess)importedState;
+		if (Sizes[resourceIndex] == 0 || resource.NumMips == 0 || resource.NumSlices == 0 || resource.NumMips * (uint64)resource.NumSlices > 0xFFFF)
+			return false;
+	}
+
+	uint32 numPasses = 0;
+	stream >> numPasses;
+	if (!HasData(numPasses, 6 * sizeof(uint32)))
+		return false;
+	Graph.Passes.resize(numPasses);
+	for (RGCoreGraph::Pass& pass : Graph.Passes)
+	{
+		uint32 flags = 0, numEvents = 0;
+		stream >> flags >> pass.NumEventsToEnd >> pass.RecordCost >> pass.MaxParts >> numEvents;
+		if (pass.MaxParts == 0)
+			return false;
+		if (!HasData(numEvents, sizeof(uint32)))
+			return false;
+		pass.Flags = (RGPassFlag)flags;
+		pass.EventsToStart.resize(numEvents);
+		for (uint32& event : pass.EventsToStart)
+			stream >> event;
+
+		uint32 numAccesses = 0;
+		stream >> numAccesses;
+		if (!HasData(numAccesses, 4 * sizeof(uint32)))
+			return false;
+		pass.Accesses.resize(numAccesses);
+		for (RGCoreGraph::Access& access : pass.Accesses)
+		{
+			uint32 accessState = 0, mips = 0, slices = 0;
+			stream >> access.Resource >> accessState >> mips >> slices;
+			access.Access = (RGAccess)accessState;
+			access.Range  = { (uint16)(mips & 0xFFFF), (uint16)(mips >> 16), (uint16)(slices & 0xFFFF), (uint16)(slices >> 16) };
+			if (access.Resource >= numResources)
+				return false;
+
+			const RGCoreGraph::Resource& resource = Graph.Resources[access.Resource];
+			if (access.Range.FirstMip >= resource.NumMips || access.Range.FirstSlice >= resource.NumSlices || access.Range.NumMips == 0 || access.Range.NumSlices == 0)
+				return false;
+		}
+	}
+
+	uint32 numEvents = 0;
+	stream >> numEvents;
+	if (!HasData(numEvents, sizeof(uint32)))
+		return false;
+	Graph.IsEventOrdered.resize(numEvents);
+	for (uint32 eventIndex = 0; eventIndex < numEvents; ++eventIndex)
+	{
+		uint32 isOrdered = 0;
+		stream >> isOrdered;
+		Graph.IsEventOrdered[eventIndex] = isOrdered != 0;
+	}
+	for (const RGCoreGraph::Pass& pass : Graph.Passes)
+	{
+		for (uint32 event : pass.EventsToStart)
+		{
+			if (event >= numEvents)
+				return false;
+		}
+	}
+	return stream.GetCursor() == stream.GetLength();
+}
+
+
+namespace RGCore
+{
+	bool Validate(const RGCoreGraph& graph, const RGGraphOptions& options, const RGNullPhysicalResources& physicalResources)
+	{
+		const uint32 numPasses = (uint32)graph.Passes.size();
+		const uint32 numResources = (uint32)graph.Resources.size();
+
+		// Culling: every pass that contributes to an output is active, everything else is culled
+		{
+			Array<Array<uint32>> dependencies(numPasses);
+			Array<uint32> lastWrite(numResources, InvalidIndex);
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				for (const RGCoreGraph::Access& access : graph.Passes[passIndex].Accesses)
+				{
+					if (lastWrite[access.Resource] != InvalidIndex)
+						dependencies[passIndex].push_back(lastWrite[access.Resource]);
+					if (IsWrite(access.Access))
+						lastWrite[access.Resource] = passIndex;
+				}
+			}
+
+			Array<bool> isRequired(numPasses, !options.PassCulling);
+			if (options.PassCulling)
+			{
+				Array<uint32> stack;
+				for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+				{
+					if (EnumHasAllFlags(graph.Passes[passIndex].Flags, RGPassFlag::NeverCull))
+						stack.push_back(passIndex);
+				}
+				for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+				{
+					const RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+					if (lastWrite[resourceIndex] != InvalidIndex && (resource.IsImported || resource.IsExported))
+						stack.push_back(lastWrite[resourceIndex]);
+				}
+				while (!stack.empty())
+				{
+					uint32 passIndex = stack.back();
+					stack.pop_back();
+					if (!isRequired[passIndex])
+					{
+						isRequired[passIndex] = true;
+						stack.insert(stack.end(), dependencies[passIndex].begin(), dependencies[passIndex].end());
+					}
+				}
+			}
+
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				if (isRequired[passIndex] == graph.Passes[passIndex].IsCulled)
+				{
+					E_LOG(Warning, "RGCore - Pass %d is %s but should %s", passIndex, graph.Passes[passIndex].IsCulled ? "culled" : "active", isRequired[passIndex] ? "be active" : "be culled");
+					return false;
+				}
+			}
+		}
+
+		// Lifetimes cover every active access
+		for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+		{
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (pass.IsCulled)
+				continue;
+
+			for (const RGCoreGraph::Access& access : pass.Accesses)
+			{
+				const RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+				if (!resource.IsAccessed || passIndex < resource.FirstAccess || passIndex > resource.LastAccess)
+				{
+					E_LOG(Warning, "RGCore - Pass %d accesses resource %d outside of its lifetime [%d, %d]", passIndex, access.Resource, resource.FirstAccess, resource.LastAccess);
+					return false;
+				}
+			}
+		}
+
+		// Queues
+		for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+		{
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			if (pass.IsCulled || pass.Queue == RGQueueType::Graphics)
+				continue;
+
+			if (!options.AsyncCompute || !EnumHasAllFlags(pass.Flags, RGPassFlag::Compute) || EnumHasAnyFlags(pass.Flags, RGPassFlag::Raster | RGPassFlag::Copy))
+			{
+				E_LOG(Warning, "RGCore - Pass %d can't run on the compute queue", passIndex);
+				return false;
+			}
+			if (!EnumHasAllFlags(pass.Flags, RGPassFlag::AsyncCompute) && !options.AutoAsyncCompute)
+			{
+				E_LOG(Warning, "RGCore - Pass %d runs on the compute queue without being flagged for it", passIndex);
+				return false;
+			}
+			if (!pass.EventsToStart.empty() || pass.NumEventsToEnd != 0)
+			{
+				E_LOG(Warning, "RGCore - Pass %d on the compute queue has GPU events", passIndex);
+				return false;
+			}
+		}
+
+		// Cross-queue ordering: a pass that modifies a resource (write or transition) must be ordered after every earlier access,
+		// and a pass that reads a resource must be ordered after the last modification.
+		Array<RGSchedulePass> schedule(numPasses);
+		for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+		{
+			const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+			schedule[passIndex].Queue	 = pass.Queue;
+			schedule[passIndex].IsActive = !pass.IsCulled;
+			schedule[passIndex].Waits	 = pass.Waits;
+			schedule[passIndex].Signal	 = pass.Signal;
+			for (uint32 wait : pass.Waits)
+			{
+				if (wait >= passIndex || graph.Passes[wait].IsCulled || graph.Passes[wait].Queue == pass.Queue || !graph.Passes[wait].Signal)
+				{
+					E_LOG(Warning, "RGCore - Pass %d has an invalid wait on pass %d", passIndex, wait);
+					return false;
+				}
+			}
+		}
+		RGScheduler::ComputeSyncIndices(schedule);
+
+		auto IsOrdered = [&](uint32 first, uint32 second)
+		{
+			return first == second || (first < second && (schedule[first].Queue == schedule[second].Queue || RGScheduler::IsOrderedBefore(schedule, first, second)));
+		};
+
+		{
+			// Tracked per subresource, as passes on different queues may use different subresources of a resource at the same time
+			Array<uint32> firstSubresource(numResources + 1, 0);
+			for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+				firstSubresource[resourceIndex + 1] = firstSubresource[resourceIndex] + GetNumSubresources(graph.Resources[resourceIndex]);
+			Array<uint32> lastModify(firstSubresource[numResources], InvalidIndex);
+			Array<Array<uint32>> accessesSinceModify(firstSubresource[numResources]);
+
+			auto ForEachAccessIndex = [&](const RGCoreGraph::Access& access, auto&& fn)
+			{
+				ForEachSubresource(graph.Resources[access.Resource], access.Range, [&](uint32 subresource)
+					{
+						fn(firstSubresource[access.Resource] + (subresource == RGCoreGraph::AllSubresources ? 0 : subresource));
+					});
+			};
+			auto ForEachTransitionIndex = [&](const RGCoreGraph::Transition& transition, auto&& fn)
+			{
+				if (transition.Subresource != RGCoreGraph::AllSubresources)
+				{
+					fn(firstSubresource[transition.Resource] + transition.Subresource);
+					return;
+				}
+				for (uint32 index = firstSubresource[transition.Resource]; index < firstSubresource[transition.Resource + 1]; ++index)
+					fn(index);
+			};
+
+			auto Access = [&](uint32 passIndex, uint32 resourceIndex, uint32 index, bool modifies)
+			{
+				if (lastModify[index] != InvalidIndex && !IsOrdered(lastModify[index], passIndex))
+				{
+					E_LOG(Warning, "RGCore - Pass %d accesses resource %d without waiting for pass %d that modified it", passIndex, resourceIndex, lastModify[index]);
+					return false;
+				}
+				if (modifies)
+				{
+					for (uint32 earlierAccess : accessesSinceModify[index])
+					{
+						if (!IsOrdered(earlierAccess, passIndex))
+						{
+							E_LOG(Warning, "RGCore - Pass %d modifies resource %d without waiting for pass %d that accessed it", passIndex, resourceIndex, earlierAccess);
+							return false;
+						}
+					}
+					lastModify[index] = passIndex;
+					accessesSinceModify[index].clear();
+				}
+				else
+				{
+					accessesSinceModify[index].push_back(passIndex);
+				}
+				return true;
+			};
+
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+				if (pass.IsCulled)
+					continue;
+
+				// A transition modifies the subresource, like a write
+				bool isValid = true;
+				for (const RGCoreGraph::Transition& transition : pass.Transitions)
+					ForEachTransitionIndex(transition, [&](uint32 index) { isValid = isValid && Access(passIndex, transition.Resource, index, true); });
+				for (const RGCoreGraph::Access& access : pass.Accesses)
+					ForEachAccessIndex(access, [&](uint32 index) { isValid = isValid && Access(passIndex, access.Resource, index, IsWrite(access.Access)); });
+				if (!isValid)
+					return false;
+
+				// A release at the end of the pass modifies the subresource as well
+				for (const RGCoreGraph::Transition& transition : pass.ExitTransitions)
+				{
+					ForEachTransitionIndex(transition, [&](uint32 index)
+						{
+							lastModify[index] = passIndex;
+							accessesSinceModify[index].clear();
+						});
+				}
+			}
+		}
+
+		// Barriers: simulate the state of every physical resource
+		{
+			Array<uint32> passGroup(numPasses, InvalidIndex);
+			for (uint32 groupIndex = 0; groupIndex < (uint32)graph.Groups.size(); ++groupIndex)
+			{
+				const RGCoreGraph::Group& group = graph.Groups[groupIndex];
+				for (uint32 i = group.FirstPass; i < group.FirstPass + group.NumPasses; ++i)
+					passGroup[graph.ScheduledPasses[i]] = groupIndex;
+			}
+
+			// Split transitions that have begun but not ended. The subresources may not be used until the transition ends
+			struct PendingTransition
+			{
+				RGCoreGraph::Transition Transition;
+				uint32					Group;
+			};
+			HashMap<uint64, Array<PendingTransition>> pendingTransitions;
+			auto IsOverlapping = [](uint32 subresourceA, uint32 subresourceB)
+			{
+				return subresourceA == subresourceB || subresourceA == RGCoreGraph::AllSubresources || subresourceB == RGCoreGraph::AllSubresources;
+			};
+			auto IsPending = [&](uint32 resourceIndex, uint32 subresource)
+			{
+				auto it = pendingTransitions.find(physicalResources.GetPhysical(resourceIndex));
+				if (it == pendingTransitions.end())
+					return false;
+				return std::find_if(it->second.begin(), it->second.end(), [&](const PendingTransition& pending) { return IsOverlapping(pending.Transition.Subresource, subresource); }) != it->second.end();
+			};
+
+			// State of every subresource of each physical resource
+			HashMap<uint64, Array<RGAccess>> states;
+			auto GetStates = [&](uint32 resourceIndex) -> Array<RGAccess>&
+			{
+				auto it = states.find(physicalResources.GetPhysical(resourceIndex));
+				if (it == states.end())
+				{
+					const RGNullPhysicalResources::PhysicalResource& physical = physicalResources.GetPhysicalResource(resourceIndex);
+					Array<RGAccess> physicalStates(physical.NumSubresources);
+					for (uint32 subresource = 0; subresource < physical.NumSubresources; ++subresource)
+						physicalStates[subresource] = physical.GetStateBefore(subresource);
+					it = states.emplace(physicalResources.GetPhysical(resourceIndex), std::move(physicalStates)).first;
+				}
+				return it->second;
+			};
+
+			// The states of the subresources a transition or access applies to. Empty if the subresource doesn't exist
+			struct StateRange
+			{
+				RGAccess* pBegin = nullptr;
+				RGAccess* pEnd	 = nullptr;
+				RGAccess* begin() const { return pBegin; }
+				RGAccess* end() const	{ return pEnd; }
+				bool	  IsEmpty() const { return pBegin == pEnd; }
+			};
+			auto GetSubresourceStates = [&](uint32 resourceIndex, uint32 subresource)
+			{
+				Array<RGAccess>& physicalStates = GetStates(resourceIndex);
+				if (subresource == RGCoreGraph::AllSubresources)
+					return StateRange{ physicalStates.data(), physicalStates.data() + physicalStates.size() };
+				if (subresource >= (uint32)physicalStates.size())
+					return StateRange{};
+				return StateRange{ &physicalStates[subresource], &physicalStates[subresource] + 1 };
+			};
+
+			auto ApplyTransition = [&](uint32 passIndex, const RGCoreGraph::Transition& transition, RGQueueType queue)
+			{
+				Array<PendingTransition>* pPending = nullptr;
+				auto pendingIt = pendingTransitions.find(physicalResources.GetPhysical(transition.Resource));
+				if (pendingIt != pendingTransitions.end())
+					pPending = &pendingIt->second;
+
+				if (transition.IsSplitEnd)
+				{
+					auto it = pPending ? std::find_if(pPending->begin(), pPending->end(), [&](const PendingTransition& pending) { return pending.Transition.Subresource == transition.Subresource; }) : Array<PendingTransition>::iterator();
+					if (!pPending || it == pPending->end() || it->Group != passGroup[passIndex] || it->Transition.Before != transition.Before || it->Transition.After != transition.After)
+					{
+						E_LOG(Warning, "RGCore - Pass %d ends a split transition of resource %d that wasn't begun in its group", passIndex, transition.Resource);
+						return false;
+					}
+					pPending->erase(it);
+					if (pPending->empty())
+						pendingTransitions.erase(pendingIt);
+				}
+				else if (IsPending(transition.Resource, transition.Subresource))
+				{
+					E_LOG(Warning, "RGCore - Pass %d transitions resource %d while a split transition is in flight", passIndex, transition.Resource);
+					return false;
+				}
+
+				StateRange subresourceStates = GetSubresourceStates(transition.Resource, transition.Subresource);
+				if (subresourceStates.IsEmpty())
+				{
+					E_LOG(Warning, "RGCore - Pass %d transitions subresource %d of resource %d which doesn't exist", passIndex, transition.Subresource, transition.Resource);
+					return false;
+				}
+				for (RGAccess& state : subresourceStates)
+				{
+					if (state != transition.Before)
+					{
+						E_LOG(Warning, "RGCore - Pass %d transitions subresource %d of resource %d from state 0x%x but it is in state 0x%x", passIndex, transition.Subresource, transition.Resource, transition.Before, state);
+						return false;
+					}
+				}
+				if (!IsAllowedOnQueue(queue, transition.Before) || !IsAllowedOnQueue(queue, transition.After))
+				{
+					E_LOG(Warning, "RGCore - Pass %d transitions resource %d from 0x%x to 0x%x which isn't allowed on its queue", passIndex, transition.Resource, transition.Before, transition.After);
+					return false;
+				}
+				for (RGAccess& state : subresourceStates)
+					state = transition.After;
+				return true;
+			};
+
+			for (const RGCoreGraph::Transition& transition : graph.EntryTransitions)
+			{
+				if (!ApplyTransition(InvalidIndex, transition, RGQueueType::Graphics))
+					return false;
+			}
+
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+				if (pass.IsCulled)
+				{
+					if (!pass.Transitions.empty() || !pass.ExitTransitions.empty() || !pass.BeginTransitions.empty() || !pass.AliasBarriers.empty())
+					{
+						E_LOG(Warning, "RGCore - Culled pass %d has barriers", passIndex);
+						return false;
+					}
+					continue;
+				}
+
+				for (const RGCoreGraph::Access& access : pass.Accesses)
+				{
+					const RGCoreGraph::Resource& resource = graph.Resources[access.Resource];
+					const bool hasAliasBarrier = std::find_if(pass.AliasBarriers.begin(), pass.AliasBarriers.end(), [&](const RGCoreGraph::AliasBarrier& barrier) { return barrier.Resource == access.Resource; }) != pass.AliasBarriers.end();
+					if (hasAliasBarrier != (!resource.IsImported && resource.FirstAccess == passIndex))
+					{
+						E_LOG(Warning, "RGCore - Pass %d %s an aliasing barrier for resource %d", passIndex, hasAliasBarrier ? "has an unexpected" : "is missing", access.Resource);
+						return false;
+					}
+				}
+
+				for (const RGCoreGraph::Transition& transition : pass.Transitions)
+				{
+					if (!ApplyTransition(passIndex, transition, pass.Queue))
+						return false;
+				}
+
+				for (const RGCoreGraph::AliasBarrier& barrier : pass.AliasBarriers)
+				{
+					if (IsPending(barrier.Resource, RGCoreGraph::AllSubresources))
+					{
+						E_LOG(Warning, "RGCore - Pass %d aliases resource %d while a split transition is in flight", passIndex, barrier.Resource);
+						return false;
+					}
+					for (RGAccess state : GetStates(barrier.Resource))
+					{
+						if (barrier.NeedsDiscard && state != RGAccess::RenderTarget && state != RGAccess::DepthWrite)
+						{
+							E_LOG(Warning, "RGCore - Pass %d discards resource %d in state 0x%x", passIndex, barrier.Resource, state);
+							return false;
+						}
+					}
+					if (barrier.PostDiscardBefore != RGAccess::Unknown)
+					{
+						if (!ApplyTransition(passIndex, { barrier.Resource, barrier.PostDiscardBefore, barrier.PostDiscardAfter }, pass.Queue))
+							return false;
+					}
+				}
+
+				for (const RGCoreGraph::Access& access : pass.Accesses)
+				{
+					bool isValid = true;
+					ForEachSubresource(graph.Resources[access.Resource], access.Range, [&](uint32 subresource)
+						{
+							if (!isValid)
+								return;
+							if (IsPending(access.Resource, subresource))
+							{
+								E_LOG(Warning, "RGCore - Pass %d accesses resource %d while a split transition is in flight", passIndex, access.Resource);
+								isValid = false;
+								return;
+							}
+							for (RGAccess state : GetSubresourceStates(access.Resource, subresource))
+							{
+								const bool isSatisfied = state == access.Access ||
+									(!IsWrite(access.Access) && !IsWrite(state) && EnumHasAllFlags(state, access.Access)) ||
+									(state == RGAccess::DepthWrite && access.Access == RGAccess::DepthRead);
+								if (!isSatisfied)
+								{
+									E_LOG(Warning, "RGCore - Pass %d accesses subresource %d of resource %d as 0x%x but it is in state 0x%x", passIndex, subresource, access.Resource, access.Access, state);
+									isValid = false;
+									return;
+								}
+							}
+						});
+					if (!isValid)
+						return false;
+				}
+
+				for (const RGCoreGraph::Transition& transition : pass.ExitTransitions)
+				{
+					if (pass.Queue != RGQueueType::Graphics || !ApplyTransition(passIndex, transition, pass.Queue))
+					{
+						E_LOG(Warning, "RGCore - Pass %d has an invalid release of resource %d", passIndex, transition.Resource);
+						return false;
+					}
+				}
+
+				for (const RGCoreGraph::Transition& transition : pass.BeginTransitions)
+				{
+					StateRange subresourceStates = GetSubresourceStates(transition.Resource, transition.Subresource);
+					const bool isInBeforeState = !subresourceStates.IsEmpty() &&
+						std::all_of(subresourceStates.begin(), subresourceStates.end(), [&](RGAccess state) { return state == transition.Before; });
+					if (IsPending(transition.Resource, transition.Subresource) || transition.IsSplitEnd || !isInBeforeState || !IsAllowedOnQueue(pass.Queue, transition.After))
+					{
+						E_LOG(Warning, "RGCore - Pass %d has an invalid split transition of resource %d", passIndex, transition.Resource);
+						return false;
+					}
+					pendingTransitions[physicalResources.GetPhysical(transition.Resource)].push_back({ transition, passGroup[passIndex] });
+				}
+			}
+
+			if (!pendingTransitions.empty())
+			{
+				E_LOG(Warning, "RGCore - Split transitions of %d resources were never ended", (uint32)pendingTransitions.size());
+				return false;
+			}
+
+			for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+			{
+				if (!graph.Resources[resourceIndex].IsAccessed)
+					continue;
+				const Array<RGAccess>& physicalStates = GetStates(resourceIndex);
+				for (uint32 subresource = 0; subresource < (uint32)physicalStates.size(); ++subresource)
+				{
+					if (physicalStates[subresource] != physicalResources.GetPhysicalResource(resourceIndex).GetState(subresource))
+					{
+						E_LOG(Warning, "RGCore - Final state of subresource %d of resource %d doesn't match the tracked state", subresource, resourceIndex);
+						return false;
+					}
+				}
+			}
+		}
+
+		// Aliasing: transient resources that share memory may not be in use at the same time.
+		// Every pass that accesses the first resource must be done before the second resource is first used.
+		{
+			Array<uint32> transients;
+			Array<Array<uint32>> accessingPasses(numResources);
+			for (uint32 resourceIndex = 0; resourceIndex < numResources; ++resourceIndex)
+			{
+				if (graph.Resources[resourceIndex].IsAccessed && !graph.Resources[resourceIndex].IsImported)
+					transients.push_back(resourceIndex);
+			}
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				if (graph.Passes[passIndex].IsCulled)
+					continue;
+				for (const RGCoreGraph::Access& access : graph.Passes[passIndex].Accesses)
+					accessingPasses[access.Resource].push_back(passIndex);
+			}
+
+			for (uint32 i = 0; i < (uint32)transients.size(); ++i)
+			{
+				for (uint32 j = i + 1; j < (uint32)transients.size(); ++j)
+				{
+					const RGNullPhysicalResources::PhysicalResource& a = physicalResources.GetPhysicalResource(transients[i]);
+					const RGNullPhysicalResources::PhysicalResource& b = physicalResources.GetPhysicalResource(transients[j]);
+					if (a.Offset >= b.Offset + b.Size || b.Offset >= a.Offset + a.Size)
+						continue;
+
+					uint32 first = transients[i];
+					uint32 second = transients[j];
+					if (graph.Resources[first].FirstAccess > graph.Resources[second].FirstAccess)
+						std::swap(first, second);
+
+					const uint32 secondFirstAccess = graph.Resources[second].FirstAccess;
+					if (graph.Resources[first].LastAccess >= secondFirstAccess)
+					{
+						E_LOG(Warning, "RGCore - Resources %d and %d share memory with overlapping lifetimes", first, second);
+						return false;
+					}
+					for (uint32 passIndex : accessingPasses[first])
+					{
+						if (!IsOrdered(passIndex, secondFirstAccess))
+						{
+							E_LOG(Warning, "RGCore - Resource %d reuses the memory of resource %d while pass %d may still access it", second, first, passIndex);
+							return false;
+						}
+					}
+				}
+			}
+		}
+
+		// GPU events are balanced on the graphics queue
+		{
+			int32 depth = 0;
+			for (const RGCoreGraph::Pass& pass : graph.Passes)
+			{
+				if (pass.IsCulled || pass.Queue != RGQueueType::Graphics)
+					continue;
+				depth += (int32)pass.EventsToStart.size() - (int32)pass.NumEventsToEnd;
+				if (depth < 0)
+				{
+					E_LOG(Warning, "RGCore - More GPU events ended than started");
+					return false;
+				}
+			}
+			if (depth != 0)
+			{
+				E_LOG(Warning, "RGCore - %d GPU events are never ended", depth);
+				return false;
+			}
+		}
+
+		// Groups: every active pass is scheduled exactly once, waits start a group and signals end a group
+		{
+			Array<uint32> numScheduled(numPasses, 0);
+			uint32 lastFirstPass = 0;
+			float defaultCost = 0.0f;
+			const bool isCostGuided = GetGroupCostBudget(graph, options, defaultCost) > 0.0f;
+			const uint32 maxPassesPerJob = options.Jobify && !isCostGuided ? options.CommandlistGroupSize : 0xFFFFFFFF;
+			for (uint32 groupIndex = 0; groupIndex < (uint32)graph.Groups.size(); ++groupIndex)
+			{
+				const RGCoreGraph::Group& group = graph.Groups[groupIndex];
+				if (group.NumPasses == 0 || group.NumPasses > maxPassesPerJob || group.FirstPass + group.NumPasses > (uint32)graph.ScheduledPasses.size())
+				{
+					E_LOG(Warning, "RGCore - Group %d has an invalid size", groupIndex);
+					return false;
+				}
+				if (groupIndex > 0 && graph.ScheduledPasses[group.FirstPass] < lastFirstPass)
+				{
+					E_LOG(Warning, "RGCore - Group %d is not submitted in pass order", groupIndex);
+					return false;
+				}
+				lastFirstPass = graph.ScheduledPasses[group.FirstPass];
+
+				int32 cpuDepth = 0;
+				for (uint32 i = 0; i < group.NumPasses; ++i)
+				{
+					const uint32 passIndex = graph.ScheduledPasses[group.FirstPass + i];
+					const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+					++numScheduled[passIndex];
+
+					if (pass.Queue != group.Queue || (i > 0 && passIndex <= graph.ScheduledPasses[group.FirstPass + i - 1]))
+					{
+						E_LOG(Warning, "RGCore - Pass %d is out of order or on the wrong queue in group %d", passIndex, groupIndex);
+						return false;
+					}
+					if ((i > 0 && !pass.Waits.empty()) || (i < group.NumPasses - 1 && pass.Signal))
+					{
+						E_LOG(Warning, "RGCore - Pass %d waits or signals in the middle of group %d", passIndex, groupIndex);
+						return false;
+					}
+					if (pass.NumParts == 0 || pass.NumParts > pass.MaxParts || (pass.NumParts > 1 && (group.NumPasses > 1 || !isCostGuided)))
+					{
+						E_LOG(Warning, "RGCore - Pass %d is split in %d parts in group %d", passIndex, pass.NumParts, groupIndex);
+						return false;
+					}
+
+					cpuDepth += (int32)pass.CPUEventsToStart.size() - (int32)pass.NumCPUEventsToEnd;
+					if (cpuDepth < 0)
+					{
+						E_LOG(Warning, "RGCore - More CPU events ended than started in group %d", groupIndex);
+						return false;
+					}
+				}
+				if (cpuDepth != 0)
+				{
+					E_LOG(Warning, "RGCore - CPU events of group %d are not balanced", groupIndex);
+					return false;
+				}
+			}
+
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				if (numScheduled[passIndex] != (graph.Passes[passIndex].IsCulled ? 0u : 1u))
+				{
+					E_LOG(Warning, "RGCore - Pass %d is scheduled %d times", passIndex, numScheduled[passIndex]);
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	namespace
+	{
+		void GenerateRandomGraph(std::mt19937& random, uint32 numPasses, RGCoreGraphRecording& outGraph)
+		{
+			auto RandomInt = [&](uint32 min, uint32 max) { return std::uniform_int_distribution<uint32>(min, max)(random); };
+			auto Chance = [&](float chance) { return std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < chance; };
+
+			RGCoreGraph& graph = outGraph.Graph;
+
+			auto AddResource = [&](bool isImported, bool isTexture, RGAccess importedState)
+			{
+				RGCoreGraph::Resource& resource = graph.Resources.emplace_back();
+				resource.IsImported = isImported;
+				resource.IsExported = Chance(isImported ? 0.3f : 0.03f);
+				resource.IsTexture	= isTexture;
+				if (isTexture && Chance(0.15f))
+					resource.DescUsage = Chance(0.5f) ? RGAccess::RenderTarget : RGAccess::DepthWrite;
+				if (isTexture && Chance(0.3f))
+				{
+					resource.NumMips   = RandomInt(2, 6);
+					resource.NumSlices = Chance(0.3f) ? RandomInt(2, 3) : 1;
+				}
+				outGraph.Sizes.push_back(RandomInt(1, 64) * 65536ull);
+				resource.Size = outGraph.Sizes.back();
+				outGraph.ImportedStates.push_back(importedState);
+				return (uint32)graph.Resources.size() - 1;
+			};
+
+			// Resources that have been written to and can be read
+			Array<uint32> readable;
+
+			const RGAccess importedStates[] = {
+				RGAccess::Common, RGAccess::ShaderRead, RGAccess::PixelShaderRead, RGAccess::NonPixelShaderRead, RGAccess::UnorderedAccess, RGAccess::CopyDest, RGAccess::CopySource,
+			};
+			const uint32 numImported = Math::Max(1u, numPasses / 20);
+			for (uint32 i = 0; i < numImported; ++i)
+			{
+				bool isTexture = Chance(0.5f);
+				RGAccess state = importedStates[RandomInt(0, ARRAYSIZE(importedStates) - 1)];
+				if (isTexture && Chance(0.2f))
+					state = RGAccess::RenderTarget;
+				readable.push_back(AddResource(true, isTexture, state));
+			}
+
+			auto PickReadable = [&]()
+			{
+				// Mostly read recent results
+				if (Chance(0.75f))
+					return readable[readable.size() - 1 - RandomInt(0, Math::Min(15u, (uint32)readable.size() - 1))];
+				return readable[RandomInt(0, (uint32)readable.size() - 1)];
+			};
+
+			// Textures with more than one subresource are often accessed one mip or slice at a time
+			auto RandomRange = [&](uint32 resourceIndex)
+			{
+				const RGCoreGraph::Resource& resource = graph.Resources[resourceIndex];
+				RGSubresourceRange range;
+				if (GetNumSubresources(resource) == 1 || Chance(0.4f))
+					return range;
+
+				range.FirstMip	 = (uint16)RandomInt(0, resource.NumMips - 1);
+				range.NumMips	 = Chance(0.7f) ? 1 : (uint16)RandomInt(1, resource.NumMips - range.FirstMip);
+				range.FirstSlice = (uint16)RandomInt(0, resource.NumSlices - 1);
+				range.NumSlices	 = Chance(0.5f) ? RGSubresourceRange::Remaining : (uint16)RandomInt(1, resource.NumSlices - range.FirstSlice);
+				return range;
+			};
+
+			uint32 numEvents = 0;
+			uint32 openEvents = 0;
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				RGCoreGraph::Pass& pass = graph.Passes.emplace_back();
+				pass.pName = "Random Pass";
+
+				uint32 type = RandomInt(0, 99);
+				if (type < 40)
+					pass.Flags = RGPassFlag::Raster;
+				else if (type < 85)
+					pass.Flags = Chance(0.4f) ? RGPassFlag::Compute | RGPassFlag::AsyncCompute : RGPassFlag::Compute;
+				else
+					pass.Flags = RGPassFlag::Copy;
+				if (Chance(0.05f))
+					pass.Flags |= RGPassFlag::NeverCull;
+
+				// Recording cost in ms: mostly cheap passes, a few heavy ones like scene draws which may be split
+				auto RandomCost = [&](float min, float max) { return std::uniform_real_distribution<float>(min, max)(random); };
+				uint32 costType = RandomInt(0, 99);
+				if (costType < 70)
+					pass.RecordCost = RandomCost(0.005f, 0.03f);
+				else if (costType < 95)
+					pass.RecordCost = RandomCost(0.05f, 0.3f);
+				else
+					pass.RecordCost = RandomCost(0.5f, 3.0f);
+				if (costType >= 95 && Chance(0.5f))
+					pass.MaxParts = 8;
+
+				const bool isCopy = EnumHasAllFlags(pass.Flags, RGPassFlag::Copy);
+				auto IsUsed = [&](uint32 resource)
+				{
+					return std::find_if(pass.Accesses.begin(), pass.Accesses.end(), [&](const RGCoreGraph::Access& access) { return access.Resource == resource; }) != pass.Accesses.end();
+				};
+
+				const uint32 numReads = isCopy ? 1 : RandomInt(0, 3);
+				for (uint32 i = 0; i < numReads; ++i)
+				{
+					uint32 resourceIndex = PickReadable();
+					if (IsUsed(resourceIndex))
+						continue;
+
+					RGAccess access = RGAccess::ShaderRead;
+					if (isCopy)
+						access = RGAccess::CopySource;
+					else if (!graph.Resources[resourceIndex].IsTexture && Chance(0.1f))
+						access |= RGAccess::IndirectArgs;
+					pass.Accesses.push_back({ resourceIndex, access, RandomRange(resourceIndex) });
+				}
+
+				const uint32 numWrites = isCopy ? 1 : RandomInt(1, 2);
+				for (uint32 i = 0; i < numWrites; ++i)
+				{
+					uint32 resourceIndex;
+					const bool isNew = Chance(0.6f);
+					if (isNew)
+					{
+						resourceIndex = AddResource(false, EnumHasAllFlags(pass.Flags, RGPassFlag::Raster) ? Chance(0.8f) : Chance(0.5f), RGAccess::Unknown);
+					}
+					else
+					{
+						resourceIndex = PickReadable();
+						if (IsUsed(resourceIndex))
+							continue;
+					}
+
+					RGAccess access = RGAccess::UnorderedAccess;
+					if (isCopy)
+						access = RGAccess::CopyDest;
+					else if (EnumHasAllFlags(pass.Flags, RGPassFlag::Raster) && graph.Resources[resourceIndex].IsTexture && Chance(0.7f))
+						access = Chance(0.8f) ? RGAccess::RenderTarget : RGAccess::DepthWrite;
+					const RGSubresourceRange range = RandomRange(resourceIndex);
+					pass.Accesses.push_back({ resourceIndex, access, range });
+					readable.push_back(resourceIndex);
+
+					// Generate the next mip from the previous one, like a downsample chain
+					if (!isNew && !isCopy && range.FirstMip > 0 && range.NumMips == 1 && Chance(0.5f))
+					{
+						RGSubresourceRange previousMip = range;
+						--previousMip.FirstMip;
+						pass.Accesses.push_back({ resourceIndex, RGAccess::NonPixelShaderRead, previousMip });
+					}
+				}
+
+				if (Chance(0.2f))
+				{
+					uint32 numStart = RandomInt(1, 2);
+					for (uint32 i = 0; i < numStart; ++i)
+						pass.EventsToStart.push_back(numEvents++);
+					openEvents += numStart;
+				}
+				if (openEvents > 0 && Chance(0.2f))
+				{
+					pass.NumEventsToEnd = RandomInt(1, openEvents);
+					openEvents -= pass.NumEventsToEnd;
+				}
+				if (passIndex == numPasses - 1)
+				{
+					pass.NumEventsToEnd += openEvents;
+					openEvents = 0;
+				}
+			}
+
+			graph.IsEventOrdered.resize(numEvents);
+			for (uint32 eventIndex = 0; eventIndex < numEvents; ++eventIndex)
+				graph.IsEventOrdered[eventIndex] = Chance(0.2f);
+		}
+
+		void RandomizeOptions(std::mt19937& random, RGGraphOptions& options)
+		{
+			auto Chance = [&](float chance) { return std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < chance; };
+			options.PassCulling			   = Chance(0.8f);
+			options.AsyncCompute		   = Chance(0.7f);
+			options.AutoAsyncCompute	   = Chance(0.5f);
+			options.AsyncComputeMinOverlap = std::uniform_int_distribution<uint32>(1, 8)(random);
+			options.Jobify				   = Chance(0.8f);
+			options.CommandlistGroupSize   = std::uniform_int_distribution<uint32>(1, 20)(random);
+			options.SplitBarriers		   = Chance(0.7f);
+			options.ReorderPasses		   = Chance(0.5f);
+			options.CostGuidedGrouping	   = Chance(0.7f);
+			options.NumRecordingJobs	   = std::uniform_int_distribution<uint32>(1, 32)(random);
+		}
+
+		// Checks that reordering kept every pair of passes that access the same resource, with at least one write, in order.
+		// Also checks that passes in scopes that keep their order are still in input order, and that no pass moved across a pass that can't be culled.
+		bool ValidatePassOrder(const RGCoreGraph& inputGraph, const RGCoreGraph& graph)
+		{
+			const uint32 numPasses = (uint32)graph.Passes.size();
+			if (graph.InputPassIndices.empty())
+				return true;
+
+			Array<bool> isUsed(numPasses, false);
+			for (uint32 inputIndex : graph.InputPassIndices)
+			{
+				if (inputIndex >= numPasses || isUsed[inputIndex])
+				{
+					E_LOG(Warning, "RGCore - Pass order is not a permutation");
+					return false;
+				}
+				isUsed[inputIndex] = true;
+			}
+
+			Array<uint32> lastWrite(graph.Resources.size(), InvalidIndex);
+			Array<uint32> lastRead(graph.Resources.size(), InvalidIndex);
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const uint32 inputIndex = graph.InputPassIndices[passIndex];
+				for (const RGCoreGraph::Access& access : inputGraph.Passes[inputIndex].Accesses)
+				{
+					const uint32 resource = access.Resource;
+					const bool isWrite = IsWrite(access.Access);
+					const bool afterWrite = lastWrite[resource] == InvalidIndex || lastWrite[resource] <= inputIndex;
+					const bool afterReads = lastRead[resource] == InvalidIndex || lastRead[resource] <= inputIndex;
+					if (!afterWrite || (isWrite && !afterReads))
+					{
+						E_LOG(Warning, "RGCore - Reordered pass %d (input %d) accesses resource %d out of order", passIndex, inputIndex, resource);
+						return false;
+					}
+					if (isWrite)
+					{
+						lastWrite[resource] = inputIndex;
+						lastRead[resource] = InvalidIndex;
+					}
+					else
+					{
+						lastRead[resource] = lastRead[resource] == InvalidIndex ? inputIndex : Math::Max(lastRead[resource], inputIndex);
+					}
+				}
+			}
+
+			// Event stack of each input pass
+			Array<Array<uint32>> eventStacks(numPasses);
+			Array<uint32> stack;
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const RGCoreGraph::Pass& pass = inputGraph.Passes[passIndex];
+				stack.insert(stack.end(), pass.EventsToStart.begin(), pass.EventsToStart.end());
+				eventStacks[passIndex] = stack;
+				stack.resize(stack.size() - Math::Min(pass.NumEventsToEnd, (uint32)stack.size()));
+			}
+
+			Array<uint32> lastInEvent(inputGraph.IsEventOrdered.size(), InvalidIndex);
+			uint32 maxInputIndex = 0;
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const uint32 inputIndex = graph.InputPassIndices[passIndex];
+				for (uint32 event : eventStacks[inputIndex])
+				{
+					if (!inputGraph.IsEventOrdered[event])
+						continue;
+					if (lastInEvent[event] != InvalidIndex && lastInEvent[event] > inputIndex)
+					{
+						E_LOG(Warning, "RGCore - Reordered pass %d (input %d) breaks the order of event %d", passIndex, inputIndex, event);
+						return false;
+					}
+					lastInEvent[event] = inputIndex;
+				}
+				// Exactly the passes before it in input order are before a pass that can't be culled
+				if (EnumHasAllFlags(inputGraph.Passes[inputIndex].Flags, RGPassFlag::NeverCull) && (passIndex != inputIndex || (passIndex > 0 && maxInputIndex > inputIndex)))
+				{
+					E_LOG(Warning, "RGCore - Reordered pass %d (input %d) can't be culled and a pass was moved across it", passIndex, inputIndex);
+					return false;
+				}
+				maxInputIndex = Math::Max(maxInputIndex, inputIndex);
+			}
+			return true;
+		}
+
+		// A graph with a known result: an async compute pass whose result is read by graphics, and two transient resources with disjoint lifetimes that share memory
+		bool RunKnownCase()
+		{
+			RGCoreGraph graph;
+			auto AddResource = [&](bool isImported, bool isTexture)
+			{
+				RGCoreGraph::Resource& resource = graph.Resources.emplace_back();
+				resource.IsImported = isImported;
+				resource.IsTexture	= isTexture;
+				return (uint32)graph.Resources.size() - 1;
+			};
+			const uint32 output		 = AddResource(true, true);
+			const uint32 scratch	 = AddResource(false, false);
+			const uint32 colorTarget = AddResource(false, true);
+			const uint32 unused		 = AddResource(false, false);
+			const uint32 history	 = AddResource(false, false);
+
+			auto AddPass = [&](RGPassFlag flags, std::initializer_list<RGCoreGraph::Access> accesses)
+			{
+				RGCoreGraph::Pass& pass = graph.Passes.emplace_back();
+				pass.Flags = flags;
+				pass.Accesses = accesses;
+			};
+			AddPass(RGPassFlag::Compute | RGPassFlag::AsyncCompute, { { scratch, RGAccess::UnorderedAccess } });
+			AddPass(RGPassFlag::Raster, { { scratch, RGAccess::ShaderRead }, { colorTarget, RGAccess::RenderTarget } });
+			AddPass(RGPassFlag::Compute, { { unused, RGAccess::UnorderedAccess } });
+			AddPass(RGPassFlag::Raster, { { colorTarget, RGAccess::ShaderRead }, { output, RGAccess::RenderTarget }, { history, RGAccess::UnorderedAccess } });
+
+			RGGraphOptions options;
+			options.AsyncCompute = true;
+
+			RGNullPhysicalResources physicalResources;
+			physicalResources.SetResources(Array<uint64>(5, 65536), Array<RGAccess>{ RGAccess::PixelShaderRead, RGAccess::Unknown, RGAccess::Unknown, RGAccess::Unknown, RGAccess::Unknown }, graph);
+			Compile(graph, options, physicalResources);
+
+			bool isValid = Validate(graph, options, physicalResources);
+			isValid &= graph.Passes[0].Queue == RGQueueType::Compute && graph.Passes[0].Signal;
+			isValid &= graph.Passes[1].Waits == Array<uint32>{ 0 };
+			isValid &= graph.Passes[2].IsCulled;
+			isValid &= graph.Passes[1].Transitions.size() == 2 && graph.Passes[1].Transitions[0].Before == RGAccess::UnorderedAccess && graph.Passes[1].Transitions[0].After == RGAccess::ShaderRead;
+			isValid &= graph.Passes[1].AliasBarriers.size() == 1 && graph.Passes[1].AliasBarriers[0].NeedsDiscard;
+			isValid &= graph.Passes[3].Transitions.size() == 3;
+			isValid &= physicalResources.GetPhysicalResource(output).GetState(RGCoreGraph::AllSubresources) == RGAccess::RenderTarget;
+			isValid &= physicalResources.GetPeakMemory() == 2 * 65536;
+			isValid &= physicalResources.GetPhysicalResource(scratch).Offset == physicalResources.GetPhysicalResource(history).Offset;
+			isValid &= graph.Groups.size() == 2;
+			if (!isValid)
+				E_LOG(Warning, "RGCore - Known case failed");
+			return isValid;
+		}
+
+		// A graph with a known result for split barriers: transitions of results that are read a few passes later begin right after they're written
+		bool RunSplitBarrierCase()
+		{
+			RGCoreGraph graph;
+			auto AddResource = [&](bool isImported, bool isTexture)
+			{
+				RGCoreGraph::Resource& resource = graph.Resources.emplace_back();
+				resource.IsImported = isImported;
+				resource.IsTexture	= isTexture;
+				return (uint32)graph.Resources.size() - 1;
+			};
+			const uint32 output = AddResource(true, true);
+			const uint32 a		= AddResource(false, false);
+			const uint32 b		= AddResource(false, false);
+			const uint32 c		= AddResource(false, false);
+
+			auto AddPass = [&](RGPassFlag flags, std::initializer_list<RGCoreGraph::Access> accesses)
+			{
+				RGCoreGraph::Pass& pass = graph.Passes.emplace_back();
+				pass.Flags = flags;
+				pass.Accesses = accesses;
+			};
+			AddPass(RGPassFlag::Compute, { { a, RGAccess::UnorderedAccess } });
+			AddPass(RGPassFlag::Compute, { { b, RGAccess::UnorderedAccess } });
+			AddPass(RGPassFlag::Compute, { { c, RGAccess::UnorderedAccess } });
+			AddPass(RGPassFlag::Raster, { { a, RGAccess::ShaderRead }, { c, RGAccess::ShaderRead }, { output, RGAccess::RenderTarget } });
+			AddPass(RGPassFlag::Raster, { { b, RGAccess::ShaderRead }, { output, RGAccess::RenderTarget } });
+
+			bool isValid = true;
+			for (bool splitBarriers : { true, false })
+			{
+				RGCoreGraph compiledGraph = graph;
+				RGGraphOptions options;
+				options.SplitBarriers = splitBarriers;
+
+				RGNullPhysicalResources physicalResources;
+				physicalResources.SetResources(Array<uint64>(4, 65536), Array<RGAccess>{ RGAccess::RenderTarget, RGAccess::Unknown, RGAccess::Unknown, RGAccess::Unknown }, compiledGraph);
+				Compile(compiledGraph, options, physicalResources);
+
+				isValid &= Validate(compiledGraph, options, physicalResources);
+				isValid &= compiledGraph.Groups.size() == 1;
+				isValid &= compiledGraph.Passes[3].Transitions.size() == 2 && compiledGraph.Passes[4].Transitions.size() == 1;
+				isValid &= compiledGraph.Passes[2].BeginTransitions.empty() && !compiledGraph.Passes[3].Transitions[1].IsSplitEnd;
+				if (splitBarriers)
+				{
+					// 'c' is read by the next pass, so there is nothing to overlap its transition with
+					isValid &= compiledGraph.Passes[0].BeginTransitions.size() == 1 && compiledGraph.Passes[0].BeginTransitions[0].Resource == a;
+					isValid &= compiledGraph.Passes[1].BeginTransitions.size() == 1 && compiledGraph.Passes[1].BeginTransitions[0].Resource == b;
+					isValid &= compiledGraph.Passes[3].Transitions[0].IsSplitEnd && compiledGraph.Passes[4].Transitions[0].IsSplitEnd;
+				}
+				else
+				{
+					isValid &= compiledGraph.Passes[0].BeginTransitions.empty() && compiledGraph.Passes[1].BeginTransitions.empty();
+					isValid &= !compiledGraph.Passes[3].Transitions[0].IsSplitEnd && !compiledGraph.Passes[4].Transitions[0].IsSplitEnd;
+				}
+			}
+			if (!isValid)
+				E_LOG(Warning, "RGCore - Split barrier case failed");
+			return isValid;
+		}
+
+		// A graph with a known result for subresource states: a downsample chain that generates each mip of a transient texture from the previous one.
+		// Each pass only transitions the mip it reads, and the texture gets a single transition once all of its mips are in the same state again.
+		bool RunMipChainCase()
+		{
+			constexpr uint32 NumMips = 6;
+
+			auto Mip = [](uint32 mip)
+			{
+				RGSubresourceRange range;
+				range.FirstMip = (uint16)mip;
+				range.NumMips  = 1;
+				return range;
+			};
+
+			bool isValid = true;
+			for (uint32 numSlices : { 1u, 3u })
+			{
+				for (bool splitBarriers : { true, false })
+				{
+					RGCoreGraph graph;
+					RGCoreGraph::Resource& chain = graph.Resources.emplace_back();
+					chain.IsTexture = true;
+					chain.NumMips	= NumMips;
+					chain.NumSlices = numSlices;
+
+					auto AddPass = [&](RGPassFlag flags, std::initializer_list<RGCoreGraph::Access> accesses)
+					{
+						RGCoreGraph::Pass& pass = graph.Passes.emplace_back();
+						pass.Flags = flags;
+						pass.Accesses = accesses;
+					};
+					AddPass(RGPassFlag::Compute, { { 0, RGAccess::UnorderedAccess, Mip(0) } });
+					for (uint32 mip = 1; mip < NumMips; ++mip)
+						AddPass(RGPassFlag::Compute, { { 0, RGAccess::NonPixelShaderRead, Mip(mip - 1) }, { 0, RGAccess::UnorderedAccess, Mip(mip) } });
+					AddPass(RGPassFlag::Compute | RGPassFlag::NeverCull, { { 0, RGAccess::NonPixelShaderRead } });
+					AddPass(RGPassFlag::Compute | RGPassFlag::NeverCull, { { 0, RGAccess::UnorderedAccess } });
+
+					RGGraphOptions options;
+					options.SplitBarriers = splitBarriers;
+
+					RGNullPhysicalResources physicalResources;
+					physicalResources.SetResources(Array<uint64>(1, 65536), Array<RGAccess>(1, RGAccess::Unknown), graph);
+					Compile(graph, options, physicalResources);
+					isValid &= Validate(graph, options, physicalResources);
+
+					// Transitions of the given mip in every slice
+					auto HasMipTransitions = [&](const RGCoreGraph::Pass& pass, uint32 mip, RGAccess before, RGAccess after)
+					{
+						if (pass.Transitions.size() != numSlices)
+							return false;
+						for (uint32 slice = 0; slice < numSlices; ++slice)
+						{
+							const RGCoreGraph::Transition& transition = pass.Transitions[slice];
+							if (transition.Subresource != mip + slice * NumMips || transition.Before != before || transition.After != after)
+								return false;
+						}
+						return true;
+					};
+
+					// The first access covers the whole texture, because the content of the other mips is undefined
+					const RGCoreGraph::Pass& first = graph.Passes[0];
+					isValid &= first.AliasBarriers.size() == 1;
+					isValid &= first.Transitions.size() == 1 && first.Transitions[0].Subresource == RGCoreGraph::AllSubresources && first.Transitions[0].After == RGAccess::UnorderedAccess;
+
+					// The mip that is written is already in the right state
+					for (uint32 mip = 1; mip < NumMips; ++mip)
+						isValid &= HasMipTransitions(graph.Passes[mip], mip - 1, RGAccess::UnorderedAccess, RGAccess::NonPixelShaderRead);
+
+					// Only the last mip is still written to
+					isValid &= HasMipTransitions(graph.Passes[NumMips], NumMips - 1, RGAccess::UnorderedAccess, RGAccess::NonPixelShaderRead);
+
+					const RGCoreGraph::Pass& last = graph.Passes[NumMips + 1];
+					isValid &= last.Transitions.size() == 1 && last.Transitions[0].Subresource == RGCoreGraph::AllSubresources && last.Transitions[0].Before == RGAccess::NonPixelShaderRead;
+					isValid &= physicalResources.GetPhysicalResource(0).States.size() == 1;
+
+					for (const RGCoreGraph::Pass& pass : graph.Passes)
+						isValid &= pass.BeginTransitions.empty();
+				}
+			}
+			if (!isValid)
+				E_LOG(Warning, "RGCore - Mip chain case failed");
+			return isValid;
+		}
+
+		// A pass that can't be culled writes resources outside of the graph, like GPU skinning writing the mesh buffers.
+		// The next pass reads them without declaring them. It releases more memory than the skinning pass, so without an edge between them it would be moved first.
+		bool RunNeverCullCase()
+		{
+			RGCoreGraph graph;
+			auto AddResource = [&](bool isImported, uint64 size)
+			{
+				RGCoreGraph::Resource& resource = graph.Resources.emplace_back();
+				resource.IsImported = isImported;
+				resource.IsTexture	= true;
+				resource.Size		= size;
+				return (uint32)graph.Resources.size() - 1;
+			};
+			const uint32 output	 = AddResource(true, 65536);
+			const uint32 bones	 = AddResource(false, 65536);
+			const uint32 gbuffer = AddResource(false, 4 * 65536);
+
+			auto AddPass = [&](RGPassFlag flags, std::initializer_list<RGCoreGraph::Access> accesses)
+			{
+				RGCoreGraph::Pass& pass = graph.Passes.emplace_back();
+				pass.Flags = flags;
+				pass.Accesses = accesses;
+			};
+			AddPass(RGPassFlag::Compute, { { bones, RGAccess::UnorderedAccess }, { gbuffer, RGAccess::UnorderedAccess } });
+			AddPass(RGPassFlag::Compute | RGPassFlag::NeverCull, { { bones, RGAccess::NonPixelShaderRead } });
+			AddPass(RGPassFlag::Raster, { { gbuffer, RGAccess::PixelShaderRead }, { output, RGAccess::RenderTarget } });
+
+			RGGraphOptions options;
+			options.ReorderPasses = true;
+
+			const RGCoreGraph inputGraph = graph;
+			RGNullPhysicalResources physicalResources;
+			physicalResources.SetResources(Array<uint64>{ 65536, 65536, 4 * 65536 }, Array<RGAccess>{ RGAccess::RenderTarget, RGAccess::Unknown, RGAccess::Unknown }, graph);
+			Compile(graph, options, physicalResources);
+
+			bool isValid = Validate(graph, options, physicalResources) && ValidatePassOrder(inputGraph, graph);
+			isValid &= graph.InputPassIndices.empty();
+			if (!isValid)
+				E_LOG(Warning, "RGCore - Never cull case failed");
+			return isValid;
+		}
+	}
+
+	bool RunSelfTest(uint32 numGraphs, uint32 seed)
+	{
+		if (!RunKnownCase() || !RunSplitBarrierCase() || !RunMipChainCase() || !RunNeverCullCase())
+			return false;
+
+		std::mt19937 random(seed);
+		for (uint32 graphIndex = 0; graphIndex < numGraphs; ++graphIndex)
+		{
+			RGCoreGraphRecording randomGraph;
+			GenerateRandomGraph(random, std::uniform_int_distribution<uint32>(1, 400)(random), randomGraph);
+
+			// Passes that haven't been recorded before have an unknown cost
+			const bool hasUnknownCosts = std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < 0.3f;
+			for (RGCoreGraph::Pass& pass : randomGraph.Graph.Passes)
+			{
+				if (hasUnknownCosts && std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < 0.2f)
+					pass.RecordCost = 0.0f;
+			}
+
+			RGGraphOptions options;
+			RandomizeOptions(random, options);
+
+			// Compile twice so the second compile starts from the states the first one left the physical resources in
+			RGNullPhysicalResources physicalResources;
+			for (uint32 compileIndex = 0; compileIndex < 2; ++compileIndex)
+			{
+				RGCoreGraph graph = randomGraph.Graph;
+				physicalResources.SetResources(randomGraph.Sizes, randomGraph.ImportedStates, graph);
+				Compile(graph, options, physicalResources);
+				if (!Validate(graph, options, physicalResources) || !ValidatePassOrder(randomGraph.Graph, graph))
+				{
+					E_LOG(Warning, "RGCore - Random graph %d (%d passes, seed %d) failed on compile %d", graphIndex, (uint32)graph.Passes.size(), seed, compileIndex);
+					return false;
+				}
+			}
+		}
+		E_LOG(Info, "RGCore - Self test passed (%d random graphs)", numGraphs);
+		return true;
+	}
+
+	void RunBenchmark(uint32 seed)
+	{
+		std::mt19937 random(seed);
+
+		const uint32 passCounts[] = { 100, 250, 500, 1000, 2500, 5000 };
+		for (uint32 numPasses : passCounts)
+		{
+			RGCoreGraphRecording randomGraph;
+			GenerateRandomGraph(random, numPasses, randomGraph);
+
+			RGGraphOptions options;
+			options.AsyncCompute = true;
+			options.AutoAsyncCompute = true;
+
+			RGNullPhysicalResources physicalResources;
+			const uint32 numIterations = Math::Max(5u, 20000u / numPasses);
+			float totalTime = 0;
+			float maxTime = 0;
+			bool isValid = true;
+			uint32 numActive = 0;
+			for (uint32 iteration = 0; iteration < numIterations + 1; ++iteration)
+			{
+				RGCoreGraph graph = randomGraph.Graph;
+				physicalResources.SetResources(randomGraph.Sizes, randomGraph.ImportedStates, graph);
+
+				Utils::TimeScope timer;
+				Compile(graph, options, physicalResources);
+				float time = timer.Stop();
+
+				if (iteration == 0)
+				{
+					// First compile creates the physical resources
+					isValid = Validate(graph, options, physicalResources);
+					numActive = (uint32)graph.ScheduledPasses.size();
+					continue;
+				}
+				totalTime += time;
+				maxTime = Math::Max(maxTime, time);
+			}
+
+			const float averageMs = totalTime * 1000.0f / numIterations;
+			E_LOG(Info, "RGCore - %4d passes (%4d active, %5d resources): avg %.3f ms, max %.3f ms, %.3f us/pass, peak memory %.1f MB%s",
+				numPasses, numActive, (uint32)randomGraph.Graph.Resources.size(), averageMs, maxTime * 1000.0f, averageMs * 1000.0f / numPasses,
+				(float)physicalResources.GetPeakMemory() / (1024 * 1024), isValid ? "" : " (VALIDATION FAILED)");
+		}
+	}
+
+	void RunGroupingBenchmark(uint32 seed)
+	{
+		std::mt19937 random(seed);
+
+		constexpr uint32 NumThreads		 = 8;
+		constexpr float  CommandlistCost = 0.02f;	///< CPU time to open and close a commandlist, in ms
+
+		struct Result
+		{
+			float	TotalCost = 0.0f;		///< Cost of all active passes
+			float	CriticalPath = 0.0f;
+			uint32	NumCommandlists = 0;
+		};
+
+		// Each part of a split pass is a separate job. Jobs are handed to the threads with the most expensive first, like RGGraph::Execute does.
+		auto Simulate = [](const RGCoreGraph& graph, Span<const float> passCosts)
+			{
+				Array<RGCoreGraph::Group> groups = graph.Groups;
+				std::stable_sort(groups.begin(), groups.end(), [](const RGCoreGraph::Group& a, const RGCoreGraph::Group& b) { return a.RecordCost > b.RecordCost; });
+
+				Result result;
+				Array<float> threadTime(NumThreads, 0.0f);
+				for (const RGCoreGraph::Group& group : groups)
+				{
+					float groupCost = 0.0f;
+					for (uint32 i = group.FirstPass; i < group.FirstPass + group.NumPasses; ++i)
+						groupCost += passCosts[graph.ScheduledPasses[i]];
+					result.TotalCost += groupCost;
+
+					const uint32 numParts = graph.Passes[graph.ScheduledPasses[group.FirstPass]].NumParts;
+					for (uint32 part = 0; part < numParts; ++part)
+					{
+						auto it = std::min_element(threadTime.begin(), threadTime.end());
+						*it += groupCost / numParts + CommandlistCost;
+						++result.NumCommandlists;
+					}
+				}
+				result.CriticalPath = *std::max_element(threadTime.begin(), threadTime.end());
+				return result;
+			};
+
+		const uint32 passCounts[] = { 100, 250, 500, 1000 };
+		for (uint32 numPasses : passCounts)
+		{
+			RGCoreGraphRecording randomGraph;
+			GenerateRandomGraph(random, numPasses, randomGraph);
+
+			// The generated costs are the real costs. Grouping sees them with the noise of a smoothed measurement.
+			Array<float> passCosts;
+			for (RGCoreGraph::Pass& pass : randomGraph.Graph.Passes)
+			{
+				passCosts.push_back(pass.RecordCost);
+				pass.RecordCost *= std::uniform_real_distribution<float>(0.75f, 1.25f)(random);
+			}
+
+			auto CompileAndSimulate = [&](bool costGuided, bool splitPasses)
+				{
+					RGGraphOptions options;
+					options.CostGuidedGrouping = costGuided;
+					options.NumRecordingJobs = 2 * NumThreads;
+
+					RGCoreGraph graph = randomGraph.Graph;
+					if (!splitPasses)
+					{
+						for (RGCoreGraph::Pass& pass : graph.Passes)
+							pass.MaxParts = 1;
+					}
+
+					RGNullPhysicalResources physicalResources;
+					physicalResources.SetResources(randomGraph.Sizes, randomGraph.ImportedStates, graph);
+					Compile(graph, options, physicalResources);
+					if (!Validate(graph, options, physicalResources))
+						E_LOG(Warning, "RGCore - Grouping benchmark failed validation");
+					return Simulate(graph, passCosts);
+				};
+
+			const Result byCount = CompileAndSimulate(false, false);
+			const Result byCost	 = CompileAndSimulate(true, false);
+			const Result split	 = CompileAndSimulate(true, true);
+
+
+			E_LOG(Info, "RGCore - %4d passes (%.2f ms, %.2f ms per thread): by count %.2f ms (%d lists), by cost %.2f ms (%d lists, %.2fx), split %.2f ms (%d lists, %.2fx)",
+				numPasses, byCount.TotalCost, byCount.TotalCost / NumThreads,
+				byCount.CriticalPath, byCount.NumCommandlists,
+				byCost.CriticalPath, byCost.NumCommandlists, byCount.CriticalPath / byCost.CriticalPath,
+				split.CriticalPath, split.NumCommandlists, byCount.CriticalPath / split.CriticalPath);
+		}
+	}
+
+	bool RunReorderBenchmark(const char* pRecordingPath, uint32 seed)
+	{
+		Array<RGCoreGraphRecording> recordings;
+		if (pRecordingPath && *pRecordingPath)
+		{
+			if (!recordings.emplace_back().Load(pRecordingPath))
+			{
+				E_LOG(Warning, "RGCore - Failed to load render graph recording '%s'", pRecordingPath);
+				return false;
+			}
+		}
+		else
+		{
+			std::mt19937 random(seed);
+			const uint32 passCounts[] = { 100, 250, 500, 1000 };
+			for (uint32 numPasses : passCounts)
+				GenerateRandomGraph(random, numPasses, recordings.emplace_back());
+		}
+
+		struct Result
+		{
+			uint64	PeakMemory = 0;
+			uint32	NumBarriers = 0;
+			uint32	NumWaits = 0;
+			float	Time = 0;
+		};
+
+		auto CompileRecording = [](const RGCoreGraphRecording& recording, bool reorder, Result& outResult)
+			{
+				RGGraphOptions options;
+				options.AsyncCompute = true;
+				options.ReorderPasses = reorder;
+
+				RGCoreGraph graph = recording.Graph;
+				RGNullPhysicalResources physicalResources;
+				physicalResources.SetResources(recording.Sizes, recording.ImportedStates, graph);
+
+				Utils::TimeScope timer;
+				Compile(graph, options, physicalResources);
+				outResult.Time = timer.Stop();
+
+				outResult.PeakMemory = physicalResources.GetPeakMemory();
+				outResult.NumBarriers = (uint32)graph.EntryTransitions.size();
+				for (uint32 passIndex : graph.ScheduledPasses)
+				{
+					const RGCoreGraph::Pass& pass = graph.Passes[passIndex];
+					outResult.NumBarriers += (uint32)(pass.Transitions.size() + pass.ExitTransitions.size() + pass.BeginTransitions.size() + pass.AliasBarriers.size());
+					outResult.NumWaits += (uint32)pass.Waits.size();
+				}
+				return Validate(graph, options, physicalResources) && ValidatePassOrder(recording.Graph, graph);
+			};
+
+		bool isValid = true;
+		for (const RGCoreGraphRecording& recording : recordings)
+		{
+			Result before, after;
+			isValid &= CompileRecording(recording, false, before);
+			isValid &= CompileRecording(recording, true, after);
+
+			E_LOG(Info, "RGCore - %4d passes: peak memory %.1f MB -> %.1f MB, barriers %d -> %d, waits %d -> %d, compile %.3f ms -> %.3f ms",
+				(uint32)recording.Graph.Passes.size(),
+				(float)before.PeakMemory / (1024 * 1024), (float)after.PeakMemory / (1024 * 1024),
+				before.NumBarriers, after.NumBarriers,
+				before.NumWaits, after.NumWaits,
+				before.Time * 1000.0f, after.Time * 1000.0f);
+		}
+		if (!isValid)
+			E_LOG(Warning, "RGCore - Reorder benchmark failed validation");
+		return isValid;
+	}
+}
+
+static ConsoleCommand<const char*> gTestRGCore("RGTestCore", [](const char* pArgs)
+	{
+		uint32 numGraphs = 200;
+		if (pArgs && *pArgs)
+			numGraphs = (uint32)atoi(pArgs);
+		RGCore::RunSelfTest(numGraphs, 0);
+	});
+
+static ConsoleCommand<> gBenchmarkRGCore("RGBenchmarkCore", []()
+	{
+		RGCore::RunBenchmark(0);
+	});
+
+static ConsoleCommand<> gBenchmarkRGGrouping("RGBenchmarkGrouping", []()
+	{
+		RGCore::RunGroupingBenchmark(0);
+	});
+
+// Usage: RGBenchmarkReorder [recording]
+// Recordings are written by RGRecordGraph. Uses random graphs if no recording is given
+static ConsoleCommand<const char*> gBenchmarkRGReorder("RGBenchmarkReorder", [](const char* pRecordingPath)
+	{
+		RGCore::RunReorderBenchmark(pRecordingPath, 0);
+	});
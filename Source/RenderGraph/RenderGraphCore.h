@@ -0,0 +1,303 @@
+#pragma once
+#include "RenderGraphScheduler.h"
+
+class RGCompileCache;
+class RGPassCostHistory;
+
+// Flags assigned to a pass that can determine various things
+enum class RGPassFlag : uint8
+{
+	None =		0,
+	Raster =	1 << 0,		///< Raster pass
+	Compute =	1 << 1,		///< Compute pass
+	Copy =		1 << 2,		///< Pass that performs a copy resource operation. Does not play well with Raster/Compute passes
+	NeverCull = 1 << 3,		///< Makes a pass never be culled when not referenced.
+	AsyncCompute = 1 << 4,	///< Compute pass that may run on the async compute queue. Requires RGGraphOptions::AsyncCompute
+};
+DECLARE_BITMASK_TYPE(RGPassFlag);
+
+// Backend-agnostic resource state. Each flag maps to exactly one resource state of the backend.
+enum class RGAccess : uint32
+{
+	Common					= 0,
+	VertexConstantBuffer	= 1 << 0,
+	IndexBuffer				= 1 << 1,
+	RenderTarget			= 1 << 2,
+	UnorderedAccess			= 1 << 3,
+	DepthWrite				= 1 << 4,
+	DepthRead				= 1 << 5,
+	NonPixelShaderRead		= 1 << 6,
+	PixelShaderRead			= 1 << 7,
+	IndirectArgs			= 1 << 8,
+	CopyDest				= 1 << 9,
+	CopySource				= 1 << 10,
+	ResolveDest				= 1 << 11,
+	ResolveSource			= 1 << 12,
+	AccelerationStructure	= 1 << 13,
+	ShadingRateSource		= 1 << 14,
+
+	Unknown					= 0xFFFFFFFF,	///< The state of a physical resource that was never used
+
+	ShaderRead				= NonPixelShaderRead | PixelShaderRead,
+	Write					= RenderTarget | UnorderedAccess | DepthWrite | CopyDest | ResolveDest,
+	ComputeQueue			= UnorderedAccess | NonPixelShaderRead | IndirectArgs | CopyDest | CopySource,	///< States the compute queue can transition to and from
+};
+DECLARE_BITMASK_TYPE(RGAccess);
+
+// Mips and array slices of a texture that a pass accesses. The default range covers the whole resource
+struct RGSubresourceRange
+{
+	static constexpr uint16 Remaining = 0xFFFF;		///< Up to the last mip or slice
+
+	uint16 FirstMip	  = 0;
+	uint16 NumMips	  = Remaining;
+	uint16 FirstSlice = 0;
+	uint16 NumSlices  = Remaining;
+
+	bool IsWhole() const { return *this == RGSubresourceRange(); }
+
+	bool Overlaps(const RGSubresourceRange& other) const
+	{
+		auto End = [](uint16 first, uint16 num) { return num == Remaining ? 0x10000u : (uint32)first + num; };
+		return FirstMip < End(other.FirstMip, other.NumMips) && other.FirstMip < End(FirstMip, NumMips) &&
+			FirstSlice < End(other.FirstSlice, other.NumSlices) && other.FirstSlice < End(FirstSlice, NumSlices);
+	}
+
+	bool operator==(const RGSubresourceRange&) const = default;
+};
+
+struct RGGraphOptions
+{
+	bool   Jobify				 = true;
+	bool   SingleThread			 = false;
+	bool   PassCulling			 = true;
+	bool   TrashAliasedResources = false;
+	uint32 CommandlistGroupSize	 = 10;		///< Maximum number of passes per commandlist when the recording cost of passes is unknown
+	bool   CostGuidedGrouping	 = true;	///< Group passes by their recording cost when it is known, so commandlists take about as long to record
+	uint32 NumRecordingJobs		 = 16;		///< Number of commandlists to divide the recording cost of the graph over
+	bool   AsyncCompute			 = false;	///< Run passes flagged with RGPassFlag::AsyncCompute on the compute queue
+	bool   AutoAsyncCompute		 = false;	///< Also run compute passes on the compute queue when their results aren't needed by the graphics queue for a while
+	uint32 AsyncComputeMinOverlap = 4;		///< Minimum number of passes between a compute pass and its first graphics consumer to use the compute queue
+	RGCompileCache* pCompileCache = nullptr;	///< Reuse the compile result of an earlier graph with the same structure
+	RGPassCostHistory* pPassCosts = nullptr;	///< Measures the recording cost of passes for CostGuidedGrouping
+	bool   SplitBarriers		 = true;	///< Begin transitions right after the last pass that uses the previous state, and end them in the pass that needs the new state
+	bool   EnhancedBarriers		 = false;	///< Record transitions with enhanced barriers when the device supports them
+	bool   ReorderPasses		 = false;	///< Reorder independent passes to lower transient memory and barriers, and to start async compute work earlier
+};
+
+// A graph as seen by the compiler.
+// Contains no backend types so the compile stage can run, be tested and be profiled without a device.
+struct RGCoreGraph
+{
+	static constexpr uint32 InvalidIndex = 0xFFFFFFFF;
+	static constexpr uint32 AllSubresources = 0xFFFFFFFF;				///< Same value as D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES
+
+	struct Access
+	{
+		uint32					Resource;
+		RGAccess				Access;
+		RGSubresourceRange		Range;
+	};
+
+	struct Transition
+	{
+		uint32					Resource;
+		RGAccess				Before;
+		RGAccess				After;
+		uint32					Subresource			= AllSubresources;		///< Mip + slice * NumMips of the resource
+		bool					IsSplitEnd			= false;				///< Ends a transition that was begun in an earlier pass
+	};
+
+	struct AliasBarrier
+	{
+		uint32					Resource;
+		bool					NeedsDiscard		= false;
+		RGAccess				PostDiscardBefore	= RGAccess::Unknown;	///< Unknown if no transition is needed after the discard
+		RGAccess				PostDiscardAfter	= RGAccess::Unknown;
+	};
+
+	struct Pass
+	{
+		// Input
+		const char*				pName				= "";
+		RGPassFlag				Flags				= RGPassFlag::None;
+		Array<Access>			Accesses;
+		Array<uint32>			EventsToStart;
+		uint32					NumEventsToEnd		= 0;
+		float					RecordCost			= 0.0f;					///< CPU time to record the pass in ms. 0 if unknown
+		uint32					MaxParts			= 1;					///< Number of commandlists the pass can be split over
+
+		// Output
+		bool					IsCulled			= true;
+		RGQueueType				Queue				= RGQueueType::Graphics;
+		bool					Signal				= false;				///< A pass on another queue waits for this pass
+		Array<uint32>			Waits;										///< Passes on other queues to wait for before this pass starts
+		Array<uint32>			Dependencies;								///< Earlier passes that wrote a resource this pass accesses
+		Array<Transition>		Transitions;
+		Array<Transition>		ExitTransitions;							///< Releases resources to the compute queue after the pass has executed
+		Array<Transition>		BeginTransitions;							///< Split transitions begun after the pass has executed, ended by a later pass of the same group
+		Array<AliasBarrier>		AliasBarriers;
+		Array<uint32>			CPUEventsToStart;
+		uint32					NumCPUEventsToEnd	= 0;
+		uint32					NumParts			= 1;					///< Number of commandlists the pass is recorded in. A pass with more than one part has its own group
+	};
+
+	struct Resource
+	{
+		// Input
+		const char*				pName				= "";
+		bool					IsImported			= false;
+		bool					IsExported			= false;
+		bool					IsTexture			= false;
+		RGAccess				DescUsage			= RGAccess::Common;		///< Usage the resource was created with. Render target and depth usage require a discard on first use
+		uint64					Size				= 0;					///< Estimated size in bytes. Weighs memory when reordering passes
+		uint32					NumMips				= 1;					///< The state of each mip and slice is tracked separately when there's more than one subresource
+		uint32					NumSlices			= 1;
+
+		// Output
+		bool					IsAccessed			= false;
+		RGAccess				Usage				= RGAccess::Common;		///< All accesses of active passes
+		uint32					FirstAccess			= InvalidIndex;			///< First active pass that accesses this resource
+		uint32					LastAccess			= InvalidIndex;			///< Last pass that may still use the memory of this resource
+		uint32					LastWrite			= InvalidIndex;			///< Last pass that wrote to this resource
+	};
+
+	// Passes that are recorded in a single commandlist
+	struct Group
+	{
+		uint32					FirstPass;			///< Index in ScheduledPasses
+		uint32					NumPasses;
+		RGQueueType				Queue;
+		float					RecordCost			= 0.0f;		///< Estimated CPU time to record the group, or each part of a split pass. 0 if unknown
+	};
+
+	Array<Pass>					Passes;
+	Array<Resource>				Resources;
+	Array<bool>					IsEventOrdered;		///< Per event, whether the passes in its scope keep their relative order when passes are reordered
+
+	// Output
+	Array<uint32>				InputPassIndices;	///< Input index of each pass if passes were reordered. Empty if the order didn't change
+	Array<Transition>			EntryTransitions;	///< Releases resources to the compute queue before any pass executes
+	Array<uint32>				ScheduledPasses;	///< Active passes ordered by queue
+	Array<Group>				Groups;				///< In submission order
+	bool						UsesAsyncCompute	= false;
+};
+
+// The input of a graph compile, with what's needed to compile it without a device.
+// Recorded from a frame with RGRecordGraph. Names are not stored.
+struct RGCoreGraphRecording
+{
+	RGCoreGraph					Graph;
+	Array<uint64>				Sizes;
+	Array<RGAccess>				ImportedStates;		///< State of each imported resource before the graph
+
+	bool Save(const char* pPath) const;
+	bool Load(const char* pPath);
+};
+
+// Physical resources backing the resources of a graph.
+// Implemented by the device backend, and by RGNullPhysicalResources to compile graphs without a device.
+class IRGPhysicalResources
+{
+public:
+	virtual ~IRGPhysicalResources() = default;
+
+	// Assigns a physical resource to every accessed transient resource. Called once usage and lifetimes are known
+	virtual void				Allocate(const RGCoreGraph& graph) = 0;
+
+	// Identifies the physical resource of a resource. Only valid for imported resources before Allocate()
+	virtual uint64				GetPhysical(uint32 resource) const = 0;
+	virtual bool				IsTracked(uint32 resource) const = 0;
+
+	// State of a subresource, or of every subresource with RGCoreGraph::AllSubresources. Those must all be in the same state.
+	// Setting a single subresource keeps the others in their state.
+	virtual RGAccess			GetState(uint32 resource, uint32 subresource) const = 0;
+	virtual void				SetState(uint32 resource, uint32 subresource, RGAccess state) = 0;
+};
+
+// Places transient resources in a single linear address space with first-fit in order of first use, and tracks states in memory.
+// Physical resources are kept across compiles, like the device allocator does, so states carry over between frames.
+class RGNullPhysicalResources : public IRGPhysicalResources
+{
+public:
+	struct PhysicalResource
+	{
+		uint64					Offset			= 0;
+		uint64					Size			= 0;
+		uint32					NumSubresources	= 1;
+		Array<RGAccess>			States;									///< Per subresource. A single state while all subresources are in the same state
+		Array<RGAccess>			StatesBefore;							///< States before the last compile
+		bool					IsImported		= false;
+
+		RGAccess				GetState(uint32 subresource) const			{ return GetState(States, subresource); }
+		RGAccess				GetStateBefore(uint32 subresource) const	{ return GetState(StatesBefore, subresource); }
+
+	private:
+		static RGAccess			GetState(const Array<RGAccess>& states, uint32 subresource);
+	};
+
+	// Resources in the next compiled graph. Imported resources get a dedicated physical resource in the given state
+	void						SetResources(Span<const uint64> sizes, Span<const RGAccess> importedStates, const RGCoreGraph& graph);
+
+	virtual void				Allocate(const RGCoreGraph& graph) override;
+	virtual uint64				GetPhysical(uint32 resource) const override		{ return m_ResourceToPhysical[resource]; }
+	virtual bool				IsTracked(uint32 resource) const override		{ return true; }
+	virtual RGAccess			GetState(uint32 resource, uint32 subresource) const override { return m_Physical[m_ResourceToPhysical[resource]].GetState(subresource); }
+	virtual void				SetState(uint32 resource, uint32 subresource, RGAccess state) override;
+
+	const PhysicalResource&		GetPhysicalResource(uint32 resource) const		{ return m_Physical[m_ResourceToPhysical[resource]]; }
+	uint64						GetPeakMemory() const							{ return m_PeakMemory; }
+
+private:
+	Array<PhysicalResource>		m_Physical;
+	Array<uint32>				m_ResourceToPhysical;
+	Array<uint64>				m_Sizes;
+	uint64						m_PeakMemory = 0;
+};
+
+namespace RGCore
+{
+	constexpr bool IsWrite(RGAccess access)
+	{
+		return EnumHasAnyFlags(access, RGAccess::Write);
+	}
+
+	// Whether a queue can transition a resource to and from the given state
+	constexpr bool IsAllowedOnQueue(RGQueueType queue, RGAccess access)
+	{
+		if (queue == RGQueueType::Compute)
+			return (access & RGAccess::ComputeQueue) == access;
+		return true;
+	}
+
+	// Returns true if a transition from 'before' to 'after' is needed.
+	// Read states that are already set are combined into 'after'.
+	bool NeedsTransition(RGAccess before, RGAccess& after);
+
+	// Runs all compile stages: pass culling, pass reordering, queue scheduling, lifetimes, allocation, barriers, event resolving and pass grouping
+	void Compile(RGCoreGraph& graph, const RGGraphOptions& options, IRGPhysicalResources& physicalResources);
+
+	// Checks the compile result: culling, lifetimes, barriers (by simulating resource states), cross-queue ordering, aliasing, events and groups.
+	// Logs the first error found.
+	bool Validate(const RGCoreGraph& graph, const RGGraphOptions& options, const RGNullPhysicalResources& physicalResources);
+
+	// Number of subresources whose state is tracked separately
+	inline uint32 GetNumSubresources(const RGCoreGraph::Resource& resource)
+	{
+		return resource.NumMips * resource.NumSlices;
+	}
+
+	// Compiles and validates random graphs with the null backend
+	bool RunSelfTest(uint32 numGraphs, uint32 seed);
+
+	// Measures compile time of random graphs from 100 to 5000 passes with the null backend
+	void RunBenchmark(uint32 seed);
+
+	// Simulates recording random graphs with synthetic pass costs on a number of threads,
+	// and compares the critical path of grouping by pass count with grouping by cost, with and without splitting passes
+	void RunGroupingBenchmark(uint32 seed);
+
+	// Compares transient memory peak, barriers and cross-queue waits with and without pass reordering.
+	// Uses the given recording, or random graphs if there is none.
+	bool RunReorderBenchmark(const char* pRecordingPath, uint32 seed);
+}
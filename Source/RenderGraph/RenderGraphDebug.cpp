@@ -52,6 +52,7 @@ static String PassFlagToString(RGPassFlag flags)
 			case RGPassFlag::Raster:	return "Raster";
 			case RGPassFlag::Copy:		return "Copy";
 			case RGPassFlag::NeverCull: return "Never Cull";
+			case RGPassFlag::AsyncCompute: return "Async Compute";
 			default: return nullptr;
 			}
 		});
@@ -77,7 +78,7 @@ void RGGraph::DrawResourceTracker(bool& enabled) const
 
 	if(ImGui::Begin("Resource usage", &enabled))
 	{
-		Array<RGResource*> sortedResources = m_Resources;
+		Array<RGResource*> sortedResources(m_Resources.begin(), m_Resources.end());
 		std::sort(sortedResources.begin(), sortedResources.end(), [](const RGResource* pA, const RGResource* pB) {
 			return pA->FirstAccess.GetIndex() < pB->FirstAccess.GetIndex();
 			});
@@ -225,6 +226,7 @@ void RGGraph::DrawResourceTracker(bool& enabled) const
 						ImGui::Text("%s", pPass->GetName());
 						ImGui::Text("Flags: %s", PassFlagToString(pPass->Flags).c_str());
 						ImGui::Text("Index: %d", pPass->ID.GetIndex());
+						ImGui::Text("Queue: %s", pPass->GetQueue() == RGQueueType::Compute ? "Compute" : "Graphics");
 						ImGui::EndTooltip();
 					}
 				}
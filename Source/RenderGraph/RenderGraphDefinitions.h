@@ -61,9 +61,10 @@ public:
 	friend class RGGraph;
 	friend class RGPass;
 	friend class RGResourceAllocator;
+	friend class RGDevicePhysicalResources;
 
 	RGResource(const char* pName, RGResourceID id, RGResourceType type, DeviceResource* pPhysicalResource = nullptr)
-		: pName(pName), ID(id), IsImported(!!pPhysicalResource), IsExported(false), Type((uint32)type), pPhysicalResource(nullptr), IsAccessed(false)
+		: pName(pName), ID(id), IsImported(!!pPhysicalResource), IsExported(false), IsHistory(false), Type((uint32)type), pPhysicalResource(nullptr), IsAccessed(false)
 	{
 		if (pPhysicalResource)
 			SetResource(pPhysicalResource);
@@ -92,6 +93,7 @@ protected:
 	RGResourceID			ID;
 	uint32					IsImported			: 1;
 	uint32					IsExported			: 1;
+	uint32					IsHistory			: 1;	///< Version of an RGHistory. Placed in the allocator's history heaps
 	uint32					IsAccessed			: 1;
 	uint32					Type				: 1;
 
@@ -99,7 +101,6 @@ protected:
 	// Compile-time data
 	RGPassID				FirstAccess;			///< First non-culled pass that accesses this resource
 	RGPassID				LastAccess;				///< Last non-culled pass that accesses this resource
-	RGPassID				LastWrite;				///< Last pass that wrote to this resource. Used for pass culling
 	uint32					Size		= 0;
 	uint32					Alignment	= 0;
 };
@@ -109,6 +110,7 @@ struct RGResourceT : public RGResource
 {
 public:
 	friend class RGGraph;
+	friend class RGDevicePhysicalResources;
 	using TDesc = typename RGResourceTypeTraits<T>::TDesc;
 
 	RGResourceT(const char* pName, RGResourceID id, const TDesc& desc, T* pPhysicalResource = nullptr)
@@ -123,3 +125,40 @@ private:
 
 using RGTexture = RGResourceT<Texture>;
 using RGBuffer = RGResourceT<Buffer>;
+
+// Versions of a resource from earlier frames, for temporal techniques.
+// The allocator owns the physical resources and a history only identifies them, so they are released once the history isn't created for a frame.
+class RGHistoryBase
+{
+public:
+	static constexpr uint32 MaxFrames = 4;
+
+	// The number of versions that exist at the same time, including the one of the current frame.
+	// A history of a single frame keeps one resource and updates it in place.
+	explicit RGHistoryBase(uint32 numFrames = 2)
+		: m_NumFrames(numFrames)
+	{
+		gAssert(numFrames >= 1 && numFrames <= MaxFrames, "History must have between 1 and %d frames", MaxFrames);
+	}
+
+	uint32 GetNumFrames() const { return m_NumFrames; }
+
+	// Drops the earlier versions, for example after a camera cut
+	void Reset() { m_PhysicalIDs = {}; }
+
+private:
+	friend class RGGraph;
+
+	StaticArray<uint64, MaxFrames>	m_PhysicalIDs{};	///< Allocator IDs of the versions, newest first. 0 if there is none
+	uint32							m_NumFrames;
+};
+
+template<typename T>
+class RGHistory : public RGHistoryBase
+{
+public:
+	using RGHistoryBase::RGHistoryBase;
+};
+
+using RGTextureHistory	= RGHistory<Texture>;
+using RGBufferHistory	= RGHistory<Buffer>;
@@ -0,0 +1,514 @@
+#include "stdafx.h"
+#include "RenderGraphPlacement.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Profiler.h"
+#include "Core/Stream.h"
+#include "Core/Utils.h"
+
+namespace RGPlacement
+{
+	static constexpr uint32 Magic			= 'PLGR';
+	static constexpr uint32 Version			= 1;
+	static constexpr uint64 UnboundedSize	= ~0ull;
+
+	// Memory in a heap that is in use during a lifetime
+	struct OccupiedRange
+	{
+		uint64 Begin;
+		uint64 End;
+		uint32 LifetimeBegin;
+		uint32 LifetimeEnd;
+	};
+
+	struct HeapState
+	{
+		uint64					Size	= 0;
+		Array<OccupiedRange>	Ranges;					///< Sorted by Begin
+		bool					IsEmpty = true;
+	};
+
+	static bool LifetimesOverlap(uint32 beginA, uint32 endA, uint32 beginB, uint32 endB)
+	{
+		return beginA < endB && beginB < endA;
+	}
+
+	static void AddRange(HeapState& heap, const OccupiedRange& range)
+	{
+		auto it = std::upper_bound(heap.Ranges.begin(), heap.Ranges.end(), range.Begin, [](uint64 begin, const OccupiedRange& other) { return begin < other.Begin; });
+		heap.Ranges.insert(it, range);
+		heap.IsEmpty = false;
+	}
+
+	// Finds the smallest free range in the heap that fits the resource for its whole lifetime
+	static bool FindBestFit(const HeapState& heap, const RGPlacementResource& resource, uint64& outOffset)
+	{
+		bool   found	= false;
+		uint64 bestSize = 0;
+		uint64 cursor	= 0;
+
+		auto TestFreeRange = [&](uint64 end) {
+			uint64 offset = Math::AlignUp<uint64>(cursor, resource.Alignment);
+			if (offset + resource.Size <= end && (!found || end - cursor < bestSize))
+			{
+				found	  = true;
+				bestSize  = end - cursor;
+				outOffset = offset;
+			}
+		};
+
+		// Ranges are sorted by offset, so the gaps between ranges with an overlapping lifetime are the free ranges
+		for (const OccupiedRange& range : heap.Ranges)
+		{
+			if (!LifetimesOverlap(range.LifetimeBegin, range.LifetimeEnd, resource.Begin, resource.End))
+				continue;
+			if (range.Begin > cursor)
+				TestFreeRange(range.Begin);
+			cursor = Math::Max(cursor, range.End);
+		}
+		TestFreeRange(heap.Size);
+		return found;
+	}
+
+	static void SortForPlacement(Span<const RGPlacementResource> resources, Array<uint32>& outOrder)
+	{
+		outOrder.resize(resources.GetSize());
+		for (uint32 i = 0; i < resources.GetSize(); ++i)
+			outOrder[i] = i;
+
+		// Persistent resources first so they don't cause fragmentation, then largest to smallest, then largest alignment to smallest
+		std::sort(outOrder.begin(), outOrder.end(), [&](uint32 a, uint32 b) {
+			const RGPlacementResource& resourceA = resources[a];
+			const RGPlacementResource& resourceB = resources[b];
+			if (resourceA.IsPersistent	!= resourceB.IsPersistent)	return resourceA.IsPersistent > resourceB.IsPersistent;
+			if (resourceA.Size			!= resourceB.Size)			return resourceA.Size > resourceB.Size;
+			if (resourceA.Alignment		!= resourceB.Alignment)		return resourceA.Alignment > resourceB.Alignment;
+			return a < b;
+		});
+	}
+
+	// Heaps from largest to smallest, so smaller heaps are left empty and can be released
+	static void SortHeaps(Span<const RGPlacementHeap> heaps, Array<uint32>& outOrder)
+	{
+		outOrder.resize(heaps.GetSize());
+		for (uint32 i = 0; i < heaps.GetSize(); ++i)
+			outOrder[i] = i;
+		std::sort(outOrder.begin(), outOrder.end(), [&](uint32 a, uint32 b) {
+			if (heaps[a].Size != heaps[b].Size)
+				return heaps[a].Size > heaps[b].Size;
+			return a < b;
+		});
+	}
+
+	void Place(Array<RGPlacementResource>& resources, Array<RGPlacementHeap>& heaps, uint64 minHeapSize)
+	{
+		PROFILE_CPU_SCOPE();
+
+		Array<uint32> resourceOrder;
+		SortForPlacement(resources, resourceOrder);
+
+		Array<uint32> heapOrder;
+		SortHeaps(heaps, heapOrder);
+
+		Array<HeapState> heapStates(heaps.size());
+		for (uint32 heapIndex = 0; heapIndex < (uint32)heaps.size(); ++heapIndex)
+		{
+			HeapState& state = heapStates[heapIndex];
+			state.Size		 = heaps[heapIndex].Size;
+			for (const RGPlacementHeap::Range& reserved : heaps[heapIndex].Reserved)
+				AddRange(state, { reserved.Begin, reserved.End, 0, RGPlacementResource::InvalidIndex });
+		}
+
+		// Resources that don't fit any existing heap are placed in a heap of unbounded size, which becomes a single new heap
+		HeapState	  overflowHeap;
+		overflowHeap.Size = UnboundedSize;
+		Array<uint32> overflowResources;
+
+		for (uint32 resourceIndex : resourceOrder)
+		{
+			RGPlacementResource& resource = resources[resourceIndex];
+			gAssert(resource.Size > 0 && resource.Begin < resource.End);
+			resource.Heap = RGPlacementResource::InvalidIndex;
+
+			for (uint32 heapIndex : heapOrder)
+			{
+				HeapState& state = heapStates[heapIndex];
+
+				// Heaps are sorted by size so if this one is too small, none of the others will fit
+				if (resource.Size > state.Size)
+					break;
+
+				// Shrinking: If the heap is empty and very large for the resource, skip it so it has the chance to be released
+				if (state.IsEmpty && Math::AlignUp<uint64>(resource.Size, minHeapSize) < state.Size)
+					continue;
+
+				uint64 offset;
+				if (FindBestFit(state, resource, offset))
+				{
+					resource.Heap	= heapIndex;
+					resource.Offset = offset;
+					AddRange(state, { offset, offset + resource.Size, resource.Begin, resource.End });
+					break;
+				}
+			}
+
+			if (resource.Heap == RGPlacementResource::InvalidIndex)
+			{
+				uint64 offset = 0;
+				gVerify(FindBestFit(overflowHeap, resource, offset), == true);
+				resource.Offset = offset;
+				AddRange(overflowHeap, { offset, offset + resource.Size, resource.Begin, resource.End });
+				overflowResources.push_back(resourceIndex);
+			}
+		}
+
+		if (!overflowResources.empty())
+		{
+			uint64 usedSize = 0;
+			for (const OccupiedRange& range : overflowHeap.Ranges)
+				usedSize = Math::Max(usedSize, range.End);
+
+			RGPlacementHeap& heap = heaps.emplace_back();
+			heap.Size			  = Math::AlignUp<uint64>(usedSize, minHeapSize);
+			heap.IsNew			  = true;
+			for (uint32 resourceIndex : overflowResources)
+				resources[resourceIndex].Heap = (uint32)heaps.size() - 1;
+		}
+	}
+
+	uint64 GetLowerBound(Span<const RGPlacementResource> resources)
+	{
+		struct Event
+		{
+			uint32 Time;
+			bool   IsBegin;
+			uint64 Size;
+		};
+		Array<Event> events;
+		events.reserve(resources.GetSize() * 2);
+		for (const RGPlacementResource& resource : resources)
+		{
+			events.push_back({ resource.Begin, true, resource.Size });
+			events.push_back({ resource.End, false, resource.Size });
+		}
+
+		// Lifetimes are half-open, so a resource that ends at a pass is released before one that begins at that pass
+		std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+			if (a.Time != b.Time)
+				return a.Time < b.Time;
+			return a.IsBegin < b.IsBegin;
+		});
+
+		uint64 aliveSize = 0;
+		uint64 maxSize	 = 0;
+		for (const Event& event : events)
+		{
+			if (event.IsBegin)
+			{
+				aliveSize += event.Size;
+				maxSize = Math::Max(maxSize, aliveSize);
+			}
+			else
+			{
+				aliveSize -= event.Size;
+			}
+		}
+		return maxSize;
+	}
+
+	uint64 GetPeakMemory(Span<const RGPlacementResource> resources, Span<const RGPlacementHeap> heaps)
+	{
+		Array<uint64> heapPeaks(heaps.GetSize(), 0);
+		for (uint32 heapIndex = 0; heapIndex < heaps.GetSize(); ++heapIndex)
+		{
+			for (const RGPlacementHeap::Range& reserved : heaps[heapIndex].Reserved)
+				heapPeaks[heapIndex] = Math::Max(heapPeaks[heapIndex], reserved.End);
+		}
+		for (const RGPlacementResource& resource : resources)
+		{
+			if (resource.Heap != RGPlacementResource::InvalidIndex)
+				heapPeaks[resource.Heap] = Math::Max(heapPeaks[resource.Heap], resource.Offset + resource.Size);
+		}
+
+		uint64 peak = 0;
+		for (uint64 heapPeak : heapPeaks)
+			peak += heapPeak;
+		return peak;
+	}
+
+	bool Validate(Span<const RGPlacementResource> resources, Span<const RGPlacementHeap> heaps)
+	{
+		for (uint32 i = 0; i < resources.GetSize(); ++i)
+		{
+			const RGPlacementResource& resource = resources[i];
+			if (resource.Heap >= heaps.GetSize())
+			{
+				E_LOG(Warning, "RGPlacement - Resource %d is not placed", i);
+				return false;
+			}
+			if (resource.Offset % resource.Alignment != 0)
+			{
+				E_LOG(Warning, "RGPlacement - Resource %d at offset %llu is not aligned to %llu", i, resource.Offset, resource.Alignment);
+				return false;
+			}
+
+			const RGPlacementHeap& heap = heaps[resource.Heap];
+			if (resource.Offset + resource.Size > heap.Size)
+			{
+				E_LOG(Warning, "RGPlacement - Resource %d [%llu, %llu] is outside of heap %d (%llu)", i, resource.Offset, resource.Offset + resource.Size, resource.Heap, heap.Size);
+				return false;
+			}
+			for (const RGPlacementHeap::Range& reserved : heap.Reserved)
+			{
+				if (resource.Offset < reserved.End && reserved.Begin < resource.Offset + resource.Size)
+				{
+					E_LOG(Warning, "RGPlacement - Resource %d [%llu, %llu] overlaps reserved memory [%llu, %llu] of heap %d", i, resource.Offset, resource.Offset + resource.Size, reserved.Begin, reserved.End, resource.Heap);
+					return false;
+				}
+			}
+
+			for (uint32 j = i + 1; j < resources.GetSize(); ++j)
+			{
+				const RGPlacementResource& other = resources[j];
+				if (other.Heap == resource.Heap &&
+					LifetimesOverlap(resource.Begin, resource.End, other.Begin, other.End) &&
+					resource.Offset < other.Offset + other.Size && other.Offset < resource.Offset + resource.Size)
+				{
+					E_LOG(Warning, "RGPlacement - Resource %d (Lifetime: [%d, %d], Memory: [%llu, %llu]) overlaps with Resource %d (Lifetime: [%d, %d], Memory: [%llu, %llu])",
+						i, resource.Begin, resource.End, resource.Offset, resource.Offset + resource.Size,
+						j, other.Begin, other.End, other.Offset, other.Offset + other.Size);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// The allocator before Place(): resources are placed one at a time in the first heap and the first free range they fit in.
+	// Every attempt collects and sorts the free ranges of the heap, and each resource that fits no heap gets a new heap of its own.
+	static void PlaceFirstFit(Array<RGPlacementResource>& resources, Array<RGPlacementHeap>& heaps, uint64 minHeapSize)
+	{
+		struct HeapOffset
+		{
+			uint64 Offset;
+			bool   IsFreeBegin;
+		};
+		Array<HeapOffset> freeRanges;
+
+		auto TryAllocate = [&](uint32 heapIndex, RGPlacementResource& resource) {
+			const RGPlacementHeap& heap = heaps[heapIndex];
+			if (resource.Size > heap.Size)
+				return false;
+
+			bool isEmpty = heap.Reserved.empty();
+			for (const RGPlacementResource& other : resources)
+				isEmpty &= other.Heap != heapIndex;
+			if (isEmpty && Math::AlignUp<uint64>(resource.Size, minHeapSize) < heap.Size)
+				return false;
+
+			freeRanges.clear();
+			freeRanges.push_back({ 0, true });
+			for (const RGPlacementHeap::Range& reserved : heap.Reserved)
+			{
+				freeRanges.push_back({ reserved.Begin, false });
+				freeRanges.push_back({ reserved.End, true });
+			}
+			for (const RGPlacementResource& other : resources)
+			{
+				if (other.Heap == heapIndex && LifetimesOverlap(other.Begin, other.End, resource.Begin, resource.End))
+				{
+					freeRanges.push_back({ other.Offset, false });
+					freeRanges.push_back({ other.Offset + other.Size, true });
+				}
+			}
+			freeRanges.push_back({ heap.Size, false });
+			std::sort(freeRanges.begin(), freeRanges.end(), [](const HeapOffset& a, const HeapOffset& b) { return a.Offset < b.Offset; });
+
+			uint32 freeRangeCounter = 0;
+			uint64 lastBeginOffset	= 0;
+			for (const HeapOffset& heapOffset : freeRanges)
+			{
+				if (heapOffset.IsFreeBegin)
+				{
+					lastBeginOffset = heapOffset.Offset;
+					++freeRangeCounter;
+				}
+				else
+				{
+					--freeRangeCounter;
+					if (freeRangeCounter == 0)
+					{
+						uint64 alignedOffset = Math::AlignUp<uint64>(lastBeginOffset, resource.Alignment);
+						if (alignedOffset + resource.Size <= heapOffset.Offset)
+						{
+							resource.Heap	= heapIndex;
+							resource.Offset = alignedOffset;
+							return true;
+						}
+					}
+				}
+			}
+			return false;
+		};
+
+		Array<uint32> resourceOrder;
+		SortForPlacement(resources, resourceOrder);
+
+		Array<uint32> heapOrder;
+		SortHeaps(heaps, heapOrder);
+
+		for (RGPlacementResource& resource : resources)
+			resource.Heap = RGPlacementResource::InvalidIndex;
+
+		for (uint32 resourceIndex : resourceOrder)
+		{
+			RGPlacementResource& resource = resources[resourceIndex];
+
+			bool success = false;
+			for (uint32 heapIndex : heapOrder)
+			{
+				if (resource.Size > heaps[heapIndex].Size)
+					break;
+				if (TryAllocate(heapIndex, resource))
+				{
+					success = true;
+					break;
+				}
+			}
+
+			if (!success)
+			{
+				RGPlacementHeap& heap = heaps.emplace_back();
+				heap.Size			  = Math::AlignUp<uint64>(resource.Size, minHeapSize);
+				heap.IsNew			  = true;
+				heapOrder.push_back((uint32)heaps.size() - 1);
+				gVerify(TryAllocate((uint32)heaps.size() - 1, resource), == true);
+			}
+		}
+	}
+
+	bool RunReplay(const char* pPath)
+	{
+		RGPlacementRecording recording;
+		if (!recording.Load(pPath))
+		{
+			E_LOG(Warning, "RGPlacement - Failed to load recording '%s'", pPath);
+			return false;
+		}
+
+		struct Result
+		{
+			uint64 HeapSize		= 0;
+			uint64 PeakMemory	= 0;
+			uint32 NumHeaps		= 0;
+			float  TimeMs		= 0;
+			bool   IsValid		= true;
+		};
+
+		auto Run = [](const RGPlacementRecording::Pool& pool, auto&& placeFunction) {
+			constexpr uint32 NumIterations = 100;
+
+			Result result;
+			Array<RGPlacementResource> resources;
+			Array<RGPlacementHeap>	   heaps;
+			Utils::TimeScope		   timer;
+			for (uint32 iteration = 0; iteration < NumIterations; ++iteration)
+			{
+				resources = pool.Resources;
+				heaps.clear();
+				placeFunction(resources, heaps, pool.MinHeapSize);
+			}
+			result.TimeMs = timer.Stop() * 1000.0f / NumIterations;
+
+			result.IsValid	  = Validate(resources, heaps);
+			result.PeakMemory = GetPeakMemory(resources, heaps);
+			result.NumHeaps	  = (uint32)heaps.size();
+			for (const RGPlacementHeap& heap : heaps)
+				result.HeapSize += heap.Size;
+			return result;
+		};
+
+		bool isValid = true;
+		for (uint32 poolIndex = 0; poolIndex < (uint32)recording.Pools.size(); ++poolIndex)
+		{
+			const RGPlacementRecording::Pool& pool = recording.Pools[poolIndex];
+			if (pool.Resources.empty())
+				continue;
+
+			const uint64 lowerBound = GetLowerBound(pool.Resources);
+			const Result bestFit	= Run(pool, Place);
+			const Result firstFit	= Run(pool, PlaceFirstFit);
+			isValid &= bestFit.IsValid && firstFit.IsValid;
+
+			auto LogResult = [&](const char* pName, const Result& result) {
+				E_LOG(Info, "RGPlacement -   %-9s: %d heaps (%s), peak %s (+%.1f%%), %.3f ms%s",
+					pName, result.NumHeaps, Math::PrettyPrintDataSize(result.HeapSize).c_str(), Math::PrettyPrintDataSize(result.PeakMemory).c_str(),
+					lowerBound > 0 ? (float)(result.PeakMemory - lowerBound) * 100.0f / lowerBound : 0.0f, result.TimeMs, result.IsValid ? "" : " (VALIDATION FAILED)");
+			};
+			E_LOG(Info, "RGPlacement - Pool %d: %d resources, lower bound %s", poolIndex, (uint32)pool.Resources.size(), Math::PrettyPrintDataSize(lowerBound).c_str());
+			LogResult("Best fit", bestFit);
+			LogResult("First fit", firstFit);
+		}
+		return isValid;
+	}
+}
+
+
+bool RGPlacementRecording::Save(const char* pPath) const
+{
+	FileStream stream;
+	if (!stream.Open(pPath, FileMode::Write | FileMode::Create))
+		return false;
+
+	stream << RGPlacement::Magic << RGPlacement::Version << (uint32)Pools.size();
+	for (const Pool& pool : Pools)
+	{
+		stream << pool.MinHeapSize << (uint32)pool.Resources.size();
+		for (const RGPlacementResource& resource : pool.Resources)
+			stream << resource.Size << resource.Alignment << resource.Begin << resource.End << (uint32)resource.IsPersistent;
+	}
+	return stream.Flush();
+}
+
+
+bool RGPlacementRecording::Load(const char* pPath)
+{
+	FileStream stream;
+	if (!stream.Open(pPath, FileMode::Read))
+		return false;
+
+	constexpr uint64 ResourceSize = 2 * sizeof(uint64) + 3 * sizeof(uint32);
+
+	uint32 magic = 0, version = 0, numPools = 0;
+	stream >> magic >> version >> numPools;
+	if (magic != RGPlacement::Magic || version != RGPlacement::Version)
+		return false;
+
+	Pools.clear();
+	for (uint32 poolIndex = 0; poolIndex < numPools; ++poolIndex)
+	{
+		Pool&  pool			= Pools.emplace_back();
+		uint32 numResources = 0;
+		stream >> pool.MinHeapSize >> numResources;
+		if (stream.GetCursor() + numResources * ResourceSize > stream.GetLength())
+			return false;
+
+		pool.Resources.resize(numResources);
+		for (RGPlacementResource& resource : pool.Resources)
+		{
+			uint32 isPersistent = 0;
+			stream >> resource.Size >> resource.Alignment >> resource.Begin >> resource.End >> isPersistent;
+			resource.IsPersistent = isPersistent != 0;
+			if (resource.Size == 0 || resource.Begin >= resource.End || resource.Alignment == 0 || (resource.Alignment & (resource.Alignment - 1)) != 0)
+				return false;
+		}
+	}
+	return stream.GetCursor() == stream.GetLength();
+}
+
+
+// Usage: RGReplayPlacement <recording>
+// Recordings are written by RGRecordPlacement
+static ConsoleCommand<const char*> gReplayRGPlacement("RGReplayPlacement", [](const char* pPath)
+	{
+		RGPlacement::RunReplay(pPath);
+	});
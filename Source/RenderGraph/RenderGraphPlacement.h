@@ -0,0 +1,67 @@
+#pragma once
+
+// A transient resource to place in a heap.
+// Resources with overlapping lifetimes never overlap in memory.
+struct RGPlacementResource
+{
+	static constexpr uint32 InvalidIndex = 0xFFFFFFFF;
+
+	// Input
+	uint64			Size			= 0;
+	uint64			Alignment		= 1;
+	uint32			Begin			= 0;			///< First pass of the lifetime
+	uint32			End				= 0;			///< One past the last pass of the lifetime
+	bool			IsPersistent	= false;		///< Stays alive after the graph. Placed before other resources so it doesn't fragment the heap
+
+	// Output
+	uint32			Heap			= InvalidIndex;
+	uint64			Offset			= 0;
+};
+
+struct RGPlacementHeap
+{
+	struct Range
+	{
+		uint64		Begin;
+		uint64		End;
+	};
+
+	uint64			Size			= 0;
+	Array<Range>	Reserved;						///< Memory that is in use for the whole graph, by resources that are still referenced outside of it
+	bool			IsNew			= false;		///< Added by Place()
+};
+
+// Transient resources of a frame, recorded to compare placement algorithms offline
+struct RGPlacementRecording
+{
+	// Resources that can share a heap
+	struct Pool
+	{
+		uint64						MinHeapSize = 0;
+		Array<RGPlacementResource>	Resources;
+	};
+	Array<Pool>		Pools;
+
+	bool Save(const char* pPath) const;
+	bool Load(const char* pPath);
+};
+
+namespace RGPlacement
+{
+	// Places all resources at once, largest first. Each resource goes in the first heap where it fits, in the smallest free range
+	// left by the resources with an overlapping lifetime (best fit). Resources that don't fit any heap are packed together in a single new heap.
+	// An empty heap isn't used for a resource that needs a much smaller heap, so the heap can be released.
+	void Place(Array<RGPlacementResource>& resources, Array<RGPlacementHeap>& heaps, uint64 minHeapSize);
+
+	// The largest total size of resources that are alive at the same time. No placement can use less memory.
+	uint64 GetLowerBound(Span<const RGPlacementResource> resources);
+
+	// Per heap, the end of the highest resource. Includes reserved memory.
+	uint64 GetPeakMemory(Span<const RGPlacementResource> resources, Span<const RGPlacementHeap> heaps);
+
+	// Checks alignment, heap bounds and that resources with overlapping lifetimes don't overlap in memory. Logs the first error found.
+	bool Validate(Span<const RGPlacementResource> resources, Span<const RGPlacementHeap> heaps);
+
+	// Places the recorded resources with Place() and with the previous first-fit allocator, and logs memory and CPU time of both
+	bool RunReplay(const char* pPath);
+}
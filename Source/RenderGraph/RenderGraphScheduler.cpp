@@ -0,0 +1,351 @@
+#include "stdafx.h"
+#include "RenderGraphScheduler.h"
+#include "Core/ConsoleVariables.h"
+
+#include <random>
+
+namespace RGScheduler
+{
+	static constexpr int32 NumQueues = (int32)RGQueueType::Num;
+
+	void ResolveSyncPoints(Array<RGSchedulePass>& passes)
+	{
+		PROFILE_CPU_SCOPE();
+
+		// Sync indices at the start of the last pass of each queue, with the queue's own entry pointing to that pass
+		int32 queueSync[NumQueues][NumQueues];
+		for (int32 queue = 0; queue < NumQueues; ++queue)
+		{
+			for (int32 other = 0; other < NumQueues; ++other)
+				queueSync[queue][other] = RGSchedulePass::InvalidIndex;
+		}
+
+		for (uint32 passIndex = 0; passIndex < (uint32)passes.size(); ++passIndex)
+		{
+			RGSchedulePass& pass = passes[passIndex];
+			pass.Waits.clear();
+			pass.Signal = false;
+
+			if (!pass.IsActive)
+			{
+				for (int32& syncIndex : pass.SyncIndex)
+					syncIndex = RGSchedulePass::InvalidIndex;
+				continue;
+			}
+
+			const int32 queue = (int32)pass.Queue;
+			for (int32 other = 0; other < NumQueues; ++other)
+				pass.SyncIndex[other] = queueSync[queue][other];
+
+			// Per queue, the latest dependency that isn't ordered before this pass yet
+			int32 required[NumQueues];
+			for (int32& index : required)
+				index = RGSchedulePass::InvalidIndex;
+
+			for (uint32 dependency : pass.Dependencies)
+			{
+				gAssert(dependency < passIndex, "Pass %d can only depend on earlier passes (depends on %d)", passIndex, dependency);
+				const RGSchedulePass& dependencyPass = passes[dependency];
+				if (!dependencyPass.IsActive)
+					continue;
+
+				const int32 dependencyQueue = (int32)dependencyPass.Queue;
+				if ((int32)dependency > pass.SyncIndex[dependencyQueue])
+					required[dependencyQueue] = Math::Max(required[dependencyQueue], (int32)dependency);
+			}
+
+			// A wait is redundant if waiting on another queue already orders it before this pass
+			for (int32 waitQueue = 0; waitQueue < NumQueues; ++waitQueue)
+			{
+				if (required[waitQueue] == RGSchedulePass::InvalidIndex)
+					continue;
+
+				bool isImplied = false;
+				for (int32 other = 0; other < NumQueues && !isImplied; ++other)
+				{
+					if (other != waitQueue && required[other] != RGSchedulePass::InvalidIndex)
+						isImplied = passes[required[other]].SyncIndex[waitQueue] >= required[waitQueue];
+				}
+				if (!isImplied)
+					pass.Waits.push_back((uint32)required[waitQueue]);
+			}
+
+			for (uint32 wait : pass.Waits)
+			{
+				RGSchedulePass& waitPass = passes[wait];
+				waitPass.Signal = true;
+				for (int32 other = 0; other < NumQueues; ++other)
+					pass.SyncIndex[other] = Math::Max(pass.SyncIndex[other], waitPass.SyncIndex[other]);
+				pass.SyncIndex[(int32)waitPass.Queue] = Math::Max(pass.SyncIndex[(int32)waitPass.Queue], (int32)wait);
+			}
+
+			for (int32 other = 0; other < NumQueues; ++other)
+				queueSync[queue][other] = pass.SyncIndex[other];
+			queueSync[queue][queue] = (int32)passIndex;
+		}
+	}
+
+	void ComputeSyncIndices(Array<RGSchedulePass>& passes)
+	{
+		int32 queueSync[NumQueues][NumQueues];
+		for (int32 queue = 0; queue < NumQueues; ++queue)
+		{
+			for (int32 other = 0; other < NumQueues; ++other)
+				queueSync[queue][other] = RGSchedulePass::InvalidIndex;
+		}
+
+		for (uint32 passIndex = 0; passIndex < (uint32)passes.size(); ++passIndex)
+		{
+			RGSchedulePass& pass = passes[passIndex];
+			if (!pass.IsActive)
+			{
+				for (int32& syncIndex : pass.SyncIndex)
+					syncIndex = RGSchedulePass::InvalidIndex;
+				continue;
+			}
+
+			const int32 queue = (int32)pass.Queue;
+			for (int32 other = 0; other < NumQueues; ++other)
+				pass.SyncIndex[other] = queueSync[queue][other];
+
+			for (uint32 wait : pass.Waits)
+			{
+				const RGSchedulePass& waitPass = passes[wait];
+				for (int32 other = 0; other < NumQueues; ++other)
+					pass.SyncIndex[other] = Math::Max(pass.SyncIndex[other], waitPass.SyncIndex[other]);
+				pass.SyncIndex[(int32)waitPass.Queue] = Math::Max(pass.SyncIndex[(int32)waitPass.Queue], (int32)wait);
+			}
+
+			for (int32 other = 0; other < NumQueues; ++other)
+				queueSync[queue][other] = pass.SyncIndex[other];
+			queueSync[queue][queue] = (int32)passIndex;
+		}
+	}
+
+	bool IsOrderedBefore(Span<const RGSchedulePass> passes, uint32 first, uint32 second)
+	{
+		gAssert(passes[first].IsActive && passes[second].IsActive);
+		if (first >= second)
+			return false;
+		return passes[second].SyncIndex[(int32)passes[first].Queue] >= (int32)first;
+	}
+
+	uint32 GetLastOverlappingPass(Span<const RGSchedulePass> passes, uint32 pass)
+	{
+		const RGSchedulePass& source = passes[pass];
+		gAssert(source.IsActive);
+
+		// Sync indices only grow along a queue: once a pass on a queue is ordered after the source pass, all later passes on that queue are too
+		bool isQueueOrdered[NumQueues]{};
+		isQueueOrdered[(int32)source.Queue] = true;
+		int32 numUnorderedQueues = NumQueues - 1;
+
+		uint32 lastOverlapping = pass;
+		for (uint32 passIndex = pass + 1; passIndex < passes.GetSize() && numUnorderedQueues > 0; ++passIndex)
+		{
+			const RGSchedulePass& other = passes[passIndex];
+			const int32 queue = (int32)other.Queue;
+			if (!other.IsActive || isQueueOrdered[queue])
+				continue;
+
+			if (other.SyncIndex[(int32)source.Queue] >= (int32)pass)
+			{
+				isQueueOrdered[queue] = true;
+				--numUnorderedQueues;
+			}
+			else
+			{
+				lastOverlapping = passIndex;
+			}
+		}
+		return lastOverlapping;
+	}
+
+	bool Validate(Span<const RGSchedulePass> passes)
+	{
+		// Sync indices are recomputed from the waits alone so a missing or stale wait can't hide behind the stored SyncIndex
+		Array<int32> syncIndices(passes.GetSize() * NumQueues, RGSchedulePass::InvalidIndex);
+		int32 queueSync[NumQueues][NumQueues];
+		for (int32 queue = 0; queue < NumQueues; ++queue)
+		{
+			for (int32 other = 0; other < NumQueues; ++other)
+				queueSync[queue][other] = RGSchedulePass::InvalidIndex;
+		}
+
+		for (uint32 passIndex = 0; passIndex < passes.GetSize(); ++passIndex)
+		{
+			const RGSchedulePass& pass = passes[passIndex];
+			if (!pass.IsActive)
+				continue;
+
+			const int32 queue = (int32)pass.Queue;
+			int32* pSyncIndex = &syncIndices[passIndex * NumQueues];
+
+			for (uint32 wait : pass.Waits)
+			{
+				const RGSchedulePass& waitPass = passes[wait];
+				const int32 waitQueue = (int32)waitPass.Queue;
+				if (wait >= passIndex || !waitPass.IsActive || waitQueue == queue || !waitPass.Signal)
+				{
+					E_LOG(Warning, "RGScheduler - Pass %d waits on pass %d which is not an earlier, active and signaling pass on another queue", passIndex, wait);
+					return false;
+				}
+				if (std::find(pass.Dependencies.begin(), pass.Dependencies.end(), wait) == pass.Dependencies.end())
+				{
+					E_LOG(Warning, "RGScheduler - Pass %d waits on pass %d which it doesn't depend on", passIndex, wait);
+					return false;
+				}
+
+				// What this pass would be ordered after without this wait
+				int32 syncIndex = queueSync[queue][waitQueue];
+				for (uint32 otherWait : pass.Waits)
+				{
+					if (otherWait != wait)
+						syncIndex = Math::Max(syncIndex, (int32)passes[otherWait].Queue == waitQueue ? (int32)otherWait : syncIndices[otherWait * NumQueues + waitQueue]);
+				}
+				if (syncIndex >= (int32)wait)
+				{
+					E_LOG(Warning, "RGScheduler - Wait of pass %d on pass %d is redundant", passIndex, wait);
+					return false;
+				}
+			}
+
+			for (int32 other = 0; other < NumQueues; ++other)
+				pSyncIndex[other] = queueSync[queue][other];
+			for (uint32 wait : pass.Waits)
+			{
+				const int32 waitQueue = (int32)passes[wait].Queue;
+				for (int32 other = 0; other < NumQueues; ++other)
+					pSyncIndex[other] = Math::Max(pSyncIndex[other], syncIndices[wait * NumQueues + other]);
+				pSyncIndex[waitQueue] = Math::Max(pSyncIndex[waitQueue], (int32)wait);
+			}
+
+			for (uint32 dependency : pass.Dependencies)
+			{
+				const RGSchedulePass& dependencyPass = passes[dependency];
+				if (dependencyPass.IsActive && pSyncIndex[(int32)dependencyPass.Queue] < (int32)dependency)
+				{
+					E_LOG(Warning, "RGScheduler - Dependency of pass %d on pass %d is not satisfied", passIndex, dependency);
+					return false;
+				}
+			}
+
+			for (int32 other = 0; other < NumQueues; ++other)
+			{
+				if (pSyncIndex[other] != pass.SyncIndex[other])
+				{
+					E_LOG(Warning, "RGScheduler - Sync indices of pass %d don't match its waits", passIndex);
+					return false;
+				}
+				queueSync[queue][other] = pSyncIndex[other];
+			}
+			queueSync[queue][queue] = (int32)passIndex;
+		}
+		return true;
+	}
+
+	bool RunSelfTest(uint32 numGraphs, uint32 seed)
+	{
+		PROFILE_CPU_SCOPE();
+
+		// Graphics pass 0 produces something for compute pass 1, which is consumed by graphics pass 3. Graphics pass 2 is independent and overlaps with pass 1.
+		{
+			Array<RGSchedulePass> passes(4);
+			passes[1].Queue = RGQueueType::Compute;
+			passes[1].Dependencies = { 0 };
+			passes[3].Dependencies = { 1, 2 };
+			ResolveSyncPoints(passes);
+
+			bool success = Validate(passes)
+				&& passes[1].Waits == Array<uint32>{ 0 }
+				&& passes[2].Waits.empty()
+				&& passes[3].Waits == Array<uint32>{ 1 }
+				&& passes[0].Signal && passes[1].Signal && !passes[2].Signal
+				&& !IsOrderedBefore(passes, 1, 2)
+				&& GetLastOverlappingPass(passes, 1) == 2
+				&& GetLastOverlappingPass(passes, 2) == 2;
+			if (!success)
+			{
+				E_LOG(Warning, "RGScheduler - Basic async compute case failed");
+				return false;
+			}
+		}
+
+		std::mt19937 random(seed);
+		uint64 numDependencies = 0;
+		uint64 numCrossQueueDependencies = 0;
+		uint64 numWaits = 0;
+
+		for (uint32 graphIndex = 0; graphIndex < numGraphs; ++graphIndex)
+		{
+			const uint32 numPasses = std::uniform_int_distribution<uint32>(1, 300)(random);
+			const float computeRatio = std::uniform_real_distribution<float>(0.0f, 1.0f)(random);
+
+			Array<RGSchedulePass> passes(numPasses);
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				RGSchedulePass& pass = passes[passIndex];
+				pass.Queue = std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < computeRatio ? RGQueueType::Compute : RGQueueType::Graphics;
+				pass.IsActive = std::uniform_int_distribution<uint32>(0, 9)(random) != 0;
+
+				// Mostly local dependencies with the occasional long range one
+				const uint32 numPassDependencies = passIndex > 0 ? std::uniform_int_distribution<uint32>(0, 4)(random) : 0;
+				for (uint32 i = 0; i < numPassDependencies; ++i)
+				{
+					const uint32 range = std::uniform_int_distribution<uint32>(0, 3)(random) == 0 ? passIndex : Math::Min(passIndex, 8u);
+					const uint32 dependency = passIndex - std::uniform_int_distribution<uint32>(1, range)(random);
+					if (std::find(pass.Dependencies.begin(), pass.Dependencies.end(), dependency) == pass.Dependencies.end())
+						pass.Dependencies.push_back(dependency);
+				}
+			}
+
+			ResolveSyncPoints(passes);
+			if (!Validate(passes))
+			{
+				E_LOG(Warning, "RGScheduler - Random graph %d (seed %d) failed validation", graphIndex, seed);
+				return false;
+			}
+
+			for (uint32 passIndex = 0; passIndex < numPasses; ++passIndex)
+			{
+				const RGSchedulePass& pass = passes[passIndex];
+				if (!pass.IsActive)
+					continue;
+
+				numWaits += pass.Waits.size();
+				for (uint32 dependency : pass.Dependencies)
+				{
+					if (passes[dependency].IsActive)
+					{
+						++numDependencies;
+						numCrossQueueDependencies += passes[dependency].Queue != pass.Queue;
+					}
+				}
+
+				// Everything after the last overlapping pass must be ordered after this pass, and the last overlapping pass itself must not be
+				uint32 lastOverlapping = GetLastOverlappingPass(passes, passIndex);
+				if (lastOverlapping != passIndex && (!passes[lastOverlapping].IsActive || IsOrderedBefore(passes, passIndex, lastOverlapping)))
+				{
+					E_LOG(Warning, "RGScheduler - Random graph %d: pass %d is ordered before its last overlapping pass %d", graphIndex, passIndex, lastOverlapping);
+					return false;
+				}
+				for (uint32 otherIndex = lastOverlapping + 1; otherIndex < numPasses; ++otherIndex)
+				{
+					if (passes[otherIndex].IsActive && !IsOrderedBefore(passes, passIndex, otherIndex))
+					{
+						E_LOG(Warning, "RGScheduler - Random graph %d: pass %d may overlap with pass %d after its last overlapping pass %d", graphIndex, passIndex, otherIndex, lastOverlapping);
+						return false;
+					}
+				}
+			}
+		}
+
+		E_LOG(Info, "RGScheduler - %d random graphs passed. %llu dependencies, %llu across queues, resolved with %llu waits", numGraphs, numDependencies, numCrossQueueDependencies, numWaits);
+		return true;
+	}
+}
+
+static ConsoleCommand<> gTestRGScheduler("RGTestScheduler", []()
+	{
+		RGScheduler::RunSelfTest(1000, 0);
+	});
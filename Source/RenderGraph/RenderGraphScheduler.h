@@ -0,0 +1,49 @@
+#pragma once
+
+// Queue a render graph pass is executed on
+enum class RGQueueType : uint8
+{
+	Graphics,
+	Compute,
+	Num,
+};
+
+// A pass as seen by the queue scheduler.
+// Only contains what's needed to place cross-queue synchronization so it can be used without a device.
+struct RGSchedulePass
+{
+	static constexpr int32 InvalidIndex = -1;
+
+	// Input
+	RGQueueType		Queue		= RGQueueType::Graphics;
+	bool			IsActive	= true;				///< Inactive (culled) passes are ignored
+	Array<uint32>	Dependencies;					///< Earlier passes that must be complete before this pass can start
+
+	// Output
+	Array<uint32>	Waits;							///< Passes on other queues to wait for before this pass starts
+	bool			Signal		= false;			///< A pass on another queue waits for this pass
+	int32			SyncIndex[(int)RGQueueType::Num];	///< Per queue, the last pass that is guaranteed to be ordered before this pass starts
+};
+
+namespace RGScheduler
+{
+	// Places the minimal set of cross-queue waits that satisfies all dependencies.
+	// Dependencies on the same queue, and dependencies already covered by an earlier wait (also transitively through another queue), don't add a wait.
+	void ResolveSyncPoints(Array<RGSchedulePass>& passes);
+
+	// Computes the sync indices from the waits of each pass, for passes that weren't resolved with ResolveSyncPoints()
+	void ComputeSyncIndices(Array<RGSchedulePass>& passes);
+
+	// True if pass 'first' is guaranteed to be complete before pass 'second' starts. Requires ResolveSyncPoints()
+	bool IsOrderedBefore(Span<const RGSchedulePass> passes, uint32 first, uint32 second);
+
+	// The last pass that can still run at the same time as the given pass. Every pass after it is ordered after the given pass.
+	// Memory used by the given pass can't be aliased by anything up to and including the returned pass.
+	uint32 GetLastOverlappingPass(Span<const RGSchedulePass> passes, uint32 pass);
+
+	// Checks that all dependencies are satisfied and that no wait is redundant. Logs the first error found.
+	bool Validate(Span<const RGSchedulePass> passes);
+
+	// Resolves and validates a few known cases and a number of random graphs
+	bool RunSelfTest(uint32 numGraphs, uint32 seed);
+}
@@ -0,0 +1,404 @@
+#include "stdafx.h"
+#include "AnimationCompression.h"
+#include "Core/TaskQueue.h"
+#include "Core/Profiler.h"
+#include "Core/Utils.h"
+#include "Renderer/Mesh.h"
+#include "Renderer/SkeletalAnimation.h"
+#include "RenderGraph/RenderGraph.h"
+
+#include <random>
+
+static void EncodeKey(const CompressedAnimation::Track& track, const Vector4& value, uint16* pData)
+{
+	if (track.Path == AnimationChannel::PathType::Rotation)
+	{
+		// Smallest three: the largest component is made positive and rebuilt from the others, which are within +-1/sqrt(2)
+		constexpr float InvSqrt2 = 0.70710678118f;
+		const float* pComponents = &value.x;
+		uint32 largest = 0;
+		for (uint32 i = 1; i < 4; ++i)
+		{
+			if (fabsf(pComponents[i]) > fabsf(pComponents[largest]))
+				largest = i;
+		}
+		float sign = pComponents[largest] < 0.0f ? -1.0f : 1.0f;
+
+		uint32 index = 0;
+		for (uint32 i = 0; i < 4; ++i)
+		{
+			if (i != largest)
+				pData[index++] = (uint16)Math::Clamp((int)((pComponents[i] * sign + InvSqrt2) / (2.0f * InvSqrt2) * 0x7FFF + 0.5f), 0, 0x7FFF);
+		}
+		pData[0] |= (uint16)((largest & 1) << 15);
+		pData[1] |= (uint16)((largest >> 1) << 15);
+	}
+	else
+	{
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			float scale = (&track.RangeScale.x)[i];
+			pData[i] = scale > 0.0f ? (uint16)Math::Clamp((int)(((&value.x)[i] - (&track.RangeMin.x)[i]) / scale + 0.5f), 0, 0xFFFF) : 0;
+		}
+	}
+}
+
+bool AnimationCompression::Compress(Animation& animation, const Skeleton& skeleton, const AnimationCompressionSettings& settings)
+{
+	PROFILE_CPU_SCOPE();
+
+	for (const AnimationChannel& channel : animation.Channels)
+	{
+		if (skeleton.GetJoint(channel.Target) == Skeleton::InvalidJoint)
+			return false;
+	}
+
+	// A joint moves all its descendants along, so its error is measured at the furthest of them in the bind pose
+	uint32 numJoints = skeleton.NumJoints();
+	Array<Vector3> bindPositions(numJoints);
+	for (uint32 i = 0; i < numJoints; ++i)
+		bindPositions[i] = skeleton.InverseBindMatrices[i].Invert().Translation();
+	Array<float> reach(numJoints, settings.ShellDistance);
+	for (auto it = skeleton.JointUpdateOrder.rbegin(); it != skeleton.JointUpdateOrder.rend(); ++it)
+	{
+		Skeleton::JointIndex parent = skeleton.ParentIndices[*it];
+		if (parent != Skeleton::InvalidJoint)
+			reach[parent] = Math::Max(reach[parent], reach[*it] + Vector3::Distance(bindPositions[*it], bindPositions[parent]));
+	}
+
+	// Sampling in between the keys of the source would cut their corners, so the key rate of the densest channel is used
+	float  duration		= Math::Max(0.0f, animation.TimeEnd - animation.TimeStart);
+	uint32 numIntervals = 0;
+	for (const AnimationChannel& channel : animation.Channels)
+		numIntervals = Math::Max(numIntervals, (uint32)channel.KeyFrames.size() - 1);
+	numIntervals = duration > 0.0f ? Math::Clamp(numIntervals, 1u, Math::Max(1u, (uint32)roundf(duration * settings.MaxSampleRate))) : 0;
+	gAssert(numIntervals < 0xFFFF, "Animation '%s' has too many frames to compress (%d)", animation.Name.c_str(), numIntervals);
+
+	CompressedAnimation& compressed = animation.Compressed;
+	compressed			  = {};
+	compressed.TimeStart  = animation.TimeStart;
+	compressed.SampleRate = numIntervals > 0 ? numIntervals / duration : 0.0f;
+
+	Array<Vector4> samples(numIntervals + 1);
+	Array<Vector4> quantized(numIntervals + 1);
+	Array<uint32>  keys;
+	for (const AnimationChannel& channel : animation.Channels)
+	{
+		Skeleton::JointIndex joint = skeleton.GetJoint(channel.Target);
+
+		CompressedAnimation::Track track;
+		track.Path	   = channel.Path;
+		track.FirstKey = (uint32)compressed.KeyFrames.size();
+
+		Vector3 rangeMin(FLT_MAX), rangeMax(-FLT_MAX);
+		for (uint32 frame = 0; frame <= numIntervals; ++frame)
+		{
+			float time = frame == numIntervals ? animation.TimeEnd : animation.TimeStart + frame / compressed.SampleRate;
+			samples[frame] = channel.Evaluate(time);
+			if (channel.Path == AnimationChannel::PathType::Rotation)
+				samples[frame].Normalize();
+			rangeMin = Vector3::Min(rangeMin, Vector3(samples[frame]));
+			rangeMax = Vector3::Max(rangeMax, Vector3(samples[frame]));
+		}
+		track.RangeMin	 = rangeMin;
+		track.RangeScale = (rangeMax - rangeMin) / 0xFFFF;
+
+		for (uint32 frame = 0; frame <= numIntervals; ++frame)
+		{
+			uint16 data[3];
+			EncodeKey(track, samples[frame], data);
+			quantized[frame] = CompressedAnimation::Decode(track, data);
+		}
+
+		float jointReach = reach[joint];
+		auto GetError = [&](const Vector4& value, const Vector4& reference)
+			{
+				if (channel.Path == AnimationChannel::PathType::Rotation)
+				{
+					// Angle from the chord between the quaternions, which unlike the dot product is precise for small angles
+					float chord = (value - (value.Dot(reference) < 0.0f ? -reference : reference)).Length();
+					return 4.0f * asinf(Math::Min(1.0f, chord * 0.5f)) * jointReach;
+				}
+				float distance = Vector3(value - reference).Length();
+				return channel.Path == AnimationChannel::PathType::Translation ? distance : distance * jointReach;
+			};
+
+		// Constant tracks keep only their first key
+		keys.clear();
+		keys.push_back(0);
+		bool isConstant = true;
+		for (uint32 frame = 1; frame <= numIntervals && isConstant; ++frame)
+			isConstant = GetError(quantized[0], samples[frame]) <= settings.MaxError;
+
+		// Whether interpolating between the quantized keys at 'start' and 'end' stays within the error for every frame in between
+		auto Fits = [&](uint32 start, uint32 end)
+			{
+				for (uint32 frame = start + 1; frame < end; ++frame)
+				{
+					Vector4 value = CompressedAnimation::Interpolate(channel.Path, quantized[start], quantized[end], (float)(frame - start) / (end - start));
+					if (GetError(value, samples[frame]) > settings.MaxError)
+						return false;
+				}
+				return true;
+			};
+
+		// Extend each segment as far as it fits. The length doubles until it doesn't fit, then a binary search finds the end in between.
+		// Checking every length would cost quadratic time in the length of the segment, which stalls loading long clips.
+		// Every end that is accepted is checked over the whole segment, so the error holds even where fitting isn't monotonic.
+		if (!isConstant)
+		{
+			uint32 start = 0;
+			while (start < numIntervals)
+			{
+				uint32 end = start + 1;
+				uint32 limit = numIntervals + 1;
+				while (end < numIntervals)
+				{
+					uint32 candidate = Math::Min(start + 2 * (end - start), numIntervals);
+					if (!Fits(start, candidate))
+					{
+						limit = candidate;
+						break;
+					}
+					end = candidate;
+				}
+				while (limit - end > 1)
+				{
+					uint32 candidate = (end + limit) / 2;
+					if (Fits(start, candidate))
+						end = candidate;
+					else
+						limit = candidate;
+				}
+				keys.push_back(end);
+				start = end;
+			}
+		}
+
+		for (uint32 key : keys)
+		{
+			compressed.KeyFrames.push_back((uint16)key);
+			uint64 offset = compressed.KeyData.size();
+			compressed.KeyData.resize(offset + 3);
+			EncodeKey(track, samples[key], &compressed.KeyData[offset]);
+		}
+		track.NumKeys = (uint32)keys.size();
+		compressed.Tracks.push_back(track);
+		compressed.Targets.push_back(channel.Target);
+	}
+
+	Array<AnimationChannel>().swap(animation.Channels);
+	return true;
+}
+
+// Branches of short chains of bones, like a character's spine, limbs and fingers
+static void CreateCharacterSkeleton(std::mt19937& random, uint32 numJoints, Skeleton& outSkeleton, Array<Vector3>& outBindPositions)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	outSkeleton.ParentIndices.resize(numJoints);
+	outSkeleton.InverseBindMatrices.resize(numJoints);
+	outSkeleton.JointUpdateOrder.resize(numJoints);
+	outBindPositions.resize(numJoints);
+	for (uint32 i = 0; i < numJoints; ++i)
+	{
+		Skeleton::JointIndex parent = Skeleton::InvalidJoint;
+		Vector3 position(0.0f, 1.0f, 0.0f);
+		if (i > 0)
+		{
+			parent = (Skeleton::JointIndex)(unit(random) < 0.7f ? i - 1 : random() % i);
+			Vector3 direction(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+			direction.Normalize();
+			position = outBindPositions[parent] + direction * (0.03f + 0.2f * unit(random));
+		}
+		outSkeleton.ParentIndices[i]		= parent;
+		outSkeleton.InverseBindMatrices[i]	= Matrix::CreateTranslation(-position);
+		outSkeleton.JointUpdateOrder[i]		= (Skeleton::JointIndex)i;
+		outSkeleton.JointsMap[Sprintf("Joint %d", i)] = (Skeleton::JointIndex)i;
+		outBindPositions[i] = position;
+	}
+}
+
+// Smooth motion sampled at 30 keys per second, like an exported motion capture clip.
+// Bones keep their length and scale, and some joints don't rotate at all.
+static void CreateCharacterAnimation(std::mt19937& random, const Skeleton& skeleton, const Array<Vector3>& bindPositions, float duration, Animation& outAnimation)
+{
+	constexpr float KeyFramesPerSecond = 30.0f;
+
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	uint32 numKeyFrames = (uint32)(duration * KeyFramesPerSecond) + 1;
+	float  frequency	= 2.0f * Math::PI / duration;
+
+	for (uint32 joint = 0; joint < skeleton.NumJoints(); ++joint)
+	{
+		Skeleton::JointIndex parent = skeleton.ParentIndices[joint];
+		Vector3 boneOffset = parent == Skeleton::InvalidJoint ? bindPositions[joint] : bindPositions[joint] - bindPositions[parent];
+
+		Vector3 axis(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+		axis.Normalize();
+		float amplitude = joint % 4 == 3 ? 0.0f : 0.1f + 0.7f * unit(random);
+		float phase		= 2.0f * Math::PI * unit(random);
+		float cycles	= (float)(1 + random() % 3);
+
+		AnimationChannel channels[3];
+		const AnimationChannel::PathType paths[] = { AnimationChannel::PathType::Translation, AnimationChannel::PathType::Rotation, AnimationChannel::PathType::Scale };
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			channels[i].Target = Sprintf("Joint %d", joint);
+			channels[i].Path   = paths[i];
+		}
+
+		for (uint32 key = 0; key < numKeyFrames; ++key)
+		{
+			float time	= duration * key / (numKeyFrames - 1);
+			float angle = amplitude * (sinf(cycles * frequency * time + phase) + 0.3f * sinf(2.0f * cycles * frequency * time));
+
+			Vector3 translation = boneOffset;
+			if (parent == Skeleton::InvalidJoint)
+				translation += Vector3(0.3f * sinf(frequency * time), 0.05f * sinf(2.0f * frequency * time), 0.3f * cosf(frequency * time));
+
+			for (AnimationChannel& channel : channels)
+				channel.KeyFrames.push_back(time);
+			channels[0].Data.push_back(Vector4(translation.x, translation.y, translation.z, 0.0f));
+			channels[1].Data.push_back(Quaternion::CreateFromAxisAngle(axis, angle));
+			channels[2].Data.push_back(Vector4(1.0f, 1.0f, 1.0f, 0.0f));
+		}
+
+		for (AnimationChannel& channel : channels)
+			outAnimation.Channels.push_back(std::move(channel));
+	}
+	outAnimation.TimeStart = 0.0f;
+	outAnimation.TimeEnd   = duration;
+}
+
+void AnimationCompression::RunBenchmark(uint32 seed)
+{
+	constexpr uint32 NumJoints		= 64;
+	constexpr uint32 NumAnimations	= 8;
+	constexpr uint32 NumCharacters	= 1000;
+	constexpr uint32 NumFrames		= 240;
+	constexpr float	 FrameTime		= 1.0f / 60.0f;
+
+	std::mt19937						  random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	Skeleton	   skeleton;
+	Array<Vector3> bindPositions;
+	CreateCharacterSkeleton(random, NumJoints, skeleton, bindPositions);
+
+	Array<Animation> animations(NumAnimations);
+	float			 totalDuration = 0.0f;
+	for (Animation& animation : animations)
+	{
+		CreateCharacterAnimation(random, skeleton, bindPositions, 2.0f + 8.0f * unit(random), animation);
+		totalDuration += animation.TimeEnd - animation.TimeStart;
+	}
+
+	uint64 rawSize = 0;
+	uint32 numChannels = 0;
+	for (const Animation& animation : animations)
+	{
+		numChannels += (uint32)animation.Channels.size();
+		for (const AnimationChannel& channel : animation.Channels)
+			rawSize += channel.KeyFrames.size() * sizeof(float) + channel.Data.size() * sizeof(Vector4);
+	}
+
+	AnimationCompressionSettings settings;
+	Array<Animation> compressedAnimations = animations;
+	float compressTime;
+	{
+		Utils::TimeScope timer;
+		for (Animation& animation : compressedAnimations)
+			Compress(animation, skeleton, settings);
+		compressTime = timer.Stop();
+	}
+
+	uint64 compressedSize = 0;
+	uint32 numConstantTracks = 0, numKeys = 0, numAnimatedFrames = 0;
+	float  sampleRate = 0.0f;
+	for (const Animation& animation : compressedAnimations)
+	{
+		const CompressedAnimation& compressed = animation.Compressed;
+		compressedSize += compressed.GetSize();
+		sampleRate = Math::Max(sampleRate, compressed.SampleRate);
+		for (const CompressedAnimation::Track& track : compressed.Tracks)
+		{
+			if (track.NumKeys == 1)
+			{
+				++numConstantTracks;
+			}
+			else
+			{
+				numKeys += track.NumKeys;
+				numAnimatedFrames += compressed.KeyFrames[track.FirstKey + track.NumKeys - 1] + 1;
+			}
+		}
+	}
+
+	E_LOG(Info, "AnimationCompression - %d animations of %d joints, %d channels, %.1f s in total:", NumAnimations, NumJoints, numChannels, totalDuration);
+	E_LOG(Info, "\tUncompressed:  %s", Math::PrettyPrintDataSize(rawSize));
+	E_LOG(Info, "\tCompressed:    %s, %.1fx smaller, in %.1f ms", Math::PrettyPrintDataSize(compressedSize), (float)rawSize / compressedSize, compressTime * 1000.0f);
+	E_LOG(Info, "\tTracks:        %d of %d constant, animated tracks keep %.1f%% of the keys resampled at up to %.1f Hz", numConstantTracks, numChannels, 100.0f * numKeys / Math::Max(1u, numAnimatedFrames), sampleRate);
+
+	// Play both versions on the same characters and compare the joint positions
+	struct Character
+	{
+		uint32			AnimationIndex;
+		float			TimeOffset;
+		AnimationState	State;
+		AnimationState	CompressedState;
+	};
+	Array<Character> characters(NumCharacters);
+	for (Character& character : characters)
+	{
+		character.AnimationIndex = random() % NumAnimations;
+		character.TimeOffset	 = 10.0f * unit(random);
+		character.State.Bind(animations[character.AnimationIndex], skeleton);
+		character.CompressedState.Bind(compressedAnimations[character.AnimationIndex], skeleton);
+	}
+
+	Array<AnimationJob> jobs(NumCharacters);
+	Array<AnimationJob> compressedJobs(NumCharacters);
+	Array<Matrix>		skinMatrices(NumCharacters * NumJoints);
+	Array<Matrix>		compressedSkinMatrices(NumCharacters * NumJoints);
+	float  rawTime = 0, compressedTime = 0;
+	float  maxError = 0;
+	double totalError = 0;
+	for (uint32 frame = 0; frame < NumFrames; ++frame)
+	{
+		for (uint32 i = 0; i < NumCharacters; ++i)
+		{
+			const Animation& animation = animations[characters[i].AnimationIndex];
+			float time = fmod(characters[i].TimeOffset + frame * FrameTime, animation.TimeEnd - animation.TimeStart) + animation.TimeStart;
+			jobs[i]			  = { &characters[i].State, time, i * NumJoints };
+			compressedJobs[i] = { &characters[i].CompressedState, time, i * NumJoints };
+		}
+
+		auto EvaluateJobs = [](Span<const AnimationJob> frameJobs, Matrix* pSkinMatrices)
+			{
+				Utils::TimeScope timer;
+				RGGraphAllocator allocator(64 * 1024);
+				TaskContext context;
+				SkeletalAnimation::Evaluate(frameJobs, pSkinMatrices, allocator, context);
+				TaskQueue::Join(context);
+				return timer.Stop();
+			};
+		rawTime += EvaluateJobs(jobs, skinMatrices.data());
+		compressedTime += EvaluateJobs(compressedJobs, compressedSkinMatrices.data());
+
+		for (uint32 i = 0; i < NumCharacters * NumJoints; ++i)
+		{
+			const Vector3& bindPosition = bindPositions[i % NumJoints];
+			float error = Vector3::Distance(Vector3::Transform(bindPosition, skinMatrices[i]), Vector3::Transform(bindPosition, compressedSkinMatrices[i]));
+			maxError	= Math::Max(maxError, error);
+			totalError += error;
+		}
+	}
+
+	uint64 numTracks = (uint64)NumFrames * NumCharacters * numChannels / NumAnimations;
+	E_LOG(Info, "\tJoint error:   %.3f mm max, %.4f mm average. Each joint's tracks are within %.2f mm, the error adds up along the hierarchy",
+		maxError * 1000.0f, totalError * 1000.0 / ((uint64)NumFrames * NumCharacters * NumJoints), settings.MaxError * 1000.0f);
+	E_LOG(Info, "\tSampling %d characters, %d threads:", NumCharacters, TaskQueue::ThreadCount());
+	E_LOG(Info, "\t\tUncompressed: %.3f ms per frame (%.1f M tracks/s)", rawTime * 1000.0f / NumFrames, numTracks / rawTime / 1e6f);
+	E_LOG(Info, "\t\tCompressed:   %.3f ms per frame (%.1f M tracks/s)", compressedTime * 1000.0f / NumFrames, numTracks / compressedTime / 1e6f);
+}
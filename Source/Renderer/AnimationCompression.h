@@ -0,0 +1,24 @@
+#pragma once
+
+struct Animation;
+struct Skeleton;
+
+struct AnimationCompressionSettings
+{
+	float MaxSampleRate	= 60.0f;		///< Channels are resampled at the key rate of the densest channel, up to this rate, before keys are removed
+	float MaxError		= 0.0002f;		///< Maximum displacement, in meters, of a point at 'ShellDistance' around the joint and its descendants
+	float ShellDistance	= 0.05f;		///< Distance of the points around a joint that the error is measured at, like the skin around a bone
+};
+
+namespace AnimationCompression
+{
+	// Replaces the channels of 'animation' with compressed tracks. 'skeleton' must own every target of the animation,
+	// its bind pose is what the error is measured against. Returns false and leaves 'animation' untouched if a target is not one of its joints.
+	// Each channel is resampled and quantized. Clips exported with evenly spaced keys are resampled at their own keys, so no detail is lost. Keys that linear interpolation can reproduce within the error are removed, and constant tracks keep a single key.
+	// The error of a joint is scaled by the reach of its descendants, as they move along with it.
+	bool Compress(Animation& animation, const Skeleton& skeleton, const AnimationCompressionSettings& settings = {});
+
+	// Compresses synthetic character animations and reports the compression ratio, the error of the joints
+	// and the sampling throughput compared with the uncompressed animations
+	void RunBenchmark(uint32 seed);
+}
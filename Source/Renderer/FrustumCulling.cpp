@@ -0,0 +1,353 @@
+#include "stdafx.h"
+#include "FrustumCulling.h"
+#include "Core/TaskQueue.h"
+#include "Core/Profiler.h"
+#include "Core/Utils.h"
+#include "Renderer/RenderTypes.h"
+
+#include <random>
+
+void CullBounds::Resize(uint32 count)
+{
+	Count = count;
+	uint32 paddedCount = Math::AlignUp(count, 32u);
+	for (Array<float>* pArray : { &CenterX, &CenterY, &CenterZ, &ExtentsX, &ExtentsY, &ExtentsZ })
+		pArray->resize(paddedCount, 0.0f);
+}
+
+void CullBounds::Set(uint32 index, const BoundingBox& bounds)
+{
+	gAssert(index < Count);
+	CenterX[index]	= bounds.Center.x;
+	CenterY[index]	= bounds.Center.y;
+	CenterZ[index]	= bounds.Center.z;
+	ExtentsX[index] = bounds.Extents.x;
+	ExtentsY[index] = bounds.Extents.y;
+	ExtentsZ[index] = bounds.Extents.z;
+}
+
+CullFrustum::CullFrustum(const ViewTransform& view)
+{
+	if (view.IsPerspective)
+	{
+		DirectX::XMVECTOR planes[6];
+		view.PerspectiveFrustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+		for (uint32 i = 0; i < 6; ++i)
+			DirectX::XMStoreFloat4(&Planes[i], planes[i]);
+	}
+	else
+	{
+		// A plane on both sides of each axis of the box
+		const OrientedBoundingBox& box = view.OrthographicFrustum;
+		Quaternion	  orientation(box.Orientation);
+		const Vector3 axes[]	= { Vector3::Transform(Vector3::UnitX, orientation), Vector3::Transform(Vector3::UnitY, orientation), Vector3::Transform(Vector3::UnitZ, orientation) };
+		const float	  extents[] = { box.Extents.x, box.Extents.y, box.Extents.z };
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			float distance	  = axes[i].Dot(Vector3(box.Center));
+			Planes[i * 2 + 0] = Vector4(axes[i].x, axes[i].y, axes[i].z, -distance - extents[i]);
+			Planes[i * 2 + 1] = Vector4(-axes[i].x, -axes[i].y, -axes[i].z, distance - extents[i]);
+		}
+	}
+}
+
+namespace FrustumCulling
+{
+	// A box is outside if it is entirely in front of one of the planes.
+	// All paths evaluate the same expressions in the same order so they produce the same result.
+	static bool IsOutside(const CullBounds& bounds, uint32 index, const CullFrustum& frustum)
+	{
+		for (const Vector4& plane : frustum.Planes)
+		{
+			float distance = bounds.CenterX[index] * plane.x + bounds.CenterY[index] * plane.y + bounds.CenterZ[index] * plane.z + plane.w;
+			float radius   = bounds.ExtentsX[index] * fabsf(plane.x) + bounds.ExtentsY[index] * fabsf(plane.y) + bounds.ExtentsZ[index] * fabsf(plane.z);
+			if (distance > radius)
+				return true;
+		}
+		return false;
+	}
+
+	// Sign bit of each lane. DirectXMath picks SSE, NEON or plain C++ depending on the platform
+	static uint32 MoveMask(DirectX::FXMVECTOR v)
+	{
+#if defined(_XM_SSE_INTRINSICS_)
+		return (uint32)_mm_movemask_ps(v);
+#else
+		uint32 bits[4];
+		DirectX::XMStoreInt4(bits, v);
+		return (bits[0] >> 31) | ((bits[1] >> 31) << 1) | ((bits[2] >> 31) << 2) | ((bits[3] >> 31) << 3);
+#endif
+	}
+
+	// Visibility of the 32 boxes starting at 'first', 4 at a time
+	static uint32 CullWord(const CullBounds& bounds, uint32 first, const CullFrustum& frustum)
+	{
+		using namespace DirectX;
+
+		// No XMVectorMultiplyAdd, it may fuse and round differently from the scalar path
+		XMVECTOR normalsX[6], normalsY[6], normalsZ[6], distances[6], absNormalsX[6], absNormalsY[6], absNormalsZ[6];
+		for (uint32 p = 0; p < 6; ++p)
+		{
+			normalsX[p]	   = XMVectorReplicate(frustum.Planes[p].x);
+			normalsY[p]	   = XMVectorReplicate(frustum.Planes[p].y);
+			normalsZ[p]	   = XMVectorReplicate(frustum.Planes[p].z);
+			distances[p]   = XMVectorReplicate(frustum.Planes[p].w);
+			absNormalsX[p] = XMVectorAbs(normalsX[p]);
+			absNormalsY[p] = XMVectorAbs(normalsY[p]);
+			absNormalsZ[p] = XMVectorAbs(normalsZ[p]);
+		}
+
+		uint32 visible = 0;
+		for (uint32 block = 0; block < 32; block += 4)
+		{
+			uint32	 i		  = first + block;
+			XMVECTOR centerX  = XMLoadFloat4((const XMFLOAT4*)&bounds.CenterX[i]);
+			XMVECTOR centerY  = XMLoadFloat4((const XMFLOAT4*)&bounds.CenterY[i]);
+			XMVECTOR centerZ  = XMLoadFloat4((const XMFLOAT4*)&bounds.CenterZ[i]);
+			XMVECTOR extentsX = XMLoadFloat4((const XMFLOAT4*)&bounds.ExtentsX[i]);
+			XMVECTOR extentsY = XMLoadFloat4((const XMFLOAT4*)&bounds.ExtentsY[i]);
+			XMVECTOR extentsZ = XMLoadFloat4((const XMFLOAT4*)&bounds.ExtentsZ[i]);
+
+			XMVECTOR outside = XMVectorFalseInt();
+			for (uint32 p = 0; p < 6; ++p)
+			{
+				XMVECTOR distance = XMVectorAdd(XMVectorAdd(XMVectorAdd(XMVectorMultiply(centerX, normalsX[p]), XMVectorMultiply(centerY, normalsY[p])), XMVectorMultiply(centerZ, normalsZ[p])), distances[p]);
+				XMVECTOR radius	  = XMVectorAdd(XMVectorAdd(XMVectorMultiply(extentsX, absNormalsX[p]), XMVectorMultiply(extentsY, absNormalsY[p])), XMVectorMultiply(extentsZ, absNormalsZ[p]));
+				outside			  = XMVectorOrInt(outside, XMVectorGreater(distance, radius));
+			}
+			visible |= (~MoveMask(outside) & 0xFu) << block;
+		}
+		return visible;
+	}
+
+	// Bits of the word starting at 'first' that don't belong to an instance
+	static uint32 GetPaddingBits(const CullBounds& bounds, uint32 first)
+	{
+		uint32 numValid = bounds.Count - first;
+		return numValid >= 32 ? 0u : ~((1u << numValid) - 1u);
+	}
+
+	static void CullWords(const CullBounds& bounds, Span<const CullFrustum> frustums, Span<uint32*> masks, uint32 firstWord, uint32 lastWord)
+	{
+		for (uint32 word = firstWord; word < lastWord; ++word)
+		{
+			// Test one word of boxes against all frustums while they are in the cache
+			uint32 first   = word * 32;
+			uint32 padding = GetPaddingBits(bounds, first);
+			for (uint32 frustumIndex = 0; frustumIndex < frustums.GetSize(); ++frustumIndex)
+				masks[frustumIndex][word] = CullWord(bounds, first, frustums[frustumIndex]) | padding;
+		}
+	}
+
+	void Cull(const CullBounds& bounds, Span<const CullFrustum> frustums, Span<uint32*> masks, TaskContext& context)
+	{
+		gAssert(frustums.GetSize() == masks.GetSize());
+		uint32 numWords = Math::DivideAndRoundUp(bounds.Count, 32);
+		if (numWords == 0 || frustums.GetSize() == 0)
+			return;
+
+		TaskQueue::ParallelFor([&bounds, frustums, masks](TaskDistributeArgs args)
+			{
+				CullWords(bounds, frustums, masks, args.JobIndex, args.JobIndex + 1);
+			}, context, numWords, 8);
+	}
+
+	void CullScalar(const CullBounds& bounds, Span<const CullFrustum> frustums, Span<uint32*> masks)
+	{
+		gAssert(frustums.GetSize() == masks.GetSize());
+		uint32 numWords = Math::DivideAndRoundUp(bounds.Count, 32);
+		for (uint32 frustumIndex = 0; frustumIndex < frustums.GetSize(); ++frustumIndex)
+		{
+			for (uint32 word = 0; word < numWords; ++word)
+			{
+				uint32 first   = word * 32;
+				uint32 visible = GetPaddingBits(bounds, first);
+				for (uint32 bit = 0; bit < 32 && first + bit < bounds.Count; ++bit)
+				{
+					if (!IsOutside(bounds, first + bit, frustums[frustumIndex]))
+						visible |= 1u << bit;
+				}
+				masks[frustumIndex][word] = visible;
+			}
+		}
+	}
+
+	static ViewTransform CreateRandomView(std::mt19937& random, bool perspective)
+	{
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> angle(-Math::PI, Math::PI);
+		std::uniform_real_distribution<float> size(20.0f, 400.0f);
+
+		Matrix	rotation = Matrix::CreateFromYawPitchRoll(angle(random), angle(random), angle(random));
+		Vector3 origin(position(random), position(random), position(random));
+
+		ViewTransform view;
+		view.IsPerspective = perspective;
+		if (perspective)
+		{
+			float fov = std::uniform_real_distribution<float>(Math::Radians(20.0f), Math::Radians(120.0f))(random);
+			view.PerspectiveFrustum = Math::CreateBoundingFrustum(Math::CreatePerspectiveMatrix(fov, 1.7f, 0.1f, size(random) * 4.0f), Math::CreateLookToMatrix(origin, rotation.Forward(), rotation.Up()));
+		}
+		else
+		{
+			view.OrthographicFrustum.Center		 = origin;
+			view.OrthographicFrustum.Extents	 = Vector3(size(random), size(random), size(random));
+			view.OrthographicFrustum.Orientation = Quaternion::CreateFromRotationMatrix(rotation);
+		}
+		return view;
+	}
+
+	static void CreateRandomBounds(std::mt19937& random, uint32 count, CullBounds& outBounds)
+	{
+		std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<float> extents(0.1f, 50.0f);
+
+		outBounds.Resize(count);
+		for (uint32 i = 0; i < count; ++i)
+			outBounds.Set(i, BoundingBox(Vector3(position(random), position(random), position(random)), Vector3(extents(random), extents(random), extents(random))));
+	}
+
+	static BoundingBox GetBounds(const CullBounds& bounds, uint32 index)
+	{
+		return BoundingBox(
+			Vector3(bounds.CenterX[index], bounds.CenterY[index], bounds.CenterZ[index]),
+			Vector3(bounds.ExtentsX[index], bounds.ExtentsY[index], bounds.ExtentsZ[index]));
+	}
+
+	bool RunSelfTest(uint32 seed)
+	{
+		std::mt19937 random(seed);
+
+		const uint32 counts[] = { 0, 1, 31, 32, 33, 1000, 8191 };
+		uint32		 numConservative = 0;
+		uint32		 numOrthographic = 0;
+		for (uint32 count : counts)
+		{
+			CullBounds bounds;
+			CreateRandomBounds(random, count, bounds);
+
+			Array<ViewTransform> views;
+			Array<CullFrustum>	 frustums;
+			for (uint32 i = 0; i < 12; ++i)
+			{
+				views.push_back(CreateRandomView(random, i % 3 != 0));
+				frustums.push_back(CullFrustum(views.back()));
+			}
+
+			uint32				 numWords = Math::DivideAndRoundUp(count, 32);
+			Array<Array<uint32>> masks(views.size(), Array<uint32>(numWords));
+			Array<Array<uint32>> scalarMasks(views.size(), Array<uint32>(numWords));
+			Array<uint32*>		 pMasks, pScalarMasks;
+			for (uint32 i = 0; i < views.size(); ++i)
+			{
+				pMasks.push_back(masks[i].data());
+				pScalarMasks.push_back(scalarMasks[i].data());
+			}
+
+			TaskContext context;
+			Cull(bounds, frustums, pMasks, context);
+			TaskQueue::Join(context);
+			CullScalar(bounds, frustums, pScalarMasks);
+
+			for (uint32 viewIndex = 0; viewIndex < views.size(); ++viewIndex)
+			{
+				if (masks[viewIndex] != scalarMasks[viewIndex])
+				{
+					E_LOG(Warning, "FrustumCulling - Kernel and scalar path differ (%d boxes, view %d)", count, viewIndex);
+					return false;
+				}
+				if (numWords > 0 && (masks[viewIndex].back() & GetPaddingBits(bounds, (numWords - 1) * 32)) != GetPaddingBits(bounds, (numWords - 1) * 32))
+				{
+					E_LOG(Warning, "FrustumCulling - Padding bits are not set (%d boxes, view %d)", count, viewIndex);
+					return false;
+				}
+
+				// The plane test is exact for perspective views. For orthographic views it keeps some boxes that only a separating axis test rejects
+				const ViewTransform& view = views[viewIndex];
+				for (uint32 i = 0; i < count; ++i)
+				{
+					bool visible	 = (masks[viewIndex][i / 32] >> (i % 32)) & 1;
+					bool isInFrustum = view.IsInFrustum(GetBounds(bounds, i));
+					if (visible == isInFrustum)
+						continue;
+					if (!visible || view.IsPerspective)
+					{
+						E_LOG(Warning, "FrustumCulling - Box %d is %s but IsInFrustum says otherwise (%d boxes, view %d)", i, visible ? "visible" : "culled", count, viewIndex);
+						return false;
+					}
+					++numConservative;
+				}
+				if (!view.IsPerspective)
+					numOrthographic += count;
+			}
+		}
+		E_LOG(Info, "FrustumCulling - Self test passed (%d of %d orthographic tests kept conservatively)", numConservative, numOrthographic);
+		return true;
+	}
+
+	void RunBenchmark(uint32 seed)
+	{
+		std::mt19937 random(seed);
+
+		// The main view, 4 cascades and 8 spot light views
+		Array<ViewTransform> views;
+		Array<CullFrustum>	 frustums;
+		for (uint32 i = 0; i < 13; ++i)
+		{
+			views.push_back(CreateRandomView(random, i == 0 || i > 4));
+			frustums.push_back(CullFrustum(views.back()));
+		}
+
+		const uint32 counts[] = { 10000, 100000, 1000000 };
+		for (uint32 count : counts)
+		{
+			CullBounds bounds;
+			CreateRandomBounds(random, count, bounds);
+
+			uint32				 numWords = Math::DivideAndRoundUp(count, 32);
+			Array<Array<uint32>> masks(views.size(), Array<uint32>(numWords));
+			Array<uint32*>		 pMasks;
+			for (Array<uint32>& mask : masks)
+				pMasks.push_back(mask.data());
+
+			const uint32 numIterations = Math::Max(3u, 10000000u / count);
+			float		 isInFrustumTime = 0, kernelTime = 0, parallelTime = 0;
+			for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+			{
+				// What the renderer did before: a DirectXMath test per box and view
+				{
+					Utils::TimeScope timer;
+					for (uint32 viewIndex = 0; viewIndex < views.size(); ++viewIndex)
+					{
+						for (uint32 i = 0; i < count; ++i)
+						{
+							if (views[viewIndex].IsInFrustum(GetBounds(bounds, i)))
+								masks[viewIndex][i / 32] |= 1u << (i % 32);
+							else
+								masks[viewIndex][i / 32] &= ~(1u << (i % 32));
+						}
+					}
+					isInFrustumTime += timer.Stop();
+				}
+				{
+					Utils::TimeScope timer;
+					CullWords(bounds, frustums, pMasks, 0, numWords);
+					kernelTime += timer.Stop();
+				}
+				{
+					Utils::TimeScope timer;
+					TaskContext		 context;
+					Cull(bounds, frustums, pMasks, context);
+					TaskQueue::Join(context);
+					parallelTime += timer.Stop();
+				}
+			}
+
+			float toMs = 1000.0f / numIterations;
+			E_LOG(Info, "FrustumCulling - %d boxes, %d views:", count, (uint32)views.size());
+			E_LOG(Info, "\tIsInFrustum:             %.3f ms", isInFrustumTime * toMs);
+			E_LOG(Info, "\tKernel (1 thread):       %.3f ms (%.1fx)", kernelTime * toMs, isInFrustumTime / kernelTime);
+			E_LOG(Info, "\tKernel (%2d threads):     %.3f ms (%.1fx)", TaskQueue::ThreadCount(), parallelTime * toMs, isInFrustumTime / parallelTime);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+struct ViewTransform;
+class TaskContext;
+
+// World space bounds of the scene instances, indexed by instance ID.
+// Stored as a structure of arrays so the culling kernel can test several boxes with each instruction.
+// The arrays are padded to a multiple of 32 boxes so every word of a visibility mask is written as a whole.
+struct CullBounds
+{
+	void Resize(uint32 count);
+	void Set(uint32 index, const BoundingBox& bounds);
+
+	uint32			Count = 0;
+	Array<float>	CenterX;
+	Array<float>	CenterY;
+	Array<float>	CenterZ;
+	Array<float>	ExtentsX;
+	Array<float>	ExtentsY;
+	Array<float>	ExtentsZ;
+};
+
+// The six planes bounding a view. Normals point out of the view.
+struct CullFrustum
+{
+	CullFrustum() = default;
+	explicit CullFrustum(const ViewTransform& view);
+
+	Vector4 Planes[6];
+};
+
+namespace FrustumCulling
+{
+	// Tests all bounds against each frustum and writes one bit per instance to the matching mask, set if the instance is visible.
+	// Each mask must hold at least DivideAndRoundUp(bounds.Count, 32) words. Bits past bounds.Count in the last word are set.
+	// The work is split over the task queue and is complete once 'context' is joined.
+	void Cull(const CullBounds& bounds, Span<const CullFrustum> frustums, Span<uint32*> masks, TaskContext& context);
+
+	// Same as Cull() but on a single thread and one box at a time
+	void CullScalar(const CullBounds& bounds, Span<const CullFrustum> frustums, Span<uint32*> masks);
+
+	// Compares Cull() with CullScalar() and with the DirectXMath tests of ViewTransform::IsInFrustum on random views and boxes
+	bool RunSelfTest(uint32 seed);
+
+	// Measures Cull() against calling ViewTransform::IsInFrustum for each box and view, for 10k, 100k and 1M instances
+	void RunBenchmark(uint32 seed);
+}
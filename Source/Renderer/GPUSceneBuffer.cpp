@@ -0,0 +1,245 @@
+#include "stdafx.h"
+#include "GPUSceneBuffer.h"
+#include "Core/Profiler.h"
+#include "Core/Utils.h"
+#include "RHI/Device.h"
+#include "RHI/CommandContext.h"
+#include "RHI/Buffer.h"
+#include "RHI/PipelineState.h"
+#include "Renderer/RenderTypes.h"
+
+#include <random>
+
+GPUSceneBuffer::GPUSceneBuffer(const char* pName, uint32 elementSize)
+	: m_Name(pName), m_ElementSize(elementSize)
+{
+	gAssert(elementSize % sizeof(uint32) == 0, "Elements of '%s' are scattered per uint and must be a multiple of 4 bytes", pName);
+}
+
+GPUSceneBuffer::~GPUSceneBuffer() = default;
+
+bool GPUSceneBuffer::Set(uint32 index, const void* pData)
+{
+	gAssert(index <= m_Count, "Elements of '%s' must be added in order", m_Name.c_str());
+
+	uint8* pElement = nullptr;
+	if (index == m_Count)
+	{
+		++m_Count;
+		m_Elements.resize((uint64)m_Count * m_ElementSize);
+		m_IsDirty.resize(m_Count, false);
+		pElement = &m_Elements[(uint64)index * m_ElementSize];
+	}
+	else
+	{
+		pElement = &m_Elements[(uint64)index * m_ElementSize];
+		if (memcmp(pElement, pData, m_ElementSize) == 0)
+			return false;
+	}
+
+	memcpy(pElement, pData, m_ElementSize);
+	if (!m_IsDirty[index])
+	{
+		m_IsDirty[index] = true;
+		m_DirtyElements.push_back(index);
+	}
+	return true;
+}
+
+void GPUSceneBuffer::Resize(uint32 count)
+{
+	gAssert(count <= m_Count, "Elements of '%s' are added with Set()", m_Name.c_str());
+	if (count == m_Count)
+		return;
+
+	m_Count = count;
+	m_Elements.resize((uint64)m_Count * m_ElementSize);
+	m_IsDirty.resize(m_Count);
+	m_DirtyElements.erase(std::remove_if(m_DirtyElements.begin(), m_DirtyElements.end(), [count](uint32 index) { return index >= count; }), m_DirtyElements.end());
+}
+
+uint64 GPUSceneBuffer::GetUploadSize(bool& outScatter) const
+{
+	uint64 fullSize	   = (uint64)m_Count * m_ElementSize;
+	uint64 scatterSize = GetScatterDataOffset() + (uint64)m_DirtyElements.size() * m_ElementSize;
+	outScatter		   = !m_NeedsFullUpload && scatterSize < fullSize;
+	if (!m_NeedsFullUpload && m_DirtyElements.empty())
+		return 0;
+	return outScatter ? scatterSize : fullSize;
+}
+
+void GPUSceneBuffer::WriteUpload(void* pTarget, bool scatter)
+{
+	if (scatter)
+	{
+		uint32* pIndices = (uint32*)pTarget;
+		uint8*	pData	 = (uint8*)pTarget + GetScatterDataOffset();
+		for (uint32 i = 0; i < (uint32)m_DirtyElements.size(); ++i)
+		{
+			uint32 index = m_DirtyElements[i];
+			pIndices[i]	 = index;
+			memcpy(pData + (uint64)i * m_ElementSize, &m_Elements[(uint64)index * m_ElementSize], m_ElementSize);
+		}
+	}
+	else
+	{
+		memcpy(pTarget, m_Elements.data(), m_Elements.size());
+	}
+
+	for (uint32 index : m_DirtyElements)
+		m_IsDirty[index] = false;
+	m_DirtyElements.clear();
+	m_NeedsFullUpload = false;
+}
+
+uint64 GPUSceneBuffer::Upload(CommandContext& context, PipelineState* pScatterPSO)
+{
+	PROFILE_CPU_SCOPE();
+
+	GraphicsDevice* pDevice = context.GetParent();
+
+	// The buffer has some headroom so that adding a few elements doesn't cause a full upload every time
+	uint32 desiredElements = Math::AlignUp(Math::Max(1u, m_Count), 64u);
+	if (!m_pBuffer || desiredElements > m_pBuffer->GetNumElements())
+	{
+		// Readers use the structured SRV. Only the scatter shader writes the buffer, through a raw UAV without a counter.
+		m_pBuffer		  = pDevice->CreateBuffer(BufferDesc::CreateStructured(desiredElements, m_ElementSize, BufferFlag::UnorderedAccess | BufferFlag::RawUnorderedAccess), m_Name.c_str());
+		m_NeedsFullUpload = true;
+	}
+
+	bool   scatter;
+	uint64 size		  = GetUploadSize(scatter);
+	uint32 numDirty	  = (uint32)m_DirtyElements.size();
+	uint32 dataOffset = GetScatterDataOffset();
+	if (size == 0)
+	{
+		WriteUpload(nullptr, false);
+		return 0;
+	}
+
+	ScratchAllocation alloc = context.AllocateScratch(size);
+	WriteUpload(alloc.pMappedMemory, scatter);
+
+	if (scatter)
+	{
+		context.InsertResourceBarrier(m_pBuffer, D3D12_RESOURCE_STATE_UNKNOWN, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+		context.SetComputeRootSignature(GraphicsCommon::pCommonRS);
+		context.SetPipelineState(pScatterPSO);
+
+		struct
+		{
+			uint32		 NumElements;
+			uint32		 ElementSize;
+			uint32		 DataOffset;
+			RWBufferView Target;
+		} params{
+			.NumElements = numDirty,
+			.ElementSize = m_ElementSize,
+			.DataOffset	 = dataOffset,
+			.Target		 = m_pBuffer->GetUAV(),
+		};
+		context.BindRootSRV(BindingSlot::PerInstance, params);
+		context.BindRootSRV(BindingSlot::PerPass, alloc.GPUAddress);
+		context.Dispatch(ComputeUtils::GetNumThreadGroups(numDirty * m_ElementSize / sizeof(uint32), 64));
+
+		context.InsertResourceBarrier(m_pBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	}
+	else
+	{
+		context.InsertResourceBarrier(m_pBuffer, D3D12_RESOURCE_STATE_UNKNOWN, D3D12_RESOURCE_STATE_COPY_DEST);
+		context.CopyBuffer(alloc.pBackingResource, m_pBuffer, size, alloc.Offset, 0);
+		context.InsertResourceBarrier(m_pBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	}
+	return size;
+}
+
+void GPUSceneBuffer::RunBenchmark(uint32 numElements, float changeRatio)
+{
+	constexpr uint32 NumFrames = 60;
+
+	struct Instance
+	{
+		Matrix World	 = Matrix::Identity;
+		Matrix WorldPrev = Matrix::Identity;
+	};
+	Array<Instance> instances(numElements);
+
+	auto FillInstance = [](uint32 index, const Instance& instance, ShaderInterop::InstanceData& data)
+		{
+			data.ID					= index;
+			data.MeshIndex			= index % 64;
+			data.MaterialIndex		= index % 16;
+			data.LocalToWorld		= instance.World;
+			data.LocalToWorldPrev	= instance.WorldPrev;
+			data.LocalBoundsOrigin	= Vector3::Zero;
+			data.LocalBoundsExtents = Vector3::One;
+		};
+
+	GPUSceneBuffer	buffer("Benchmark Instances", sizeof(ShaderInterop::InstanceData));
+	Array<uint8>	uploadTarget;		///< Stands in for the scratch memory the upload is written to
+	std::mt19937	random(0);
+	uint32			numChanges = (uint32)(numElements * changeRatio);
+
+	float  fullTime = 0, deltaTime = 0;
+	uint64 fullSize = 0, deltaSize = 0;
+	for (uint32 frame = 0; frame < NumFrames; ++frame)
+	{
+		// Like the transform update, every instance moves its current transform into the previous one
+		for (Instance& instance : instances)
+			instance.WorldPrev = instance.World;
+		for (uint32 i = 0; i < numChanges; ++i)
+			instances[random() % numElements].World = Matrix::CreateTranslation((float)frame, (float)i, 0.0f);
+
+		// Rebuild and copy all elements
+		{
+			Utils::TimeScope timer;
+			Array<ShaderInterop::InstanceData> elements;
+			elements.reserve(numElements);
+			for (uint32 i = 0; i < numElements; ++i)
+				FillInstance(i, instances[i], elements.emplace_back());
+
+			uint64 size = elements.size() * sizeof(ShaderInterop::InstanceData);
+			uploadTarget.resize(size);
+			memcpy(uploadTarget.data(), elements.data(), size);
+			if (frame > 0)
+			{
+				fullTime += timer.Stop();
+				fullSize += size;
+			}
+		}
+
+		// Upload the elements that changed
+		{
+			Utils::TimeScope timer;
+			for (uint32 i = 0; i < numElements; ++i)
+				buffer.Update<ShaderInterop::InstanceData>(i, [&](ShaderInterop::InstanceData& data) { FillInstance(i, instances[i], data); });
+			buffer.Resize(numElements);
+
+			uint32 numDirty = buffer.GetNumDirty();
+			bool   scatter;
+			uint64 size = buffer.GetUploadSize(scatter);
+			uploadTarget.resize(size);
+			buffer.WriteUpload(uploadTarget.data(), scatter);
+			float time = timer.Stop();
+
+			// The first frame uploads everything
+			if (frame == 0)
+			{
+				E_LOG(Info, "GPUSceneBuffer - Initial upload of %d elements: %s in %.3f ms", numElements, Math::PrettyPrintDataSize(size), time * 1000.0f);
+			}
+			else
+			{
+				deltaTime += time;
+				deltaSize += size;
+				if (frame == 1)
+					E_LOG(Info, "GPUSceneBuffer - %d of %d elements changed (%s)", numDirty, numElements, scatter ? "scattered" : "full upload");
+			}
+		}
+	}
+
+	uint32 numMeasured = NumFrames - 1;
+	E_LOG(Info, "GPUSceneBuffer - %d elements, %.1f%% moving. Per frame:", numElements, changeRatio * 100.0f);
+	E_LOG(Info, "\tFull rebuild:  %s in %.3f ms", Math::PrettyPrintDataSize(fullSize / numMeasured), fullTime * 1000.0f / numMeasured);
+	E_LOG(Info, "\tDelta upload:  %s in %.3f ms", Math::PrettyPrintDataSize(deltaSize / numMeasured), deltaTime * 1000.0f / numMeasured);
+}
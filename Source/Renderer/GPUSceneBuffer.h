@@ -0,0 +1,61 @@
+#pragma once
+
+#include "RHI/RHI.h"
+
+// Structured buffer of scene data that stays on the GPU across frames.
+// The CPU keeps a copy of the elements. Elements that differ from the copy are uploaded and scattered into place by a compute shader,
+// so static elements are never copied again.
+class GPUSceneBuffer
+{
+public:
+	GPUSceneBuffer(const char* pName, uint32 elementSize);
+	~GPUSceneBuffer();
+
+	GPUSceneBuffer(const GPUSceneBuffer&) = delete;
+	GPUSceneBuffer& operator=(const GPUSceneBuffer&) = delete;
+
+	// Fills the element at 'index' and marks it dirty if it changed. Returns true if it changed.
+	// The element is zeroed before 'fill' so padding compares equal. Elements past the current count are added.
+	template<typename T, typename FillFn>
+	bool Update(uint32 index, FillFn&& fill)
+	{
+		gAssert(sizeof(T) == m_ElementSize, "Element of %d bytes doesn't match the buffer stride of %d bytes", (uint32)sizeof(T), m_ElementSize);
+		alignas(T) uint8 data[sizeof(T)]{};
+		fill(*new (data) T);
+		return Set(index, data);
+	}
+
+	bool		Set(uint32 index, const void* pData);
+	// Removes the elements from 'count' onwards
+	void		Resize(uint32 count);
+
+	// Uploads the dirty elements. Falls back to copying all elements if the buffer grows or most elements changed.
+	// Returns the number of bytes copied to the GPU.
+	uint64		Upload(CommandContext& context, PipelineState* pScatterPSO);
+
+	uint32		GetCount() const		{ return m_Count; }
+	uint32		GetNumDirty() const		{ return (uint32)m_DirtyElements.size(); }
+	Buffer*		GetBuffer() const		{ return m_pBuffer; }
+
+	// Tracks 'numElements' instances of which 'changeRatio' move every frame and logs the bytes and time spent uploading them,
+	// compared to rebuilding and copying all elements each frame. Doesn't need a device.
+	static void RunBenchmark(uint32 numElements, float changeRatio);
+
+private:
+	// Size of the next upload. 'outScatter' is false if copying all elements is cheaper than scattering the dirty ones
+	uint64		GetUploadSize(bool& outScatter) const;
+	// Writes the next upload to 'pTarget' and clears the dirty state.
+	// A scatter upload is the destination index of each dirty element, followed by the elements at GetScatterDataOffset().
+	void		WriteUpload(void* pTarget, bool scatter);
+	uint32		GetScatterDataOffset() const	{ return Math::AlignUp((uint32)(m_DirtyElements.size() * sizeof(uint32)), 16u); }
+
+	String			m_Name;
+	uint32			m_ElementSize;
+	uint32			m_Count			= 0;
+	Array<uint8>	m_Elements;					///< Contents of the GPU buffer after the next upload
+	Array<uint32>	m_DirtyElements;
+	Array<bool>		m_IsDirty;
+	bool			m_NeedsFullUpload = true;
+
+	Ref<Buffer>		m_pBuffer;
+};
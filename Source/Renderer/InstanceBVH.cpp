@@ -0,0 +1,949 @@
+#include "stdafx.h"
+#include "InstanceBVH.h"
+#include "Core/TaskQueue.h"
+#include "Core/Profiler.h"
+#include "Core/Utils.h"
+#include "Renderer/FrustumCulling.h"
+#include "Renderer/RenderTypes.h"
+
+#include <random>
+
+namespace
+{
+	constexpr float FloatMax = std::numeric_limits<float>::max();
+
+	// Subtrees with more items than this are built on another task
+	constexpr uint32 ParallelBuildItems = 8192;
+
+	// Rebuild once refitting made the tree this much more expensive than a fresh build
+	constexpr float RebuildCostRatio = 1.5f;
+}
+
+struct InstanceBVH::BuildContext
+{
+	Array<Vector3>		 Centroids;
+	std::atomic<uint32>	 NumNodes = 0;
+	TaskContext			 Tasks;
+};
+
+static InstanceBVH::Bounds EmptyBounds()
+{
+	return { Vector3(FloatMax), Vector3(-FloatMax) };
+}
+
+static void Grow(InstanceBVH::Bounds& bounds, const InstanceBVH::Bounds& other)
+{
+	// Per component rather than Vector3::Min/Max, which load and store every Vector3 from the SIMD registers
+	bounds.Min.x = Math::Min(bounds.Min.x, other.Min.x);
+	bounds.Min.y = Math::Min(bounds.Min.y, other.Min.y);
+	bounds.Min.z = Math::Min(bounds.Min.z, other.Min.z);
+	bounds.Max.x = Math::Max(bounds.Max.x, other.Max.x);
+	bounds.Max.y = Math::Max(bounds.Max.y, other.Max.y);
+	bounds.Max.z = Math::Max(bounds.Max.z, other.Max.z);
+}
+
+static InstanceBVH::Bounds Union(const InstanceBVH::Bounds& a, const InstanceBVH::Bounds& b)
+{
+	InstanceBVH::Bounds bounds = a;
+	Grow(bounds, b);
+	return bounds;
+}
+
+static float SurfaceArea(const InstanceBVH::Bounds& bounds)
+{
+	Vector3 size = Vector3::Max(bounds.Max - bounds.Min, Vector3::Zero);
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static InstanceBVH::Bounds ToBounds(const BoundingBox& box)
+{
+	return { Vector3(box.Center) - Vector3(box.Extents), Vector3(box.Center) + Vector3(box.Extents) };
+}
+
+static bool operator==(const InstanceBVH::Bounds& a, const InstanceBVH::Bounds& b)
+{
+	return a.Min == b.Min && a.Max == b.Max;
+}
+
+// Frustum test of the planes in 'planeMask'. Returns false if the box is outside.
+// Planes the box is entirely inside of are removed from 'planeMask', so the children don't test them again.
+static bool TestFrustum(const InstanceBVH::Bounds& bounds, const CullFrustum& frustum, uint32& planeMask)
+{
+	Vector3 center	= (bounds.Min + bounds.Max) * 0.5f;
+	Vector3 extents = (bounds.Max - bounds.Min) * 0.5f;
+	for (uint32 i = 0; i < 6; ++i)
+	{
+		if ((planeMask & (1u << i)) == 0)
+			continue;
+		const Vector4& plane	= frustum.Planes[i];
+		float		   distance = center.x * plane.x + center.y * plane.y + center.z * plane.z + plane.w;
+		float		   radius	= extents.x * fabsf(plane.x) + extents.y * fabsf(plane.y) + extents.z * fabsf(plane.z);
+		if (distance > radius)
+			return false;
+		if (distance < -radius)
+			planeMask &= ~(1u << i);
+	}
+	return true;
+}
+
+static float DistanceSquaredToPoint(const InstanceBVH::Bounds& bounds, const Vector3& point)
+{
+	Vector3 closest = Vector3::Min(Vector3::Max(point, bounds.Min), bounds.Max);
+	return Vector3::DistanceSquared(closest, point);
+}
+
+static float MaxDistanceSquaredToPoint(const InstanceBVH::Bounds& bounds, const Vector3& point)
+{
+	Vector3 farthest = Vector3::Max(Vector3(point) - bounds.Min, bounds.Max - point);
+	return farthest.LengthSquared();
+}
+
+static bool IntersectRay(const InstanceBVH::Bounds& bounds, const Vector3& origin, const Vector3& inverseDirection, float maxDistance)
+{
+	Vector3 t0	 = (bounds.Min - origin) * inverseDirection;
+	Vector3 t1	 = (bounds.Max - origin) * inverseDirection;
+	Vector3 tMin = Vector3::Min(t0, t1);
+	Vector3 tMax = Vector3::Max(t0, t1);
+	float	enter = Math::Max(Math::Max(tMin.x, tMin.y), Math::Max(tMin.z, 0.0f));
+	float	exit  = Math::Min(Math::Min(tMax.x, tMax.y), Math::Min(tMax.z, maxDistance));
+	return enter <= exit;
+}
+
+void InstanceBVH::Build(Span<const BoundingBox> bounds)
+{
+	PROFILE_CPU_SCOPE();
+
+	uint32 numItems = bounds.GetSize();
+
+	BuildContext context;
+	context.Centroids.resize(numItems);
+	m_ItemBounds.resize(numItems);
+	m_ItemLeaf.resize(numItems);
+	m_LeafItems.resize(numItems);
+	for (uint32 i = 0; i < numItems; ++i)
+	{
+		m_ItemBounds[i]		  = ToBounds(bounds[i]);
+		context.Centroids[i] = bounds[i].Center;
+		m_LeafItems[i]		  = i;
+	}
+
+	// A binary tree with at least one item per leaf has at most 2n - 1 nodes
+	m_Nodes.clear();
+	m_Nodes.resize(numItems > 0 ? 2 * numItems - 1 : 1);
+	m_Nodes[0]		 = Node();
+	m_Nodes[0].Box	 = numItems > 0 ? EmptyBounds() : Bounds{ Vector3::Zero, Vector3::Zero };
+	context.NumNodes = 1;
+
+	if (numItems > 0)
+	{
+		BuildNode(0, 0, numItems, context);
+		TaskQueue::Join(context.Tasks);
+	}
+
+	m_NumNodes	= context.NumNodes;
+	m_BuildCost = GetCost();
+}
+
+void InstanceBVH::BuildNode(uint32 nodeIndex, uint32 begin, uint32 end, BuildContext& context)
+{
+	Node& node = m_Nodes[nodeIndex];
+
+	Bounds centroidBounds = EmptyBounds();
+	node.Box			  = EmptyBounds();
+	for (uint32 i = begin; i < end; ++i)
+	{
+		uint32 item = m_LeafItems[i];
+		Grow(node.Box, m_ItemBounds[item]);
+		Grow(centroidBounds, { context.Centroids[item], context.Centroids[item] });
+	}
+
+	auto MakeLeaf = [&]()
+		{
+			node.FirstItem = begin;
+			node.NumItems  = end - begin;
+			for (uint32 i = begin; i < end; ++i)
+				m_ItemLeaf[m_LeafItems[i]] = nodeIndex;
+		};
+
+	uint32 count = end - begin;
+	if (count <= 2)
+	{
+		MakeLeaf();
+		return;
+	}
+
+	Vector3 centroidExtents = centroidBounds.Max - centroidBounds.Min;
+	uint32	axis			= centroidExtents.x > centroidExtents.y ? (centroidExtents.x > centroidExtents.z ? 0 : 2) : (centroidExtents.y > centroidExtents.z ? 1 : 2);
+	float	axisMin			= (&centroidBounds.Min.x)[axis];
+	float	axisExtent		= (&centroidExtents.x)[axis];
+
+	uint32 mid = begin + count / 2;
+	if (axisExtent > 0.0f)
+	{
+		// Binned surface area heuristic along the axis with the largest centroid extent
+		constexpr uint32 NumBins = 16;
+		struct Bin
+		{
+			Bounds Box	 = EmptyBounds();
+			uint32 Count = 0;
+		};
+		Bin	  bins[NumBins];
+		float binScale = NumBins / axisExtent;
+		auto  GetBin   = [&](uint32 item) { return Math::Min(NumBins - 1, (uint32)(((&context.Centroids[item].x)[axis] - axisMin) * binScale)); };
+
+		for (uint32 i = begin; i < end; ++i)
+		{
+			uint32 item = m_LeafItems[i];
+			Bin&   bin	= bins[GetBin(item)];
+			Grow(bin.Box, m_ItemBounds[item]);
+			++bin.Count;
+		}
+
+		// Area and count left of each split, swept from the left
+		float  leftArea[NumBins - 1];
+		uint32 leftCount[NumBins - 1];
+		Bounds leftBounds = EmptyBounds();
+		uint32 numLeft	  = 0;
+		for (uint32 i = 0; i < NumBins - 1; ++i)
+		{
+			Grow(leftBounds, bins[i].Box);
+			numLeft += bins[i].Count;
+			leftArea[i]	 = numLeft > 0 ? SurfaceArea(leftBounds) : 0.0f;
+			leftCount[i] = numLeft;
+		}
+
+		float  bestCost	 = FloatMax;
+		uint32 bestSplit = 0;
+		Bounds rightBounds = EmptyBounds();
+		uint32 numRight	   = 0;
+		for (uint32 i = NumBins - 1; i > 0; --i)
+		{
+			Grow(rightBounds, bins[i].Box);
+			numRight += bins[i].Count;
+			float cost = leftArea[i - 1] * leftCount[i - 1] + (numRight > 0 ? SurfaceArea(rightBounds) : 0.0f) * numRight;
+			if (leftCount[i - 1] > 0 && numRight > 0 && cost < bestCost)
+			{
+				bestCost  = cost;
+				bestSplit = i;
+			}
+		}
+
+		// Visiting a node costs as much as testing an item
+		float nodeArea	= SurfaceArea(node.Box);
+		float splitCost = 1.0f + (nodeArea > 0.0f ? bestCost / nodeArea : 0.0f);
+		if (bestSplit > 0 && count <= MaxLeafItems && splitCost >= (float)count)
+		{
+			MakeLeaf();
+			return;
+		}
+
+		if (bestSplit > 0)
+		{
+			uint32* pMid = std::partition(&m_LeafItems[begin], &m_LeafItems[begin] + count, [&](uint32 item) { return GetBin(item) < bestSplit; });
+			mid			 = (uint32)(pMid - m_LeafItems.data());
+		}
+	}
+	else if (count <= MaxLeafItems)
+	{
+		// All centroids are in the same place, there is nothing to split on
+		MakeLeaf();
+		return;
+	}
+
+	uint32 left	 = context.NumNodes.fetch_add(2);
+	uint32 right = left + 1;
+	node.NumItems	 = 0;
+	node.Children[0] = left;
+	node.Children[1] = right;
+	m_Nodes[left]	 = Node();
+	m_Nodes[right]	 = Node();
+	m_Nodes[left].Parent  = nodeIndex;
+	m_Nodes[right].Parent = nodeIndex;
+
+	if (mid - begin > ParallelBuildItems)
+	{
+		TaskQueue::Execute([this, left, begin, mid, &context](int)
+			{
+				BuildNode(left, begin, mid, context);
+			}, context.Tasks);
+	}
+	else
+	{
+		BuildNode(left, begin, mid, context);
+	}
+	BuildNode(right, mid, end, context);
+}
+
+uint32 InstanceBVH::Update(Span<const BoundingBox> bounds)
+{
+	PROFILE_CPU_SCOPE();
+
+	if (bounds.GetSize() != GetNumItems())
+	{
+		Build(bounds);
+		return bounds.GetSize();
+	}
+
+	Array<uint32> changedItems;
+	for (uint32 i = 0; i < bounds.GetSize(); ++i)
+	{
+		if (!(ToBounds(bounds[i]) == m_ItemBounds[i]))
+			changedItems.push_back(i);
+	}
+	if (changedItems.empty())
+		return 0;
+
+	UpdateItems(changedItems, bounds);
+	if (GetCost() > m_BuildCost * RebuildCostRatio)
+		Build(bounds);
+	return (uint32)changedItems.size();
+}
+
+void InstanceBVH::UpdateItems(Span<const uint32> items, Span<const BoundingBox> bounds)
+{
+	PROFILE_CPU_SCOPE();
+
+	for (uint32 item : items)
+	{
+		m_ItemBounds[item] = ToBounds(bounds[item]);
+
+		// Ancestors are the union of their children, so they stop changing once a node keeps its bounds
+		uint32 nodeIndex = m_ItemLeaf[item];
+		while (nodeIndex != InvalidNode)
+		{
+			Bounds previous = m_Nodes[nodeIndex].Box;
+			TryRotate(nodeIndex);
+			RefitNode(nodeIndex);
+			if (m_Nodes[nodeIndex].Box == previous)
+				break;
+			nodeIndex = m_Nodes[nodeIndex].Parent;
+		}
+	}
+}
+
+void InstanceBVH::Refit()
+{
+	PROFILE_CPU_SCOPE();
+
+	if (GetNumItems() == 0)
+		return;
+
+	// Children are allocated after their parent, but rotations can move a node under a parent that was allocated later.
+	// Visit the nodes in post order instead of relying on the allocation order.
+	Array<std::pair<uint32, bool>> stack;
+	stack.push_back({ 0, false });
+	while (!stack.empty())
+	{
+		auto [nodeIndex, childrenDone] = stack.back();
+		stack.pop_back();
+		const Node& node = m_Nodes[nodeIndex];
+		if (node.NumItems > 0 || childrenDone)
+		{
+			RefitNode(nodeIndex);
+			continue;
+		}
+		stack.push_back({ nodeIndex, true });
+		stack.push_back({ node.Children[0], false });
+		stack.push_back({ node.Children[1], false });
+	}
+}
+
+void InstanceBVH::RefitNode(uint32 nodeIndex)
+{
+	Node& node = m_Nodes[nodeIndex];
+	if (node.NumItems > 0)
+	{
+		node.Box = EmptyBounds();
+		for (uint32 i = node.FirstItem; i < node.FirstItem + node.NumItems; ++i)
+			Grow(node.Box, m_ItemBounds[m_LeafItems[i]]);
+	}
+	else if (nodeIndex != 0 || GetNumItems() > 0)
+	{
+		node.Box = Union(m_Nodes[node.Children[0]].Box, m_Nodes[node.Children[1]].Box);
+	}
+}
+
+// Tree rotations from "Fast, Effective BVH Updates for Animated Scenes" (Kopta et al.).
+// Swaps a child with one of the children of its sibling if that makes the sibling smaller.
+// The node itself keeps the same items, so its bounds don't change.
+void InstanceBVH::TryRotate(uint32 nodeIndex)
+{
+	Node& node = m_Nodes[nodeIndex];
+	if (node.NumItems > 0)
+		return;
+
+	float  bestGain		 = 0.0f;
+	uint32 bestSide		 = 0;
+	uint32 bestGrandchild = 0;
+	for (uint32 side = 0; side < 2; ++side)
+	{
+		const Node& child	= m_Nodes[node.Children[side]];
+		const Node& sibling = m_Nodes[node.Children[1 - side]];
+		if (sibling.NumItems > 0)
+			continue;
+
+		// 'child' takes the place of a grandchild, which makes the sibling hold 'child' and the other grandchild
+		float siblingArea = SurfaceArea(sibling.Box);
+		for (uint32 grandchild = 0; grandchild < 2; ++grandchild)
+		{
+			float gain = siblingArea - SurfaceArea(Union(child.Box, m_Nodes[sibling.Children[1 - grandchild]].Box));
+			if (gain > bestGain)
+			{
+				bestGain	   = gain;
+				bestSide	   = side;
+				bestGrandchild = grandchild;
+			}
+		}
+	}
+	if (bestGain <= 0.0f)
+		return;
+
+	uint32 childIndex		 = node.Children[bestSide];
+	uint32 siblingIndex		 = node.Children[1 - bestSide];
+	Node&  sibling			 = m_Nodes[siblingIndex];
+	uint32 grandchildIndex	 = sibling.Children[bestGrandchild];
+
+	node.Children[bestSide]			 = grandchildIndex;
+	m_Nodes[grandchildIndex].Parent	 = nodeIndex;
+	sibling.Children[bestGrandchild] = childIndex;
+	m_Nodes[childIndex].Parent		 = siblingIndex;
+	RefitNode(siblingIndex);
+}
+
+void InstanceBVH::AddSubtreeItems(uint32 nodeIndex, Array<uint32>& outItems) const
+{
+	Array<uint32> stack;
+	stack.push_back(nodeIndex);
+	while (!stack.empty())
+	{
+		const Node& node = m_Nodes[stack.back()];
+		stack.pop_back();
+		if (node.NumItems > 0)
+		{
+			outItems.insert(outItems.end(), &m_LeafItems[node.FirstItem], &m_LeafItems[node.FirstItem] + node.NumItems);
+		}
+		else
+		{
+			stack.push_back(node.Children[0]);
+			stack.push_back(node.Children[1]);
+		}
+	}
+}
+
+void InstanceBVH::QueryFrustum(const CullFrustum& frustum, Array<uint32>& outItems) const
+{
+	if (GetNumItems() == 0)
+		return;
+
+	struct Entry
+	{
+		uint32 NodeIndex;
+		uint32 PlaneMask;
+	};
+	Array<Entry> stack;
+	stack.push_back({ 0, 0x3F });
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+
+		const Node& node = m_Nodes[entry.NodeIndex];
+		if (!TestFrustum(node.Box, frustum, entry.PlaneMask))
+			continue;
+
+		if (entry.PlaneMask == 0)
+		{
+			AddSubtreeItems(entry.NodeIndex, outItems);
+		}
+		else if (node.NumItems > 0)
+		{
+			for (uint32 i = node.FirstItem; i < node.FirstItem + node.NumItems; ++i)
+			{
+				uint32 planeMask = entry.PlaneMask;
+				if (TestFrustum(m_ItemBounds[m_LeafItems[i]], frustum, planeMask))
+					outItems.push_back(m_LeafItems[i]);
+			}
+		}
+		else
+		{
+			stack.push_back({ node.Children[0], entry.PlaneMask });
+			stack.push_back({ node.Children[1], entry.PlaneMask });
+		}
+	}
+}
+
+void InstanceBVH::QuerySphere(const BoundingSphere& sphere, Array<uint32>& outItems) const
+{
+	if (GetNumItems() == 0)
+		return;
+
+	Vector3 center(sphere.Center);
+	float	radiusSq = sphere.Radius * sphere.Radius;
+
+	Array<uint32> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		uint32 nodeIndex = stack.back();
+		stack.pop_back();
+
+		const Node& node = m_Nodes[nodeIndex];
+		if (DistanceSquaredToPoint(node.Box, center) > radiusSq)
+			continue;
+
+		if (MaxDistanceSquaredToPoint(node.Box, center) <= radiusSq)
+		{
+			AddSubtreeItems(nodeIndex, outItems);
+		}
+		else if (node.NumItems > 0)
+		{
+			for (uint32 i = node.FirstItem; i < node.FirstItem + node.NumItems; ++i)
+			{
+				if (DistanceSquaredToPoint(m_ItemBounds[m_LeafItems[i]], center) <= radiusSq)
+					outItems.push_back(m_LeafItems[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.Children[0]);
+			stack.push_back(node.Children[1]);
+		}
+	}
+}
+
+bool InstanceBVH::AnyInSphere(const BoundingSphere& sphere) const
+{
+	if (GetNumItems() == 0)
+		return false;
+
+	Vector3 center(sphere.Center);
+	float	radiusSq = sphere.Radius * sphere.Radius;
+
+	Array<uint32> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		uint32 nodeIndex = stack.back();
+		stack.pop_back();
+
+		// Node bounds are tight around their items, so a node entirely inside the sphere has an item in it
+		const Node& node = m_Nodes[nodeIndex];
+		if (DistanceSquaredToPoint(node.Box, center) > radiusSq)
+			continue;
+		if (MaxDistanceSquaredToPoint(node.Box, center) <= radiusSq)
+			return true;
+
+		if (node.NumItems > 0)
+		{
+			for (uint32 i = node.FirstItem; i < node.FirstItem + node.NumItems; ++i)
+			{
+				if (DistanceSquaredToPoint(m_ItemBounds[m_LeafItems[i]], center) <= radiusSq)
+					return true;
+			}
+		}
+		else
+		{
+			stack.push_back(node.Children[0]);
+			stack.push_back(node.Children[1]);
+		}
+	}
+	return false;
+}
+
+void InstanceBVH::QueryRay(const Vector3& origin, const Vector3& direction, float maxDistance, Array<uint32>& outItems) const
+{
+	if (GetNumItems() == 0)
+		return;
+
+	Vector3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	Array<uint32> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const Node& node = m_Nodes[stack.back()];
+		stack.pop_back();
+		if (!IntersectRay(node.Box, origin, inverseDirection, maxDistance))
+			continue;
+
+		if (node.NumItems > 0)
+		{
+			for (uint32 i = node.FirstItem; i < node.FirstItem + node.NumItems; ++i)
+			{
+				if (IntersectRay(m_ItemBounds[m_LeafItems[i]], origin, inverseDirection, maxDistance))
+					outItems.push_back(m_LeafItems[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.Children[0]);
+			stack.push_back(node.Children[1]);
+		}
+	}
+}
+
+float InstanceBVH::GetCost() const
+{
+	float rootArea = SurfaceArea(m_Nodes[0].Box);
+	if (GetNumItems() == 0 || rootArea <= 0.0f)
+		return 0.0f;
+
+	// Rotations keep every node in use, so all allocated nodes are part of the tree
+	float cost = 0.0f;
+	for (uint32 i = 0; i < m_NumNodes; ++i)
+	{
+		const Node& node = m_Nodes[i];
+		cost += SurfaceArea(node.Box) * (node.NumItems > 0 ? (float)node.NumItems : 1.0f);
+	}
+	return cost / rootArea;
+}
+
+bool InstanceBVH::Validate() const
+{
+	auto Contains = [](const Bounds& outer, const Bounds& inner)
+		{
+			return outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z &&
+				outer.Max.x >= inner.Max.x && outer.Max.y >= inner.Max.y && outer.Max.z >= inner.Max.z;
+		};
+
+	if (GetNumItems() == 0)
+		return true;
+
+	uint32		  numNodes = 0;
+	Array<uint32> itemCount(GetNumItems());
+	Array<uint32> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		uint32 nodeIndex = stack.back();
+		stack.pop_back();
+		++numNodes;
+
+		const Node& node = m_Nodes[nodeIndex];
+		if (node.NumItems > 0)
+		{
+			for (uint32 i = node.FirstItem; i < node.FirstItem + node.NumItems; ++i)
+			{
+				uint32 item = m_LeafItems[i];
+				++itemCount[item];
+				if (m_ItemLeaf[item] != nodeIndex || !Contains(node.Box, m_ItemBounds[item]))
+				{
+					E_LOG(Warning, "InstanceBVH - Item %d is not contained by leaf %d", item, nodeIndex);
+					return false;
+				}
+			}
+			continue;
+		}
+
+		for (uint32 child : node.Children)
+		{
+			if (m_Nodes[child].Parent != nodeIndex || !Contains(node.Box, m_Nodes[child].Box))
+			{
+				E_LOG(Warning, "InstanceBVH - Node %d is not contained by its parent %d", child, nodeIndex);
+				return false;
+			}
+			stack.push_back(child);
+		}
+	}
+
+	if (numNodes != m_NumNodes)
+	{
+		E_LOG(Warning, "InstanceBVH - %d of %d nodes are reachable", numNodes, m_NumNodes);
+		return false;
+	}
+	for (uint32 item = 0; item < GetNumItems(); ++item)
+	{
+		if (itemCount[item] != 1)
+		{
+			E_LOG(Warning, "InstanceBVH - Item %d is in %d leaves", item, itemCount[item]);
+			return false;
+		}
+	}
+	return true;
+}
+
+// A city of blocks of buildings with props and cars in the streets. Returns the indices of the cars.
+static void CreateCity(std::mt19937& random, uint32 numItems, Array<BoundingBox>& outBounds, Array<uint32>& outCars)
+{
+	constexpr uint32 ItemsPerBlock = 64;
+	constexpr float	 BlockSize	   = 100.0f;
+
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	uint32 blocksPerSide = (uint32)ceilf(sqrtf((float)Math::DivideAndRoundUp(numItems, ItemsPerBlock)));
+	outBounds.resize(numItems);
+	outCars.clear();
+	for (uint32 i = 0; i < numItems; ++i)
+	{
+		uint32	block = i / ItemsPerBlock;
+		uint32	index = i % ItemsPerBlock;
+		Vector3 blockOrigin((block % blocksPerSide) * BlockSize, 0.0f, (block / blocksPerSide) * BlockSize);
+		if (index < 16)
+		{
+			// Buildings on a 4x4 grid in the block
+			Vector3 extents(5.0f + 5.0f * unit(random), 10.0f + 90.0f * unit(random), 5.0f + 5.0f * unit(random));
+			Vector3 center = blockOrigin + Vector3(15.0f + (index % 4) * 20.0f, extents.y, 15.0f + (index / 4) * 20.0f);
+			outBounds[i]   = BoundingBox(center, extents);
+		}
+		else if (index < ItemsPerBlock - 1)
+		{
+			// Props on the sidewalks
+			Vector3 center = blockOrigin + Vector3(BlockSize * unit(random), 1.0f, unit(random) < 0.5f ? 2.0f : BlockSize - 2.0f);
+			outBounds[i]   = BoundingBox(center, Vector3(0.5f, 1.0f + 3.0f * unit(random), 0.5f));
+		}
+		else
+		{
+			// A car in the street
+			Vector3 center = blockOrigin + Vector3(BlockSize * unit(random), 0.8f, -2.0f + 4.0f * unit(random));
+			outBounds[i]   = BoundingBox(center, Vector3(2.2f, 0.8f, 1.0f));
+			outCars.push_back(i);
+		}
+	}
+}
+
+static void MoveItems(std::mt19937& random, Span<const uint32> items, float distance, Array<BoundingBox>& bounds)
+{
+	std::uniform_real_distribution<float> offset(-distance, distance);
+	for (uint32 item : items)
+		bounds[item].Center = Vector3(bounds[item].Center) + Vector3(offset(random), 0.0f, offset(random));
+}
+
+static bool CompareItems(const char* pQuery, Array<uint32>& items, Array<uint32>& expected)
+{
+	std::sort(items.begin(), items.end());
+	std::sort(expected.begin(), expected.end());
+	if (items != expected)
+	{
+		E_LOG(Warning, "InstanceBVH - %s query returned %d items, expected %d", pQuery, (uint32)items.size(), (uint32)expected.size());
+		return false;
+	}
+	return true;
+}
+
+static ViewTransform CreateStreetView(std::mt19937& random, const Vector3& cityMin, const Vector3& cityMax, float farPlane)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	Vector3 position  = Vector3::Lerp(cityMin, cityMax, unit(random));
+	position.y		  = 2.0f + 50.0f * unit(random);
+	float	  angle	  = unit(random) * 2.0f * Math::PI;
+	Vector3 direction = Vector3(cosf(angle), -0.2f * unit(random), sinf(angle));
+	direction.Normalize();
+
+	ViewTransform view;
+	view.IsPerspective		= true;
+	view.PerspectiveFrustum = Math::CreateBoundingFrustum(Math::CreatePerspectiveMatrix(Math::Radians(70.0f), 1.7f, 0.1f, farPlane), Math::CreateLookToMatrix(position, direction, Vector3::Up));
+	return view;
+}
+
+bool InstanceBVH::RunSelfTest(uint32 seed)
+{
+	std::mt19937						  random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	const uint32 itemCounts[] = { 0, 1, 2, 9, 100, 5000, 40000 };
+	for (uint32 numItems : itemCounts)
+	{
+		Array<BoundingBox> bounds;
+		Array<uint32>	   cars;
+		CreateCity(random, numItems, bounds, cars);
+
+		InstanceBVH bvh;
+		bvh.Build(bounds);
+
+		for (uint32 round = 0; round < 8; ++round)
+		{
+			if (!bvh.Validate())
+			{
+				E_LOG(Warning, "InstanceBVH - Invalid tree (%d items, round %d)", numItems, round);
+				return false;
+			}
+
+			Vector3 cityMin = Vector3::Zero;
+			Vector3 cityMax = Vector3::Zero;
+			for (const BoundingBox& box : bounds)
+			{
+				cityMin = Vector3::Min(cityMin, Vector3(box.Center) - Vector3(box.Extents));
+				cityMax = Vector3::Max(cityMax, Vector3(box.Center) + Vector3(box.Extents));
+			}
+
+			for (uint32 query = 0; query < 16; ++query)
+			{
+				Array<uint32> items, expected;
+
+				CullFrustum frustum(CreateStreetView(random, cityMin, cityMax, 50.0f + 500.0f * unit(random)));
+				bvh.QueryFrustum(frustum, items);
+				for (uint32 i = 0; i < numItems; ++i)
+				{
+					uint32 planeMask = 0x3F;
+					if (TestFrustum(ToBounds(bounds[i]), frustum, planeMask))
+						expected.push_back(i);
+				}
+				if (!CompareItems("Frustum", items, expected))
+					return false;
+
+				items.clear();
+				expected.clear();
+				BoundingSphere sphere(Vector3::Lerp(cityMin, cityMax, unit(random)), 5.0f + 200.0f * unit(random));
+				bvh.QuerySphere(sphere, items);
+				for (uint32 i = 0; i < numItems; ++i)
+				{
+					if (DistanceSquaredToPoint(ToBounds(bounds[i]), sphere.Center) <= sphere.Radius * sphere.Radius)
+						expected.push_back(i);
+				}
+				if (!CompareItems("Sphere", items, expected))
+					return false;
+				if (bvh.AnyInSphere(sphere) != !expected.empty())
+				{
+					E_LOG(Warning, "InstanceBVH - AnyInSphere returned %d for a sphere with %d items", bvh.AnyInSphere(sphere), (uint32)expected.size());
+					return false;
+				}
+
+				items.clear();
+				expected.clear();
+				Vector3 origin = Vector3::Lerp(cityMin, cityMax, unit(random));
+				Vector3 direction(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+				direction.Normalize();
+				Vector3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+				float	maxDistance = 1000.0f * unit(random);
+				bvh.QueryRay(origin, direction, maxDistance, items);
+				for (uint32 i = 0; i < numItems; ++i)
+				{
+					if (IntersectRay(ToBounds(bounds[i]), origin, inverseDirection, maxDistance))
+						expected.push_back(i);
+				}
+				if (!CompareItems("Ray", items, expected))
+					return false;
+			}
+
+			// Move the cars, every other round far enough to make rotations worthwhile
+			MoveItems(random, cars, round % 2 == 0 ? 5.0f : 200.0f, bounds);
+			bvh.UpdateItems(cars, bounds);
+		}
+
+		// Update() rebuilds when items are added
+		bounds.push_back(BoundingBox(Vector3::Zero, Vector3::One));
+		bvh.Update(bounds);
+		if (bvh.GetNumItems() != numItems + 1 || !bvh.Validate())
+		{
+			E_LOG(Warning, "InstanceBVH - Update with a new item failed (%d items)", numItems);
+			return false;
+		}
+	}
+
+	E_LOG(Info, "InstanceBVH - Self test passed");
+	return true;
+}
+
+void InstanceBVH::RunBenchmark(uint32 seed)
+{
+	std::mt19937						  random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	const uint32 itemCounts[] = { 100000, 1000000 };
+	for (uint32 numItems : itemCounts)
+	{
+		Array<BoundingBox> bounds;
+		Array<uint32>	   cars;
+		CreateCity(random, numItems, bounds, cars);
+
+		Vector3 cityMin = Vector3::Zero;
+		Vector3 cityMax = Vector3::Zero;
+		for (const BoundingBox& box : bounds)
+			cityMax = Vector3::Max(cityMax, Vector3(box.Center) + Vector3(box.Extents));
+
+		E_LOG(Info, "InstanceBVH - City of %d instances (%.0f x %.0f m):", numItems, cityMax.x, cityMax.z);
+
+		InstanceBVH bvh;
+		{
+			constexpr uint32 NumBuilds = 5;
+			Utils::TimeScope timer;
+			for (uint32 i = 0; i < NumBuilds; ++i)
+				bvh.Build(bounds);
+			E_LOG(Info, "\tBuild:                  %.2f ms (%d nodes, cost %.1f)", timer.Stop() * 1000.0f / NumBuilds, bvh.GetNumNodes(), bvh.GetCost());
+		}
+
+		// Cars move every frame. Compare updating only the cars with refitting the whole tree.
+		{
+			constexpr uint32 NumFrames = 60;
+			float updateTime = 0, refitTime = 0;
+			for (uint32 frame = 0; frame < NumFrames; ++frame)
+			{
+				MoveItems(random, cars, 1.0f, bounds);
+				{
+					Utils::TimeScope timer;
+					bvh.UpdateItems(cars, bounds);
+					updateTime += timer.Stop();
+				}
+				{
+					Utils::TimeScope timer;
+					bvh.Refit();
+					refitTime += timer.Stop();
+				}
+			}
+			E_LOG(Info, "\tUpdate %6d cars:       %.2f ms (cost after %d frames: %.1f)", (uint32)cars.size(), updateTime * 1000.0f / NumFrames, NumFrames, bvh.GetCost());
+			E_LOG(Info, "\tRefit all:              %.2f ms", refitTime * 1000.0f / NumFrames);
+		}
+
+		// Queries compared with testing every instance
+		Array<uint32>	   items;
+		Array<uint8>	   mask(numItems);
+		{
+			constexpr uint32 NumQueries = 50;
+			float	bvhTime = 0, bruteForceTime = 0;
+			uint64	numFound = 0;
+			for (uint32 query = 0; query < NumQueries; ++query)
+			{
+				CullFrustum frustum(CreateStreetView(random, cityMin, cityMax, 1000.0f));
+				{
+					Utils::TimeScope timer;
+					items.clear();
+					bvh.QueryFrustum(frustum, items);
+					bvhTime += timer.Stop();
+					numFound += items.size();
+				}
+				{
+					Utils::TimeScope timer;
+					for (uint32 i = 0; i < numItems; ++i)
+					{
+						uint32 planeMask = 0x3F;
+						mask[i]			 = TestFrustum(ToBounds(bounds[i]), frustum, planeMask);
+					}
+					bruteForceTime += timer.Stop();
+				}
+			}
+			E_LOG(Info, "\tFrustum query:          %.3f ms, every instance: %.3f ms (%d visible on average)", bvhTime * 1000.0f / NumQueries, bruteForceTime * 1000.0f / NumQueries, (uint32)(numFound / NumQueries));
+		}
+		{
+			constexpr uint32 NumQueries = 1000;
+			float	bvhTime = 0;
+			uint64	numFound = 0;
+			for (uint32 query = 0; query < NumQueries; ++query)
+			{
+				BoundingSphere sphere(Vector3::Lerp(cityMin, cityMax, unit(random)), 30.0f);
+				Utils::TimeScope timer;
+				items.clear();
+				bvh.QuerySphere(sphere, items);
+				bvhTime += timer.Stop();
+				numFound += items.size();
+			}
+			E_LOG(Info, "\tSphere query (30 m):    %.4f ms (%d found on average)", bvhTime * 1000.0f / NumQueries, (uint32)(numFound / NumQueries));
+		}
+		{
+			constexpr uint32 NumQueries = 10000;
+			float	bvhTime = 0;
+			uint64	numFound = 0;
+			for (uint32 query = 0; query < NumQueries; ++query)
+			{
+				Vector3 origin	  = Vector3::Lerp(cityMin, cityMax, unit(random));
+				origin.y		  = 1.7f;
+				float	angle	  = unit(random) * 2.0f * Math::PI;
+				Vector3 direction(cosf(angle), 0.0f, sinf(angle));
+				Utils::TimeScope timer;
+				items.clear();
+				bvh.QueryRay(origin, direction, 500.0f, items);
+				bvhTime += timer.Stop();
+				numFound += items.size();
+			}
+			E_LOG(Info, "\tRay query (500 m):      %.4f ms (%d found on average)", bvhTime * 1000.0f / NumQueries, (uint32)(numFound / NumQueries));
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+struct CullFrustum;
+
+// Bounding volume hierarchy over the world bounds of the scene instances, one item per instance.
+// Built top down with a binned surface area heuristic. Moving items refit their ancestors and rotate them
+// where that reduces the surface area, which keeps the tree efficient without rebuilding it every frame.
+class InstanceBVH
+{
+public:
+	// Builds the tree over 'bounds'. Large subtrees are built in parallel on the task queue.
+	void Build(Span<const BoundingBox> bounds);
+
+	// Brings the tree up to date with 'bounds'. Rebuilds if the number of items changed or the refits degraded the tree too much,
+	// otherwise only moves the items whose bounds changed. Returns the number of items that changed.
+	uint32 Update(Span<const BoundingBox> bounds);
+
+	// Moves 'items' to their new bounds in 'bounds' (indexed by item) and refits and rotates their ancestors
+	void UpdateItems(Span<const uint32> items, Span<const BoundingBox> bounds);
+
+	// Recomputes the bounds of all nodes from their items
+	void Refit();
+
+	// Items whose bounds are inside or intersect 'frustum'. Subtrees entirely inside the frustum are added without testing their items.
+	void QueryFrustum(const CullFrustum& frustum, Array<uint32>& outItems) const;
+	// Items whose bounds intersect 'sphere'. Subtrees entirely inside the sphere are added without testing their items.
+	void QuerySphere(const BoundingSphere& sphere, Array<uint32>& outItems) const;
+	// True if the bounds of any item intersect 'sphere'. Stops at the first one.
+	bool AnyInSphere(const BoundingSphere& sphere) const;
+	// Items whose bounds are hit by the ray before 'maxDistance'
+	void QueryRay(const Vector3& origin, const Vector3& direction, float maxDistance, Array<uint32>& outItems) const;
+
+	// Expected cost of a query relative to testing the root, using the surface area heuristic. Lower is better.
+	float GetCost() const;
+
+	uint32 GetNumItems() const { return (uint32)m_ItemBounds.size(); }
+	uint32 GetNumNodes() const { return m_NumNodes; }
+
+	// Validates the tree and compares queries with testing every item, on random scenes with moving items
+	static bool RunSelfTest(uint32 seed);
+
+	// Measures build, refit and query times on a synthetic city of 100k and 1M instances
+	static void RunBenchmark(uint32 seed);
+
+	struct Bounds
+	{
+		Vector3 Min;
+		Vector3 Max;
+	};
+
+private:
+
+	struct Node
+	{
+		Bounds Box;
+		uint32 Parent	 = InvalidNode;
+		uint32 NumItems	 = 0;			///< 0 for internal nodes
+		uint32 FirstItem = 0;			///< Leaves: first item in m_LeafItems
+		uint32 Children[2]{};			///< Internal nodes
+	};
+
+	static constexpr uint32 InvalidNode		= ~0u;
+	static constexpr uint32 MaxLeafItems	= 8;
+
+	struct BuildContext;
+	void BuildNode(uint32 nodeIndex, uint32 begin, uint32 end, BuildContext& context);
+	void RefitNode(uint32 nodeIndex);
+	void TryRotate(uint32 nodeIndex);
+	void AddSubtreeItems(uint32 nodeIndex, Array<uint32>& outItems) const;
+	bool Validate() const;
+
+	Array<Node>		m_Nodes;
+	uint32			m_NumNodes = 0;
+	Array<uint32>	m_LeafItems;					///< Items grouped by leaf
+	Array<uint32>	m_ItemLeaf;						///< Leaf of each item
+	Array<Bounds>	m_ItemBounds;
+	float			m_BuildCost = 0.0f;				///< Cost right after the last build
+};
@@ -4,12 +4,37 @@
 Vector4 AnimationChannel::Evaluate(float time) const
 {
 	auto it = std::lower_bound(KeyFrames.begin(), KeyFrames.end(), time);
-	if (it == KeyFrames.begin())
+	return Evaluate(time, (uint32)(it - KeyFrames.begin()));
+}
+
+uint32 AnimationChannel::FindKeyFrame(float time, uint32 hint) const
+{
+	// Beyond this many steps from the hint, a binary search is faster
+	constexpr uint32 MaxLinearSteps = 4;
+
+	uint32 numKeyFrames = (uint32)KeyFrames.size();
+	uint32 i = Math::Min(hint, numKeyFrames);
+
+	// Time went back, like when the animation loops
+	if (i > 0 && KeyFrames[i - 1] >= time)
+		return (uint32)(std::lower_bound(KeyFrames.begin(), KeyFrames.begin() + i, time) - KeyFrames.begin());
+
+	for (uint32 step = 0; i < numKeyFrames && KeyFrames[i] < time; ++step, ++i)
+	{
+		if (step == MaxLinearSteps)
+			return (uint32)(std::lower_bound(KeyFrames.begin() + i, KeyFrames.end(), time) - KeyFrames.begin());
+	}
+	return i;
+}
+
+Vector4 AnimationChannel::Evaluate(float time, uint32 keyFrame) const
+{
+	if (keyFrame == 0)
 		return Data.front();
-	if (it == KeyFrames.end())
+	if (keyFrame == (uint32)KeyFrames.size())
 		return Data.back();
 
-	int i = (int)(it - KeyFrames.begin());
+	int i = (int)keyFrame;
 
 	if (Interpolation == Interpolation::Linear)
 	{
@@ -33,3 +58,73 @@ Vector4 AnimationChannel::Evaluate(float time) const
 	gUnreachable();
 	return Vector4::Zero;
 }
+
+Vector4 CompressedAnimation::Decode(const Track& track, const uint16* pData)
+{
+	if (track.Path == AnimationChannel::PathType::Rotation)
+	{
+		// The sign bits of the first two values hold the index of the largest component, which is positive
+		constexpr float InvSqrt2 = 0.70710678118f;
+		constexpr float Scale = 2.0f * InvSqrt2 / 0x7FFF;
+		uint32 largest = (pData[0] >> 15) | ((pData[1] >> 15) << 1);
+		float a = (pData[0] & 0x7FFF) * Scale - InvSqrt2;
+		float b = (pData[1] & 0x7FFF) * Scale - InvSqrt2;
+		float c = (pData[2] & 0x7FFF) * Scale - InvSqrt2;
+		float d = sqrtf(Math::Max(0.0f, 1.0f - a * a - b * b - c * c));
+		switch (largest)
+		{
+		case 0: return Vector4(d, a, b, c);
+		case 1: return Vector4(a, d, b, c);
+		case 2: return Vector4(a, b, d, c);
+		default: return Vector4(a, b, c, d);
+		}
+	}
+	return Vector4(track.RangeMin.x + pData[0] * track.RangeScale.x, track.RangeMin.y + pData[1] * track.RangeScale.y, track.RangeMin.z + pData[2] * track.RangeScale.z, 0.0f);
+}
+
+Vector4 CompressedAnimation::Interpolate(AnimationChannel::PathType path, const Vector4& a, const Vector4& b, float t)
+{
+	if (path == AnimationChannel::PathType::Rotation)
+	{
+		// Normalized lerp along the shortest arc. The compressor measures the error with the same interpolation.
+		Vector4 result = Vector4::Lerp(a, a.Dot(b) < 0.0f ? -b : b, t);
+		result.Normalize();
+		return result;
+	}
+	return Vector4::Lerp(a, b, t);
+}
+
+Vector4 CompressedAnimation::Sample(const Track& track, float time, uint32& keyHint) const
+{
+	if (track.NumKeys == 1)
+		return DecodeKey(track, 0);
+
+	// Beyond this many steps from the hint, a binary search is faster
+	constexpr uint32 MaxLinearSteps = 4;
+
+	// Find the key that starts the segment containing 'frame'
+	const uint16* pFrames = &KeyFrames[track.FirstKey];
+	float frame = (time - TimeStart) * SampleRate;
+	uint32 lastSegment = track.NumKeys - 2;
+	uint32 key = Math::Min(keyHint, lastSegment);
+	if (key > 0 && pFrames[key] > frame)
+	{
+		// Time went back, like when the animation loops
+		key = (uint32)(std::upper_bound(pFrames + 1, pFrames + key, frame) - pFrames) - 1;
+	}
+	else
+	{
+		for (uint32 step = 0; key < lastSegment && pFrames[key + 1] <= frame; ++step, ++key)
+		{
+			if (step == MaxLinearSteps)
+			{
+				key = Math::Min(lastSegment, (uint32)(std::upper_bound(pFrames + key + 1, pFrames + track.NumKeys, frame) - pFrames) - 1);
+				break;
+			}
+		}
+	}
+	keyHint = key;
+
+	float t = Math::Clamp((frame - pFrames[key]) / (pFrames[key + 1] - pFrames[key]), 0.0f, 1.0f);
+	return Interpolate(track.Path, DecodeKey(track, key), DecodeKey(track, key + 1), t);
+}
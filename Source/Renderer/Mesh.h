@@ -43,6 +43,13 @@ struct AnimationChannel
 
 	Vector4 Evaluate(float time) const;
 
+	// Index of the first keyframe at or after 'time', found by searching from 'hint' first.
+	// Pass the result for a slightly earlier time as the hint to find the keyframe in constant time during playback.
+	uint32 FindKeyFrame(float time, uint32 hint) const;
+
+	// Same as Evaluate(time), with the keyframe already found by FindKeyFrame()
+	Vector4 Evaluate(float time, uint32 keyFrame) const;
+
 	const Vector4& GetInTangent(int index) const { gAssert(Interpolation == Interpolation::Cubic); return Data[index * 3 + 0]; }
 	const Vector4& GetVertex(int index)	const { return Interpolation == Interpolation::Cubic ? Data[index * 3 + 1] : Data[index]; }
 	const Vector4& GetOutTangent(int index) const { gAssert(Interpolation == Interpolation::Cubic); return Data[index * 3 + 2]; }
@@ -54,10 +61,48 @@ struct AnimationChannel
 	PathType		Path = PathType::Translation;
 };
 
+// Animation tracks resampled, reduced and quantized by AnimationCompression.
+// Like the channels they replace, tracks target nodes by name and can be bound to any skeleton with those joints.
+struct CompressedAnimation
+{
+	struct Track
+	{
+		AnimationChannel::PathType	Path;
+		uint32						FirstKey;		///< Index in KeyFrames. The data of the key is at 3 * index in KeyData
+		uint32						NumKeys;		///< 1 if the track is constant
+		Vector3						RangeMin;		///< Translation and scale components are quantized to 16 bits between RangeMin and RangeMin + 65535 * RangeScale
+		Vector3						RangeScale;
+	};
+
+	// Samples 'track' at 'time'. 'keyHint' is the key found by the previous sample of the track, and is updated.
+	Vector4 Sample(const Track& track, float time, uint32& keyHint) const;
+
+	// Decodes key 'key' of 'track'
+	Vector4 DecodeKey(const Track& track, uint32 key) const { return Decode(track, &KeyData[(track.FirstKey + key) * 3]); }
+
+	// Decodes the 3 values of a key. Rotations are stored as the three smallest components of the quaternion.
+	static Vector4 Decode(const Track& track, const uint16* pData);
+
+	// Interpolates between two decoded keys, like Sample()
+	static Vector4 Interpolate(AnimationChannel::PathType path, const Vector4& a, const Vector4& b, float t);
+
+	uint64 GetSize() const { return Tracks.size() * sizeof(Track) + KeyFrames.size() * sizeof(uint16) + KeyData.size() * sizeof(uint16); }
+
+	float			TimeStart	= 0.0f;
+	float			SampleRate	= 0.0f;		///< Frames per second of the frame numbers in KeyFrames
+	Array<Track>	Tracks;
+	Array<String>	Targets;				///< Target node of each track. Not included in GetSize(), like the targets of the raw channels
+	Array<uint16>	KeyFrames;				///< Frame number of each key, from TimeStart
+	Array<uint16>	KeyData;				///< 3 values per key
+};
+
 struct Animation
 {
+	bool IsCompressed() const { return !Compressed.Tracks.empty(); }
+
 	String Name;
-	Array<AnimationChannel> Channels;
+	Array<AnimationChannel> Channels;		///< Empty once the animation is compressed
+	CompressedAnimation Compressed;
 	float TimeStart = std::numeric_limits<float>::max();
 	float TimeEnd = std::numeric_limits<float>::min();
 };
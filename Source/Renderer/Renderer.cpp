@@ -20,6 +20,7 @@
 
 #include "Renderer/Mesh.h"
 #include "Renderer/Light.h"
+#include "Renderer/SkeletalAnimation.h"
 #include "Renderer/Techniques/DebugRenderer.h"
 #include "Renderer/Techniques/GpuParticles.h"
 #include "Renderer/Techniques/RTAO.h"
@@ -97,19 +98,117 @@ namespace Tweakables
 	ConsoleVariable gRenderGraphTrashAliasedResources("r.RenderGraph.TrashAliasedResources", false);
 	ConsoleVariable gRenderGraphPassCulling("r.RenderGraph.PassCulling", true);
 	ConsoleVariable gRenderGraphPassGroupSize("r.RenderGraph.PassGroupSize", 10);
+	ConsoleVariable gRenderGraphCostGuidedGrouping("r.RenderGraph.CostGuidedGrouping", true);
 	ConsoleVariable gRenderGraphSingleThread("r.RenderGraph.SingleThread", false);
+	ConsoleVariable gRenderGraphAsyncCompute("r.RenderGraph.AsyncCompute", false);
+	ConsoleVariable gRenderGraphAutoAsyncCompute("r.RenderGraph.AutoAsyncCompute", false);
+	ConsoleVariable gRenderGraphSplitBarriers("r.RenderGraph.SplitBarriers", true);
+	ConsoleVariable gRenderGraphEnhancedBarriers("r.RenderGraph.EnhancedBarriers", false);
+	ConsoleVariable gRenderGraphReorderPasses("r.RenderGraph.ReorderPasses", false);
 	ConsoleVariable gRenderGraphResourceTracker("r.RenderGraph.ResourceTracker", false);
 	ConsoleVariable gRenderGraphResourceAllocatorView("r.RenderGraph.ResourceAllocatorView", false);
 	ConsoleVariable gRenderGraphPassView("r.RenderGraph.PassView", false);
+	ConsoleVariable gRenderGraphCompileCache("r.RenderGraph.CompileCache", true);
 
 	bool gDumpRenderGraphNextFrame = false;
 	ConsoleCommand<> gDumpRenderGraph("DumpRenderGraph", []() { gDumpRenderGraphNextFrame = true; });
 
+	bool gRenderGraphCompileBenchmarkNextFrame = false;
+	ConsoleCommand<> gRenderGraphCompileBenchmark("RGCompileBenchmark", []() { gRenderGraphCompileBenchmarkNextFrame = true; });
+
 	String VisualizeTextureName = "";
 	ConsoleCommand<const char*> gVisualizeTexture("vis", [](const char* pName) { VisualizeTextureName = pName; });
 }
 
 
+static constexpr const char* sRenderPathNames[] =
+{
+	"Tiled",
+	"Clustered",
+	"Path Tracing",
+	"Visibility",
+	"Visibility Deferred",
+};
+static_assert(ARRAYSIZE(sRenderPathNames) == (int)RenderPath::MAX);
+
+
+// Measures the CPU cost of compiling the render graph of each raster render path, with and without the compile cache.
+// Every run renders a few frames first so history resources and resource states can settle.
+struct RenderGraphCompileBenchmark
+{
+	static constexpr uint32 NumWarmupFrames	  = 10;
+	static constexpr uint32 NumMeasuredFrames = 100;
+
+	struct Run
+	{
+		RenderPath	Path;
+		bool		UseCache;
+		float		TotalTime = 0.0f;
+		float		MaxTime	  = 0.0f;
+		uint32		NumHits	  = 0;
+	};
+
+	Array<Run>	Runs;
+	uint32		CurrentRun		   = 0;
+	uint32		Frame			   = 0;
+	RenderPath	RestoreRenderPath  = RenderPath::Visibility;
+
+	bool IsRunning() const { return CurrentRun < (uint32)Runs.size(); }
+
+	void Start(RenderPath currentPath, bool supportsMeshShading)
+	{
+		Runs.clear();
+		for (RenderPath path : { RenderPath::Clustered, RenderPath::Tiled, RenderPath::Visibility, RenderPath::VisibilityDeferred })
+		{
+			if ((path == RenderPath::Visibility || path == RenderPath::VisibilityDeferred) && !supportsMeshShading)
+				continue;
+			Runs.push_back({ path, false });
+			Runs.push_back({ path, true });
+		}
+		CurrentRun		  = 0;
+		Frame			  = 0;
+		RestoreRenderPath = currentPath;
+	}
+
+	// Returns true when the benchmark completed
+	bool AddFrame(float compileTime, bool cacheHit)
+	{
+		Run& run = Runs[CurrentRun];
+		if (Frame >= NumWarmupFrames)
+		{
+			run.TotalTime += compileTime;
+			run.MaxTime = Math::Max(run.MaxTime, compileTime);
+			run.NumHits += cacheHit ? 1 : 0;
+		}
+
+		if (++Frame < NumWarmupFrames + NumMeasuredFrames)
+			return false;
+
+		Frame = 0;
+		++CurrentRun;
+		if (IsRunning())
+			return false;
+
+		E_LOG(Info, "Render Graph compile benchmark (%d frames per run)", NumMeasuredFrames);
+		for (uint32 i = 0; i + 1 < (uint32)Runs.size(); i += 2)
+		{
+			const Run& uncached = Runs[i];
+			const Run& cached	= Runs[i + 1];
+			const float uncachedAvg = uncached.TotalTime / NumMeasuredFrames * 1000.0f;
+			const float cachedAvg	= cached.TotalTime / NumMeasuredFrames * 1000.0f;
+			E_LOG(Info, "\t%-20s No Cache: %.3f ms (max %.3f ms) - Cache: %.3f ms (max %.3f ms, %d/%d hits) - %.1fx",
+				sRenderPathNames[(int)uncached.Path],
+				uncachedAvg, uncached.MaxTime * 1000.0f,
+				cachedAvg, cached.MaxTime * 1000.0f, cached.NumHits, NumMeasuredFrames,
+				cachedAvg > 0.0f ? uncachedAvg / cachedAvg : 0.0f);
+		}
+		return true;
+	}
+};
+
+static RenderGraphCompileBenchmark sCompileBenchmark;
+
+
 Renderer::Renderer() = default;
 Renderer::~Renderer() = default;
 
@@ -265,6 +364,7 @@ void Renderer::InitializePipelines()
 
 	{
 		m_pSkinPSO = m_pDevice->CreateComputePipeline(GraphicsCommon::pCommonRS, "Skinning.hlsl", "CSMain");
+		m_pSceneScatterPSO = m_pDevice->CreateComputePipeline(GraphicsCommon::pCommonRS, "SceneScatterUpload.hlsl", "ScatterUploadCS");
 	}
 }
 
@@ -309,6 +409,14 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 			newRenderPath = RenderPath::Clustered;
 		m_RenderPath = newRenderPath;
 
+		if (Tweakables::gRenderGraphCompileBenchmarkNextFrame)
+		{
+			sCompileBenchmark.Start(m_RenderPath, m_pDevice->GetCapabilities().SupportsMeshShading());
+			Tweakables::gRenderGraphCompileBenchmarkNextFrame = false;
+		}
+		if (sCompileBenchmark.IsRunning())
+			m_RenderPath = sCompileBenchmark.Runs[sCompileBenchmark.CurrentRun].Path;
+
 		Tweakables::gRaytracedAO = m_pDevice->GetCapabilities().SupportsRaytracing() && Tweakables::gRaytracedAO;
 		Tweakables::gRaytracedReflections = m_pDevice->GetCapabilities().SupportsRaytracing() && Tweakables::gRaytracedReflections;
 
@@ -366,6 +474,9 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 			return (int)a.Type < (int)b.Type;
 			});
 
+		// The batches and the instance BVH are needed to select shadow casters, and by the sorting and culling below
+		UpdateInstances();
+
 		CreateShadowViews(m_MainView);
 	}
 	{
@@ -389,34 +500,28 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 				std::sort(m_Batches.begin(), m_Batches.end(), CompareSort);
 			}
 
+			// All views are culled in a single pass over the instance bounds
+			Array<CullFrustum> frustums;
+			Array<uint32*> visibilityMasks;
+			auto AddCullView = [&](RenderView& view)
+				{
+					view.VisibilityMask.SetAll();
+					frustums.push_back(CullFrustum(view));
+					visibilityMasks.push_back(view.VisibilityMask.GetData());
+				};
+
 			// In Visibility Buffer mode, culling is done on the GPU.
 			if (m_RenderPath != RenderPath::Visibility && m_RenderPath != RenderPath::VisibilityDeferred)
-			{
-				TaskQueue::Execute([&](int)
-					{
-						PROFILE_CPU_SCOPE("Frustum Cull Main");
-						m_MainView.VisibilityMask.SetAll();
-						BoundingFrustum frustum = pView->PerspectiveFrustum;
-						for (const Batch& b : m_Batches)
-						{
-							m_MainView.VisibilityMask.AssignBit(b.InstanceID, frustum.Contains(b.Bounds));
-						}
-					}, taskContext);
-			}
+				AddCullView(m_MainView);
 			if (!Tweakables::gShadowsGPUCull)
 			{
-				TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
-					{
-						PROFILE_CPU_SCOPE("Frustum Cull Shadows");
-						RenderView& shadowView = m_ShadowViews[args.JobIndex];
-						shadowView.VisibilityMask.SetAll();
-						for (const Batch& b : m_Batches)
-						{
-							shadowView.VisibilityMask.AssignBit(b.InstanceID, shadowView.IsInFrustum(b.Bounds));
-						}
-					}, taskContext, (uint32)m_ShadowViews.size(), 1);
+				for (ShadowView& shadowView : m_ShadowViews)
+					AddCullView(shadowView);
 			}
 
+			gAssert(m_BatchBounds.Count <= VisibilityMask::Size(), "%d instances don't fit in a visibility mask of %d bits", m_BatchBounds.Count, VisibilityMask::Size());
+			FrustumCulling::Cull(m_BatchBounds, frustums, visibilityMasks, taskContext);
+
 			TaskQueue::Join(taskContext);
 		}
 
@@ -432,7 +537,7 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 			UploadSceneData(*pContext);
 
 			// Build RTAS
-			m_AccelerationStructure.Build(*pContext, m_InstanceBuffer.pBuffer, m_Batches);
+			m_AccelerationStructure.Build(*pContext, m_InstanceBuffer.GetBuffer(), m_Batches);
 
 			// Upload PerView uniforms
 			Renderer::UploadViewUniforms(*pContext, m_MainView);
@@ -464,11 +569,12 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 					RWBufferView MeshData;
 				};
 				Array<SkinningUpdateInfo> skinDatas;
-				Array<Matrix> skinningTransforms;
 				Array<Mesh*> meshes;
+				Array<AnimationJob> animationJobs;
+				uint32 numSkinMatrices = 0;
 
 				auto view = m_pWorld->Registry.view<const Model>();
-				view.each([&](const Model& model)
+				view.each([&](entt::entity entity, const Model& model)
 					{
 						if (model.SkeletonIndex != -1)
 						{
@@ -476,7 +582,7 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 
 							Mesh& mesh = m_pWorld->Meshes[model.MeshIndex];
 							meshes.push_back(&mesh);
-							skinData.SkinMatrixOffset		= (uint32)skinningTransforms.size();
+							skinData.SkinMatrixOffset		= numSkinMatrices;
 							skinData.SkinnedPositionsOffset	= mesh.SkinnedPositionStreamLocation.OffsetFromStart;
 							skinData.SkinnedNormalsOffset	= mesh.SkinnedNormalStreamLocation.OffsetFromStart;
 							skinData.PositionsOffset		= mesh.PositionStreamLocation.OffsetFromStart;
@@ -492,56 +598,34 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 							float t = fmod(Time::TotalTime(), anim.TimeEnd - anim.TimeStart);
 							float time = t + anim.TimeStart;
 
-							Array<JointTransform> jointTransforms(skeleton.NumJoints());
-							for (const AnimationChannel& channel : anim.Channels)
-							{
-								JointTransform& jointTransform = jointTransforms[skeleton.GetJoint(channel.Target)];
-								if (channel.Path == AnimationChannel::PathType::Translation)
-									jointTransform.Translation = Vector3(channel.Evaluate(time));
-								else if (channel.Path == AnimationChannel::PathType::Rotation)
-									jointTransform.Rotation = channel.Evaluate(time);
-								else if (channel.Path == AnimationChannel::PathType::Scale)
-									jointTransform.Scale = Vector3(channel.Evaluate(time));
-							}
-
-							for (int i = 0; i < (int)skeleton.NumJoints(); ++i)
-							{
-								// Update joints in an order so that parent joints are always computed before any children
-								Skeleton::JointIndex jointIndex = skeleton.JointUpdateOrder[i];
-								Skeleton::JointIndex parentJointIndex = skeleton.ParentIndices[jointIndex];
-
-								if (parentJointIndex != Skeleton::InvalidJoint)
-								{
-									JointTransform& transform = jointTransforms[jointIndex];
-									const JointTransform& parentTransform = jointTransforms[parentJointIndex];
-
-									JointTransform newTransform;
-									newTransform.Translation	= parentTransform.Translation + Vector3::Transform(parentTransform.Scale * transform.Translation, parentTransform.Rotation);
-									newTransform.Rotation		= transform.Rotation * parentTransform.Rotation;
-									newTransform.Scale			= transform.Scale * parentTransform.Scale;
-
-									transform = newTransform;
-								}
-							}
-
-							// Compute final skin transforms
-							skinningTransforms.resize(skinningTransforms.size() + skeleton.NumJoints());
-							Matrix* pSkinMatrices = &skinningTransforms[skinData.SkinMatrixOffset];
-							for (int i = 0; i < (int)skeleton.NumJoints(); ++i)
-							{
-								const JointTransform& transform = jointTransforms[i];
-								Matrix jointMatrix = Matrix::CreateScale(transform.Scale) *
-														Matrix::CreateFromQuaternion(transform.Rotation) *
-														Matrix::CreateTranslation(transform.Translation);
-								pSkinMatrices[i] = skeleton.InverseBindMatrices[i] * jointMatrix;
-							}
+							// Keeps the keyframe cursors of the instance across frames
+							AnimationState& animationState = m_pWorld->Registry.get_or_emplace<AnimationState>(entity);
+							animationState.Bind(anim, skeleton);
+							animationJobs.push_back({ &animationState, time, numSkinMatrices });
+							numSkinMatrices += skeleton.NumJoints();
 						}
 					});
 
-				if (!skinningTransforms.empty())
+				if (numSkinMatrices > 0)
 				{
-					RGBuffer* pSkinningMatrices = graph.Create("Skinning Matrices", BufferDesc::CreateStructured((uint32)skinningTransforms.size(), sizeof(Matrix)));
-					RGUtils::DoUpload(graph, pSkinningMatrices, skinningTransforms.data(), (uint32)skinningTransforms.size() * sizeof(Matrix));
+					// The skin matrices and the poses are written straight into the memory of the graph
+					uint32 skinMatricesSize = numSkinMatrices * sizeof(Matrix);
+					Matrix* pSkinMatrices = (Matrix*)graph.Allocate(skinMatricesSize);
+					{
+						TaskContext animationContext;
+						SkeletalAnimation::Evaluate(animationJobs, pSkinMatrices, graph.GetAllocator(), animationContext);
+						TaskQueue::Join(animationContext);
+					}
+
+					RGBuffer* pSkinningMatrices = graph.Create("Skinning Matrices", BufferDesc::CreateStructured(numSkinMatrices, sizeof(Matrix)));
+					graph.AddPass("Upload Skinning Matrices", RGPassFlag::Copy)
+						.Write(pSkinningMatrices)
+						.Bind([=](CommandContext& context, const RGResources& resources)
+							{
+								ScratchAllocation alloc = context.AllocateScratch(skinMatricesSize);
+								memcpy(alloc.pMappedMemory, pSkinMatrices, skinMatricesSize);
+								context.CopyBuffer(alloc.pBackingResource, resources.Get(pSkinningMatrices), skinMatricesSize, alloc.Offset, 0);
+							});
 
 					graph.AddPass("GPU Skinning", RGPassFlag::Compute | RGPassFlag::NeverCull)
 						.Read(pSkinningMatrices)
@@ -589,7 +673,7 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 			{
 				if (needVisibilityBuffer)
 				{
-					RasterContext rasterContext(graph, sceneTextures.pDepth, RasterMode::VisibilityBuffer, &m_pHZB);
+					RasterContext rasterContext(graph, sceneTextures.pDepth, RasterMode::VisibilityBuffer, &m_HZBHistory);
 					rasterContext.EnableDebug = Tweakables::gVisibilityDebugMode > 0;
 					rasterContext.EnableOcclusionCulling = Tweakables::gOcclusionCulling;
 					rasterContext.WorkGraph = Tweakables::gWorkGraph;
@@ -601,21 +685,22 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 				{
 					graph.AddPass("Depth Prepass", RGPassFlag::Raster)
 						.DepthStencil(sceneTextures.pDepth, RenderPassDepthFlags::Clear)
-						.Bind([=](CommandContext& context, const RGResources& resources)
+						.BindParallel(8, [=](CommandContext& context, const RGResources& resources, uint32 partIndex, uint32 numParts)
 							{
 								context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 								context.SetGraphicsRootSignature(GraphicsCommon::pCommonRS);
 
+								Span<const Batch> batches = GetBatchesOfPart(pView->pRenderer->GetBatches(), partIndex, numParts);
 								Renderer::BindViewUniforms(context, *pView);
 								{
 									PROFILE_GPU_SCOPE(context.GetCommandList(), "Opaque");
 									context.SetPipelineState(m_pDepthPrepassOpaquePSO);
-									DrawScene(context, *pView, Batch::Blending::Opaque);
+									DrawScene(context, batches, pView->VisibilityMask, Batch::Blending::Opaque);
 								}
 								{
 									PROFILE_GPU_SCOPE(context.GetCommandList(), "Masked");
 									context.SetPipelineState(m_pDepthPrepassAlphaMaskPSO);
-									DrawScene(context, *pView, Batch::Blending::AlphaMask);
+									DrawScene(context, batches, pView->VisibilityMask, Batch::Blending::AlphaMask);
 								}
 							});
 				}
@@ -665,7 +750,7 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 						RGTexture* pShadowmap = graph.Import(m_ShadowViews[i].pDepthTexture);
 						if (Tweakables::gShadowsGPUCull)
 						{
-							RasterContext context(graph, pShadowmap, RasterMode::Shadows, &m_ShadowHZBs[i]);
+							RasterContext context(graph, pShadowmap, RasterMode::Shadows, &m_ShadowHZBHistories[i]);
 							context.EnableOcclusionCulling = Tweakables::gShadowsOcclusionCulling;
 							RasterResult result;
 							m_pMeshletRasterizer->Render(graph, &shadowView, context, result);
@@ -676,7 +761,7 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 						{
 							graph.AddPass("Raster", RGPassFlag::Raster)
 								.DepthStencil(pShadowmap, RenderPassDepthFlags::Clear)
-								.Bind([=](CommandContext& context, const RGResources& resources)
+								.BindParallel(8, [=](CommandContext& context, const RGResources& resources, uint32 partIndex, uint32 numParts)
 									{
 										context.SetGraphicsRootSignature(GraphicsCommon::pCommonRS);
 										context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -684,15 +769,16 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 										const ShadowView& view = m_ShadowViews[i];
 										Renderer::BindViewUniforms(context, view);
 
+										Span<const Batch> batches = GetBatchesOfPart(m_Batches, partIndex, numParts);
 										{
 											PROFILE_GPU_SCOPE(context.GetCommandList(), "Opaque");
 											context.SetPipelineState(m_pShadowsOpaquePSO);
-											DrawScene(context, m_Batches, view.VisibilityMask, Batch::Blending::Opaque);
+											DrawScene(context, batches, view.VisibilityMask, Batch::Blending::Opaque);
 										}
 										{
 											PROFILE_GPU_SCOPE(context.GetCommandList(), "Masked");
 											context.SetPipelineState(m_pShadowsAlphaMaskPSO);
-											DrawScene(context, m_Batches, view.VisibilityMask, Batch::Blending::AlphaMask | Batch::Blending::AlphaBlend);
+											DrawScene(context, batches, view.VisibilityMask, Batch::Blending::AlphaMask | Batch::Blending::AlphaBlend);
 										}
 									});
 						}
@@ -1184,9 +1270,12 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 				for (uint32 i = 0; i < numMips; ++i)
 				{
 					Vector2u targetDimensions(Math::Max(1u, bloomDimensions.x >> i), Math::Max(1u, bloomDimensions.y >> i));
-					graph.AddPass(Sprintf("Downsample %d [%dx%d > %dx%d]", i, targetDimensions.x << 1, targetDimensions.y << 1, targetDimensions.x, targetDimensions.y).c_str(), RGPassFlag::Compute)
-						.Read(i == 0 ? pSourceTexture : nullptr)
-						.Write(pDownscaleTarget)
+					RGPass& pass = graph.AddPass(Sprintf("Downsample %d [%dx%d > %dx%d]", i, targetDimensions.x << 1, targetDimensions.y << 1, targetDimensions.x, targetDimensions.y).c_str(), RGPassFlag::Compute);
+					if (i == 0)
+						pass.Read(pSourceTexture);
+					else
+						pass.Read(RGTextureSubresources::Mips(pDownscaleTarget, i - 1));
+					pass.Write(RGTextureSubresources::Mips(pDownscaleTarget, i))
 						.Bind([=](CommandContext& context, const RGResources& resources)
 							{
 								context.SetComputeRootSignature(GraphicsCommon::pCommonRS);
@@ -1200,7 +1289,7 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 								} params;
 								params.TargetDimensionsInv = Vector2(1.0f / targetDimensions.x, 1.0f / targetDimensions.y);
 								params.SourceMip		   = i == 0 ? 0 : i - 1;
-								params.Source = static_cast<Texture*>(resources.GetResourceUnsafe(pSourceTexture))->GetSRV();
+								params.Source = resources.GetSRV(pSourceTexture);
 								params.Target = resources.GetUAV(pDownscaleTarget, i);
 								context.BindRootSRV(BindingSlot::PerInstance, params);
 
@@ -1218,9 +1307,12 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 				for (int32 i = numMips - 2; i >= 0; --i)
 				{
 					Vector2u targetDimensions(Math::Max(1u, bloomDimensions.x >> i), Math::Max(1u, bloomDimensions.y >> i));
-					graph.AddPass(Sprintf("UpsampleCombine %d [%dx%d > %dx%d]", numMips - 2 - i, Math::Max(1u, targetDimensions.x >> 1), Math::Max(1u, targetDimensions.y >> 1), targetDimensions.x, targetDimensions.y).c_str(), RGPassFlag::Compute)
-						.Read(pDownscaleTarget)
-						.Write(pUpscaleTarget)
+					RGPass& pass = graph.AddPass(Sprintf("UpsampleCombine %d [%dx%d > %dx%d]", numMips - 2 - i, Math::Max(1u, targetDimensions.x >> 1), Math::Max(1u, targetDimensions.y >> 1), targetDimensions.x, targetDimensions.y).c_str(), RGPassFlag::Compute);
+					if (pPreviousSource == pDownscaleTarget)
+						pass.Read(RGTextureSubresources::Mips(pDownscaleTarget, i, 2));
+					else
+						pass.Read(RGTextureSubresources::Mips(pDownscaleTarget, i)).Read(RGTextureSubresources::Mips(pPreviousSource, i + 1));
+					pass.Write(RGTextureSubresources::Mips(pUpscaleTarget, i))
 						.Bind([=](CommandContext& context, const RGResources& resources)
 							{
 								context.SetComputeRootSignature(GraphicsCommon::pCommonRS);
@@ -1343,10 +1435,32 @@ void Renderer::Render(const Transform& cameraTransform, const Camera& camera, Te
 		graphOptions.PassCulling		   = Tweakables::gRenderGraphPassCulling;
 		graphOptions.TrashAliasedResources = Tweakables::gRenderGraphTrashAliasedResources;
 		graphOptions.CommandlistGroupSize  = Tweakables::gRenderGraphPassGroupSize;
+		graphOptions.CostGuidedGrouping	   = Tweakables::gRenderGraphCostGuidedGrouping;
+		graphOptions.NumRecordingJobs	   = 2 * TaskQueue::ThreadCount();
+		graphOptions.pPassCosts			   = &m_RenderGraphCosts;
 		graphOptions.SingleThread		   = Tweakables::gRenderGraphSingleThread;
+		graphOptions.AsyncCompute		   = Tweakables::gRenderGraphAsyncCompute;
+		graphOptions.AutoAsyncCompute	   = Tweakables::gRenderGraphAutoAsyncCompute;
+		graphOptions.SplitBarriers		   = Tweakables::gRenderGraphSplitBarriers;
+		graphOptions.EnhancedBarriers	   = Tweakables::gRenderGraphEnhancedBarriers;
+		graphOptions.ReorderPasses		   = Tweakables::gRenderGraphReorderPasses;
+
+		bool useCompileCache = Tweakables::gRenderGraphCompileCache;
+		if (sCompileBenchmark.IsRunning())
+			useCompileCache = sCompileBenchmark.Runs[sCompileBenchmark.CurrentRun].UseCache;
+		graphOptions.pCompileCache = useCompileCache ? &m_RenderGraphCache : nullptr;
 
 		// Compile graph
+		const uint32	 numCacheHits = m_RenderGraphCache.GetNumHits();
+		Utils::TimeScope compileTimer;
 		graph.Compile(graphOptions);
+		const float compileTime = compileTimer.Stop();
+
+		if (sCompileBenchmark.IsRunning())
+		{
+			if (sCompileBenchmark.AddFrame(compileTime, m_RenderGraphCache.GetNumHits() != numCacheHits))
+				m_RenderPath = sCompileBenchmark.RestoreRenderPath;
+		}
 
 		// Debug options
 		graph.DrawResourceTracker(Tweakables::gRenderGraphResourceTracker.Get());
@@ -1414,19 +1528,19 @@ void Renderer::GetViewUniforms(const RenderView& view, ShaderInterop::ViewUnifor
 
 	outUniforms.NumInstances			= (uint32)m_Batches.size();
 	outUniforms.SsrSamples				= Tweakables::gSSRSamples.Get();
-	outUniforms.LightCount				= m_LightBuffer.Count;
+	outUniforms.LightCount				= m_LightBuffer.GetCount();
 	outUniforms.CascadeDepths			= m_ShadowCascadeDepths;
 	outUniforms.NumCascades				= m_NumShadowCascades;
 
 	outUniforms.TLAS					= m_AccelerationStructure.GetSRV();
-	outUniforms.MeshesBuffer			= m_MeshBuffer.pBuffer->GetSRV();
-	outUniforms.MaterialsBuffer			= m_MaterialBuffer.pBuffer->GetSRV();
-	outUniforms.InstancesBuffer			= m_InstanceBuffer.pBuffer->GetSRV();
-	outUniforms.LightsBuffer			= m_LightBuffer.pBuffer->GetSRV();
-	outUniforms.LightMatricesBuffer		= m_LightMatricesBuffer.pBuffer->GetSRV();
+	outUniforms.MeshesBuffer			= m_MeshBuffer.GetBuffer()->GetSRV();
+	outUniforms.MaterialsBuffer			= m_MaterialBuffer.GetBuffer()->GetSRV();
+	outUniforms.InstancesBuffer			= m_InstanceBuffer.GetBuffer()->GetSRV();
+	outUniforms.LightsBuffer			= m_LightBuffer.GetBuffer()->GetSRV();
+	outUniforms.LightMatricesBuffer		= m_LightMatricesBuffer.GetBuffer()->GetSRV();
 	outUniforms.SkyTexture				= Tweakables::gSky ? m_pSky->GetSRV() : GraphicsCommon::GetDefaultTexture(DefaultTexture::BlackCube)->GetSRV();
-	outUniforms.DDGIVolumesBuffer		= m_DDGIVolumesBuffer.pBuffer->GetSRV();
-	outUniforms.NumDDGIVolumes			= m_DDGIVolumesBuffer.Count;
+	outUniforms.DDGIVolumesBuffer		= m_DDGIVolumesBuffer.GetBuffer()->GetSRV();
+	outUniforms.NumDDGIVolumes			= m_DDGIVolumesBuffer.GetCount();
 
 	outUniforms.FontData				= m_DebugRenderData.FontDataSRV;
 	outUniforms.DebugRenderData			= m_DebugRenderData.RenderDataUAV;
@@ -1462,185 +1576,204 @@ void Renderer::UploadViewUniforms(CommandContext& context, RenderView& view)
 }
 
 
-void Renderer::UploadSceneData(CommandContext& context)
+void Renderer::UpdateInstances()
 {
 	PROFILE_CPU_SCOPE();
-	PROFILE_GPU_SCOPE(context.GetCommandList());
 
 	const World* pWorld = m_pWorld;
 
-	GraphicsDevice* pDevice = context.GetParent();
-	auto CopyBufferData = [&](uint32 numElements, uint32 stride, const char* pName, const void* pSource, SceneBuffer& target)
+	// Rebuilt in place so the batches keep their allocation
+	m_Batches.clear();
+	uint32 instanceID = 0;
+
+	auto view = pWorld->Registry.view<Transform, Model>();
+	view.each([&](const Transform& transform, const Model& model)
 		{
-			uint32 desiredElements = Math::AlignUp(Math::Max(1u, numElements), 8u);
-			if (!target.pBuffer || desiredElements > target.pBuffer->GetNumElements())
-				target.pBuffer = pDevice->CreateBuffer(BufferDesc::CreateStructured(desiredElements, stride, BufferFlag::ShaderResource), pName);
-			ScratchAllocation alloc = context.AllocateScratch(numElements * stride);
-			memcpy(alloc.pMappedMemory, pSource, numElements * stride);
-			context.CopyBuffer(alloc.pBackingResource, target.pBuffer, alloc.Size, alloc.Offset, 0);
-			target.Count = numElements;
-		};
+			const Mesh& mesh = pWorld->Meshes[model.MeshIndex];
+			const Material& material = pWorld->Materials[model.MaterialId];
 
-	Array<Batch> sceneBatches;
-	uint32 instanceID = 0;
+			auto GetBlendMode = [](MaterialAlphaMode mode) {
+				switch (mode)
+				{
+				case MaterialAlphaMode::Blend: return Batch::Blending::AlphaBlend;
+				case MaterialAlphaMode::Opaque: return Batch::Blending::Opaque;
+				case MaterialAlphaMode::Masked: return Batch::Blending::AlphaMask;
+				}
+				return Batch::Blending::Opaque;
+				};
 
-	// Instances
-	{
-		Array<ShaderInterop::InstanceData> meshInstances;
-		meshInstances.reserve(pWorld->Registry.view<Model>().size());
+			Batch& batch = m_Batches.emplace_back();
+			batch.InstanceID = instanceID;
+			batch.pMesh = &mesh;
+			batch.pMaterial = &material;
+			batch.BlendMode = GetBlendMode(material.AlphaMode);
+			batch.WorldMatrix = transform.World;
+			batch.Radius = Vector3(batch.Bounds.Extents).Length();
+			mesh.Bounds.Transform(batch.Bounds, batch.WorldMatrix);
 
-		auto view = pWorld->Registry.view<Transform, Model>();
-		view.each([&](const Transform& transform, const Model& model)
-			{
-				const Mesh& mesh = pWorld->Meshes[model.MeshIndex];
-				const Material& material = pWorld->Materials[model.MaterialId];
+			m_InstanceBuffer.Update<ShaderInterop::InstanceData>(instanceID, [&](ShaderInterop::InstanceData& meshInstance)
+				{
+					meshInstance.ID = instanceID;
+					meshInstance.MeshIndex = model.MeshIndex;
+					meshInstance.MaterialIndex = model.MaterialId;
+					meshInstance.LocalToWorld = transform.World;
+					meshInstance.LocalToWorldPrev = transform.WorldPrev;
+					meshInstance.LocalBoundsOrigin = mesh.Bounds.Center;
+					meshInstance.LocalBoundsExtents = mesh.Bounds.Extents;
+				});
 
-				auto GetBlendMode = [](MaterialAlphaMode mode) {
-					switch (mode)
-					{
-					case MaterialAlphaMode::Blend: return Batch::Blending::AlphaBlend;
-					case MaterialAlphaMode::Opaque: return Batch::Blending::Opaque;
-					case MaterialAlphaMode::Masked: return Batch::Blending::AlphaMask;
-					}
-					return Batch::Blending::Opaque;
-					};
+			++instanceID;
+		});
 
-				Batch& batch = sceneBatches.emplace_back();
-				batch.InstanceID = instanceID;
-				batch.pMesh = &mesh;
-				batch.pMaterial = &material;
-				batch.BlendMode = GetBlendMode(material.AlphaMode);
-				batch.WorldMatrix = transform.World;
-				batch.Radius = Vector3(batch.Bounds.Extents).Length();
-				mesh.Bounds.Transform(batch.Bounds, batch.WorldMatrix);
-
-				ShaderInterop::InstanceData& meshInstance = meshInstances.emplace_back();
-				meshInstance.ID = instanceID;
-				meshInstance.MeshIndex = model.MeshIndex;
-				meshInstance.MaterialIndex = model.MaterialId;
-				meshInstance.LocalToWorld = transform.World;
-				meshInstance.LocalToWorldPrev = transform.WorldPrev;
-				meshInstance.LocalBoundsOrigin = mesh.Bounds.Center;
-				meshInstance.LocalBoundsExtents = mesh.Bounds.Extents;
-
-				++instanceID;
-			});
-		CopyBufferData((uint32)meshInstances.size(), sizeof(ShaderInterop::InstanceData), "Instances", meshInstances.data(), m_InstanceBuffer);
+	m_BatchBounds.Resize(instanceID);
+	m_InstanceBounds.resize(instanceID);
+	for (const Batch& batch : m_Batches)
+	{
+		m_BatchBounds.Set(batch.InstanceID, batch.Bounds);
+		m_InstanceBounds[batch.InstanceID] = batch.Bounds;
 	}
+	m_InstanceBVH.Update(m_InstanceBounds);
+}
+
+void Renderer::UploadSceneData(CommandContext& context)
+{
+	PROFILE_CPU_SCOPE();
+	PROFILE_GPU_SCOPE(context.GetCommandList());
+
+	const World* pWorld = m_pWorld;
+
+	// The buffers keep their contents across frames. Only the elements that changed since the previous frame are uploaded
+	auto UploadBuffer = [&](GPUSceneBuffer& buffer, uint32 numElements)
+		{
+			buffer.Resize(numElements);
+			buffer.Upload(context, m_pSceneScatterPSO);
+		};
+
+	// Instances, gathered by UpdateInstances()
+	UploadBuffer(m_InstanceBuffer, (uint32)m_Batches.size());
 
 	// Meshes
 	{
-		Array<ShaderInterop::MeshData> meshes;
-		meshes.reserve(pWorld->Meshes.size());
-		for (const Mesh& mesh : pWorld->Meshes)
+		for (uint32 i = 0; i < (uint32)pWorld->Meshes.size(); ++i)
 		{
-			ShaderInterop::MeshData& meshData = meshes.emplace_back();
-			meshData.DataBuffer = mesh.pBuffer->GetSRV();
-			meshData.IndexByteSize = mesh.IndicesLocation.Stride();
-			meshData.IndicesOffset = (uint32)mesh.IndicesLocation.OffsetFromStart;
-			meshData.PositionsOffset = mesh.SkinnedPositionStreamLocation.IsValid() ? (uint32)mesh.SkinnedPositionStreamLocation.OffsetFromStart : (uint32)mesh.PositionStreamLocation.OffsetFromStart;
-			meshData.NormalsOffset = mesh.SkinnedNormalStreamLocation.IsValid() ? (uint32)mesh.SkinnedNormalStreamLocation.OffsetFromStart : (uint32)mesh.NormalStreamLocation.OffsetFromStart;
-			meshData.ColorsOffset = (uint32)mesh.ColorsStreamLocation.OffsetFromStart;
-			meshData.UVsOffset = (uint32)mesh.UVStreamLocation.OffsetFromStart;
-
-			meshData.MeshletOffset = mesh.MeshletsLocation;
-			meshData.MeshletVertexOffset = mesh.MeshletVerticesLocation;
-			meshData.MeshletTriangleOffset = mesh.MeshletTrianglesLocation;
-			meshData.MeshletBoundsOffset = mesh.MeshletBoundsLocation;
-			meshData.MeshletCount = mesh.NumMeshlets;
+			const Mesh& mesh = pWorld->Meshes[i];
+			m_MeshBuffer.Update<ShaderInterop::MeshData>(i, [&](ShaderInterop::MeshData& meshData)
+				{
+					meshData.DataBuffer = mesh.pBuffer->GetSRV();
+					meshData.IndexByteSize = mesh.IndicesLocation.Stride();
+					meshData.IndicesOffset = (uint32)mesh.IndicesLocation.OffsetFromStart;
+					meshData.PositionsOffset = mesh.SkinnedPositionStreamLocation.IsValid() ? (uint32)mesh.SkinnedPositionStreamLocation.OffsetFromStart : (uint32)mesh.PositionStreamLocation.OffsetFromStart;
+					meshData.NormalsOffset = mesh.SkinnedNormalStreamLocation.IsValid() ? (uint32)mesh.SkinnedNormalStreamLocation.OffsetFromStart : (uint32)mesh.NormalStreamLocation.OffsetFromStart;
+					meshData.ColorsOffset = (uint32)mesh.ColorsStreamLocation.OffsetFromStart;
+					meshData.UVsOffset = (uint32)mesh.UVStreamLocation.OffsetFromStart;
+
+					meshData.MeshletOffset = mesh.MeshletsLocation;
+					meshData.MeshletVertexOffset = mesh.MeshletVerticesLocation;
+					meshData.MeshletTriangleOffset = mesh.MeshletTrianglesLocation;
+					meshData.MeshletBoundsOffset = mesh.MeshletBoundsLocation;
+					meshData.MeshletCount = mesh.NumMeshlets;
+				});
 		}
-		CopyBufferData((uint32)meshes.size(), sizeof(ShaderInterop::MeshData), "Meshes", meshes.data(), m_MeshBuffer);
+		UploadBuffer(m_MeshBuffer, (uint32)pWorld->Meshes.size());
 	}
 
 	// Materials
 	{
-		Array<ShaderInterop::MaterialData> materials;
-		materials.reserve(pWorld->Materials.size());
-		for (const Material& material : pWorld->Materials)
+		for (uint32 i = 0; i < (uint32)pWorld->Materials.size(); ++i)
 		{
-			ShaderInterop::MaterialData& materialData = materials.emplace_back();
-			materialData.Diffuse = material.pDiffuseTexture ? material.pDiffuseTexture->GetSRV() : TextureView::Invalid();
-			materialData.Normal = material.pNormalTexture ? material.pNormalTexture->GetSRV() : TextureView::Invalid();
-			materialData.RoughnessMetalness = material.pRoughnessMetalnessTexture ? material.pRoughnessMetalnessTexture->GetSRV() : TextureView::Invalid();
-			materialData.Emissive = material.pEmissiveTexture ? material.pEmissiveTexture->GetSRV() : TextureView::Invalid();
-			materialData.BaseColorFactor = material.BaseColorFactor;
-			materialData.MetalnessFactor = material.MetalnessFactor;
-			materialData.RoughnessFactor = material.RoughnessFactor;
-			materialData.EmissiveFactor = material.EmissiveFactor;
-			materialData.AlphaCutoff = material.AlphaCutoff;
-			switch (material.AlphaMode)
-			{
-			case MaterialAlphaMode::Blend:	materialData.RasterBin = 0xFFFFFFFF;	break;
-			case MaterialAlphaMode::Opaque: materialData.RasterBin = 0;				break;
-			case MaterialAlphaMode::Masked: materialData.RasterBin = 1;				break;
-			}
+			const Material& material = pWorld->Materials[i];
+			m_MaterialBuffer.Update<ShaderInterop::MaterialData>(i, [&](ShaderInterop::MaterialData& materialData)
+				{
+					materialData.Diffuse = material.pDiffuseTexture ? material.pDiffuseTexture->GetSRV() : TextureView::Invalid();
+					materialData.Normal = material.pNormalTexture ? material.pNormalTexture->GetSRV() : TextureView::Invalid();
+					materialData.RoughnessMetalness = material.pRoughnessMetalnessTexture ? material.pRoughnessMetalnessTexture->GetSRV() : TextureView::Invalid();
+					materialData.Emissive = material.pEmissiveTexture ? material.pEmissiveTexture->GetSRV() : TextureView::Invalid();
+					materialData.BaseColorFactor = material.BaseColorFactor;
+					materialData.MetalnessFactor = material.MetalnessFactor;
+					materialData.RoughnessFactor = material.RoughnessFactor;
+					materialData.EmissiveFactor = material.EmissiveFactor;
+					materialData.AlphaCutoff = material.AlphaCutoff;
+					switch (material.AlphaMode)
+					{
+					case MaterialAlphaMode::Blend:	materialData.RasterBin = 0xFFFFFFFF;	break;
+					case MaterialAlphaMode::Opaque: materialData.RasterBin = 0;				break;
+					case MaterialAlphaMode::Masked: materialData.RasterBin = 1;				break;
+					}
+				});
 		}
-		CopyBufferData((uint32)materials.size(), sizeof(ShaderInterop::MaterialData), "Materials", materials.data(), m_MaterialBuffer);
+		UploadBuffer(m_MaterialBuffer, (uint32)pWorld->Materials.size());
 	}
 
 	// DDGI
 	{
-		Array<ShaderInterop::DDGIVolume> ddgiVolumes;
+		uint32 numVolumes = 0;
 		if (Tweakables::gEnableDDGI)
 		{
 			auto ddgi_view = pWorld->Registry.view<Transform, DDGIVolume>();
 			ddgi_view.each([&](const Transform& transform, const DDGIVolume& volume)
 				{
-					ShaderInterop::DDGIVolume& ddgi = ddgiVolumes.emplace_back();
-					ddgi.BoundsMin = transform.Position - volume.Extents;
-					ddgi.ProbeSize = 2 * volume.Extents / (Vector3((float)volume.NumProbes.x, (float)volume.NumProbes.y, (float)volume.NumProbes.z) - Vector3::One);
-					ddgi.ProbeVolumeDimensions = Vector3u(volume.NumProbes.x, volume.NumProbes.y, volume.NumProbes.z);
-					ddgi.IrradianceTexture = volume.pIrradianceHistory ? volume.pIrradianceHistory->GetSRV() : TextureView::Invalid();
-					ddgi.DepthTexture = volume.pDepthHistory ? volume.pDepthHistory->GetSRV() : TextureView::Invalid();
-					ddgi.ProbeOffsetBuffer = volume.pProbeOffset ? volume.pProbeOffset->GetSRV() : BufferView::Invalid();
-					ddgi.ProbeStatesBuffer = volume.pProbeStates ? volume.pProbeStates->GetSRV() : BufferView::Invalid();
-					ddgi.NumRaysPerProbe = volume.NumRays;
-					ddgi.MaxRaysPerProbe = volume.MaxNumRays;
+					m_DDGIVolumesBuffer.Update<ShaderInterop::DDGIVolume>(numVolumes++, [&](ShaderInterop::DDGIVolume& ddgi)
+						{
+							ddgi.BoundsMin = transform.Position - volume.Extents;
+							ddgi.ProbeSize = 2 * volume.Extents / (Vector3((float)volume.NumProbes.x, (float)volume.NumProbes.y, (float)volume.NumProbes.z) - Vector3::One);
+							ddgi.ProbeVolumeDimensions = Vector3u(volume.NumProbes.x, volume.NumProbes.y, volume.NumProbes.z);
+							ddgi.IrradianceTexture = volume.pIrradianceHistory ? volume.pIrradianceHistory->GetSRV() : TextureView::Invalid();
+							ddgi.DepthTexture = volume.pDepthHistory ? volume.pDepthHistory->GetSRV() : TextureView::Invalid();
+							ddgi.ProbeOffsetBuffer = volume.pProbeOffset ? volume.pProbeOffset->GetSRV() : BufferView::Invalid();
+							ddgi.ProbeStatesBuffer = volume.pProbeStates ? volume.pProbeStates->GetSRV() : BufferView::Invalid();
+							ddgi.NumRaysPerProbe = volume.NumRays;
+							ddgi.MaxRaysPerProbe = volume.MaxNumRays;
+						});
 				});
 		}
-		CopyBufferData((uint32)ddgiVolumes.size(), sizeof(ShaderInterop::DDGIVolume), "DDGI Volumes", ddgiVolumes.data(), m_DDGIVolumesBuffer);
+		UploadBuffer(m_DDGIVolumesBuffer, numVolumes);
 	}
 	// Lights
 	{
-		Array<ShaderInterop::Light> lightData;
-		lightData.reserve(pWorld->Registry.view<Light>().size());
+		uint32 numLights = 0;
 		auto light_view = pWorld->Registry.view<const Transform, const Light>();
 		light_view.each([&](const Transform& transform, const Light& light)
 			{
-				ShaderInterop::Light& data = lightData.emplace_back();
-				data.Position = transform.Position;
-				data.Direction = Vector3::Transform(Vector3::Forward, transform.Rotation);
-				data.SpotlightAngles.x = cos(light.InnerConeAngle / 2.0f);
-				data.SpotlightAngles.y = cos(light.OuterConeAngle / 2.0f);
-				data.Color = Math::Pack_RGBA8_UNORM(light.Colour);
-				data.Intensity = light.Intensity;
-				data.Range = light.Range;
-				data.ShadowMap = light.CastShadows && light.ShadowMaps.size() ? light.ShadowMaps[0]->GetSRV() : TextureView::Invalid();
-				data.MaskTexture = light.pLightTexture ? light.pLightTexture->GetSRV() : TextureView::Invalid();
-				data.MatrixIndex = light.MatrixIndex;
-				data.InvShadowSize = 1.0f / light.ShadowMapSize;
-				data.IsEnabled = light.Intensity > 0 ? 1 : 0;
-				data.IsVolumetric = light.VolumetricLighting;
-				data.CastShadows = light.ShadowMaps.size() && light.CastShadows;
-				data.IsPoint = light.Type == LightType::Point;
-				data.IsSpot = light.Type == LightType::Spot;
-				data.IsDirectional = light.Type == LightType::Directional;
+				m_LightBuffer.Update<ShaderInterop::Light>(numLights++, [&](ShaderInterop::Light& data)
+					{
+						data.Position = transform.Position;
+						data.Direction = Vector3::Transform(Vector3::Forward, transform.Rotation);
+						data.SpotlightAngles.x = cos(light.InnerConeAngle / 2.0f);
+						data.SpotlightAngles.y = cos(light.OuterConeAngle / 2.0f);
+						data.Color = Math::Pack_RGBA8_UNORM(light.Colour);
+						data.Intensity = light.Intensity;
+						data.Range = light.Range;
+						data.ShadowMap = light.CastShadows && light.ShadowMaps.size() ? light.ShadowMaps[0]->GetSRV() : TextureView::Invalid();
+						data.MaskTexture = light.pLightTexture ? light.pLightTexture->GetSRV() : TextureView::Invalid();
+						data.MatrixIndex = light.MatrixIndex;
+						data.InvShadowSize = 1.0f / light.ShadowMapSize;
+						data.IsEnabled = light.Intensity > 0 ? 1 : 0;
+						data.IsVolumetric = light.VolumetricLighting;
+						data.CastShadows = light.ShadowMaps.size() && light.CastShadows;
+						data.IsPoint = light.Type == LightType::Point;
+						data.IsSpot = light.Type == LightType::Spot;
+						data.IsDirectional = light.Type == LightType::Directional;
+					});
 			});
-		CopyBufferData((uint32)lightData.size(), sizeof(ShaderInterop::Light), "Lights", lightData.data(), m_LightBuffer);
+		UploadBuffer(m_LightBuffer, numLights);
 	}
 
 	// Shadow Matrices
 	{
-		Array<Matrix> lightMatrices(m_ShadowViews.size());
 		for (uint32 i = 0; i < m_ShadowViews.size(); ++i)
-			lightMatrices[i] = m_ShadowViews[i].WorldToClip;
-		CopyBufferData((uint32)lightMatrices.size(), sizeof(Matrix), "Light Matrices", lightMatrices.data(), m_LightMatricesBuffer);
+			m_LightMatricesBuffer.Set(i, &m_ShadowViews[i].WorldToClip);
+		UploadBuffer(m_LightMatricesBuffer, (uint32)m_ShadowViews.size());
 	}
-
-	sceneBatches.swap(m_Batches);
 }
 
 
+Span<const Batch> Renderer::GetBatchesOfPart(Span<const Batch> batches, uint32 partIndex, uint32 numParts)
+{
+	uint32 first = (uint32)((uint64)batches.GetSize() * partIndex / numParts);
+	uint32 last	 = (uint32)((uint64)batches.GetSize() * (partIndex + 1) / numParts);
+	return batches.Subspan(first, last - first);
+}
+
 void Renderer::DrawScene(CommandContext& context, const RenderView& view, Batch::Blending blendModes)
 {
 	DrawScene(context, view.pRenderer->GetBatches(), view.VisibilityMask, blendModes);
@@ -1869,6 +2002,9 @@ void Renderer::CreateShadowViews(const RenderView& mainView)
 				BoundingBox box(transform.Position, Vector3(light.Range));
 				if (!viewTransform.PerspectiveFrustum.Contains(box))
 					return;
+				// Local lights without any instance in range have nothing to cast a shadow and don't need a shadow map
+				if (!m_InstanceBVH.AnyInSphere(BoundingSphere(transform.Position, light.Range)))
+					return;
 
 				const Matrix projection = Math::CreatePerspectiveMatrix(light.OuterConeAngle, 1.0f, light.Range, 0.01f);
 				const Matrix lightView = transform.World.Invert();
@@ -1885,6 +2021,8 @@ void Renderer::CreateShadowViews(const RenderView& mainView)
 				BoundingSphere sphere(transform.Position, light.Range);
 				if (!viewTransform.PerspectiveFrustum.Contains(sphere))
 					return;
+				if (!m_InstanceBVH.AnyInSphere(sphere))
+					return;
 
 				Matrix viewMatrices[] = {
 					Math::CreateLookToMatrix(transform.Position, Vector3::Right,	Vector3::Up),
@@ -1908,7 +2046,7 @@ void Renderer::CreateShadowViews(const RenderView& mainView)
 			}
 		});
 
-	m_ShadowHZBs.resize(shadowIndex);
+	m_ShadowHZBHistories.resize(shadowIndex);
 }
 
 
@@ -2022,15 +2160,7 @@ void Renderer::DrawImGui()
 	{
 		if (ImGui::CollapsingHeader("General"))
 		{
-			static constexpr const char* pPathNames[] =
-			{
-				"Tiled",
-				"Clustered",
-				"Path Tracing",
-				"Visibility",
-				"Visibility Deferred",
-			};
-			ImGui::Combo("Render Path", (int*)&m_RenderPath, pPathNames, ARRAYSIZE(pPathNames));
+			ImGui::Combo("Render Path", (int*)&m_RenderPath, sRenderPathNames, ARRAYSIZE(sRenderPathNames));
 
 			if (m_RenderPath == RenderPath::Visibility || m_RenderPath == RenderPath::VisibilityDeferred)
 			{
@@ -2073,6 +2203,15 @@ void Renderer::DrawImGui()
 			ImGui::Checkbox("Trash Aliased Resources", &Tweakables::gRenderGraphTrashAliasedResources.Get());
 			ImGui::Checkbox("Pass Culling", &Tweakables::gRenderGraphPassCulling.Get());
 			ImGui::SliderInt("Pass Group Size", &Tweakables::gRenderGraphPassGroupSize.Get(), 5, 50);
+			ImGui::Checkbox("Cost Guided Grouping", &Tweakables::gRenderGraphCostGuidedGrouping.Get());
+			ImGui::Checkbox("Async Compute", &Tweakables::gRenderGraphAsyncCompute.Get());
+			ImGui::Checkbox("Auto Async Compute", &Tweakables::gRenderGraphAutoAsyncCompute.Get());
+			ImGui::Checkbox("Split Barriers", &Tweakables::gRenderGraphSplitBarriers.Get());
+			ImGui::Checkbox("Enhanced Barriers", &Tweakables::gRenderGraphEnhancedBarriers.Get());
+			ImGui::Checkbox("Reorder Passes", &Tweakables::gRenderGraphReorderPasses.Get());
+			ImGui::Checkbox("Compile Cache", &Tweakables::gRenderGraphCompileCache.Get());
+			ImGui::SameLine();
+			ImGui::Text("(%d hits - %d misses)", m_RenderGraphCache.GetNumHits(), m_RenderGraphCache.GetNumMisses());
 		}
 
 		if (ImGui::CollapsingHeader("Atmosphere"))
@@ -8,6 +8,9 @@
 #include "Renderer/Techniques/ShaderDebugRenderer.h"
 #include "Renderer/Techniques/VolumetricFog.h"
 #include "Renderer/AccelerationStructure.h"
+#include "Renderer/GPUSceneBuffer.h"
+#include "Renderer/FrustumCulling.h"
+#include "Renderer/InstanceBVH.h"
 #include "RenderGraph/RenderGraphDefinitions.h"
 #include "RenderGraph/RenderGraph.h"
 
@@ -42,9 +45,11 @@ public:
 
 	static void DrawScene(CommandContext& context, const RenderView& view, Batch::Blending blendModes);
 	static void DrawScene(CommandContext& context, Span<const Batch> batches, const VisibilityMask& visibility, Batch::Blending blendModes);
+	// Range of batches drawn by one part of a pass bound with RGPass::BindParallel
+	static Span<const Batch> GetBatchesOfPart(Span<const Batch> batches, uint32 partIndex, uint32 numParts);
 	static void BindViewUniforms(CommandContext& context, const RenderView& view, RenderView::Type type = RenderView::Type::Default);
 
-	uint32 GetNumLights() const { return m_LightBuffer.Count; }
+	uint32 GetNumLights() const { return m_LightBuffer.GetCount(); }
 	uint32 GetFrameIndex() const { return m_Frame; }
 	Span<const Batch> GetBatches() const { return m_Batches; }
 	const RenderView& GetMainView() const { return m_MainView; }
@@ -66,6 +71,9 @@ private:
 	void GetViewUniforms(const RenderView& view, ShaderInterop::ViewUniforms& outUniforms);
 
 	void UploadViewUniforms(CommandContext& context, RenderView& view);
+
+	// Gathers the instances of the world into batches and updates their bounds and the instance BVH
+	void UpdateInstances();
 	void UploadSceneData(CommandContext& context);
 
 	void CreateShadowViews(const RenderView& mainView);
@@ -92,9 +100,12 @@ private:
 	CaptureTextureContext					m_CaptureTextureContext;
 
 	Ref<Texture>							m_pColorHistory;
-	Ref<Texture>							m_pHZB;
+	RGTextureHistory						m_HZBHistory;
 	Array<Ref<Texture>>						m_ShadowMaps;
-	Array<Ref<Texture>>						m_ShadowHZBs;
+	Array<RGTextureHistory>					m_ShadowHZBHistories;
+
+	RGCompileCache							m_RenderGraphCache;
+	RGPassCostHistory						m_RenderGraphCosts;
 
 	uint32									m_Frame			= 0;
 	RenderPath								m_RenderPath	= RenderPath::Visibility;
@@ -103,6 +114,9 @@ private:
 	GraphicsDevice*							m_pDevice		= nullptr;
 	World*									m_pWorld		= nullptr;
 	Array<Batch>							m_Batches;
+	CullBounds								m_BatchBounds;				///< World bounds of m_Batches, indexed by instance ID
+	Array<BoundingBox>						m_InstanceBounds;			///< Same bounds as m_BatchBounds, to update m_InstanceBVH with
+	InstanceBVH								m_InstanceBVH;				///< Spatial queries over the instances, like selecting shadow casters
 
 	struct SceneBuffer
 	{
@@ -111,13 +125,14 @@ private:
 	};
 
 	AccelerationStructure					m_AccelerationStructure;
-	SceneBuffer								m_LightBuffer;
-	SceneBuffer								m_MaterialBuffer;
-	SceneBuffer								m_MeshBuffer;
-	SceneBuffer								m_InstanceBuffer;
-	SceneBuffer								m_DDGIVolumesBuffer;
+	GPUSceneBuffer							m_LightBuffer{ "Lights", sizeof(ShaderInterop::Light) };
+	GPUSceneBuffer							m_MaterialBuffer{ "Materials", sizeof(ShaderInterop::MaterialData) };
+	GPUSceneBuffer							m_MeshBuffer{ "Meshes", sizeof(ShaderInterop::MeshData) };
+	GPUSceneBuffer							m_InstanceBuffer{ "Instances", sizeof(ShaderInterop::InstanceData) };
+	GPUSceneBuffer							m_DDGIVolumesBuffer{ "DDGI Volumes", sizeof(ShaderInterop::DDGIVolume) };
 	SceneBuffer								m_FogVolumesBuffer;
-	SceneBuffer								m_LightMatricesBuffer;
+	GPUSceneBuffer							m_LightMatricesBuffer{ "Light Matrices", sizeof(Matrix) };
+	Ref<PipelineState>						m_pSceneScatterPSO;
 	Ref<Texture>							m_pSky;
 	GPUDebugRenderData						m_DebugRenderData{};
 
@@ -0,0 +1,324 @@
+#include "stdafx.h"
+#include "SkeletalAnimation.h"
+#include "Core/TaskQueue.h"
+#include "Core/Profiler.h"
+#include "Core/Utils.h"
+#include "Renderer/Mesh.h"
+#include "RenderGraph/RenderGraph.h"
+
+#include <random>
+
+void AnimationState::Bind(const Animation& animation, const Skeleton& skeleton)
+{
+	if (pAnimation == &animation && pSkeleton == &skeleton)
+		return;
+
+	pAnimation = &animation;
+	pSkeleton  = &skeleton;
+	if (animation.IsCompressed())
+	{
+		const CompressedAnimation& compressed = animation.Compressed;
+		Channels.resize(compressed.Tracks.size());
+		for (uint32 i = 0; i < (uint32)compressed.Tracks.size(); ++i)
+		{
+			Channels[i].Joint	 = skeleton.GetJoint(compressed.Targets[i]);
+			Channels[i].KeyFrame = 0;
+		}
+	}
+	else
+	{
+		Channels.resize(animation.Channels.size());
+		for (uint32 i = 0; i < (uint32)animation.Channels.size(); ++i)
+		{
+			Channels[i].Joint	 = skeleton.GetJoint(animation.Channels[i].Target);
+			Channels[i].KeyFrame = 0;
+		}
+	}
+}
+
+// Shared with the reference path of the benchmark, so both compute exactly the same floats
+static void ToModelSpace(Vector3& translation, Quaternion& rotation, Vector3& scale, const Vector3& parentTranslation, const Quaternion& parentRotation, const Vector3& parentScale)
+{
+	translation = parentTranslation + Vector3::Transform(parentScale * translation, parentRotation);
+	rotation	= rotation * parentRotation;
+	scale		= scale * parentScale;
+}
+
+static Matrix GetSkinMatrix(const Matrix& inverseBindMatrix, const Vector3& translation, const Quaternion& rotation, const Vector3& scale)
+{
+	Matrix jointMatrix = Matrix::CreateScale(scale) *
+							Matrix::CreateFromQuaternion(rotation) *
+							Matrix::CreateTranslation(translation);
+	return inverseBindMatrix * jointMatrix;
+}
+
+// Pose of all jobs as a structure of arrays, indexed like the skin matrices
+struct PoseBuffers
+{
+	Vector3*	pTranslations;
+	Quaternion* pRotations;
+	Vector3*	pScales;
+};
+
+static void EvaluateJob(const AnimationJob& job, const PoseBuffers& pose, Matrix* pSkinMatrices)
+{
+	AnimationState&	 state	   = *job.pState;
+	const Animation& animation = *state.pAnimation;
+	const Skeleton&	 skeleton  = *state.pSkeleton;
+	uint32			 numJoints = skeleton.NumJoints();
+
+	Vector3*	pTranslations = pose.pTranslations + job.SkinMatrixOffset;
+	Quaternion* pRotations	  = pose.pRotations + job.SkinMatrixOffset;
+	Vector3*	pScales		  = pose.pScales + job.SkinMatrixOffset;
+
+	// Joints without a channel keep the default transform
+	const JointTransform defaultTransform{};
+	for (uint32 i = 0; i < numJoints; ++i)
+	{
+		pTranslations[i] = defaultTransform.Translation;
+		pRotations[i]	 = defaultTransform.Rotation;
+		pScales[i]		 = defaultTransform.Scale;
+	}
+
+	auto SetValue = [&](uint16 joint, AnimationChannel::PathType path, const Vector4& value)
+		{
+			if (path == AnimationChannel::PathType::Translation)
+				pTranslations[joint] = Vector3(value);
+			else if (path == AnimationChannel::PathType::Rotation)
+				pRotations[joint] = value;
+			else if (path == AnimationChannel::PathType::Scale)
+				pScales[joint] = Vector3(value);
+		};
+
+	for (uint32 i = 0; i < (uint32)state.Channels.size(); ++i)
+	{
+		AnimationState::Channel& channelState = state.Channels[i];
+		if (channelState.Joint == Skeleton::InvalidJoint)
+			continue;
+
+		if (animation.IsCompressed())
+		{
+			const CompressedAnimation::Track& track = animation.Compressed.Tracks[i];
+			SetValue(channelState.Joint, track.Path, animation.Compressed.Sample(track, job.Time, channelState.KeyFrame));
+		}
+		else
+		{
+			const AnimationChannel& channel = animation.Channels[i];
+			channelState.KeyFrame = channel.FindKeyFrame(job.Time, channelState.KeyFrame);
+			SetValue(channelState.Joint, channel.Path, channel.Evaluate(job.Time, channelState.KeyFrame));
+		}
+	}
+
+	// Parents are always updated before their children
+	for (Skeleton::JointIndex jointIndex : skeleton.JointUpdateOrder)
+	{
+		Skeleton::JointIndex parentIndex = skeleton.ParentIndices[jointIndex];
+		if (parentIndex != Skeleton::InvalidJoint)
+			ToModelSpace(pTranslations[jointIndex], pRotations[jointIndex], pScales[jointIndex], pTranslations[parentIndex], pRotations[parentIndex], pScales[parentIndex]);
+	}
+
+	Matrix* pJobSkinMatrices = pSkinMatrices + job.SkinMatrixOffset;
+	for (uint32 i = 0; i < numJoints; ++i)
+		pJobSkinMatrices[i] = GetSkinMatrix(skeleton.InverseBindMatrices[i], pTranslations[i], pRotations[i], pScales[i]);
+}
+
+void SkeletalAnimation::Evaluate(Span<const AnimationJob> jobs, Matrix* pSkinMatrices, RGGraphAllocator& allocator, TaskContext& context)
+{
+	PROFILE_CPU_SCOPE();
+
+	uint32 numJoints = 0;
+	for (const AnimationJob& job : jobs)
+		numJoints = Math::Max(numJoints, job.SkinMatrixOffset + job.pState->pSkeleton->NumJoints());
+	if (numJoints == 0)
+		return;
+
+	// The allocator is not thread safe, so the pose of all jobs is allocated before the tasks start
+	PoseBuffers pose;
+	pose.pTranslations = (Vector3*)allocator.Allocate(numJoints * sizeof(Vector3), alignof(Vector3));
+	pose.pRotations	   = (Quaternion*)allocator.Allocate(numJoints * sizeof(Quaternion), alignof(Quaternion));
+	pose.pScales	   = (Vector3*)allocator.Allocate(numJoints * sizeof(Vector3), alignof(Vector3));
+
+	// A character takes a few microseconds, so give each task a few of them
+	constexpr uint32 JobsPerTask = 4;
+	TaskQueue::ParallelFor([jobs, pose, pSkinMatrices](TaskDistributeArgs args)
+		{
+			EvaluateJob(jobs[args.JobIndex], pose, pSkinMatrices);
+		}, context, jobs.GetSize(), JobsPerTask);
+}
+
+// How the renderer sampled animations before: allocates the pose, looks up each channel's joint by name and searches all keyframes
+static void EvaluateReference(const Animation& animation, const Skeleton& skeleton, float time, Array<Matrix>& skinMatrices)
+{
+	Array<JointTransform> jointTransforms(skeleton.NumJoints());
+	for (const AnimationChannel& channel : animation.Channels)
+	{
+		JointTransform& jointTransform = jointTransforms[skeleton.GetJoint(channel.Target)];
+		if (channel.Path == AnimationChannel::PathType::Translation)
+			jointTransform.Translation = Vector3(channel.Evaluate(time));
+		else if (channel.Path == AnimationChannel::PathType::Rotation)
+			jointTransform.Rotation = channel.Evaluate(time);
+		else if (channel.Path == AnimationChannel::PathType::Scale)
+			jointTransform.Scale = Vector3(channel.Evaluate(time));
+	}
+
+	for (int i = 0; i < (int)skeleton.NumJoints(); ++i)
+	{
+		Skeleton::JointIndex jointIndex = skeleton.JointUpdateOrder[i];
+		Skeleton::JointIndex parentJointIndex = skeleton.ParentIndices[jointIndex];
+		if (parentJointIndex != Skeleton::InvalidJoint)
+		{
+			JointTransform& transform = jointTransforms[jointIndex];
+			const JointTransform& parentTransform = jointTransforms[parentJointIndex];
+			ToModelSpace(transform.Translation, transform.Rotation, transform.Scale, parentTransform.Translation, parentTransform.Rotation, parentTransform.Scale);
+		}
+	}
+
+	uint32 offset = (uint32)skinMatrices.size();
+	skinMatrices.resize(skinMatrices.size() + skeleton.NumJoints());
+	for (int i = 0; i < (int)skeleton.NumJoints(); ++i)
+	{
+		const JointTransform& transform = jointTransforms[i];
+		skinMatrices[offset + i] = GetSkinMatrix(skeleton.InverseBindMatrices[i], transform.Translation, transform.Rotation, transform.Scale);
+	}
+}
+
+// A humanoid-sized skeleton with joints stored in a random order, so the update order is not trivial
+static void CreateSkeleton(std::mt19937& random, uint32 numJoints, Skeleton& outSkeleton)
+{
+	std::uniform_real_distribution<float> offset(-0.3f, 0.3f);
+
+	Array<Skeleton::JointIndex> order(numJoints);
+	for (uint32 i = 0; i < numJoints; ++i)
+		order[i] = (Skeleton::JointIndex)i;
+	std::shuffle(order.begin(), order.end(), random);
+
+	outSkeleton.ParentIndices.resize(numJoints);
+	outSkeleton.InverseBindMatrices.resize(numJoints);
+	for (uint32 i = 0; i < numJoints; ++i)
+	{
+		Skeleton::JointIndex joint = order[i];
+		outSkeleton.ParentIndices[joint]	   = i == 0 ? Skeleton::InvalidJoint : order[random() % i];
+		outSkeleton.InverseBindMatrices[joint] = Matrix::CreateTranslation(offset(random), offset(random), offset(random));
+		outSkeleton.JointsMap[Sprintf("Joint %d", joint)] = joint;
+	}
+	outSkeleton.JointUpdateOrder = order;
+}
+
+// Translation, rotation and scale keys for every joint, like exported character animations, with each type of interpolation
+static void CreateAnimation(std::mt19937& random, const Skeleton& skeleton, float duration, Animation& outAnimation)
+{
+	constexpr float KeyFramesPerSecond = 30.0f;
+
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	uint32 numKeyFrames = (uint32)(duration * KeyFramesPerSecond) + 1;
+
+	auto AddChannel = [&](uint32 joint, AnimationChannel::PathType path, enum AnimationChannel::Interpolation interpolation)
+		{
+			AnimationChannel& channel = outAnimation.Channels.emplace_back();
+			channel.Target		  = Sprintf("Joint %d", joint);
+			channel.Path		  = path;
+			channel.Interpolation = interpolation;
+			for (uint32 key = 0; key < numKeyFrames; ++key)
+			{
+				channel.KeyFrames.push_back(duration * key / (numKeyFrames - 1));
+				for (uint32 i = 0; i < (interpolation == AnimationChannel::Interpolation::Cubic ? 3u : 1u); ++i)
+				{
+					Vector4 value(unit(random), unit(random), unit(random), unit(random));
+					if (path == AnimationChannel::PathType::Rotation)
+						value.Normalize();
+					else if (path == AnimationChannel::PathType::Scale)
+						value = Vector4(1.0f) + value * 0.1f;
+					channel.Data.push_back(value);
+				}
+			}
+		};
+
+	for (uint32 joint = 0; joint < skeleton.NumJoints(); ++joint)
+	{
+		AddChannel(joint, AnimationChannel::PathType::Translation, joint % 8 == 0 ? AnimationChannel::Interpolation::Cubic : AnimationChannel::Interpolation::Linear);
+		AddChannel(joint, AnimationChannel::PathType::Rotation, AnimationChannel::Interpolation::Linear);
+		AddChannel(joint, AnimationChannel::PathType::Scale, joint % 4 == 0 ? AnimationChannel::Interpolation::Step : AnimationChannel::Interpolation::Linear);
+	}
+	outAnimation.TimeStart = 0.0f;
+	outAnimation.TimeEnd   = duration;
+}
+
+bool SkeletalAnimation::RunBenchmark(uint32 numCharacters, uint32 seed)
+{
+	constexpr uint32 NumJoints		= 64;
+	constexpr uint32 NumAnimations	= 4;
+	constexpr uint32 NumFrames		= 240;
+	constexpr float	 FrameTime		= 1.0f / 60.0f;
+
+	std::mt19937						  random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	Skeleton skeleton;
+	CreateSkeleton(random, NumJoints, skeleton);
+	Array<Animation> animations(NumAnimations);
+	for (uint32 i = 0; i < NumAnimations; ++i)
+		CreateAnimation(random, skeleton, 1.0f + 2.0f * unit(random), animations[i]);
+
+	struct Character
+	{
+		const Animation* pAnimation;
+		float			 TimeOffset;
+		float			 PlaybackRate;
+		AnimationState	 State;
+	};
+	Array<Character> characters(numCharacters);
+	for (Character& character : characters)
+	{
+		character.pAnimation   = &animations[random() % NumAnimations];
+		character.TimeOffset   = 10.0f * unit(random);
+		character.PlaybackRate = 0.5f + unit(random);
+		character.State.Bind(*character.pAnimation, skeleton);
+	}
+
+	auto GetTime = [](const Character& character, uint32 frame)
+		{
+			const Animation& animation = *character.pAnimation;
+			float t = fmod(character.TimeOffset + frame * FrameTime * character.PlaybackRate, animation.TimeEnd - animation.TimeStart);
+			return t + animation.TimeStart;
+		};
+
+	float referenceTime = 0, runtimeTime = 0;
+	Array<Matrix>		referenceMatrices;
+	Array<Matrix>		skinMatrices(numCharacters * NumJoints);
+	Array<AnimationJob> jobs(numCharacters);
+	for (uint32 frame = 0; frame < NumFrames; ++frame)
+	{
+		{
+			Utils::TimeScope timer;
+			referenceMatrices.clear();
+			for (const Character& character : characters)
+				EvaluateReference(*character.pAnimation, skeleton, GetTime(character, frame), referenceMatrices);
+			referenceTime += timer.Stop();
+		}
+
+		{
+			Utils::TimeScope timer;
+			// Like the graph allocator of a frame, which gets its memory from the chunk pool
+			RGGraphAllocator allocator(64 * 1024);
+			for (uint32 i = 0; i < numCharacters; ++i)
+				jobs[i] = { &characters[i].State, GetTime(characters[i], frame), i * NumJoints };
+
+			TaskContext context;
+			Evaluate(jobs, skinMatrices.data(), allocator, context);
+			TaskQueue::Join(context);
+			runtimeTime += timer.Stop();
+		}
+
+		if (memcmp(referenceMatrices.data(), skinMatrices.data(), skinMatrices.size() * sizeof(Matrix)) != 0)
+		{
+			E_LOG(Warning, "SkeletalAnimation - Skin matrices differ from the reference in frame %d", frame);
+			return false;
+		}
+	}
+
+	E_LOG(Info, "SkeletalAnimation - %d characters, %d joints, %d channels, %d threads. Per frame:", numCharacters, NumJoints, (uint32)animations[0].Channels.size(), TaskQueue::ThreadCount());
+	E_LOG(Info, "\tPer character, searching all keyframes: %.3f ms", referenceTime * 1000.0f / NumFrames);
+	E_LOG(Info, "\tKeyframe cursors, on the task queue:    %.3f ms", runtimeTime * 1000.0f / NumFrames);
+	E_LOG(Info, "SkeletalAnimation - Skin matrices of all %d frames are identical", NumFrames);
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+struct Animation;
+struct Skeleton;
+class TaskContext;
+class RGGraphAllocator;
+
+// Playback state of an animated instance, kept as a component next to its Model.
+// The channel targets are resolved to joints once, and each channel remembers the keyframe it sampled last.
+// Playback moves forward a little every frame, so the next keyframe is found without searching all of them.
+struct AnimationState
+{
+	// Resolves the channels of 'animation' to the joints of 'skeleton'. Does nothing if the state is already bound to both.
+	void Bind(const Animation& animation, const Skeleton& skeleton);
+
+	struct Channel
+	{
+		uint16 Joint	= 0;	///< Skeleton::InvalidJoint if the skeleton has no joint for the channel's target
+		uint32 KeyFrame = 0;	///< Keyframe found for the last sampled time
+	};
+
+	const Animation*	pAnimation = nullptr;
+	const Skeleton*		pSkeleton  = nullptr;
+	Array<Channel>		Channels;
+};
+
+struct AnimationJob
+{
+	AnimationState* pState;
+	float			Time;
+	uint32			SkinMatrixOffset;	///< Skin matrix of the first joint. The other joints of the skeleton follow it.
+};
+
+namespace SkeletalAnimation
+{
+	// Samples the animation of each job and writes the skin matrices of its skeleton to 'pSkinMatrices'.
+	// The pose buffers are allocated from 'allocator'. The jobs are split over the task queue and are complete once 'context' is joined.
+	// 'jobs' and the states they point to must stay alive until then. Each state may only be used by one job.
+	void Evaluate(Span<const AnimationJob> jobs, Matrix* pSkinMatrices, RGGraphAllocator& allocator, TaskContext& context);
+
+	// Animates 'numCharacters' characters for a number of frames and compares Evaluate() with sampling every character on its own,
+	// the way the renderer used to. Returns false if the skin matrices are not identical.
+	bool RunBenchmark(uint32 numCharacters, uint32 seed);
+}
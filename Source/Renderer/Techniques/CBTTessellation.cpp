@@ -162,7 +162,7 @@ void CBTTessellation::RasterMain(RGGraph& graph, const RenderView* pView, const
 		{
 			uint32 size = CBT::ComputeSize(CBTSettings::CBTDepth);
 			bool isNew = false;
-			RGBuffer* pCBTBuffer = RGUtils::CreatePersistent(graph, "CBT", BufferDesc::CreateByteAddress(size, BufferFlag::ShaderResource | BufferFlag::UnorderedAccess), &cbtData.pCBTBuffer, &isNew);
+			RGBuffer* pCBTBuffer = graph.CreateHistory(cbtData.CBTHistory, "CBT", BufferDesc::CreateByteAddress(size, BufferFlag::ShaderResource | BufferFlag::UnorderedAccess), &isNew);
 			if (isNew)
 			{
 				graph.AddPass("CBT Upload", RGPassFlag::Copy)
@@ -191,9 +191,11 @@ void CBTTessellation::RasterMain(RGGraph& graph, const RenderView* pView, const
 			commonArgs.Depth = CBTSettings::CBTDepth;
 			commonArgs.NumCBTElements = (uint32)pCBTBuffer->GetDesc().Size / sizeof(uint32);
 
-			RGBuffer* pIndirectArgs = RGUtils::CreatePersistent(graph, "CBT.IndirectArgs", BufferDesc::CreateIndirectArguments<IndirectDrawArgs>(1, BufferFlag::UnorderedAccess), &cbtData.pCBTIndirectArgs);
+			bool isNewArgs = false;
+			RGBuffer* pIndirectArgs = graph.CreateHistory(cbtData.IndirectArgsHistory, "CBT.IndirectArgs", BufferDesc::CreateIndirectArguments<IndirectDrawArgs>(1, BufferFlag::UnorderedAccess), &isNewArgs);
 
-			if (!CBTSettings::MeshShader)
+			// The update dispatches with the arguments written at the end of the previous frame. New arguments aren't written yet.
+			if (!CBTSettings::MeshShader && !isNewArgs)
 			{
 				graph.AddPass("CBT Update", RGPassFlag::Compute)
 					.Write({ pCBTBuffer })
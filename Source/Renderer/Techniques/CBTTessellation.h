@@ -10,8 +10,9 @@ struct CBTData
 	uint32 SplitMode = 0;
 	RGBuffer* pCBT = nullptr;
 
-	Ref<Buffer> pCBTBuffer;
-	Ref<Buffer> pCBTIndirectArgs;
+	// Both are updated in place every frame
+	RGBufferHistory CBTHistory{ 1 };
+	RGBufferHistory IndirectArgsHistory{ 1 };
 	Ref<Texture> pDebugVisualizeTexture;
 };
 
@@ -114,7 +114,7 @@ void LightCulling::ComputeClusteredLightCulling(RGGraph& graph, const RenderView
 				context.CopyBuffer(allocation.pBackingResource, resources.Get(pPrecomputeData), precomputedLightDataSize, allocation.Offset, 0);
 			});
 
-	graph.AddPass("Cull Lights", RGPassFlag::Compute)
+	graph.AddPass("Cull Lights", RGPassFlag::Compute | RGPassFlag::AsyncCompute)
 		.Read(pPrecomputeData)
 		.Write({ cullData.pLightGrid })
 		.Bind([=](CommandContext& context, const RGResources& resources)
@@ -210,7 +210,7 @@ void LightCulling::ComputeTiledLightCulling(RGGraph& graph, const RenderView* pV
 				context.CopyBuffer(allocation.pBackingResource, resources.Get(pPrecomputeData), precomputedLightDataSize, allocation.Offset, 0);
 			});
 
-	graph.AddPass("2D Light Culling", RGPassFlag::Compute)
+	graph.AddPass("2D Light Culling", RGPassFlag::Compute | RGPassFlag::AsyncCompute)
 		.Read({ sceneTextures.pDepth, pPrecomputeData })
 		.Write({ cullResources.pLightListOpaque, cullResources.pLightListTransparent })
 		.Bind([=](CommandContext& context, const RGResources& resources)
@@ -207,8 +207,8 @@ MeshletRasterizer::MeshletRasterizer(GraphicsDevice* pDevice)
 	}
 }
 
-RasterContext::RasterContext(RGGraph& graph, RGTexture* pDepth, RasterMode mode, Ref<Texture>* pPreviousHZB)
-	: Mode(mode), pDepth(pDepth), pPreviousHZB(pPreviousHZB)
+RasterContext::RasterContext(RGGraph& graph, RGTexture* pDepth, RasterMode mode, RGTextureHistory* pHZBHistory)
+	: Mode(mode), pDepth(pDepth), pHZBHistory(pHZBHistory)
 {
 	/// Must be kept in sync with shader! See "VisibilityBuffer.hlsli"
 	struct MeshletCandidate
@@ -238,7 +238,7 @@ void MeshletRasterizer::CullAndRasterize(RGGraph& graph, const RenderView* pView
 	if (rasterContext.EnableOcclusionCulling)
 	{
 		if (rasterPhase == RasterPhase::Phase1)
-			pSourceHZB = graph.TryImport(*rasterContext.pPreviousHZB, GraphicsCommon::GetDefaultTexture(DefaultTexture::Black2D));
+			pSourceHZB = graph.TryImportHistory(*rasterContext.pHZBHistory, GraphicsCommon::GetDefaultTexture(DefaultTexture::Black2D));
 		else
 			pSourceHZB = outResult.pHZB;
 	}
@@ -685,7 +685,7 @@ void MeshletRasterizer::CullAndRasterize(RGGraph& graph, const RenderView* pView
 
 void MeshletRasterizer::Render(RGGraph& graph, const RenderView* pView, RasterContext& rasterContext, RasterResult& outResult)
 {
-	gAssert(!rasterContext.EnableOcclusionCulling || rasterContext.pPreviousHZB, "Occlusion Culling required previous frame's HZB");
+	gAssert(!rasterContext.EnableOcclusionCulling || rasterContext.pHZBHistory, "Occlusion Culling required previous frame's HZB");
 
 	RG_GRAPH_SCOPE("Cull and Rasterize", graph);
 
@@ -706,8 +706,7 @@ void MeshletRasterizer::Render(RGGraph& graph, const RenderView* pView, RasterCo
 
 	if (rasterContext.EnableOcclusionCulling)
 	{
-		outResult.pHZB = InitHZB(graph, dimensions);
-		graph.Export(outResult.pHZB, rasterContext.pPreviousHZB, TextureFlag::ShaderResource);
+		outResult.pHZB = InitHZB(graph, dimensions, *rasterContext.pHZBHistory);
 	}
 
 	// Debug mode outputs an extra debug buffer containing information for debug statistics/visualization
@@ -825,14 +824,14 @@ void MeshletRasterizer::RenderVisibilityDebug(RGGraph& graph, const RenderView*
 		});
 }
 
-RGTexture* MeshletRasterizer::InitHZB(RGGraph& graph, const Vector2u& viewDimensions) const
+RGTexture* MeshletRasterizer::InitHZB(RGGraph& graph, const Vector2u& viewDimensions, RGTextureHistory& history) const
 {
 	Vector2u hzbDimensions;
 	hzbDimensions.x = Math::Max(Math::NextPowerOfTwo(viewDimensions.x) >> 1u, 1u);
 	hzbDimensions.y = Math::Max(Math::NextPowerOfTwo(viewDimensions.y) >> 1u, 1u);
 	uint32 numMips = (uint32)Math::Floor(log2f((float)Math::Max(hzbDimensions.x, hzbDimensions.y)));
-	TextureDesc desc = TextureDesc::Create2D(hzbDimensions.x, hzbDimensions.y, ResourceFormat::R16_FLOAT, numMips);
-	return graph.Create("HZB", desc);
+	TextureDesc desc = TextureDesc::Create2D(hzbDimensions.x, hzbDimensions.y, ResourceFormat::R16_FLOAT, numMips, TextureFlag::ShaderResource);
+	return graph.CreateHistory(history, "HZB", desc);
 }
 
 void MeshletRasterizer::BuildHZB(RGGraph& graph, RGTexture* pDepth, RGTexture* pHZB)
@@ -841,7 +840,7 @@ void MeshletRasterizer::BuildHZB(RGGraph& graph, RGTexture* pDepth, RGTexture* p
 
 	const Vector2u hzbDimensions = pHZB->GetDesc().Size2D();
 
-	graph.AddPass("HZB Create", RGPassFlag::Compute)
+	graph.AddPass("HZB Create", RGPassFlag::Compute | RGPassFlag::AsyncCompute)
 		.Read(pDepth)
 		.Write(pHZB)
 		.Bind([=](CommandContext& context, const RGResources& resources)
@@ -865,7 +864,7 @@ void MeshletRasterizer::BuildHZB(RGGraph& graph, RGTexture* pDepth, RGTexture* p
 
 	RGBuffer* pSPDCounter = graph.Create("SPD.Counter", BufferDesc::CreateTyped(1, ResourceFormat::R32_UINT));
 
-	graph.AddPass("HZB Mips", RGPassFlag::Compute)
+	graph.AddPass("HZB Mips", RGPassFlag::Compute | RGPassFlag::AsyncCompute)
 		.Write({ pHZB, pSPDCounter })
 		.Bind([=](CommandContext& context, const RGResources& resources)
 			{
@@ -12,10 +12,10 @@ enum class RasterMode
 
 struct RasterContext
 {
-	RasterContext(RGGraph& graph, RGTexture* pDepth, RasterMode mode, Ref<Texture>* pPreviousHZB);
+	RasterContext(RGGraph& graph, RGTexture* pDepth, RasterMode mode, RGTextureHistory* pHZBHistory);
 
 	RGTexture* pDepth = nullptr;
-	Ref<Texture>* pPreviousHZB = nullptr;
+	RGTextureHistory* pHZBHistory = nullptr;
 	bool EnableDebug = false;
 	bool EnableOcclusionCulling = false;
 	bool WorkGraph = false;
@@ -61,7 +61,7 @@ private:
 	};
 	using PipelineStateBinSet = StaticArray<Ref<PipelineState>, (int)PipelineBin::Count>;
 
-	RGTexture* InitHZB(RGGraph& graph, const Vector2u& viewDimensions) const;
+	RGTexture* InitHZB(RGGraph& graph, const Vector2u& viewDimensions, RGTextureHistory& history) const;
 	void BuildHZB(RGGraph& graph, RGTexture* pDepth, RGTexture* pHZB);
 
 	void CullAndRasterize(RGGraph& graph, const RenderView* pView, RasterPhase rasterPhase, RasterContext& context, RasterResult& outResult);
@@ -85,8 +85,8 @@ RGTexture* RTAO::Execute(RGGraph& graph, const RenderView* pView, RGTexture* pDe
 				context.DispatchRays(bindingTable, pTarget->GetWidth(), pTarget->GetHeight());
 			});
 
-	RGTexture* pDenoiseTarget = graph.Create("RTAO.DenoiseTarget", aoDesc);
-	RGTexture* pAOHistory = graph.TryImport(m_pHistory, GraphicsCommon::GetDefaultTexture(DefaultTexture::Black2D));
+	RGTexture* pAOHistory = graph.TryImportHistory(m_History, GraphicsCommon::GetDefaultTexture(DefaultTexture::Black2D));
+	RGTexture* pDenoiseTarget = graph.CreateHistory(m_History, "RTAO.DenoiseTarget", aoDesc);
 
 	graph.AddPass("Denoise", RGPassFlag::Compute)
 		.Read({ pRayTraceTarget, pVelocity, pDepth, pAOHistory })
@@ -117,8 +117,6 @@ RGTexture* RTAO::Execute(RGGraph& graph, const RenderView* pView, RGTexture* pDe
 				context.Dispatch(ComputeUtils::GetNumThreadGroups(pTarget->GetWidth(), 8, pTarget->GetHeight(), 8));
 			});
 
-	graph.Export(pDenoiseTarget, &m_pHistory, TextureFlag::ShaderResource);
-
 	RGTexture* pBlurTarget1 = graph.Create("RTAO.BlurTarget", aoDesc);
 
 	graph.AddPass("Blur AO - Horizontal", RGPassFlag::Compute)
@@ -14,7 +14,7 @@ public:
 	RGTexture* Execute(RGGraph& graph, const RenderView* pView, RGTexture* pDepth, RGTexture* pVelocity);
 
 private:
-	Ref<Texture> m_pHistory;
+	RGTextureHistory m_History;
 
 	Ref<StateObject> m_pTraceRaysSO;
 	Ref<PipelineState> m_pDenoisePSO;
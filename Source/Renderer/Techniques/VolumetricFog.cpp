@@ -53,15 +53,14 @@ RGTexture* VolumetricFog::RenderFog(RGGraph& graph, const RenderView* pView, con
 		gVolumetricNumZSlices,
 		ResourceFormat::RGBA16_FLOAT);
 
-	RGTexture* pSourceVolume = graph.TryImport(fogData.pFogHistory, GraphicsCommon::GetDefaultTexture(DefaultTexture::Black3D));
-	RGTexture* pTargetVolume = graph.Create("Fog Target", volumeDesc);
-	graph.Export(pTargetVolume, &fogData.pFogHistory);
+	RGTexture* pSourceVolume = graph.TryImportHistory(fogData.FogHistory, GraphicsCommon::GetDefaultTexture(DefaultTexture::Black3D));
+	RGTexture* pTargetVolume = graph.CreateHistory(fogData.FogHistory, "Fog Target", volumeDesc);
 
 
 	RGBuffer* pFogVolumes = graph.Create("Fog Volumes", BufferDesc::CreateStructured((uint32)volumes.size(), sizeof(ShaderInterop::FogVolume)));
 	RGUtils::DoUpload(graph, pFogVolumes, volumes.data(), (uint32)volumes.size() * sizeof(ShaderInterop::FogVolume));
 
-	graph.AddPass("Inject Volume Lights", RGPassFlag::Compute)
+	graph.AddPass("Inject Volume Lights", RGPassFlag::Compute | RGPassFlag::AsyncCompute)
 		.Read({ pSourceVolume, lightCullData.pLightGrid, pFogVolumes })
 		.Write(pTargetVolume)
 		.Bind([=](CommandContext& context, const RGResources& resources)
@@ -115,7 +114,7 @@ RGTexture* VolumetricFog::RenderFog(RGGraph& graph, const RenderView* pView, con
 
 	RGTexture* pFinalVolumeFog = graph.Create("Volumetric Fog", volumeDesc);
 
-	graph.AddPass("Accumulate Volume Fog", RGPassFlag::Compute)
+	graph.AddPass("Accumulate Volume Fog", RGPassFlag::Compute | RGPassFlag::AsyncCompute)
 		.Read({ pTargetVolume })
 		.Write(pFinalVolumeFog)
 		.Bind([=](CommandContext& context, const RGResources& resources)
@@ -8,7 +8,7 @@ struct LightCull3DData;
 
 struct VolumetricFogData
 {
-	Ref<Texture> pFogHistory;
+	RGTextureHistory FogHistory;
 };
 
 struct FogVolume
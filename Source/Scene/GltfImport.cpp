@@ -0,0 +1,341 @@
+#include "stdafx.h"
+#include "GltfImport.h"
+#include "MeshCache.h"
+#include "Core/AsyncIO.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
+#include "Core/Stream.h"
+#include "Core/TaskQueue.h"
+#include "Core/Utils.h"
+#include "Renderer/AnimationCompression.h"
+
+#include <cgltf.h>
+
+namespace GltfImport
+{
+	// Collects the timings of a stage while its jobs run concurrently
+	struct StageCounters
+	{
+		void AddJob(float jobTime, float endTime)
+		{
+			++NumJobs;
+			JobTimeUs += (uint64)(jobTime * 1'000'000.0f);
+			uint64 endTimeUs = (uint64)(endTime * 1'000'000.0f);
+			uint64 current = EndTimeUs.load();
+			while (current < endTimeUs && !EndTimeUs.compare_exchange_weak(current, endTimeUs)) {}
+		}
+
+		GltfImportStage Resolve() const
+		{
+			GltfImportStage stage;
+			stage.NumJobs = NumJobs;
+			stage.JobTime = JobTimeUs / 1'000'000.0f;
+			stage.EndTime = EndTimeUs / 1'000'000.0f;
+			return stage;
+		}
+
+		std::atomic<uint32> NumJobs		= 0;
+		std::atomic<uint64> JobTimeUs	= 0;
+		std::atomic<uint64> EndTimeUs	= 0;
+	};
+
+	static void UnpackAnimation(const cgltf_animation& gltfAnimation, Animation& animation)
+	{
+		PROFILE_CPU_SCOPE();
+
+		animation.Name = gltfAnimation.name ? gltfAnimation.name : "Unnamed";
+		for (const cgltf_animation_channel& gltfChannel : Span(gltfAnimation.channels, (uint32)gltfAnimation.channels_count))
+		{
+			AnimationChannel& channel = animation.Channels.emplace_back();
+
+			channel.Target = gltfChannel.target_node->name;
+
+			// Animation type
+			switch (gltfChannel.target_path)
+			{
+			case cgltf_animation_path_type_translation:		channel.Path = AnimationChannel::PathType::Translation; break;
+			case cgltf_animation_path_type_rotation:		channel.Path = AnimationChannel::PathType::Rotation; break;
+			case cgltf_animation_path_type_scale:			channel.Path = AnimationChannel::PathType::Scale; break;
+			default: gUnreachable();
+			}
+
+			// Sampler
+			const cgltf_animation_sampler& gltfSampler = *gltfChannel.sampler;
+			switch (gltfSampler.interpolation)
+			{
+			case cgltf_interpolation_type_step:				channel.Interpolation = AnimationChannel::Interpolation::Step; break;
+			case cgltf_interpolation_type_linear:			channel.Interpolation = AnimationChannel::Interpolation::Linear; break;
+			case cgltf_interpolation_type_cubic_spline:		channel.Interpolation = AnimationChannel::Interpolation::Cubic; break;
+			default: gUnreachable();
+			}
+
+			// Read time keys
+			channel.KeyFrames.resize(gltfSampler.input->count);
+			gAssert(cgltf_num_components(gltfSampler.input->type) == 1);
+			gVerify(cgltf_accessor_unpack_floats(gltfSampler.input, &channel.KeyFrames[0], gltfSampler.input->count), > 0);
+
+			// Read key data
+			channel.Data.resize(gltfSampler.output->count);
+			int num_components = (int)cgltf_num_components(gltfSampler.output->type);
+			gAssert(num_components <= 4);
+			for (int i = 0; i < gltfSampler.output->count; ++i)
+			{
+				gVerify(cgltf_accessor_read_float(gltfSampler.output, i, &channel.Data[i].x, num_components), == 1);
+			}
+
+			// Track min/max time of animation
+			animation.TimeStart = Math::Min(animation.TimeStart, channel.KeyFrames.front());
+			animation.TimeEnd = Math::Max(animation.TimeEnd, channel.KeyFrames.back());
+		}
+	}
+
+	static void BuildSkeleton(const cgltf_skin& gltfSkin, Skeleton& skeleton)
+	{
+		PROFILE_CPU_SCOPE();
+
+		// Load inverse bind matrices
+		skeleton.InverseBindMatrices.resize(gltfSkin.joints_count);
+		gAssert(cgltf_num_components(gltfSkin.inverse_bind_matrices->type) == 16);
+		gVerify(cgltf_accessor_unpack_floats(gltfSkin.inverse_bind_matrices, &skeleton.InverseBindMatrices[0].m[0][0], gltfSkin.joints_count * 16), > 0);
+
+		// Joint name to index mapping
+		for (int i = 0; i < gltfSkin.joints_count; ++i)
+		{
+			Skeleton::JointIndex joint = (Skeleton::JointIndex)i;
+			skeleton.JointsMap[gltfSkin.joints[i]->name] = joint;
+		}
+
+		// Compute parent index of each joint
+		Skeleton::JointIndex rootJoint = Skeleton::InvalidJoint;
+		Array<Array<Skeleton::JointIndex>> parentToChildMap(gltfSkin.joints_count);
+		skeleton.ParentIndices.resize(gltfSkin.joints_count);
+		for (Skeleton::JointIndex i = 0; i < (Skeleton::JointIndex)gltfSkin.joints_count; ++i)
+		{
+			if (gltfSkin.joints[i] != gltfSkin.skeleton)
+			{
+				const cgltf_node* pParent = gltfSkin.joints[i]->parent;
+				Skeleton::JointIndex parentJoint = skeleton.GetJoint(pParent->name);
+				skeleton.ParentIndices[i] = parentJoint;
+
+				parentToChildMap[parentJoint].push_back(i);
+			}
+			else
+			{
+				skeleton.ParentIndices[i] = Skeleton::InvalidJoint;
+				rootJoint = i;
+			}
+		}
+
+		// Compute joints order so that parent joints are always evaluates before any children
+		skeleton.JointUpdateOrder.reserve(gltfSkin.joints_count);
+		Array<Skeleton::JointIndex> stack;
+		stack.reserve(gltfSkin.joints_count);
+		stack.push_back(rootJoint);
+		while (!stack.empty())
+		{
+			Skeleton::JointIndex joint = stack.back();
+			stack.pop_back();
+			skeleton.JointUpdateOrder.push_back(joint);
+			for (Skeleton::JointIndex childJoint : parentToChildMap[joint])
+				stack.push_back(childJoint);
+		}
+	}
+
+	bool Load(const char* pFilePath, GltfImportData& outData)
+	{
+		PROFILE_CPU_SCOPE();
+
+		Utils::TimeScope totalTimer;
+
+		cgltf_options options{};
+		cgltf_data* pGltfData = nullptr;
+		cgltf_result result = cgltf_parse_file(&options, pFilePath, &pGltfData);
+		if (result != cgltf_result_success)
+		{
+			E_LOG(Warning, "GLTF - Failed to load '%s'", pFilePath);
+			return false;
+		}
+		outData.pData = pGltfData;
+
+		result = cgltf_load_buffers(&options, pGltfData, pFilePath);
+		if (result != cgltf_result_success)
+		{
+			E_LOG(Warning, "GLTF - Failed to load buffers '%s'", pFilePath);
+			return false;
+		}
+		outData.Timings.Parse = totalTimer.Stop();
+
+		// Every output slot is allocated up front so jobs never touch shared containers
+		outData.Images = Array<Image>(pGltfData->images_count);
+		outData.IsImageLoaded.assign(pGltfData->images_count, 0);
+		outData.Animations.resize(pGltfData->animations_count);
+		outData.Skeletons.resize(pGltfData->skins_count);
+		for (const cgltf_mesh& mesh : Span(pGltfData->meshes, (uint32)pGltfData->meshes_count))
+		{
+			for (const cgltf_primitive& primitive : Span(mesh.primitives, (uint32)mesh.primitives_count))
+				outData.Primitives.push_back(&primitive);
+		}
+		outData.Meshes.resize(outData.Primitives.size());
+
+		StageCounters textureStage, meshStage, animationStage, skeletonStage, compressionStage;
+		Utils::TimeScope fanOutTimer;
+		TaskContext context;
+
+		// Images. External files are read through AsyncIO and decoded in its callback.
+		// DDS files are loaded by path, so their pixels can reference the mapped file instead of being copied.
+		String directory = Paths::GetDirectoryPath(pFilePath);
+		for (uint32 imageIndex = 0; imageIndex < (uint32)pGltfData->images_count; ++imageIndex)
+		{
+			const cgltf_image& gltfImage = pGltfData->images[imageIndex];
+			if (gltfImage.buffer_view)
+			{
+				TaskQueue::Execute([&, imageIndex](int)
+					{
+						Utils::TimeScope jobTimer;
+						const cgltf_image* pImage = &pGltfData->images[imageIndex];
+						const cgltf_buffer_view& view = *pImage->buffer_view;
+						MemoryStream stream(false, (const uint8*)view.buffer->data + view.offset, view.size);
+						outData.IsImageLoaded[imageIndex] = outData.Images[imageIndex].Load(stream, pImage->mime_type);
+						textureStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+					}, context);
+			}
+			else if (gltfImage.uri)
+			{
+				String imagePath = Paths::Combine(directory, gltfImage.uri);
+				String extension = Paths::GetFileExtenstion(gltfImage.uri);
+				if (extension == "dds")
+				{
+					TaskQueue::Execute([&, imageIndex, imagePath](int)
+						{
+							Utils::TimeScope jobTimer;
+							outData.IsImageLoaded[imageIndex] = outData.Images[imageIndex].Load(imagePath.c_str());
+							textureStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+						}, context);
+				}
+				else
+				{
+					AsyncIO::ReadFile(imagePath.c_str(), [&, imageIndex, extension](const AsyncReadResult& result)
+						{
+							if (!result.Success)
+								return;
+							Utils::TimeScope jobTimer;
+							MemoryStream stream(false, result.Data.GetData(), result.Data.GetSize());
+							outData.IsImageLoaded[imageIndex] = outData.Images[imageIndex].Load(stream, extension.c_str());
+							textureStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+						}, context);
+				}
+			}
+		}
+
+		// Meshes
+		for (uint32 meshIndex = 0; meshIndex < (uint32)outData.Primitives.size(); ++meshIndex)
+		{
+			TaskQueue::Execute([&, meshIndex](int)
+				{
+					Utils::TimeScope jobTimer;
+					MeshData& meshData = outData.Meshes[meshIndex];
+					UnpackGltfPrimitive(*outData.Primitives[meshIndex], meshData);
+					MeshCache::BuildCached(meshData);
+					meshStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+				}, context);
+		}
+
+		// Animations and skeletons get their own contexts, so compression can start as soon as both are done
+		TaskContext animationContext, skeletonContext;
+
+		// Animations
+		for (uint32 animationIndex = 0; animationIndex < (uint32)pGltfData->animations_count; ++animationIndex)
+		{
+			TaskQueue::Execute([&, animationIndex](int)
+				{
+					Utils::TimeScope jobTimer;
+					UnpackAnimation(pGltfData->animations[animationIndex], outData.Animations[animationIndex]);
+					animationStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+				}, animationContext);
+		}
+
+		// Skeletons
+		for (uint32 skinIndex = 0; skinIndex < (uint32)pGltfData->skins_count; ++skinIndex)
+		{
+			TaskQueue::Execute([&, skinIndex](int)
+				{
+					Utils::TimeScope jobTimer;
+					BuildSkeleton(pGltfData->skins[skinIndex], outData.Skeletons[skinIndex]);
+					skeletonStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+				}, skeletonContext);
+		}
+
+		// Animation compression. Each animation is compressed against the first skin that owns all of its targets.
+		// Animations that no single skin owns, like ones that also move unskinned nodes, are kept uncompressed.
+		if (!outData.Skeletons.empty())
+		{
+			TaskContext* compressionDependencies[] = { &animationContext, &skeletonContext };
+			for (uint32 animationIndex = 0; animationIndex < (uint32)outData.Animations.size(); ++animationIndex)
+			{
+				TaskQueue::Execute([&, animationIndex](int)
+					{
+						Utils::TimeScope jobTimer;
+						Animation& animation = outData.Animations[animationIndex];
+						bool compressed = false;
+						for (const Skeleton& skeleton : outData.Skeletons)
+						{
+							if (AnimationCompression::Compress(animation, skeleton))
+							{
+								compressed = true;
+								break;
+							}
+						}
+						if (!compressed)
+							E_LOG(Info, "Animation '%s' targets nodes outside of a single skin and is not compressed", animation.Name.c_str());
+						compressionStage.AddJob(jobTimer.Stop(), fanOutTimer.Stop());
+					}, context, compressionDependencies);
+			}
+		}
+
+		TaskQueue::Join(context);
+		TaskQueue::Join(animationContext);
+		TaskQueue::Join(skeletonContext);
+
+		outData.Timings.Textures	= textureStage.Resolve();
+		outData.Timings.Meshes		= meshStage.Resolve();
+		outData.Timings.Animations	= animationStage.Resolve();
+		outData.Timings.Skeletons	= skeletonStage.Resolve();
+		outData.Timings.Compression	= compressionStage.Resolve();
+		outData.Timings.Total		= totalTimer.Stop();
+		return true;
+	}
+
+	void LogTimings(const char* pFilePath, const GltfImportTimings& timings)
+	{
+		auto LogStage = [](const char* pName, const GltfImportStage& stage)
+			{
+				E_LOG(Info, "\t%-11s %4u jobs, %8.2f ms in jobs, done after %8.2f ms", pName, stage.NumJobs, stage.JobTime * 1000.0f, stage.EndTime * 1000.0f);
+			};
+
+		E_LOG(Info, "GLTF - Imported '%s' in %.2f ms (parse %.2f ms)", pFilePath, timings.Total * 1000.0f, timings.Parse * 1000.0f);
+		LogStage("Textures", timings.Textures);
+		LogStage("Meshes", timings.Meshes);
+		LogStage("Animations", timings.Animations);
+		LogStage("Skeletons", timings.Skeletons);
+		LogStage("Compression", timings.Compression);
+	}
+}
+
+GltfImportData::~GltfImportData()
+{
+	if (pData)
+		cgltf_free(pData);
+}
+
+uint32 GltfImportData::GetImageIndex(const cgltf_image* pImage) const
+{
+	return (uint32)(pImage - pData->images);
+}
+
+// Runs the CPU side of a glTF import, without creating any GPU resources, and logs the time spent in each stage
+static ConsoleCommand<const char*> gImportGltf("ImportGltf", [](const char* pFilePath)
+	{
+		GltfImportData data;
+		if (GltfImport::Load(pFilePath, data))
+			GltfImport::LogTimings(pFilePath, data.Timings);
+	});
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Core/Image.h"
+#include "Renderer/Mesh.h"
+#include "Scene/MeshData.h"
+
+struct cgltf_data;
+struct cgltf_image;
+struct cgltf_primitive;
+
+struct GltfImportStage
+{
+	uint32 NumJobs	= 0;
+	float JobTime	= 0;	///< Summed duration of all jobs in the stage, in seconds
+	float EndTime	= 0;	///< Time from the start of the fan-out until the last job of the stage finished, in seconds
+};
+
+struct GltfImportTimings
+{
+	float			Parse = 0;		///< Parsing the file and loading its buffers, in seconds
+	GltfImportStage	Textures;
+	GltfImportStage	Meshes;
+	GltfImportStage	Animations;
+	GltfImportStage	Skeletons;
+	GltfImportStage	Compression;	///< Animation compression, which starts once the skeletons are built
+	float			Total = 0;		///< Parse and fan-out until everything is joined, in seconds
+};
+
+// Everything of a glTF scene that can be prepared without a device
+struct GltfImportData
+{
+	GltfImportData() = default;
+	~GltfImportData();
+
+	GltfImportData(const GltfImportData&) = delete;
+	GltfImportData& operator=(const GltfImportData&) = delete;
+
+	uint32 GetImageIndex(const cgltf_image* pImage) const;
+
+	cgltf_data*						pData = nullptr;
+	Array<Image>					Images;			///< Decoded images, indexed like cgltf_data::images. Each image is decoded once, no matter how many textures use it. sRGB is chosen when a texture is created from it
+	Array<uint8>					IsImageLoaded;	///< False for images that failed to load
+	Array<const cgltf_primitive*>	Primitives;		///< Primitives of all meshes, in file order
+	Array<MeshData>					Meshes;			///< Built mesh of each entry in Primitives
+	Array<Animation>				Animations;
+	Array<Skeleton>					Skeletons;
+	GltfImportTimings				Timings;
+};
+
+// Staged glTF import.
+// After parsing, image decoding, mesh building, animation unpacking and skeleton building all run as independent jobs
+// on the TaskQueue (external images are read through AsyncIO) and are joined before returning.
+// Animations are compressed once they and the skeletons are done.
+namespace GltfImport
+{
+	bool Load(const char* pFilePath, GltfImportData& outData);
+
+	void LogTimings(const char* pFilePath, const GltfImportTimings& timings);
+}
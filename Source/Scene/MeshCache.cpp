@@ -0,0 +1,273 @@
+#include "stdafx.h"
+#include "MeshCache.h"
+#include "MeshData.h"
+#include "Core/ConsoleVariables.h"
+#include "Core/Paths.h"
+#include "Core/Stream.h"
+#include "Core/TaskQueue.h"
+#include "Core/Utils.h"
+
+#include <bit>
+#include <cgltf.h>
+
+namespace MeshCache
+{
+	// Bump when the file layout or BuildMeshData() changes
+	static constexpr uint32 Version			= 1;
+	static constexpr uint32 Magic			= 'HSEM';
+	static constexpr uint64 StreamAlignment	= 16;
+
+	struct FileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint64 Key;
+		uint64 StreamSizes[MeshData::NumStreams];	///< Size in bytes of each stream, in MeshData::ForEachStream() order
+	};
+
+	static std::mutex				sCacheMutex;
+	static std::atomic<uint64>		sNumHits = 0;
+	static std::atomic<uint64>		sNumMisses = 0;
+	static std::atomic<uint64>		sNumBytesRead = 0;
+	static std::atomic<uint64>		sNumBytesWritten = 0;
+	static std::atomic<uint64>		sBuildTimeUs = 0;
+	static std::atomic<uint64>		sLoadTimeUs = 0;
+
+	static uint64 ToMicroseconds(float seconds)
+	{
+		return (uint64)(seconds * 1'000'000.0f);
+	}
+
+	uint64 ComputeKey(const MeshData& meshData)
+	{
+		gAssert(meshData.Meshlets.empty(), "Mesh key must be computed from the source streams");
+
+		// Values are hashed as bytes before they are combined: gHash(uint64) and gHashCombine() both map 0 to 0, which would discard the key
+		const uint32 settings[] = { Version, ShaderInterop::MESHLET_MAX_VERTICES, ShaderInterop::MESHLET_MAX_TRIANGLES, std::bit_cast<uint32>(MeshData::OverdrawThreshold) };
+		uint64 key = gHash(settings, sizeof(settings));
+
+		MeshData::ForEachStream(meshData, [&](const auto& stream)
+			{
+				uint64 size = stream.size() * sizeof(stream[0]);
+				key = gHashCombine(key, gHash(&size, sizeof(size)));
+				if (size > 0)
+					key = gHashCombine(key, gHash(stream.data(), size));
+			});
+		return key;
+	}
+
+	String GetPath(uint64 key)
+	{
+		return Sprintf("%s%016llx.mesh", Paths::MeshCacheDir(), key);
+	}
+
+	bool Load(uint64 key, MeshData& outMeshData)
+	{
+		String path = GetPath(key);
+		MappedFileStream stream;
+		if (!stream.Open(path.c_str()))
+			return false;
+
+		Span<const uint8> headerData = stream.ReadView(sizeof(FileHeader));
+		if (headerData.GetSize() != sizeof(FileHeader))
+			return false;
+
+		FileHeader header;
+		memcpy(&header, headerData.GetData(), sizeof(FileHeader));
+		if (header.Magic != Magic || header.Version != Version || header.Key != key)
+			return false;
+
+		// Validate the whole file before touching the output
+		uint64 expectedSize = sizeof(FileHeader);
+		for (uint64 streamSize : header.StreamSizes)
+			expectedSize = Math::AlignUp(expectedSize, StreamAlignment) + streamSize;
+		if (stream.GetLength() < expectedSize)
+		{
+			E_LOG(Warning, "MeshCache - '%s' is truncated", path);
+			return false;
+		}
+
+		bool valid = true;
+		uint32 streamIndex = 0;
+		MeshData::ForEachStream(outMeshData, [&](auto& outStream)
+			{
+				using ElementType = typename std::decay_t<decltype(outStream)>::value_type;
+				uint64 size = header.StreamSizes[streamIndex++];
+				if (!valid || size % sizeof(ElementType) != 0)
+				{
+					valid = false;
+					return;
+				}
+
+				stream.Seek(Math::AlignUp(stream.GetCursor(), StreamAlignment), StreamSeekMode::Absolute);
+				outStream.resize(size / sizeof(ElementType));
+				if (size > 0)
+				{
+					Span<const uint8> data = stream.ReadView(size);
+					valid = data.GetSize() == size;
+					if (valid)
+						memcpy(outStream.data(), data.GetData(), size);
+				}
+			});
+
+		if (valid)
+			sNumBytesRead += expectedSize;
+		return valid;
+	}
+
+	bool Save(uint64 key, const MeshData& meshData)
+	{
+		FileHeader header;
+		header.Magic = Magic;
+		header.Version = Version;
+		header.Key = key;
+		uint32 streamIndex = 0;
+		MeshData::ForEachStream(meshData, [&](const auto& stream)
+			{
+				header.StreamSizes[streamIndex++] = stream.size() * sizeof(stream[0]);
+			});
+
+		String path = GetPath(key);
+
+		std::lock_guard lock(sCacheMutex);
+		Paths::CreateDirectoryTree(path);
+
+		FileStream stream;
+		if (!stream.Open(path.c_str(), FileMode::Write | FileMode::Create))
+		{
+			E_LOG(Warning, "MeshCache - Failed to open '%s' for writing", path);
+			return false;
+		}
+
+		const uint8 padding[StreamAlignment]{};
+		bool success = stream.Write(&header, sizeof(FileHeader));
+		MeshData::ForEachStream(meshData, [&](const auto& data)
+			{
+				uint64 cursor = stream.GetCursor();
+				uint64 paddingSize = Math::AlignUp(cursor, StreamAlignment) - cursor;
+				uint64 size = data.size() * sizeof(data[0]);
+				if (paddingSize > 0)
+					success &= stream.Write(padding, paddingSize);
+				if (size > 0)
+					success &= stream.Write(data.data(), size);
+			});
+
+		if (!success)
+		{
+			// Load() rejects the truncated file and the next miss overwrites it
+			E_LOG(Warning, "MeshCache - Failed to write '%s'", path);
+			return false;
+		}
+
+		sNumBytesWritten += stream.GetCursor();
+		return true;
+	}
+
+	void BuildCached(MeshData& meshData)
+	{
+		PROFILE_CPU_SCOPE();
+
+		uint64 key = ComputeKey(meshData);
+		{
+			Utils::TimeScope timer;
+			MeshData cooked;
+			if (Load(key, cooked))
+			{
+				meshData = std::move(cooked);
+				sLoadTimeUs += ToMicroseconds(timer.Stop());
+				++sNumHits;
+				return;
+			}
+		}
+
+		Utils::TimeScope timer;
+		BuildMeshData(meshData);
+		sBuildTimeUs += ToMicroseconds(timer.Stop());
+		++sNumMisses;
+
+		Save(key, meshData);
+	}
+
+	bool CookScene(const char* pFilePath)
+	{
+		PROFILE_CPU_SCOPE();
+
+		cgltf_options options{};
+		cgltf_data* pGltfData = nullptr;
+		if (cgltf_parse_file(&options, pFilePath, &pGltfData) != cgltf_result_success)
+		{
+			E_LOG(Warning, "MeshCache - Failed to load '%s'", pFilePath);
+			return false;
+		}
+		if (cgltf_load_buffers(&options, pGltfData, pFilePath) != cgltf_result_success)
+		{
+			E_LOG(Warning, "MeshCache - Failed to load buffers '%s'", pFilePath);
+			cgltf_free(pGltfData);
+			return false;
+		}
+
+		MeshCacheStats statsBefore = GetStats();
+		Utils::TimeScope timer;
+
+		// Each task keeps its MeshData only for as long as it takes to cook it
+		TaskContext context;
+		for (const cgltf_mesh& mesh : Span(pGltfData->meshes, (uint32)pGltfData->meshes_count))
+		{
+			for (const cgltf_primitive& primitive : Span(mesh.primitives, (uint32)mesh.primitives_count))
+			{
+				TaskQueue::Execute([&primitive](int)
+					{
+						MeshData meshData;
+						UnpackGltfPrimitive(primitive, meshData);
+						BuildCached(meshData);
+					}, context);
+			}
+		}
+		TaskQueue::Join(context);
+		cgltf_free(pGltfData);
+
+		MeshCacheStats stats = GetStats();
+		E_LOG(Info, "MeshCache - Cooked '%s' in %.2f ms. %llu cached, %llu built (%.2f MB written)",
+			pFilePath,
+			timer.Stop() * 1000.0f,
+			stats.NumHits - statsBefore.NumHits,
+			stats.NumMisses - statsBefore.NumMisses,
+			Math::BytesToMegaBytes * (stats.NumBytesWritten - statsBefore.NumBytesWritten));
+		return true;
+	}
+
+	MeshCacheStats GetStats()
+	{
+		MeshCacheStats stats;
+		stats.NumHits			= sNumHits.load(std::memory_order_relaxed);
+		stats.NumMisses			= sNumMisses.load(std::memory_order_relaxed);
+		stats.NumBytesRead		= sNumBytesRead.load(std::memory_order_relaxed);
+		stats.NumBytesWritten	= sNumBytesWritten.load(std::memory_order_relaxed);
+		stats.BuildTime			= sBuildTimeUs.load(std::memory_order_relaxed) / 1'000'000.0f;
+		stats.LoadTime			= sLoadTimeUs.load(std::memory_order_relaxed) / 1'000'000.0f;
+		return stats;
+	}
+
+	void ResetStats()
+	{
+		sNumHits			= 0;
+		sNumMisses			= 0;
+		sNumBytesRead		= 0;
+		sNumBytesWritten	= 0;
+		sBuildTimeUs		= 0;
+		sLoadTimeUs			= 0;
+	}
+}
+
+static ConsoleCommand<const char*> gCookMeshes("CookMeshes", [](const char* pFilePath)
+	{
+		MeshCache::CookScene(pFilePath);
+	});
+
+static ConsoleCommand<> gMeshCacheStats("MeshCacheStats", []()
+	{
+		MeshCacheStats stats = MeshCache::GetStats();
+		E_LOG(Info, "MeshCache - %llu hits (%.2f MB read, %.2f ms), %llu misses (%.2f MB written, %.2f ms)",
+			stats.NumHits, Math::BytesToMegaBytes * stats.NumBytesRead, stats.LoadTime * 1000.0f,
+			stats.NumMisses, Math::BytesToMegaBytes * stats.NumBytesWritten, stats.BuildTime * 1000.0f);
+	});
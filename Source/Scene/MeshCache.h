@@ -0,0 +1,36 @@
+#pragma once
+
+struct MeshData;
+
+struct MeshCacheStats
+{
+	uint64 NumHits			= 0;	///< Meshes loaded from the cache
+	uint64 NumMisses		= 0;	///< Meshes built with meshoptimizer and written to the cache
+	uint64 NumBytesRead		= 0;
+	uint64 NumBytesWritten	= 0;
+	float BuildTime			= 0;	///< Total time spent building meshes on cache misses, in seconds (summed over threads)
+	float LoadTime			= 0;	///< Total time spent reading meshes on cache hits, in seconds (summed over threads)
+};
+
+// On-disk cache of meshes after BuildMeshData().
+// The key is a hash of the source streams combined with everything that affects the build (format version, meshlet limits, optimizer settings),
+// so a cooked file never has to be invalidated: a changed mesh or changed settings simply result in a different file.
+// Cooked files are memory mapped and copied straight into the MeshData streams.
+namespace MeshCache
+{
+	// Key of a mesh that still holds its source streams. Must be called before BuildMeshData()
+	uint64 ComputeKey(const MeshData& meshData);
+
+	// Replace the source streams with the cooked mesh if it is in the cache, otherwise build the mesh and add it to the cache
+	void BuildCached(MeshData& meshData);
+
+	bool Load(uint64 key, MeshData& outMeshData);
+	bool Save(uint64 key, const MeshData& meshData);
+	String GetPath(uint64 key);
+
+	// Build and cache all meshes of a glTF scene without creating any GPU resources
+	bool CookScene(const char* pFilePath);
+
+	MeshCacheStats GetStats();
+	void ResetStats();
+}
@@ -0,0 +1,144 @@
+#include "stdafx.h"
+#include "MeshData.h"
+#include <cgltf.h>
+#include <meshoptimizer.h>
+
+void BuildMeshData(MeshData& meshData)
+{
+	meshopt_optimizeVertexCache(meshData.Indices.data(), meshData.Indices.data(), meshData.Indices.size(), meshData.PositionsStream.size());
+	meshopt_optimizeOverdraw(meshData.Indices.data(), meshData.Indices.data(), meshData.Indices.size(), &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3), MeshData::OverdrawThreshold);
+
+	Array<uint32> remap(meshData.PositionsStream.size());
+	meshopt_optimizeVertexFetchRemap(&remap[0], meshData.Indices.data(), meshData.Indices.size(), meshData.PositionsStream.size());
+	meshopt_remapIndexBuffer(meshData.Indices.data(), meshData.Indices.data(), meshData.Indices.size(), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.PositionsStream.data(), meshData.PositionsStream.data(), meshData.PositionsStream.size(), sizeof(Vector3), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.NormalsStream.data(), meshData.NormalsStream.data(), meshData.NormalsStream.size(), sizeof(Vector3), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.TangentsStream.data(), meshData.TangentsStream.data(), meshData.TangentsStream.size(), sizeof(Vector4), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.UVsStream.data(), meshData.UVsStream.data(), meshData.UVsStream.size(), sizeof(Vector2), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.JointsStream.data(), meshData.JointsStream.data(), meshData.JointsStream.size(), sizeof(Vector4i), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.WeightsStream.data(), meshData.WeightsStream.data(), meshData.WeightsStream.size(), sizeof(Vector4), &remap[0]);
+	meshopt_remapVertexBuffer(meshData.ColorsStream.data(), meshData.ColorsStream.data(), meshData.ColorsStream.size(), sizeof(Vector4), &remap[0]);
+
+	// Meshlet generation
+	const size_t maxVertices = ShaderInterop::MESHLET_MAX_VERTICES;
+	const size_t maxTriangles = ShaderInterop::MESHLET_MAX_TRIANGLES;
+	const size_t maxMeshlets = meshopt_buildMeshletsBound(meshData.Indices.size(), maxVertices, maxTriangles);
+
+	meshData.Meshlets.resize(maxMeshlets);
+	meshData.MeshletVertices.resize(maxMeshlets * maxVertices);
+
+	Array<unsigned char> meshletTriangles(maxMeshlets * maxTriangles * 3);
+	Array<meshopt_Meshlet> meshlets(maxMeshlets);
+
+	size_t meshlet_count = meshopt_buildMeshlets(meshlets.data(), meshData.MeshletVertices.data(), meshletTriangles.data(),
+		meshData.Indices.data(), meshData.Indices.size(), &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3), maxVertices, maxTriangles, 0);
+
+	// Trimming
+	const meshopt_Meshlet& last = meshlets[meshlet_count - 1];
+	meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
+	meshlets.resize(meshlet_count);
+
+	meshData.MeshletVertices.resize(last.vertex_offset + last.vertex_count);
+	meshData.Meshlets.resize(meshlet_count);
+	meshData.MeshletBounds.resize(meshlet_count);
+	meshData.MeshletTriangles.resize(meshletTriangles.size() / 3);
+
+	uint32 triangleOffset = 0;
+	for (size_t i = 0; i < meshlet_count; ++i)
+	{
+		const meshopt_Meshlet& meshlet = meshlets[i];
+
+		Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32 k = 0; k < meshlet.triangle_count * 3; ++k)
+		{
+			uint32 idx = meshData.MeshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + k]];
+			const Vector3& p = meshData.PositionsStream[idx];
+			max = Vector3::Max(max, p);
+			min = Vector3::Min(min, p);
+		}
+		ShaderInterop::Meshlet::Bounds& outBounds = meshData.MeshletBounds[i];
+		outBounds.LocalCenter = (max + min) / 2;
+		outBounds.LocalExtents = (max - min) / 2;
+
+		// Encode triangles and get rid of 4 byte padding
+		unsigned char* pSourceTriangles = meshletTriangles.data() + meshlet.triangle_offset;
+
+		meshopt_optimizeMeshlet(&meshData.MeshletVertices[meshlet.vertex_offset], pSourceTriangles, meshlet.triangle_count, meshlet.vertex_count);
+
+		for (uint32 triIdx = 0; triIdx < meshlet.triangle_count; ++triIdx)
+		{
+			ShaderInterop::Meshlet::Triangle& tri = meshData.MeshletTriangles[triIdx + triangleOffset];
+			tri.V0 = *pSourceTriangles++;
+			tri.V1 = *pSourceTriangles++;
+			tri.V2 = *pSourceTriangles++;
+		}
+
+		ShaderInterop::Meshlet& outMeshlet = meshData.Meshlets[i];
+		outMeshlet.TriangleCount = meshlet.triangle_count;
+		outMeshlet.TriangleOffset = triangleOffset;
+		outMeshlet.VertexCount = meshlet.vertex_count;
+		outMeshlet.VertexOffset = meshlet.vertex_offset;
+		triangleOffset += meshlet.triangle_count;
+	}
+	meshData.MeshletTriangles.resize(triangleOffset);
+}
+
+
+void UnpackGltfPrimitive(const cgltf_primitive& primitive, MeshData& outMeshData)
+{
+	outMeshData.Indices.resize(primitive.indices->count);
+
+	constexpr int indexMap[] = { 0, 2, 1 };
+	for (size_t i = 0; i < primitive.indices->count; i += 3)
+	{
+		outMeshData.Indices[i + 0] = (uint32)cgltf_accessor_read_index(primitive.indices, i + indexMap[0]);
+		outMeshData.Indices[i + 1] = (uint32)cgltf_accessor_read_index(primitive.indices, i + indexMap[1]);
+		outMeshData.Indices[i + 2] = (uint32)cgltf_accessor_read_index(primitive.indices, i + indexMap[2]);
+	}
+
+	for (size_t attrIdx = 0; attrIdx < primitive.attributes_count; ++attrIdx)
+	{
+		const cgltf_attribute& attribute = primitive.attributes[attrIdx];
+		if (attribute.type == cgltf_attribute_type_position)
+		{
+			outMeshData.PositionsStream.resize(attribute.data->count);
+			gVerify(cgltf_accessor_unpack_floats(attribute.data, &outMeshData.PositionsStream[0].x, attribute.data->count * 3), > 0);
+		}
+		else if (attribute.type == cgltf_attribute_type_normal)
+		{
+			outMeshData.NormalsStream.resize(attribute.data->count);
+			gVerify(cgltf_accessor_unpack_floats(attribute.data, &outMeshData.NormalsStream[0].x, attribute.data->count * 3), > 0);
+		}
+		else if (attribute.type == cgltf_attribute_type_tangent)
+		{
+			outMeshData.TangentsStream.resize(attribute.data->count);
+			gVerify(cgltf_accessor_unpack_floats(attribute.data, &outMeshData.TangentsStream[0].x, attribute.data->count * 4), > 0);
+		}
+		else if (attribute.type == cgltf_attribute_type_texcoord && attribute.index == 0)
+		{
+			outMeshData.UVsStream.resize(attribute.data->count);
+			gVerify(cgltf_accessor_unpack_floats(attribute.data, &outMeshData.UVsStream[0].x, attribute.data->count * 2), > 0);
+		}
+		else if (attribute.type == cgltf_attribute_type_color && attribute.index == 0)
+		{
+			outMeshData.ColorsStream.resize(attribute.data->count);
+			gVerify(cgltf_accessor_unpack_floats(attribute.data, &outMeshData.ColorsStream[0].x, attribute.data->count * 4), > 0);
+		}
+		else if (attribute.type == cgltf_attribute_type_weights && attribute.index == 0)
+		{
+			outMeshData.WeightsStream.resize(attribute.data->count);
+			gVerify(cgltf_accessor_unpack_floats(attribute.data, &outMeshData.WeightsStream[0].x, attribute.data->count * 4), > 0);
+		}
+		else if (attribute.type == cgltf_attribute_type_joints && attribute.index == 0)
+		{
+			Vector4 joints;
+			outMeshData.JointsStream.resize(attribute.data->count);
+			for (int i = 0; i < attribute.data->count; ++i)
+			{
+				gVerify(cgltf_accessor_read_float(attribute.data, i, &joints.x, 4), > 0);
+				outMeshData.JointsStream[i] = Vector4i((int)joints.x, (int)joints.y, (int)joints.z, (int)joints.w);
+			}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "RHI/DescriptorHandle.h"
+#include "ShaderInterop.h"
+
+struct cgltf_primitive;
+
+// CPU side geometry of a single mesh, before it is uploaded to the GPU
+struct MeshData
+{
+	Array<Vector3> PositionsStream;
+	Array<Vector3> NormalsStream;
+	Array<Vector4> TangentsStream;
+	Array<Vector2> UVsStream;
+	Array<Vector4> ColorsStream;
+	Array<Vector4i> JointsStream;
+	Array<Vector4> WeightsStream;
+	Array<uint32> Indices;
+
+	Array<ShaderInterop::Meshlet> Meshlets;
+	Array<uint32> MeshletVertices;
+	Array<ShaderInterop::Meshlet::Triangle> MeshletTriangles;
+	Array<ShaderInterop::Meshlet::Bounds> MeshletBounds;
+
+	// Calls 'callback' with each stream, in a fixed order
+	template<typename TMeshData, typename Callback>
+	static void ForEachStream(TMeshData& meshData, Callback&& callback)
+	{
+		callback(meshData.PositionsStream);
+		callback(meshData.NormalsStream);
+		callback(meshData.TangentsStream);
+		callback(meshData.UVsStream);
+		callback(meshData.ColorsStream);
+		callback(meshData.JointsStream);
+		callback(meshData.WeightsStream);
+		callback(meshData.Indices);
+		callback(meshData.Meshlets);
+		callback(meshData.MeshletVertices);
+		callback(meshData.MeshletTriangles);
+		callback(meshData.MeshletBounds);
+	}
+
+	static constexpr uint32 NumStreams = 12;
+
+	// Threshold passed to meshopt_optimizeOverdraw() by BuildMeshData(). Part of the MeshCache key, so cached meshes are rebuilt when it changes.
+	static constexpr float OverdrawThreshold = 1.05f;
+};
+
+// Optimize the vertex and index streams and build meshlets
+void BuildMeshData(MeshData& meshData);
+
+// Read the index and vertex streams of a glTF primitive
+void UnpackGltfPrimitive(const cgltf_primitive& primitive, MeshData& outMeshData);
@@ -14,6 +14,9 @@
 #include "Renderer/Light.h"
 #include "Core/Stream.h"
 #include "Scene/World.h"
+#include "Scene/MeshData.h"
+#include "Scene/MeshCache.h"
+#include "Scene/GltfImport.h"
 
 #pragma warning(push)
 #pragma warning(disable: 4996) //_CRT_SECURE_NO_WARNINGS
@@ -21,112 +24,11 @@
 #include <cgltf.h>
 #pragma warning(pop)
 
-#include <meshoptimizer.h>
 #include <LDraw.h>
 #include <Core/TaskQueue.h>
 
 
 
-struct MeshData
-{
-	Array<Vector3> PositionsStream;
-	Array<Vector3> NormalsStream;
-	Array<Vector4> TangentsStream;
-	Array<Vector2> UVsStream;
-	Array<Vector4> ColorsStream;
-	Array<Vector4i> JointsStream;
-	Array<Vector4> WeightsStream;
-	Array<uint32> Indices;
-
-	Array<ShaderInterop::Meshlet> Meshlets;
-	Array<uint32> MeshletVertices;
-	Array<ShaderInterop::Meshlet::Triangle> MeshletTriangles;
-	Array<ShaderInterop::Meshlet::Bounds> MeshletBounds;
-};
-
-
-static void BuildMeshData(MeshData& meshData)
-{
-	meshopt_optimizeVertexCache(meshData.Indices.data(), meshData.Indices.data(), meshData.Indices.size(), meshData.PositionsStream.size());
-	meshopt_optimizeOverdraw(meshData.Indices.data(), meshData.Indices.data(), meshData.Indices.size(), &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3), 1.05f);
-
-	Array<uint32> remap(meshData.PositionsStream.size());
-	meshopt_optimizeVertexFetchRemap(&remap[0], meshData.Indices.data(), meshData.Indices.size(), meshData.PositionsStream.size());
-	meshopt_remapIndexBuffer(meshData.Indices.data(), meshData.Indices.data(), meshData.Indices.size(), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.PositionsStream.data(), meshData.PositionsStream.data(), meshData.PositionsStream.size(), sizeof(Vector3), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.NormalsStream.data(), meshData.NormalsStream.data(), meshData.NormalsStream.size(), sizeof(Vector3), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.TangentsStream.data(), meshData.TangentsStream.data(), meshData.TangentsStream.size(), sizeof(Vector4), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.UVsStream.data(), meshData.UVsStream.data(), meshData.UVsStream.size(), sizeof(Vector2), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.JointsStream.data(), meshData.JointsStream.data(), meshData.JointsStream.size(), sizeof(Vector4i), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.WeightsStream.data(), meshData.WeightsStream.data(), meshData.WeightsStream.size(), sizeof(Vector4), &remap[0]);
-	meshopt_remapVertexBuffer(meshData.ColorsStream.data(), meshData.ColorsStream.data(), meshData.ColorsStream.size(), sizeof(Vector4), &remap[0]);
-
-	// Meshlet generation
-	const size_t maxVertices = ShaderInterop::MESHLET_MAX_VERTICES;
-	const size_t maxTriangles = ShaderInterop::MESHLET_MAX_TRIANGLES;
-	const size_t maxMeshlets = meshopt_buildMeshletsBound(meshData.Indices.size(), maxVertices, maxTriangles);
-
-	meshData.Meshlets.resize(maxMeshlets);
-	meshData.MeshletVertices.resize(maxMeshlets * maxVertices);
-
-	Array<unsigned char> meshletTriangles(maxMeshlets * maxTriangles * 3);
-	Array<meshopt_Meshlet> meshlets(maxMeshlets);
-
-	size_t meshlet_count = meshopt_buildMeshlets(meshlets.data(), meshData.MeshletVertices.data(), meshletTriangles.data(),
-		meshData.Indices.data(), meshData.Indices.size(), &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3), maxVertices, maxTriangles, 0);
-
-	// Trimming
-	const meshopt_Meshlet& last = meshlets[meshlet_count - 1];
-	meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
-	meshlets.resize(meshlet_count);
-
-	meshData.MeshletVertices.resize(last.vertex_offset + last.vertex_count);
-	meshData.Meshlets.resize(meshlet_count);
-	meshData.MeshletBounds.resize(meshlet_count);
-	meshData.MeshletTriangles.resize(meshletTriangles.size() / 3);
-
-	uint32 triangleOffset = 0;
-	for (size_t i = 0; i < meshlet_count; ++i)
-	{
-		const meshopt_Meshlet& meshlet = meshlets[i];
-
-		Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
-		Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-		for (uint32 k = 0; k < meshlet.triangle_count * 3; ++k)
-		{
-			uint32 idx = meshData.MeshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + k]];
-			const Vector3& p = meshData.PositionsStream[idx];
-			max = Vector3::Max(max, p);
-			min = Vector3::Min(min, p);
-		}
-		ShaderInterop::Meshlet::Bounds& outBounds = meshData.MeshletBounds[i];
-		outBounds.LocalCenter = (max + min) / 2;
-		outBounds.LocalExtents = (max - min) / 2;
-
-		// Encode triangles and get rid of 4 byte padding
-		unsigned char* pSourceTriangles = meshletTriangles.data() + meshlet.triangle_offset;
-
-		meshopt_optimizeMeshlet(&meshData.MeshletVertices[meshlet.vertex_offset], pSourceTriangles, meshlet.triangle_count, meshlet.vertex_count);
-
-		for (uint32 triIdx = 0; triIdx < meshlet.triangle_count; ++triIdx)
-		{
-			ShaderInterop::Meshlet::Triangle& tri = meshData.MeshletTriangles[triIdx + triangleOffset];
-			tri.V0 = *pSourceTriangles++;
-			tri.V1 = *pSourceTriangles++;
-			tri.V2 = *pSourceTriangles++;
-		}
-
-		ShaderInterop::Meshlet& outMeshlet = meshData.Meshlets[i];
-		outMeshlet.TriangleCount = meshlet.triangle_count;
-		outMeshlet.TriangleOffset = triangleOffset;
-		outMeshlet.VertexCount = meshlet.vertex_count;
-		outMeshlet.VertexOffset = meshlet.vertex_offset;
-		triangleOffset += meshlet.triangle_count;
-	}
-	meshData.MeshletTriangles.resize(triangleOffset);
-}
-
-
 static void UploadMesh(GraphicsDevice* pDevice, const MeshData& meshData, Mesh& outMesh)
 {
 	bool hasAnim = !meshData.WeightsStream.empty();
@@ -414,7 +316,7 @@ static bool LoadLdr(const char* pFilePath, GraphicsDevice* pDevice, World& world
 			map.push_back(combination);
 			meshIndex = combination.Index;
 
-			BuildMeshData(meshData);
+			MeshCache::BuildCached(meshData);
 			Mesh& mesh = world.Meshes.emplace_back();
 			UploadMesh(pDevice, meshData, mesh);
 			
@@ -436,164 +338,44 @@ static bool LoadLdr(const char* pFilePath, GraphicsDevice* pDevice, World& world
 
 static bool LoadGltf(const char* pFilePath, GraphicsDevice* pDevice, World& world)
 {
-	cgltf_options options{};
-	cgltf_data* pGltfData = nullptr;
-	cgltf_result result = cgltf_parse_file(&options, pFilePath, &pGltfData);
-	if (result != cgltf_result_success)
-	{
-		E_LOG(Warning, "GLTF - Failed to load '%s'", pFilePath);
+	// Decode images, build meshes and unpack animations in parallel before anything is uploaded
+	GltfImportData importData;
+	if (!GltfImport::Load(pFilePath, importData))
 		return false;
-	}
-	result = cgltf_load_buffers(&options, pGltfData, pFilePath);
-	if (result != cgltf_result_success)
-	{
-		E_LOG(Warning, "GLTF - Failed to load buffers '%s'", pFilePath);
-		return false;
-	}
+	GltfImport::LogTimings(pFilePath, importData.Timings);
 
-	// Load unique textures;
-	HashMap<const cgltf_texture*, Texture*> imageToTexture;
+	const cgltf_data* pGltfData = importData.pData;
+
+	// The decoded image is shared, but an image used both as color and as data needs an sRGB and a linear texture
+	StaticArray<HashMap<const cgltf_image*, Texture*>, 2> imageToTexture;
 	HashMap<const cgltf_material*, uint32> materialToIndex;
 	materialToIndex[nullptr] = 0;
 	HashMap<const cgltf_primitive*, uint32> meshToIndex;
 
-	// Load Animations
-	for (const cgltf_animation& gltfAnimation : Span(pGltfData->animations, (uint32)pGltfData->animations_count))
-	{
-		Animation& animation = world.Animations.emplace_back();
-
-		animation.Name = gltfAnimation.name ? gltfAnimation.name : "Unnamed";
-		for (const cgltf_animation_channel& gltfChannel : Span(gltfAnimation.channels, (uint32)gltfAnimation.channels_count))
-		{
-			AnimationChannel& channel = animation.Channels.emplace_back();
-
-			channel.Target = gltfChannel.target_node->name;
-
-			// Animation type
-			switch (gltfChannel.target_path)
-			{
-			case cgltf_animation_path_type_translation:		channel.Path = AnimationChannel::PathType::Translation; break;
-			case cgltf_animation_path_type_rotation:		channel.Path = AnimationChannel::PathType::Rotation; break;
-			case cgltf_animation_path_type_scale:			channel.Path = AnimationChannel::PathType::Scale; break;
-			default: gUnreachable();
-			}
-
-			// Sampler
-			const cgltf_animation_sampler& gltfSampler = *gltfChannel.sampler;
-			switch (gltfSampler.interpolation)
-			{
-			case cgltf_interpolation_type_step:				channel.Interpolation = AnimationChannel::Interpolation::Step; break;
-			case cgltf_interpolation_type_linear:			channel.Interpolation = AnimationChannel::Interpolation::Linear; break;
-			case cgltf_interpolation_type_cubic_spline:		channel.Interpolation = AnimationChannel::Interpolation::Cubic; break;
-			default: gUnreachable();
-			}
-
-			// Read time keys
-			channel.KeyFrames.resize(gltfSampler.input->count);
-			gAssert(cgltf_num_components(gltfSampler.input->type) == 1);
-			gVerify(cgltf_accessor_unpack_floats(gltfSampler.input, &channel.KeyFrames[0], gltfSampler.input->count), > 0);
-
-			// Read key data
-			channel.Data.resize(gltfSampler.output->count);
-			int num_components = (int)cgltf_num_components(gltfSampler.output->type);
-			gAssert(num_components <= 4);
-			for (int i = 0; i < gltfSampler.output->count; ++i)
-			{
-				gVerify(cgltf_accessor_read_float(gltfSampler.output, i, &channel.Data[i].x, num_components), == 1);
-			}
-
-			// Track min/max time of animation
-			animation.TimeStart = Math::Min(animation.TimeStart, channel.KeyFrames.front());
-			animation.TimeEnd = Math::Max(animation.TimeEnd, channel.KeyFrames.back());
-		}
-	}
-
-	// Load Skeletons
-	for (const cgltf_skin& gltfSkin : Span(pGltfData->skins, (uint32)pGltfData->skins_count))
-	{
-		Skeleton& skeleton = world.Skeletons.emplace_back();
-
-		// Load inverse bind matrices
-		skeleton.InverseBindMatrices.resize(gltfSkin.joints_count);
-		gAssert(cgltf_num_components(gltfSkin.inverse_bind_matrices->type) == 16);
-		gVerify(cgltf_accessor_unpack_floats(gltfSkin.inverse_bind_matrices, &skeleton.InverseBindMatrices[0].m[0][0], gltfSkin.joints_count * 16), > 0);
-
-		// Joint name to index mapping
-		for (int i = 0; i < gltfSkin.joints_count; ++i)
-		{
-			Skeleton::JointIndex joint = (Skeleton::JointIndex)i;
-			skeleton.JointsMap[gltfSkin.joints[i]->name] = joint;
-		}
-
-		// Compute parent index of each joint
-		Skeleton::JointIndex rootJoint = Skeleton::InvalidJoint;
-		Array<Array<Skeleton::JointIndex>> parentToChildMap(gltfSkin.joints_count);
-		skeleton.ParentIndices.resize(gltfSkin.joints_count);
-		for (Skeleton::JointIndex i = 0; i < (Skeleton::JointIndex)gltfSkin.joints_count; ++i)
-		{
-			if (gltfSkin.joints[i] != gltfSkin.skeleton)
-			{
-				const cgltf_node* pParent = gltfSkin.joints[i]->parent;
-				Skeleton::JointIndex parentJoint = skeleton.GetJoint(pParent->name);
-				skeleton.ParentIndices[i] = parentJoint;
-
-				parentToChildMap[parentJoint].push_back(i);
-			}
-			else
-			{
-				skeleton.ParentIndices[i] = Skeleton::InvalidJoint;
-				rootJoint = i;
-			}
-		}
-
-		// Compute joints order so that parent joints are always evaluates before any children
-		skeleton.JointUpdateOrder.reserve(gltfSkin.joints_count);
-		Array<Skeleton::JointIndex> stack;
-		stack.reserve(gltfSkin.joints_count);
-		stack.push_back(rootJoint);
-		while (!stack.empty())
-		{
-			Skeleton::JointIndex joint = stack.back();
-			stack.pop_back();
-			skeleton.JointUpdateOrder.push_back(joint);
-			for (Skeleton::JointIndex childJoint : parentToChildMap[joint])
-				stack.push_back(childJoint);
-		}
-	}
+	for (Animation& animation : importData.Animations)
+		world.Animations.push_back(std::move(animation));
+	for (Skeleton& skeleton : importData.Skeletons)
+		world.Skeletons.push_back(std::move(skeleton));
 
 	// Load Materials and Textures
 	for (const cgltf_material& gltfMaterial : Span(pGltfData->materials, (uint32)pGltfData->materials_count))
 	{
 		materialToIndex[&gltfMaterial] = (uint32)world.Materials.size();
 		Material& material = world.Materials.emplace_back();
-		auto RetrieveTexture = [&imageToTexture, &world, pDevice, pFilePath](const cgltf_texture_view& texture, bool srgb) -> Texture*
+		auto RetrieveTexture = [&imageToTexture, &world, &importData, pDevice, pFilePath](const cgltf_texture_view& texture, bool srgb) -> Texture*
 			{
 				if (texture.texture)
 				{
-					auto it = imageToTexture.find(texture.texture);
 					const cgltf_image* pImage = texture.texture->image;
-					const char* pName = pImage->uri ? pImage->uri : "Material Texture";
-					Ref<Texture> pTex;
-					if (it == imageToTexture.end())
+					HashMap<const cgltf_image*, Texture*>& textures = imageToTexture[srgb ? 1 : 0];
+					auto it = textures.find(pImage);
+					if (it == textures.end())
 					{
-						Image image;
-						bool validImage = false;
-						if (pImage->buffer_view)
-						{
-							MemoryStream stream(false, (char*)pImage->buffer_view->buffer->data + pImage->buffer_view->offset, (uint32)pImage->buffer_view->size);
-							validImage = image.Load(stream, pImage->mime_type);
-						}
-						else
-						{
-							FileStream stream;
-							if (stream.Open(Paths::Combine(Paths::GetDirectoryPath(pFilePath), pImage->uri).c_str(), FileMode::Read))
-							{
-								validImage = image.Load(stream, Paths::GetFileExtenstion(pImage->uri).c_str());
-							}
-						}
-
-						if (validImage)
-							pTex = GraphicsCommon::CreateTextureFromImage(pDevice, image, srgb, pName);
+						const char* pName = pImage->uri ? pImage->uri : "Material Texture";
+						const uint32 imageIndex = importData.GetImageIndex(pImage);
+						Ref<Texture> pTex;
+						if (importData.IsImageLoaded[imageIndex])
+							pTex = GraphicsCommon::CreateTextureFromImage(pDevice, importData.Images[imageIndex], srgb, pName);
 
 						if (!pTex.Get())
 						{
@@ -602,7 +384,7 @@ static bool LoadGltf(const char* pFilePath, GraphicsDevice* pDevice, World& worl
 						}
 
 						world.Textures.push_back(pTex);
-						imageToTexture[texture.texture] = world.Textures.back();
+						textures[pImage] = world.Textures.back();
 						return world.Textures.back();
 
 					}
@@ -654,93 +436,14 @@ static bool LoadGltf(const char* pFilePath, GraphicsDevice* pDevice, World& worl
 			material.Name = gltfMaterial.name;
 	}
 
-	uint32 meshCount = 0;
-	for (const cgltf_mesh& mesh : Span(pGltfData->meshes, (uint32)pGltfData->meshes_count))
-		meshCount += (uint32)mesh.primitives_count;
-
-	TaskContext taskContext;
-	Array<MeshData> meshDatas;
-	meshDatas.reserve(meshCount);
-	Array<uint32> meshIndices;
-	meshIndices.reserve(meshCount);
-
-	// Load Meshes
-	for (const cgltf_mesh& mesh : Span(pGltfData->meshes, (uint32)pGltfData->meshes_count))
+	// Upload Meshes
+	for (uint32 i = 0; i < (uint32)importData.Primitives.size(); ++i)
 	{
-		for (const cgltf_primitive& primitive : Span(mesh.primitives, (uint32)mesh.primitives_count))
-		{
-			uint32 meshIndex = (uint32)world.Meshes.size();
-			world.Meshes.emplace_back();
-			meshIndices.push_back(meshIndex);
-			MeshData& meshData = meshDatas.emplace_back();
-			meshToIndex[&primitive] = meshIndex;
-
-			TaskQueue::Execute([&](int)
-				{
-					meshData.Indices.resize(primitive.indices->count);
-
-					constexpr int indexMap[] = { 0, 2, 1 };
-					for (size_t i = 0; i < primitive.indices->count; i += 3)
-					{
-						meshData.Indices[i + 0] = (uint32)cgltf_accessor_read_index(primitive.indices, i + indexMap[0]);
-						meshData.Indices[i + 1] = (uint32)cgltf_accessor_read_index(primitive.indices, i + indexMap[1]);
-						meshData.Indices[i + 2] = (uint32)cgltf_accessor_read_index(primitive.indices, i + indexMap[2]);
-					}
-
-					for (size_t attrIdx = 0; attrIdx < primitive.attributes_count; ++attrIdx)
-					{
-						const cgltf_attribute& attribute = primitive.attributes[attrIdx];
-						if (attribute.type == cgltf_attribute_type_position)
-						{
-							meshData.PositionsStream.resize(attribute.data->count);
-							gVerify(cgltf_accessor_unpack_floats(attribute.data, &meshData.PositionsStream[0].x, attribute.data->count * 3), > 0);
-						}
-						else if (attribute.type == cgltf_attribute_type_normal)
-						{
-							meshData.NormalsStream.resize(attribute.data->count);
-							gVerify(cgltf_accessor_unpack_floats(attribute.data, &meshData.NormalsStream[0].x, attribute.data->count * 3), > 0);
-						}
-						else if (attribute.type == cgltf_attribute_type_tangent)
-						{
-							meshData.TangentsStream.resize(attribute.data->count);
-							gVerify(cgltf_accessor_unpack_floats(attribute.data, &meshData.TangentsStream[0].x, attribute.data->count * 4), > 0);
-						}
-						else if (attribute.type == cgltf_attribute_type_texcoord && attribute.index == 0)
-						{
-							meshData.UVsStream.resize(attribute.data->count);
-							gVerify(cgltf_accessor_unpack_floats(attribute.data, &meshData.UVsStream[0].x, attribute.data->count * 2), > 0);
-						}
-						else if (attribute.type == cgltf_attribute_type_color && attribute.index == 0)
-						{
-							meshData.ColorsStream.resize(attribute.data->count);
-							gVerify(cgltf_accessor_unpack_floats(attribute.data, &meshData.ColorsStream[0].x, attribute.data->count * 4), > 0);
-						}
-						else if (attribute.type == cgltf_attribute_type_weights && attribute.index == 0)
-						{
-							meshData.WeightsStream.resize(attribute.data->count);
-							gVerify(cgltf_accessor_unpack_floats(attribute.data, &meshData.WeightsStream[0].x, attribute.data->count * 4), > 0);
-						}
-						else if (attribute.type == cgltf_attribute_type_joints && attribute.index == 0)
-						{
-							Vector4 joints;
-							meshData.JointsStream.resize(attribute.data->count);
-							for (int i = 0; i < attribute.data->count; ++i)
-							{
-								gVerify(cgltf_accessor_read_float(attribute.data, i, &joints.x, 4), > 0);
-								meshData.JointsStream[i] = Vector4i((int)joints.x, (int)joints.y, (int)joints.z, (int)joints.w);
-							}
-						}
-					}
-					BuildMeshData(meshData);
-				}, taskContext);
-		}
+		meshToIndex[importData.Primitives[i]] = (uint32)world.Meshes.size();
+		Mesh& mesh = world.Meshes.emplace_back();
+		UploadMesh(pDevice, importData.Meshes[i], mesh);
 	}
 
-	TaskQueue::Join(taskContext);
-
-	for(uint32 i = 0; i < (uint32)meshDatas.size(); ++i)
-		UploadMesh(pDevice, meshDatas[i], world.Meshes[meshIndices[i]]);
-
 	// Load Scene Nodes
 	for (const cgltf_node& node : Span(pGltfData->nodes, (uint32)pGltfData->nodes_count))
 	{
@@ -792,13 +495,14 @@ static bool LoadGltf(const char* pFilePath, GraphicsDevice* pDevice, World& worl
 		}
 	}
 
-	cgltf_free(pGltfData);
 	return true;
 }
 
 
 bool SceneLoader::Load(const char* pFilePath, GraphicsDevice* pDevice, World& world)
 {
+	MeshCacheStats statsBefore = MeshCache::GetStats();
+
 	String extension = Paths::GetFileExtenstion(pFilePath);
 	if (extension == "dat" || extension == "ldr" || extension == "mpd")
 	{
@@ -808,6 +512,9 @@ bool SceneLoader::Load(const char* pFilePath, GraphicsDevice* pDevice, World& wo
 	{
 		LoadGltf(pFilePath, pDevice, world);
 	}
+
+	MeshCacheStats stats = MeshCache::GetStats();
+	E_LOG(Info, "Mesh cache: %llu hits, %llu misses", stats.NumHits - statsBefore.NumHits, stats.NumMisses - statsBefore.NumMisses);
 	return true;
 }
 